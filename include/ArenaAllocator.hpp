@@ -0,0 +1,188 @@
+#ifndef ARENA_ALLOCATOR_HPP
+#define ARENA_ALLOCATOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+// Where an arena takes its backing memory from
+enum MemoryRegion {
+    MEMORY_INTERNAL,  // On-chip SRAM: hot per-packet buffers
+    MEMORY_PSRAM      // 8 MB OPI PSRAM: large, latency-tolerant buffers
+};
+
+// Static bump allocator over one block grabbed from a memory region at boot.
+//
+// Allocation is a pointer bump, there is no per-object free and therefore
+// no fragmentation; everything is meant to live until reset(). On the
+// ESP32-S3 the block comes from heap_caps_malloc() with the matching caps,
+// on a host from malloc(), so the API and the counters are identical.
+class Arena {
+public:
+    Arena()
+        : _base(NULL),
+          _size(0),
+          _used(0),
+          _peak(0),
+          _allocations(0),
+          _failures(0),
+          _region(MEMORY_INTERNAL)
+    {}
+
+    // Grab the backing block; false if the region cannot provide it
+    bool begin(size_t size, MemoryRegion region) {
+        _region = region;
+#if defined(ESP32)
+        uint32_t caps = region == MEMORY_PSRAM ? MALLOC_CAP_SPIRAM : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        _base = (uint8_t*)heap_caps_malloc(size, caps);
+#else
+        _base = (uint8_t*)malloc(size);
+#endif
+        _size = _base != NULL ? size : 0;
+        _used = 0;
+        return _base != NULL;
+    }
+
+    // Give the backing block back; everything carved from it is gone
+    void end() {
+#if defined(ESP32)
+        heap_caps_free(_base);
+#else
+        free(_base);
+#endif
+        _base = NULL;
+        _size = 0;
+        _used = 0;
+    }
+
+    // Carve size bytes aligned to align (a power of two); NULL when exhausted
+    void* allocate(size_t size, size_t align = 4) {
+        uintptr_t start = ((uintptr_t)_base + _used + align - 1) & ~(uintptr_t)(align - 1);
+        size_t offset = start - (uintptr_t)_base;
+        if (_base == NULL || offset + size > _size) {
+            _failures++;
+            return NULL;
+        }
+
+        _used = offset + size;
+        if (_used > _peak) {
+            _peak = _used;
+        }
+        _allocations++;
+        return (void*)start;
+    }
+
+    template<typename T>
+    T* allocateArray(size_t count) {
+        return (T*)allocate(sizeof(T) * count, alignof(T));
+    }
+
+    // Drop everything allocated so far
+    void reset() { _used = 0; }
+
+    MemoryRegion getRegion() const { return _region; }
+    size_t getSize() const { return _size; }
+    size_t getUsed() const { return _used; }
+    size_t getPeak() const { return _peak; }
+    uint32_t getAllocationCount() const { return _allocations; }
+    uint32_t getFailureCount() const { return _failures; }
+
+private:
+    uint8_t* _base;
+    size_t _size;
+    size_t _used;
+    size_t _peak;
+    uint32_t _allocations;
+    uint32_t _failures;
+    MemoryRegion _region;
+};
+
+// Fixed-size block pool carved out of an arena. Blocks are recycled through
+// an intrusive free list, so allocate() and release() are O(1) and blocks
+// of one size cannot fragment. Not thread-safe, keep one pool per task.
+class Pool {
+public:
+    Pool()
+        : _freeList(NULL),
+          _blockSize(0),
+          _blockCount(0),
+          _inUse(0),
+          _peakInUse(0),
+          _allocations(0),
+          _failures(0)
+    {}
+
+    // Arena bytes a pool of blockCount blocks of blockSize takes
+    static size_t footprint(size_t blockSize, size_t blockCount) {
+        return roundBlockSize(blockSize) * blockCount + sizeof(void*) - 1;
+    }
+
+    bool begin(Arena& arena, size_t blockSize, size_t blockCount) {
+        _blockSize = roundBlockSize(blockSize);
+        uint8_t* blocks = (uint8_t*)arena.allocate(_blockSize * blockCount, sizeof(void*));
+        if (blocks == NULL) {
+            return false;
+        }
+
+        _freeList = NULL;
+        for (size_t i = blockCount; i > 0; i--) {
+            void** block = (void**)(blocks + (i - 1) * _blockSize);
+            *block = _freeList;
+            _freeList = block;
+        }
+        _blockCount = blockCount;
+        return true;
+    }
+
+    void* allocate() {
+        if (_freeList == NULL) {
+            _failures++;
+            return NULL;
+        }
+
+        void** block = (void**)_freeList;
+        _freeList = *block;
+        _inUse++;
+        if (_inUse > _peakInUse) {
+            _peakInUse = _inUse;
+        }
+        _allocations++;
+        return block;
+    }
+
+    void release(void* block) {
+        if (block == NULL) {
+            return;
+        }
+        *(void**)block = _freeList;
+        _freeList = block;
+        _inUse--;
+    }
+
+    size_t getBlockSize() const { return _blockSize; }
+    size_t getBlockCount() const { return _blockCount; }
+    size_t getInUse() const { return _inUse; }
+    size_t getPeakInUse() const { return _peakInUse; }
+    uint32_t getAllocationCount() const { return _allocations; }
+    uint32_t getFailureCount() const { return _failures; }
+
+private:
+    // Every free block has to hold the link to the next one
+    static size_t roundBlockSize(size_t blockSize) {
+        return (blockSize < sizeof(void*) ? sizeof(void*) : blockSize + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    }
+
+    void* _freeList;
+    size_t _blockSize;
+    size_t _blockCount;
+    size_t _inUse;
+    size_t _peakInUse;
+    uint32_t _allocations;
+    uint32_t _failures;
+};
+
+#endif
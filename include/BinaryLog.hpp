@@ -0,0 +1,156 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "MessageBuilder.hpp"
+
+// One preformatted log event: what happened, when, and up to three numbers
+struct LogRecord {
+    uint32_t timestamp;  // micros()
+    uint16_t event;      // Index into the format table
+    uint8_t argc;
+    uint8_t reserved;
+    int32_t args[3];
+};
+
+// Marker in front of every record when the log is streamed in binary
+static const uint8_t LOG_SYNC[2] = { 0xA5, 0x5A };
+static const size_t LOG_FRAME_LENGTH = sizeof(LOG_SYNC) + sizeof(LogRecord);
+
+// Marker and record in one block, so that a single write to the UART keeps
+// other output from landing between them
+static inline void logFrame(const LogRecord& record, uint8_t* out) {
+    memcpy(out, LOG_SYNC, sizeof(LOG_SYNC));
+    memcpy(out + sizeof(LOG_SYNC), &record, sizeof(record));
+}
+
+// Binary log ring buffer.
+//
+// Hot paths only copy a timestamp, an event ID and a few integers into a
+// slot, formatting happens later in a low priority task. Several tasks (and
+// ISRs) may write concurrently, one consumer drains: every slot carries a
+// sequence number that tells whether it is free, being filled or ready
+// (bounded MPMC ring after D. Vyukov). A full ring drops the new record and
+// counts it rather than blocking the writer.
+//
+// The atomics require the ring to live in internal RAM.
+template<size_t CAPACITY>
+class BinaryLog {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    BinaryLog()
+        : _head(0),
+          _tail(0),
+          _dropped(0)
+    {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            _slots[i].sequence.store((uint32_t)i, std::memory_order_relaxed);
+        }
+    }
+
+    bool write(uint16_t event, uint32_t timestamp, uint8_t argc = 0, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+        uint32_t pos = _head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &_slots[pos & (CAPACITY - 1)];
+            uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(sequence - pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record.timestamp = timestamp;
+        slot->record.event = event;
+        slot->record.argc = argc;
+        slot->record.reserved = 0;
+        slot->record.args[0] = a;
+        slot->record.args[1] = b;
+        slot->record.args[2] = c;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when nothing is ready
+    bool read(LogRecord& record) {
+        Slot& slot = _slots[_tail & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != _tail + 1) {
+            return false;
+        }
+        record = slot.record;
+        slot.sequence.store(_tail + CAPACITY, std::memory_order_release);
+        _tail++;
+        return true;
+    }
+
+    uint32_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+    // Render a record with its format string. Placeholders take the
+    // arguments in order: {} signed integer, {.2} value / 100 with two
+    // decimals, {x} hex.
+    template<size_t N>
+    static void format(const LogRecord& record, const char* fmt, MessageBuilder<N>& out) {
+        uint8_t arg = 0;
+        const char* p = fmt;
+        while (*p != '\0') {
+            if (*p != '{') {
+                const char* start = p;
+                while (*p != '\0' && *p != '{') {
+                    p++;
+                }
+                out.append(start, (size_t)(p - start));
+                continue;
+            }
+
+            const char* close = strchr(p, '}');
+            if (close == NULL) {
+                out.append(p);
+                break;
+            }
+
+            int32_t value = arg < record.argc ? record.args[arg] : 0;
+            arg++;
+            if (close - p == 3 && p[1] == '.' && p[2] == '2') {
+                if (value < 0) {
+                    out.append('-');
+                    value = -value;
+                }
+                int32_t fraction = value % 100;
+                out.append((int)(value / 100)).append('.');
+                if (fraction < 10) {
+                    out.append('0');
+                }
+                out.append((int)fraction);
+            } else if (close - p == 2 && p[1] == 'x') {
+                out.appendHex((uint32_t)value);
+            } else {
+                out.append((int)value);
+            }
+            p = close + 1;
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        LogRecord record;
+    };
+
+    Slot _slots[CAPACITY];
+    std::atomic<uint32_t> _head;
+    uint32_t _tail;
+    std::atomic<uint32_t> _dropped;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef COMMAND_CONSOLE_HPP
+#define COMMAND_CONSOLE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MessageBuilder.hpp"
+
+// Line-oriented command console.
+//
+// Characters are fed in as they arrive, nothing blocks and nothing is
+// allocated: a complete line is split in place into at most MAX_ARGS
+// words and handed to the handler registered under the first word. The
+// handler fills in the reply, returning false prints the command's usage.
+//
+//   > set rate 38.4
+//   ok
+class CommandConsole {
+public:
+    static constexpr size_t MAX_LINE = 64;
+    static constexpr uint8_t MAX_ARGS = 4;
+
+    typedef MessageBuilder<96> Reply;
+    typedef bool (*Handler)(uint8_t argc, char** argv, Reply& reply);
+    typedef void (*TextCallback)(const char* text, size_t length);
+
+    struct Command {
+        const char* name;
+        const char* usage;
+        Handler handler;
+    };
+
+    CommandConsole(const Command* commands, size_t commandCount, TextCallback output)
+        : _commands(commands),
+          _commandCount(commandCount),
+          _output(output),
+          _length(0),
+          _overflow(false),
+          _lineCount(0),
+          _errorCount(0)
+    {}
+
+    void feed(char c) {
+        if (c == '\r' || c == '\n') {
+            if (_overflow) {
+                reply("error: line too long");
+                _errorCount++;
+            } else if (_length > 0) {
+                _line[_length] = '\0';
+                execute();
+            }
+            _length = 0;
+            _overflow = false;
+        } else if (c == '\b' || c == 0x7F) {
+            if (_length > 0) {
+                _length--;
+            }
+        } else if (_length < MAX_LINE) {
+            _line[_length++] = c;
+        } else {
+            // Drop the rest of the line, it is rejected at its end
+            _overflow = true;
+        }
+    }
+
+    void feed(const char* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            feed(data[i]);
+        }
+    }
+
+    // Whole string must be a number
+    static bool parseFloat(const char* text, float& value) {
+        char* end;
+        value = strtof(text, &end);
+        return end != text && *end == '\0';
+    }
+
+    // Decimal, or hex with a 0x prefix
+    static bool parseLong(const char* text, long& value) {
+        char* end;
+        value = strtol(text, &end, 0);
+        return end != text && *end == '\0';
+    }
+
+    uint32_t getLineCount() const { return _lineCount; }
+    uint32_t getErrorCount() const { return _errorCount; }
+
+private:
+    void execute() {
+        _lineCount++;
+
+        char* argv[MAX_ARGS];
+        uint8_t argc = 0;
+        char* p = _line;
+        while (*p != '\0') {
+            while (*p == ' ' || *p == '\t') {
+                *p++ = '\0';
+            }
+            if (*p == '\0') {
+                break;
+            }
+            if (argc == MAX_ARGS) {
+                reply("error: too many arguments");
+                _errorCount++;
+                return;
+            }
+            argv[argc++] = p;
+            while (*p != '\0' && *p != ' ' && *p != '\t') {
+                p++;
+            }
+        }
+        if (argc == 0) {
+            return;
+        }
+
+        if (strcmp(argv[0], "help") == 0) {
+            for (size_t i = 0; i < _commandCount; i++) {
+                reply(_commands[i].usage);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < _commandCount; i++) {
+            if (strcmp(argv[0], _commands[i].name) != 0) {
+                continue;
+            }
+            Reply text;
+            if (!_commands[i].handler(argc, argv, text)) {
+                text.clear();
+                text.append("usage: ").append(_commands[i].usage);
+                _errorCount++;
+            }
+            if (text.length() > 0) {
+                reply(text.c_str());
+            }
+            return;
+        }
+
+        Reply text;
+        text.append("error: unknown command '").append(argv[0]).append("', try help");
+        reply(text.c_str());
+        _errorCount++;
+    }
+
+    void reply(const char* text) {
+        _output(text, strlen(text));
+        _output("\r\n", 2);
+    }
+
+    const Command* _commands;
+    size_t _commandCount;
+    TextCallback _output;
+    char _line[MAX_LINE + 1];
+    size_t _length;
+    bool _overflow;
+    uint32_t _lineCount;
+    uint32_t _errorCount;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef CONFIG_PROFILE_HPP
+#define CONFIG_PROFILE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "FrequencyHopper.hpp"
+#include "LinkAdaptation.hpp"
+#include "TalkGroups.hpp"
+
+// CC1101 configuration registers IOCFG2 (0x00) to TEST0 (0x2E), written
+// back in one burst on a fast boot
+static const uint8_t CC1101_CONFIG_REGISTERS = 0x2F;
+
+// MAC features a profile was saved with, a build without them cannot use it
+enum MacFlags : uint8_t {
+    MAC_FEC = 0x01,
+    MAC_HOPPING = 0x02,
+    MAC_AGGREGATION = 0x04,
+    MAC_MESH = 0x08
+};
+
+// One named radio configuration.
+//
+// Serialized little-endian with a small header and a CRC-16:
+//
+//   ['C']['P'][version][reserved][payload length lo][hi][payload...][crc lo][hi]
+//
+// The payload is append-only: every new layout version only adds fields at
+// the end. Loading a blob from an older firmware reads what is there and
+// keeps the defaults for the rest; a blob from a newer firmware is read up
+// to the fields this one knows about.
+struct ConfigProfile {
+    static const uint8_t VERSION = 3;
+    static const size_t HEADER_LENGTH = 6;
+    static const size_t MAX_LENGTH = 256;
+
+    // Modulation
+    float frequency;    // MHz
+    float bitRate;      // kbps
+    float freqDev;      // kHz
+    float rxBandwidth;  // kHz
+    int8_t power;       // dBm
+    uint16_t syncWord;
+
+    // Channel plan
+    float hopBase;      // MHz
+    float hopSpacing;   // MHz
+    uint8_t hopChannels;
+    uint32_t hopSeed;
+    uint16_t hopDwell;  // ms
+
+    // Codec and MAC
+    uint8_t maxLinkProfile;  // Fastest RADIO_PROFILES entry (and codec mode) allowed
+    uint8_t macFlags;        // MacFlags
+
+    // Snapshot of the configured chip, replaces the individual setters
+    uint8_t registersValid;
+    uint8_t registers[CC1101_CONFIG_REGISTERS];
+
+    // Synthesizer calibration per hop channel (FSCAL3..1)
+    uint8_t calibrated;
+    uint8_t fscal[FrequencyHopper::MAX_CHANNELS][3];
+
+    // Addressing (version 2)
+    uint8_t talkGroup;
+    uint8_t talkGroups[TalkGroups::BITMAP_LENGTH];
+
+    // Modulation set by hand, link adaptation stays off (version 3).
+    // Otherwise the rates above are the most robust link profile, where
+    // adaptation starts after a boot.
+    uint8_t manualModem;
+
+    ConfigProfile()
+        : frequency(434.0f),
+          bitRate(4.8f),
+          freqDev(5.0f),
+          rxBandwidth(135.0f),
+          power(10),
+          syncWord(0x12AD),
+          hopBase(433.1f),
+          hopSpacing(0.1f),
+          hopChannels(16),
+          hopSeed(1),
+          hopDwell(100),
+          maxLinkProfile(RADIO_PROFILE_COUNT - 1),
+          macFlags(0),
+          registersValid(0),
+          calibrated(0),
+          talkGroup(1),
+          manualModem(0)
+    {
+        memset(registers, 0, sizeof(registers));
+        memset(fscal, 0, sizeof(fscal));
+        TalkGroups groups(talkGroup);
+        memcpy(talkGroups, groups.getBitmap(), sizeof(talkGroups));
+    }
+
+    // Returns the blob length, out needs MAX_LENGTH bytes
+    size_t serialize(uint8_t* out) const {
+        Writer w(out + HEADER_LENGTH);
+        w.put(frequency);
+        w.put(bitRate);
+        w.put(freqDev);
+        w.put(rxBandwidth);
+        w.put(power);
+        w.put(syncWord);
+        w.put(hopBase);
+        w.put(hopSpacing);
+        w.put(hopChannels);
+        w.put(hopSeed);
+        w.put(hopDwell);
+        w.put(maxLinkProfile);
+        w.put(macFlags);
+        w.put(registersValid);
+        w.putBytes(registers, sizeof(registers));
+        w.put(calibrated);
+        w.putBytes(&fscal[0][0], sizeof(fscal));
+        w.put(talkGroup);
+        w.putBytes(talkGroups, sizeof(talkGroups));
+        w.put(manualModem);
+
+        out[0] = 'C';
+        out[1] = 'P';
+        out[2] = VERSION;
+        out[3] = 0;
+        out[4] = (uint8_t)w.length;
+        out[5] = (uint8_t)(w.length >> 8);
+
+        size_t length = HEADER_LENGTH + w.length;
+        uint16_t crc = crc16(out, length);
+        out[length++] = (uint8_t)crc;
+        out[length++] = (uint8_t)(crc >> 8);
+        return length;
+    }
+
+    // False on a damaged or foreign blob, the profile is left untouched then
+    bool deserialize(const uint8_t* in, size_t length) {
+        if (length < HEADER_LENGTH + 2 || in[0] != 'C' || in[1] != 'P') {
+            return false;
+        }
+        size_t payload = in[4] | ((size_t)in[5] << 8);
+        if (HEADER_LENGTH + payload + 2 != length) {
+            return false;
+        }
+        uint16_t crc = in[length - 2] | (uint16_t)(in[length - 1] << 8);
+        if (crc16(in, length - 2) != crc) {
+            return false;
+        }
+
+        ConfigProfile p(*this);
+        Reader r(in + HEADER_LENGTH, payload);
+        r.get(p.frequency);
+        r.get(p.bitRate);
+        r.get(p.freqDev);
+        r.get(p.rxBandwidth);
+        r.get(p.power);
+        r.get(p.syncWord);
+        r.get(p.hopBase);
+        r.get(p.hopSpacing);
+        r.get(p.hopChannels);
+        r.get(p.hopSeed);
+        r.get(p.hopDwell);
+        r.get(p.maxLinkProfile);
+        r.get(p.macFlags);
+        r.get(p.registersValid);
+        r.getBytes(p.registers, sizeof(p.registers));
+        r.get(p.calibrated);
+        r.getBytes(&p.fscal[0][0], sizeof(p.fscal));
+        r.get(p.talkGroup);
+        r.getBytes(p.talkGroups, sizeof(p.talkGroups));
+        r.get(p.manualModem);
+        // Fields added by later versions go here, after all the others
+
+        *this = p;
+        return true;
+    }
+
+    // CRC-16/CCITT-FALSE
+    static uint16_t crc16(const uint8_t* data, size_t length) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= (uint16_t)(data[i] << 8);
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+private:
+    struct Writer {
+        explicit Writer(uint8_t* out) : data(out), length(0) {}
+
+        template<typename T>
+        void put(T value) {
+            // Little-endian on both the ESP32-S3 and x86 hosts
+            memcpy(data + length, &value, sizeof(value));
+            length += sizeof(value);
+        }
+
+        void putBytes(const uint8_t* bytes, size_t count) {
+            memcpy(data + length, bytes, count);
+            length += count;
+        }
+
+        uint8_t* data;
+        size_t length;
+    };
+
+    // Fields beyond the stored payload keep their current value
+    struct Reader {
+        Reader(const uint8_t* in, size_t size) : data(in), length(size), offset(0) {}
+
+        template<typename T>
+        void get(T& value) {
+            if (offset + sizeof(value) <= length) {
+                memcpy(&value, data + offset, sizeof(value));
+            }
+            offset += sizeof(value);
+        }
+
+        void getBytes(uint8_t* bytes, size_t count) {
+            if (offset + count <= length) {
+                memcpy(bytes, data + offset, count);
+            }
+            offset += count;
+        }
+
+        const uint8_t* data;
+        size_t length;
+        size_t offset;
+    };
+};
+
+#endif
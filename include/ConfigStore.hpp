@@ -0,0 +1,233 @@
+#ifndef CONFIG_STORE_HPP
+#define CONFIG_STORE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "ConfigProfile.hpp"
+
+#if defined(ESP32)
+#include <Preferences.h>
+#endif
+
+// Named configuration profiles in non-volatile storage.
+//
+// On the ESP32-S3 every profile is one NVS blob in the given namespace, on
+// a host one file per profile in the given directory, so migrations and
+// load times can be tested off target. Names are limited by the 15
+// character NVS key length minus the "p." prefix. The "active" entry names
+// the profile to restore at boot. Talk-group keys live in one "keys" blob
+// next to the profiles, "epoch" holds the last nonce epoch handed out and
+// "unit" the unit ID the unit was provisioned with.
+class ConfigStore {
+public:
+    static const size_t MAX_NAME = 13;
+    static const size_t KEY_LENGTH = 16;
+    static const uint8_t MAX_KEYS = 8;
+
+    struct KeyEntry {
+        uint8_t address;
+        uint8_t key[KEY_LENGTH];
+    };
+
+    ConfigStore() : _open(false) {
+        _location[0] = '\0';
+    }
+
+    bool begin(const char* location) {
+#if defined(ESP32)
+        _open = _prefs.begin(location, false);
+#else
+        _open = strlen(location) < sizeof(_location);
+#endif
+        if (_open) {
+            strncpy(_location, location, sizeof(_location) - 1);
+            _location[sizeof(_location) - 1] = '\0';
+        }
+        return _open;
+    }
+
+    bool save(const char* name, const ConfigProfile& profile) {
+        char key[16];
+        if (!profileKey(name, key)) {
+            return false;
+        }
+        uint8_t blob[ConfigProfile::MAX_LENGTH];
+        size_t length = profile.serialize(blob);
+        return writeBlob(key, blob, length);
+    }
+
+    // False if the profile does not exist or is damaged
+    bool load(const char* name, ConfigProfile& profile) {
+        char key[16];
+        if (!profileKey(name, key)) {
+            return false;
+        }
+        uint8_t blob[ConfigProfile::MAX_LENGTH];
+        size_t length = readBlob(key, blob, sizeof(blob));
+        return length > 0 && profile.deserialize(blob, length);
+    }
+
+    bool remove(const char* name) {
+        char key[16];
+        return profileKey(name, key) && removeBlob(key);
+    }
+
+    bool setActive(const char* name) {
+        if (strlen(name) > MAX_NAME) {
+            return false;
+        }
+        return writeBlob("active", (const uint8_t*)name, strlen(name));
+    }
+
+    // Name of the profile to restore at boot, false if none was chosen
+    bool getActive(char* name, size_t size) {
+        size_t length = readBlob("active", (uint8_t*)name, size - 1);
+        name[length] = '\0';
+        return length > 0;
+    }
+
+    // Add or replace the key for an address
+    bool saveKey(uint8_t address, const uint8_t* key) {
+        KeyEntry entries[MAX_KEYS];
+        uint8_t count = loadKeys(entries);
+        uint8_t index = 0;
+        while (index < count && entries[index].address != address) {
+            index++;
+        }
+        if (index == MAX_KEYS) {
+            return false;
+        }
+        entries[index].address = address;
+        memcpy(entries[index].key, key, KEY_LENGTH);
+        bool ok = writeBlob("keys", (const uint8_t*)entries, (index == count ? count + 1 : count) * sizeof(KeyEntry));
+        memset(entries, 0, sizeof(entries));
+        return ok;
+    }
+
+    bool removeKey(uint8_t address) {
+        KeyEntry entries[MAX_KEYS];
+        uint8_t count = loadKeys(entries);
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (entries[i].address != address) {
+                entries[kept++] = entries[i];
+            }
+        }
+        bool ok = kept == count ||
+                  (kept == 0 ? removeBlob("keys") : writeBlob("keys", (const uint8_t*)entries, kept * sizeof(KeyEntry)));
+        memset(entries, 0, sizeof(entries));
+        return ok;
+    }
+
+    // Stored keys, up to MAX_KEYS entries; the caller wipes them after use
+    uint8_t loadKeys(KeyEntry* entries) {
+        size_t length = readBlob("keys", (uint8_t*)entries, MAX_KEYS * sizeof(KeyEntry));
+        return (uint8_t)(length / sizeof(KeyEntry));
+    }
+
+    // Reserve the next nonce epoch. It is written before it is used, so no
+    // epoch is handed out twice, even if the unit resets right after.
+    bool nextEpoch(uint16_t& epoch) {
+        uint8_t stored[2] = { 0, 0 };
+        readBlob("epoch", stored, sizeof(stored));
+        epoch = (uint16_t)(stored[0] | (stored[1] << 8)) + 1;
+        stored[0] = (uint8_t)epoch;
+        stored[1] = (uint8_t)(epoch >> 8);
+        return writeBlob("epoch", stored, sizeof(stored));
+    }
+
+    // Provisioned unit ID, false if there is none
+    bool loadUnit(uint16_t& unit) {
+        uint8_t stored[2];
+        if (readBlob("unit", stored, sizeof(stored)) != sizeof(stored)) {
+            return false;
+        }
+        unit = (uint16_t)(stored[0] | (stored[1] << 8));
+        return unit != 0;
+    }
+
+    bool saveUnit(uint16_t unit) {
+        uint8_t stored[2] = { (uint8_t)unit, (uint8_t)(unit >> 8) };
+        return unit != 0 && writeBlob("unit", stored, sizeof(stored));
+    }
+
+private:
+    bool profileKey(const char* name, char* key) const {
+        size_t length = strlen(name);
+        if (!_open || length == 0 || length > MAX_NAME) {
+            return false;
+        }
+        key[0] = 'p';
+        key[1] = '.';
+        memcpy(key + 2, name, length + 1);
+        return true;
+    }
+
+#if defined(ESP32)
+    bool writeBlob(const char* key, const uint8_t* data, size_t length) {
+        return _open && _prefs.putBytes(key, data, length) == length;
+    }
+
+    size_t readBlob(const char* key, uint8_t* data, size_t size) {
+        if (!_open || !_prefs.isKey(key)) {
+            return 0;
+        }
+        size_t length = _prefs.getBytesLength(key);
+        if (length > size) {
+            return 0;
+        }
+        return _prefs.getBytes(key, data, length);
+    }
+
+    bool removeBlob(const char* key) {
+        return _open && _prefs.remove(key);
+    }
+#else
+    void filePath(const char* key, char* path, size_t size) const {
+        snprintf(path, size, "%s/%s.bin", _location, key);
+    }
+
+    bool writeBlob(const char* key, const uint8_t* data, size_t length) {
+        char path[96];
+        filePath(key, path, sizeof(path));
+        FILE* file = fopen(path, "wb");
+        if (file == NULL) {
+            return false;
+        }
+        bool ok = fwrite(data, 1, length, file) == length;
+        return fclose(file) == 0 && ok;
+    }
+
+    size_t readBlob(const char* key, uint8_t* data, size_t size) {
+        char path[96];
+        filePath(key, path, sizeof(path));
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+            return 0;
+        }
+        size_t length = fread(data, 1, size, file);
+        // A blob larger than the buffer does not belong to us
+        if (fgetc(file) != EOF) {
+            length = 0;
+        }
+        fclose(file);
+        return length;
+    }
+
+    bool removeBlob(const char* key) {
+        char path[96];
+        filePath(key, path, sizeof(path));
+        return ::remove(path) == 0;
+    }
+#endif
+
+#if defined(ESP32)
+    Preferences _prefs;
+#endif
+    bool _open;
+    char _location[64];
+};
+
+#endif
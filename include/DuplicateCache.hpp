@@ -0,0 +1,118 @@
+#ifndef DUPLICATE_CACHE_HPP
+#define DUPLICATE_CACHE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recently seen frame IDs (source and sequence) with time-based expiry.
+//
+// Open addressing over a power-of-two table of 8 byte entries: an ID
+// hashes to a home slot and may live in any of the PROBES slots after it,
+// so a lookup touches one or two cache lines and never more. Expired
+// entries count as free; when all slots of a window hold live IDs the one
+// closest to expiry makes room. Full IDs are stored, so a hit is never a
+// false positive; an eviction under overload can only let a late copy
+// through once more.
+template<size_t CAPACITY>
+class DuplicateCache {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0 && CAPACITY >= 16, "CAPACITY must be a power of two >= 16");
+    static const uint8_t PROBES = 8;
+
+    explicit DuplicateCache(uint32_t lifetime = 2000)
+        : _lifetime(lifetime),
+          _lookups(0),
+          _hits(0),
+          _evictions(0)
+    {
+        clear();
+    }
+
+    // True if the ID was seen within the lifetime, otherwise it is
+    // remembered from now on
+    bool check(uint32_t id, uint32_t now) {
+        _lookups++;
+        size_t home = slot(id);
+        size_t free = CAPACITY;
+        size_t oldest = home;
+        uint32_t oldestLeft = UINT32_MAX;
+        for (uint8_t i = 0; i < PROBES; i++) {
+            size_t index = (home + i) & (CAPACITY - 1);
+            const Entry& entry = _entries[index];
+            // Live while 0 < left <= lifetime, which also holds across
+            // the 49 day wrap of the clock
+            uint32_t left = entry.expires - now;
+            bool live = left - 1 < _lifetime;
+            if (live && entry.id == id) {
+                _hits++;
+                return true;
+            }
+            if (!live) {
+                if (free == CAPACITY) {
+                    free = index;
+                }
+            } else if (left < oldestLeft) {
+                oldest = index;
+                oldestLeft = left;
+            }
+        }
+
+        if (free == CAPACITY) {
+            free = oldest;
+            _evictions++;
+        }
+        _entries[free].id = id;
+        _entries[free].expires = now + _lifetime;
+        return false;
+    }
+
+    // True if the ID was seen within the lifetime, without remembering
+    // it; for IDs only taken once the frame proved genuine
+    bool peek(uint32_t id, uint32_t now) {
+        _lookups++;
+        size_t home = slot(id);
+        for (uint8_t i = 0; i < PROBES; i++) {
+            const Entry& entry = _entries[(home + i) & (CAPACITY - 1)];
+            if (entry.expires - now - 1 < _lifetime && entry.id == id) {
+                _hits++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            _entries[i].id = 0;
+            _entries[i].expires = 0;
+        }
+    }
+
+    uint32_t getLifetime() const { return _lifetime; }
+    uint32_t getLookups() const { return _lookups; }
+    uint32_t getHits() const { return _hits; }
+    uint32_t getEvictions() const { return _evictions; }
+
+private:
+    struct Entry {
+        uint32_t id;
+        uint32_t expires;  // ms, free once reached (or lifetime ago)
+    };
+
+    // Fibonacci hashing spreads consecutive sequence numbers
+    static size_t slot(uint32_t id) {
+        return (size_t)((id * 2654435769u) >> (32 - bits(CAPACITY)));
+    }
+
+    static constexpr uint8_t bits(size_t value) {
+        return value <= 1 ? 0 : 1 + bits(value / 2);
+    }
+
+    uint32_t _lifetime;
+    Entry _entries[CAPACITY];
+    uint32_t _lookups;
+    uint32_t _hits;
+    uint32_t _evictions;
+};
+
+#endif
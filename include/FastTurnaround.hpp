@@ -0,0 +1,107 @@
+#ifndef FAST_TURNAROUND_HPP
+#define FAST_TURNAROUND_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// CC1101 turnaround without passing through IDLE.
+//
+// MCSM1's TXOFF_MODE has the chip back in RX by itself after every packet.
+// A frame that fits the 64 byte TX FIFO is written while the chip still
+// listens, as [length][address][frame...] (no address byte without the
+// radio's address filter); a bare STX then switches to TX within a few bit
+// times. With clear channel assessment the chip stays in RX while the
+// channel is busy: after timeoutUs of MARCSTATE polls the caller sends the
+// slow way, which forces TX from IDLE.
+//
+// The chip is reached through a template parameter with
+//
+//   void setRegister(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb);
+//   uint8_t readRegister(uint8_t reg);
+//   void writeBurst(uint8_t reg, const uint8_t* data, size_t length);
+//   void strobe(uint8_t command);
+//   uint32_t micros();
+//
+// so the firmware passes RadioLib's module and the host tests a mock with
+// a strobe and SPI log. Register addresses and states are the datasheet's.
+template<typename Chip>
+class FastTurnaround {
+public:
+    static const size_t FIFO_SIZE = 64;
+
+    static const uint8_t REG_MCSM1 = 0x17;
+    static const uint8_t REG_MARCSTATE = 0x35;
+    static const uint8_t REG_FIFO = 0x3F;
+    static const uint8_t BURST = 0x40;
+    static const uint8_t STROBE_TX = 0x35;
+    static const uint8_t TXOFF_RX = 0x03;  // MCSM1[1:0]
+
+    static const uint8_t STATE_RX = 0x0D;
+    static const uint8_t STATE_RX_END = 0x0E;
+    static const uint8_t STATE_RX_RST = 0x0F;
+    static const uint8_t STATE_RXFIFO_OVERFLOW = 0x11;
+
+    FastTurnaround(Chip& chip, uint32_t timeoutUs)
+        : _chip(chip),
+          _timeoutUs(timeoutUs),
+          _ready(false)
+    {}
+
+    // MCSM1 is in the profile snapshot, but older profiles were saved
+    // without TXOFF_MODE
+    void configure() {
+        _chip.setRegister(REG_MCSM1, TXOFF_RX, 1, 0);
+    }
+
+    // RadioLib sent a packet and mapped GDO0 for it, from now on frames
+    // may go the fast way
+    void setReady() { _ready = true; }
+    bool isReady() const { return _ready; }
+
+    // Fill the FIFO for a packet that fits, while the CC1101 keeps
+    // receiving; false leaves the FIFO untouched
+    bool load(const uint8_t* packet, size_t length, uint8_t address, bool radioAddress) {
+        size_t header = radioAddress ? 2 : 1;
+        if (!_ready || header + length > FIFO_SIZE) {
+            return false;
+        }
+
+        uint8_t fifo[FIFO_SIZE];
+        fifo[0] = (uint8_t)(length + header - 1);
+        fifo[1] = address;
+        memcpy(fifo + header, packet, length);
+        _chip.writeBurst(REG_FIFO | BURST, fifo, header + length);
+        return true;
+    }
+
+    // Send the loaded FIFO, true once the chip left RX. From IDLE (right
+    // after a packet was read) it always goes.
+    bool transmit() {
+        _chip.strobe(STROBE_TX);
+
+        uint32_t start = _chip.micros();
+        do {
+            uint8_t state = marcState();
+            if (state != STATE_RX && state != STATE_RX_END && state != STATE_RX_RST &&
+                state != STATE_RXFIFO_OVERFLOW) {
+                return true;
+            }
+        } while (_chip.micros() - start < _timeoutUs);
+        return false;
+    }
+
+    // TXOFF_MODE had the chip listening again after a packet, or it kept
+    // listening through one that went elsewhere
+    bool isListening() { return marcState() == STATE_RX; }
+
+    // Status registers need the burst bit, without it 0x35 is the STX strobe
+    uint8_t marcState() { return _chip.readRegister(REG_MARCSTATE | BURST) & 0x1F; }
+
+private:
+    Chip& _chip;
+    uint32_t _timeoutUs;
+    bool _ready;
+};
+
+#endif
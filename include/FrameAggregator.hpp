@@ -0,0 +1,126 @@
+#ifndef FRAME_AGGREGATOR_HPP
+#define FRAME_AGGREGATOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+
+// Packs several small frames (codec frames, data, piggybacked ACKs) into
+// one radio packet so preamble, sync word, length and CRC are paid once:
+//
+//   [FRAME_AGGREGATE][len 0][frame 0...][len 1][frame 1...]...
+//
+// A partial aggregate is flushed once its oldest frame has waited for the
+// latency budget, so aggregation never delays traffic by more than that.
+class FrameAggregator {
+public:
+    // Called once for every frame found in an aggregate
+    typedef void (*FrameCallback)(const uint8_t* frame, size_t length);
+
+    FrameAggregator(size_t maxLength = MAX_FRAME_LENGTH, unsigned long latencyBudget = 40)
+        : _maxLength(maxLength > MAX_FRAME_LENGTH ? MAX_FRAME_LENGTH : maxLength),
+          _latencyBudget(latencyBudget),
+          _length(0),
+          _count(0),
+          _firstAt(0),
+          _packets(0),
+          _frames(0)
+    {}
+
+    void setLatencyBudget(unsigned long latencyBudget) { _latencyBudget = latencyBudget; }
+    unsigned long getLatencyBudget() const { return _latencyBudget; }
+
+    bool isEmpty() const { return _count == 0; }
+
+    // Whether a frame of the given length still fits into the pending packet
+    bool canFit(size_t length) const {
+        size_t used = _count == 0 ? 1 : _length;
+        return used + 1 + length <= _maxLength;
+    }
+
+    // Append a frame; false if it does not fit, flush first in that case
+    bool add(const uint8_t* frame, size_t length, unsigned long now) {
+        if (length == 0 || length > 0xFF || !canFit(length)) {
+            return false;
+        }
+
+        if (_count == 0) {
+            _buffer[0] = FRAME_AGGREGATE;
+            _length = 1;
+            _firstAt = now;
+        }
+        _buffer[_length++] = (uint8_t)length;
+        memcpy(_buffer + _length, frame, length);
+        _length += length;
+        _count++;
+        return true;
+    }
+
+    // Length flush() returns once a frame of the given length is added
+    size_t lengthWith(size_t length) const { return _count == 0 ? length : _length + 1 + length; }
+
+    // Pending frames have waited long enough or no further frame fits
+    bool isDue(unsigned long now) const {
+        return _count > 0 && (now - _firstAt >= _latencyBudget || !canFit(1));
+    }
+
+    // Move the pending packet into out and start over; returns its length.
+    // A single frame is sent as-is, without the aggregate header.
+    size_t flush(uint8_t* out) {
+        size_t length = 0;
+        if (_count == 1) {
+            length = _buffer[1];
+            memcpy(out, _buffer + 2, length);
+        } else if (_count > 1) {
+            length = _length;
+            memcpy(out, _buffer, length);
+        }
+
+        if (_count > 0) {
+            _packets++;
+            _frames += _count;
+        }
+        _count = 0;
+        _length = 0;
+        return length;
+    }
+
+    // Walk the frames of a received FRAME_AGGREGATE.
+    // Returns the number of frames found, or -1 if the packet is malformed.
+    static int unpack(const uint8_t* packet, size_t length, FrameCallback callback) {
+        if (length < 1 || packet[0] != FRAME_AGGREGATE) {
+            return -1;
+        }
+
+        int count = 0;
+        size_t pos = 1;
+        while (pos < length) {
+            size_t frameLength = packet[pos++];
+            if (frameLength == 0 || pos + frameLength > length) {
+                return -1;
+            }
+            callback(packet + pos, frameLength);
+            pos += frameLength;
+            count++;
+        }
+        return count;
+    }
+
+    // Statistics
+    uint32_t getPacketCount() const { return _packets; }
+    uint32_t getFrameCount() const { return _frames; }
+
+private:
+    uint8_t _buffer[MAX_FRAME_LENGTH];
+    size_t _maxLength;
+    unsigned long _latencyBudget;
+    size_t _length;
+    uint8_t _count;
+    unsigned long _firstAt;
+
+    uint32_t _packets;
+    uint32_t _frames;
+};
+
+#endif
@@ -0,0 +1,467 @@
+#ifndef FRAME_CIPHER_HPP
+#define FRAME_CIPHER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+
+// The ESP32-S3 build drives the AES peripheral through the IDF's mbedtls
+// port, which streams longer CBC/CTR calls through DMA. Hosts (and
+// FRAME_CIPHER_SOFTWARE builds, for comparison) use a portable AES-128.
+#if defined(ESP32) && !defined(FRAME_CIPHER_SOFTWARE)
+#define FRAME_CIPHER_HARDWARE 1
+#include <mbedtls/aes.h>
+#else
+#define FRAME_CIPHER_HARDWARE 0
+#endif
+
+// Per-frame authenticated encryption, AES-128-CCM keyed per talk group.
+//
+//   [FRAME_SECURE][group][source lo][hi][counter 0..3][ciphertext...][tag 0..3]
+//
+// The 7 byte CCM nonce is the clear header after the type byte: group,
+// sender and its 32 bit frame counter. The counter's upper half is an
+// epoch the caller reserves in non-volatile storage (needsEpoch()), the
+// lower half counts frames within it, so one sender never repeats a
+// nonce. Across senders that only holds if no two units sharing a key
+// seal with the same source: it has to be a unit ID provisioned for the
+// fleet, nothing is sealed without one. An authentic frame from another
+// unit carrying our own ID is counted as a conflict and stops sealing
+// until a new ID is set. The whole header is authenticated along with the
+// payload; the tag is truncated to 4 bytes.
+//
+// Receivers keep the highest counter authenticated per sender and a
+// bitmap of the REPLAY_WINDOW below it, so relayed frames may arrive out
+// of order but a recorded frame is never accepted twice. Senders beyond
+// REPLAY_SOURCES push out the one heard from longest ago; its next frame
+// is taken as the new highest.
+//
+// CCM is computed as two bulk passes, a CBC-MAC over the formatted blocks
+// and one CTR pass that yields the tag mask and the ciphertext together,
+// so the hardware sees two DMA transfers per frame rather than a block at
+// a time.
+class FrameCipher {
+public:
+    static const size_t KEY_LENGTH = 16;
+    static const size_t HEADER_LENGTH = 8;
+    static const size_t TAG_LENGTH = 4;
+    static const size_t OVERHEAD = HEADER_LENGTH + TAG_LENGTH;
+    static const uint8_t MAX_KEYS = 8;
+    static const uint8_t REPLAY_SOURCES = 16;
+    static const uint32_t REPLAY_WINDOW = 32;
+
+    FrameCipher()
+        : _source(0), _counter(0), _epochValid(false), _conflict(false), _replayClock(0),
+          _sealed(0), _opened(0), _failures(0), _replays(0), _conflicts(0) {
+        memset(_keys, 0, sizeof(_keys));
+        memset(_peers, 0, sizeof(_peers));
+#if FRAME_CIPHER_HARDWARE
+        for (uint8_t i = 0; i < MAX_KEYS; i++) {
+            mbedtls_aes_init(&_keys[i].aes);
+        }
+#endif
+    }
+
+    // Our provisioned unit ID, 0 for none
+    void setSource(uint16_t source) {
+        _source = source;
+        _conflict = false;
+    }
+
+    bool hasSource() const { return _source != 0; }
+
+    // Another unit sealed with our ID, see the class comment
+    bool hasConflict() const { return _conflict; }
+
+    // A sender we authenticated frames from, still in the replay table
+    bool hasHeard(uint16_t source) const {
+        for (uint8_t i = 0; i < REPLAY_SOURCES; i++) {
+            if (_peers[i].valid && _peers[i].source == source) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // False if the table is full
+    bool setKey(uint8_t group, const uint8_t* key) {
+        Key* slot = find(group);
+        for (uint8_t i = 0; slot == NULL && i < MAX_KEYS; i++) {
+            if (!_keys[i].valid) {
+                slot = &_keys[i];
+            }
+        }
+        if (slot == NULL) {
+            return false;
+        }
+        slot->group = group;
+        slot->valid = true;
+        expandKey(*slot, key);
+        return true;
+    }
+
+    void clearKey(uint8_t group) {
+        Key* key = find(group);
+        if (key != NULL) {
+            key->valid = false;
+#if FRAME_CIPHER_HARDWARE
+            mbedtls_aes_free(&key->aes);
+            mbedtls_aes_init(&key->aes);
+#else
+            memset(key->roundKeys, 0, sizeof(key->roundKeys));
+#endif
+        }
+    }
+
+    bool hasKey(uint8_t group) const { return find(group) != NULL; }
+
+    bool hasKeys() const {
+        for (uint8_t i = 0; i < MAX_KEYS; i++) {
+            if (_keys[i].valid) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A fresh epoch is needed at the first frame and every 65536 frames
+    bool needsEpoch() const { return !_epochValid; }
+
+    void setEpoch(uint16_t epoch) {
+        _counter = (uint32_t)epoch << 16;
+        _epochValid = true;
+    }
+
+    // Encrypt a frame in place for the group; frame needs OVERHEAD bytes
+    // of room behind the payload. Returns the new length, 0 without a key,
+    // epoch or unit ID, or while another unit uses ours.
+    size_t seal(uint8_t group, uint8_t* frame, size_t length) {
+        Key* key = find(group);
+        if (key == NULL || !_epochValid || _source == 0 || _conflict || length + OVERHEAD > MAX_FRAME_LENGTH) {
+            return 0;
+        }
+        uint32_t counter = _counter++;
+        if ((_counter & 0xFFFF) == 0) {
+            _epochValid = false;
+        }
+
+        uint8_t header[HEADER_LENGTH] = {
+            FRAME_SECURE, group, (uint8_t)_source, (uint8_t)(_source >> 8),
+            (uint8_t)counter, (uint8_t)(counter >> 8), (uint8_t)(counter >> 16), (uint8_t)(counter >> 24)
+        };
+        uint8_t tag[16];
+        cbcMac(*key, header, frame, length, tag);
+
+        // Tag mask and ciphertext from one CTR pass over [zeros][plaintext]
+        memset(_ctrIn, 0, 16);
+        memcpy(_ctrIn + 16, frame, length);
+        ctr(*key, header, _ctrIn, _ctrOut, 16 + length);
+
+        memcpy(frame, header, HEADER_LENGTH);
+        memcpy(frame + HEADER_LENGTH, _ctrOut + 16, length);
+        for (uint8_t i = 0; i < TAG_LENGTH; i++) {
+            frame[HEADER_LENGTH + length + i] = tag[i] ^ _ctrOut[i];
+        }
+        _sealed++;
+        return length + OVERHEAD;
+    }
+
+    // Packet ID for a DuplicateCache from the clear header, sender and the
+    // lower counter half; false if the packet is too short to be sealed
+    static bool packetId(const uint8_t* packet, size_t length, uint32_t& id) {
+        if (length < OVERHEAD) {
+            return false;
+        }
+        id = (uint32_t)packet[2] << 16 | (uint32_t)packet[3] << 24 | packet[4] | (uint32_t)packet[5] << 8;
+        return true;
+    }
+
+    // Decrypt and verify a FRAME_SECURE packet. Returns the plaintext
+    // (valid until the next call) or NULL if there is no key for the
+    // group, the tag does not match, the frame was accepted before or it
+    // carries our own ID.
+    const uint8_t* open(const uint8_t* packet, size_t length, size_t& frameLength) {
+        Key* key = length > OVERHEAD ? find(packet[1]) : NULL;
+        if (key == NULL) {
+            _failures++;
+            return NULL;
+        }
+        size_t payload = length - OVERHEAD;
+
+        memset(_ctrIn, 0, 16);
+        memcpy(_ctrIn + 16, packet + HEADER_LENGTH, payload);
+        ctr(*key, packet, _ctrIn, _ctrOut, 16 + payload);
+
+        uint8_t tag[16];
+        cbcMac(*key, packet, _ctrOut + 16, payload, tag);
+        uint8_t diff = 0;
+        for (uint8_t i = 0; i < TAG_LENGTH; i++) {
+            diff |= (uint8_t)((tag[i] ^ _ctrOut[i]) ^ packet[HEADER_LENGTH + payload + i]);
+        }
+        if (diff != 0) {
+            _failures++;
+            return NULL;
+        }
+        // Only authentic counters move the window
+        uint16_t source = packet[2] | (uint16_t)(packet[3] << 8);
+        uint32_t counter = packet[4] | (uint32_t)packet[5] << 8 | (uint32_t)packet[6] << 16 | (uint32_t)packet[7] << 24;
+        if (source == _source && _source != 0) {
+            _conflicts++;
+            _conflict = true;
+            return NULL;
+        }
+        if (!accept(source, counter)) {
+            _replays++;
+            return NULL;
+        }
+        _opened++;
+        frameLength = payload;
+        return _ctrOut + 16;
+    }
+
+    uint32_t getSealed() const { return _sealed; }
+    uint32_t getOpened() const { return _opened; }
+    uint32_t getFailures() const { return _failures; }
+    uint32_t getReplays() const { return _replays; }
+    uint32_t getConflicts() const { return _conflicts; }
+
+    static bool isHardware() { return FRAME_CIPHER_HARDWARE; }
+
+private:
+    // CCM with a 7 byte nonce leaves 8 bytes for the length and counter
+    static const uint8_t NONCE_LENGTH = 7;
+    static const size_t BLOCKS_LENGTH = 16 + 16 + MAX_FRAME_LENGTH + 1;
+
+    struct Key {
+        uint8_t group;
+        bool valid;
+#if FRAME_CIPHER_HARDWARE
+        mbedtls_aes_context aes;
+#else
+        uint8_t roundKeys[176];
+#endif
+    };
+
+    Key* find(uint8_t group) {
+        for (uint8_t i = 0; i < MAX_KEYS; i++) {
+            if (_keys[i].valid && _keys[i].group == group) {
+                return &_keys[i];
+            }
+        }
+        return NULL;
+    }
+
+    const Key* find(uint8_t group) const {
+        return const_cast<FrameCipher*>(this)->find(group);
+    }
+
+    struct Peer {
+        uint16_t source;
+        bool valid;
+        uint32_t highest;
+        uint32_t seen;  // Bit n: highest - n was accepted
+        uint32_t used;
+    };
+
+    // Records the counter; false if it was accepted before or is older
+    // than the window
+    bool accept(uint16_t source, uint32_t counter) {
+        Peer* peer = NULL;
+        Peer* oldest = &_peers[0];
+        for (uint8_t i = 0; i < REPLAY_SOURCES && peer == NULL; i++) {
+            if (_peers[i].valid && _peers[i].source == source) {
+                peer = &_peers[i];
+            } else if (_peers[i].used < oldest->used) {
+                // Unused entries have used == 0
+                oldest = &_peers[i];
+            }
+        }
+        if (peer == NULL) {
+            peer = oldest;
+            peer->source = source;
+            peer->valid = true;
+            peer->highest = counter;
+            peer->seen = 1;
+        } else if (counter > peer->highest) {
+            uint32_t shift = counter - peer->highest;
+            peer->seen = shift < REPLAY_WINDOW ? (peer->seen << shift) | 1 : 1;
+            peer->highest = counter;
+        } else {
+            uint32_t age = peer->highest - counter;
+            if (age >= REPLAY_WINDOW || (peer->seen & ((uint32_t)1 << age)) != 0) {
+                return false;
+            }
+            peer->seen |= (uint32_t)1 << age;
+        }
+        peer->used = ++_replayClock;
+        return true;
+    }
+
+    // CBC-MAC over B0, the header as associated data and the payload
+    void cbcMac(Key& key, const uint8_t* header, const uint8_t* payload, size_t length, uint8_t* tag) {
+        uint8_t* b = _macIn;
+        b[0] = 0x40 | (((TAG_LENGTH - 2) / 2) << 3) | (15 - NONCE_LENGTH - 1);
+        memcpy(b + 1, header + 1, NONCE_LENGTH);
+        memset(b + 8, 0, 6);
+        b[14] = (uint8_t)(length >> 8);
+        b[15] = (uint8_t)length;
+
+        memset(b + 16, 0, 16);
+        b[16] = 0;
+        b[17] = HEADER_LENGTH;
+        memcpy(b + 18, header, HEADER_LENGTH);
+
+        size_t padded = (length + 15) & ~(size_t)15;
+        memcpy(b + 32, payload, length);
+        memset(b + 32 + length, 0, padded - length);
+
+        size_t total = 32 + padded;
+#if FRAME_CIPHER_HARDWARE
+        uint8_t iv[16] = { 0 };
+        mbedtls_aes_crypt_cbc(&key.aes, MBEDTLS_AES_ENCRYPT, total, iv, b, _macOut);
+        memcpy(tag, _macOut + total - 16, 16);
+#else
+        uint8_t x[16] = { 0 };
+        for (size_t offset = 0; offset < total; offset += 16) {
+            for (uint8_t i = 0; i < 16; i++) {
+                x[i] ^= b[offset + i];
+            }
+            encryptBlock(key.roundKeys, x);
+        }
+        memcpy(tag, x, 16);
+#endif
+    }
+
+    // CTR from A0 = [flags][nonce][counter 0]
+    void ctr(Key& key, const uint8_t* header, const uint8_t* in, uint8_t* out, size_t length) {
+        uint8_t counter[16];
+        counter[0] = 15 - NONCE_LENGTH - 1;
+        memcpy(counter + 1, header + 1, NONCE_LENGTH);
+        memset(counter + 8, 0, 8);
+#if FRAME_CIPHER_HARDWARE
+        size_t offset = 0;
+        uint8_t stream[16];
+        mbedtls_aes_crypt_ctr(&key.aes, length, &offset, counter, stream, in, out);
+#else
+        for (size_t offset = 0; offset < length; offset += 16) {
+            uint8_t stream[16];
+            memcpy(stream, counter, 16);
+            encryptBlock(key.roundKeys, stream);
+            size_t n = length - offset < 16 ? length - offset : 16;
+            for (size_t i = 0; i < n; i++) {
+                out[offset + i] = in[offset + i] ^ stream[i];
+            }
+            for (int8_t i = 15; i >= 8 && ++counter[i] == 0; i--) {
+            }
+        }
+#endif
+    }
+
+    void expandKey(Key& slot, const uint8_t* key) {
+#if FRAME_CIPHER_HARDWARE
+        mbedtls_aes_setkey_enc(&slot.aes, key, 128);
+#else
+        static const uint8_t RCON[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+        const uint8_t* SBOX = sbox();
+        uint8_t* w = slot.roundKeys;
+        memcpy(w, key, KEY_LENGTH);
+        for (uint8_t i = 4; i < 44; i++) {
+            uint8_t t[4];
+            memcpy(t, w + (i - 1) * 4, 4);
+            if (i % 4 == 0) {
+                uint8_t first = t[0];
+                t[0] = (uint8_t)(SBOX[t[1]] ^ RCON[i / 4 - 1]);
+                t[1] = SBOX[t[2]];
+                t[2] = SBOX[t[3]];
+                t[3] = SBOX[first];
+            }
+            for (uint8_t j = 0; j < 4; j++) {
+                w[i * 4 + j] = (uint8_t)(w[(i - 4) * 4 + j] ^ t[j]);
+            }
+        }
+#endif
+    }
+
+#if !FRAME_CIPHER_HARDWARE
+    static uint8_t xtime(uint8_t x) {
+        return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1B));
+    }
+
+    // FIPS-197 AES-128, byte oriented to stay small
+    static void encryptBlock(const uint8_t* roundKeys, uint8_t* s) {
+        const uint8_t* SBOX = sbox();
+        for (uint8_t i = 0; i < 16; i++) {
+            s[i] ^= roundKeys[i];
+        }
+        for (uint8_t round = 1; round <= 10; round++) {
+            uint8_t t[16];
+            // SubBytes and ShiftRows
+            for (uint8_t c = 0; c < 4; c++) {
+                for (uint8_t r = 0; r < 4; r++) {
+                    t[c * 4 + r] = SBOX[s[((c + r) % 4) * 4 + r]];
+                }
+            }
+            if (round < 10) {
+                for (uint8_t c = 0; c < 4; c++) {
+                    uint8_t* col = t + c * 4;
+                    uint8_t all = (uint8_t)(col[0] ^ col[1] ^ col[2] ^ col[3]);
+                    uint8_t first = col[0];
+                    col[0] ^= (uint8_t)(all ^ xtime((uint8_t)(col[0] ^ col[1])));
+                    col[1] ^= (uint8_t)(all ^ xtime((uint8_t)(col[1] ^ col[2])));
+                    col[2] ^= (uint8_t)(all ^ xtime((uint8_t)(col[2] ^ col[3])));
+                    col[3] ^= (uint8_t)(all ^ xtime((uint8_t)(col[3] ^ first)));
+                }
+            }
+            for (uint8_t i = 0; i < 16; i++) {
+                s[i] = (uint8_t)(t[i] ^ roundKeys[round * 16 + i]);
+            }
+        }
+    }
+
+    static const uint8_t* sbox() {
+        static const uint8_t SBOX[256] = {
+            0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+            0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+            0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+            0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+            0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+            0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+            0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+            0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+            0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+            0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+            0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+            0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+            0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+            0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+            0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+            0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+        };
+        return SBOX;
+    }
+#endif
+
+    uint16_t _source;
+    uint32_t _counter;
+    bool _epochValid;
+    bool _conflict;
+    Key _keys[MAX_KEYS];
+    Peer _peers[REPLAY_SOURCES];
+    uint32_t _replayClock;
+
+    uint8_t _macIn[BLOCKS_LENGTH];
+#if FRAME_CIPHER_HARDWARE
+    uint8_t _macOut[BLOCKS_LENGTH];
+#endif
+    uint8_t _ctrIn[16 + MAX_FRAME_LENGTH];
+    uint8_t _ctrOut[16 + MAX_FRAME_LENGTH];
+
+    uint32_t _sealed;
+    uint32_t _opened;
+    uint32_t _failures;
+    uint32_t _replays;
+    uint32_t _conflicts;
+};
+
+#endif
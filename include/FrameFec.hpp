@@ -0,0 +1,132 @@
+#ifndef FRAME_FEC_HPP
+#define FRAME_FEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+#include "ReedSolomon.hpp"
+
+// Forward error correction for whole radio frames.
+//
+// A frame is split into balanced blocks of at most BLOCK_DATA bytes, each
+// block gets ReedSolomon::NROOTS parity bytes and the codewords are
+// interleaved byte by byte on air. A burst of B corrupted bytes is spread
+// over all blocks, so with n blocks bursts of up to n * NROOTS / 2 bytes are
+// repaired. The on-air length alone tells the decoder the block layout:
+//
+//   onAir = length + NROOTS * ceil(length / BLOCK_DATA)
+class FrameFec {
+public:
+    static const size_t BLOCK_DATA = 32;
+    static const size_t BLOCK_LENGTH = BLOCK_DATA + ReedSolomon::NROOTS;
+    static const size_t MAX_BLOCKS = MAX_FRAME_LENGTH / BLOCK_LENGTH;
+    static const size_t MAX_PAYLOAD = MAX_BLOCKS * BLOCK_DATA;
+
+    FrameFec()
+        : _decoded(0),
+          _corrected(0),
+          _failed(0)
+    {}
+
+    static size_t encodedLength(size_t length) {
+        return length + ReedSolomon::NROOTS * ((length + BLOCK_DATA - 1) / BLOCK_DATA);
+    }
+
+    // Encode length bytes from in into out; returns the on-air length or 0
+    size_t encode(const uint8_t* in, size_t length, uint8_t* out) {
+        if (length == 0 || length > MAX_PAYLOAD) {
+            return 0;
+        }
+
+        size_t blocks = (length + BLOCK_DATA - 1) / BLOCK_DATA;
+        layout(blocks, length);
+
+        const uint8_t* data = in;
+        for (size_t b = 0; b < blocks; b++) {
+            memcpy(_blocks[b], data, _dataLength[b]);
+            _rs.encode(data, _dataLength[b], _blocks[b] + _dataLength[b]);
+            data += _dataLength[b];
+        }
+
+        return interleave(blocks, out);
+    }
+
+    // Decode an on-air frame into out, correcting what the code allows.
+    // Returns the payload length, or -1 if any block could not be repaired.
+    int decode(const uint8_t* in, size_t length, uint8_t* out) {
+        size_t blocks = (length + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+        if (blocks == 0 || blocks > MAX_BLOCKS || length <= blocks * ReedSolomon::NROOTS) {
+            _failed++;
+            return -1;
+        }
+
+        size_t payload = length - blocks * ReedSolomon::NROOTS;
+        if (encodedLength(payload) != length) {
+            _failed++;
+            return -1;
+        }
+        layout(blocks, payload);
+        deinterleave(blocks, in);
+
+        uint8_t* data = out;
+        for (size_t b = 0; b < blocks; b++) {
+            int fixed = _rs.decode(_blocks[b], _dataLength[b] + ReedSolomon::NROOTS);
+            if (fixed < 0) {
+                _failed++;
+                return -1;
+            }
+            _corrected += fixed;
+            memcpy(data, _blocks[b], _dataLength[b]);
+            data += _dataLength[b];
+        }
+
+        _decoded++;
+        return (int)payload;
+    }
+
+    uint32_t getDecodedCount() const { return _decoded; }
+    uint32_t getCorrectedBytes() const { return _corrected; }
+    uint32_t getFailedCount() const { return _failed; }
+
+private:
+    // Spread the payload evenly, the first blocks take the remainder
+    void layout(size_t blocks, size_t length) {
+        for (size_t b = 0; b < blocks; b++) {
+            _dataLength[b] = (uint8_t)(length / blocks + (b < length % blocks ? 1 : 0));
+        }
+    }
+
+    size_t interleave(size_t blocks, uint8_t* out) const {
+        size_t pos = 0;
+        for (size_t k = 0; k < BLOCK_LENGTH; k++) {
+            for (size_t b = 0; b < blocks; b++) {
+                if (k < (size_t)_dataLength[b] + ReedSolomon::NROOTS) {
+                    out[pos++] = _blocks[b][k];
+                }
+            }
+        }
+        return pos;
+    }
+
+    void deinterleave(size_t blocks, const uint8_t* in) {
+        size_t pos = 0;
+        for (size_t k = 0; k < BLOCK_LENGTH; k++) {
+            for (size_t b = 0; b < blocks; b++) {
+                if (k < (size_t)_dataLength[b] + ReedSolomon::NROOTS) {
+                    _blocks[b][k] = in[pos++];
+                }
+            }
+        }
+    }
+
+    ReedSolomon _rs;
+    uint8_t _blocks[MAX_BLOCKS][BLOCK_LENGTH];
+    uint8_t _dataLength[MAX_BLOCKS];
+
+    uint32_t _decoded;
+    uint32_t _corrected;
+    uint32_t _failed;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef FREQUENCY_HOPPER_HPP
+#define FREQUENCY_HOPPER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "LinkFrame.hpp"
+
+// Synchronized frequency hopping over a fixed channel plan.
+//
+// The hop sequence is a seeded pseudo-random permutation of the channels,
+// so every unit with the same seed derives the same order. For each channel
+// the CC1101 frequency word and the synthesizer calibration (FSCAL3..1) are
+// held in a 6 byte table entry, so a hop is two short register bursts
+// instead of a full recalibration.
+//
+// A hardware timer calls tick() once per dwell period. The hop itself is
+// applied outside the interrupt, but the timer keeps the time base. The
+// slot and the pending hop are atomics: the timer interrupt may run on
+// the other core than the task handling hopPending() and onSync(). Every
+// transmitted packet carries a FRAME_HOP sync, so receivers follow the
+// sender after hearing it once. Unsynced receivers stay on one channel and
+// wait for the sender to come by.
+//
+// At bit rates where a packet would span several dwell periods the caller
+// parks the hopper: everyone stays on the rendezvous channel, the first of
+// the sequence, while slots keep counting and syncing so hopping resumes
+// in step.
+class FrequencyHopper {
+public:
+    static const uint8_t MAX_CHANNELS = 32;
+    static const size_t SYNC_LENGTH = 4;
+
+    struct ChannelRegisters {
+        uint8_t freq[3];   // FREQ2, FREQ1, FREQ0
+        uint8_t fscal[3];  // FSCAL3, FSCAL2, FSCAL1
+    };
+
+    FrequencyHopper(float baseFrequency, float channelSpacing, uint8_t channels, uint32_t seed, unsigned long dwellTime)
+        : _slot(0), _pending(false) {
+        setChannelPlan(baseFrequency, channelSpacing, channels, seed, dwellTime);
+    }
+
+    // Start over on another plan, before the hop timer runs; calibration
+    // has to be redone
+    void setChannelPlan(float baseFrequency, float channelSpacing, uint8_t channels, uint32_t seed,
+                        unsigned long dwellTime) {
+        _baseFrequency = baseFrequency;
+        _channelSpacing = channelSpacing;
+        _channels = channels > MAX_CHANNELS ? MAX_CHANNELS : (channels == 0 ? 1 : channels);
+        _dwellTime = dwellTime;
+        _slot = 0;
+        _pending = false;
+        _parked = false;
+        _slotStart = 0;
+        _lastSync = 0;
+        _synced = false;
+        _hops = 0;
+
+        // Fisher-Yates shuffle driven by xorshift32
+        uint32_t state = seed ? seed : 1;
+        for (uint8_t i = 0; i < _channels; i++) {
+            _sequence[i] = i;
+        }
+        for (uint8_t i = _channels - 1; i > 0; i--) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            uint8_t j = (uint8_t)(state % (i + 1));
+            uint8_t tmp = _sequence[i];
+            _sequence[i] = _sequence[j];
+            _sequence[j] = tmp;
+        }
+
+        for (uint8_t ch = 0; ch < _channels; ch++) {
+            frequencyWord(channelFrequency(ch), _registers[ch].freq);
+            _registers[ch].fscal[0] = 0;
+            _registers[ch].fscal[1] = 0;
+            _registers[ch].fscal[2] = 0;
+        }
+    }
+
+    // CC1101 FREQ2..0 for a carrier in MHz with the 26 MHz crystal
+    static void frequencyWord(float frequency, uint8_t* out) {
+        uint32_t word = (uint32_t)(frequency * 65536.0f / 26.0f + 0.5f);
+        out[0] = (uint8_t)(word >> 16);
+        out[1] = (uint8_t)(word >> 8);
+        out[2] = (uint8_t)word;
+    }
+
+    float channelFrequency(uint8_t channel) const { return _baseFrequency + channel * _channelSpacing; }
+    uint8_t getChannelCount() const { return _channels; }
+    unsigned long getDwellTime() const { return _dwellTime; }
+
+    // Calibration results are filled in once at boot
+    void setCalibration(uint8_t channel, const uint8_t* fscal) {
+        _registers[channel].fscal[0] = fscal[0];
+        _registers[channel].fscal[1] = fscal[1];
+        _registers[channel].fscal[2] = fscal[2];
+    }
+
+    uint8_t channelAt(uint16_t slot) const { return _sequence[slot % _channels]; }
+    uint8_t currentChannel() const { return _parked ? _sequence[0] : channelAt(_slot.load()); }
+    const ChannelRegisters& registers(uint8_t channel) const { return _registers[channel]; }
+    const ChannelRegisters& currentRegisters() const { return _registers[currentChannel()]; }
+
+    // Called from the hop timer interrupt
+    void tick() {
+        _slot.fetch_add(1);
+        _pending.store(true);
+    }
+
+    // True once per elapsed dwell period, the caller then retunes the radio.
+    // A tick landing meanwhile stays pending for the next call.
+    bool hopPending() {
+        return _pending.exchange(false) && !_parked;
+    }
+
+    // Stay on the rendezvous channel, or resume hopping. True if that
+    // changed, the caller then retunes the radio.
+    bool setParked(bool parked) {
+        bool changed = parked != _parked;
+        _parked = parked;
+        return changed;
+    }
+
+    bool isParked() const { return _parked; }
+
+    // The radio was retuned to currentChannel()
+    void onHop(unsigned long now) {
+        _slotStart = now;
+        _hops++;
+    }
+
+    // Lost track of the sender: stay put until it is heard again
+    bool isSynced(unsigned long now) {
+        if (_synced && now - _lastSync > 2UL * _channels * _dwellTime) {
+            _synced = false;
+        }
+        return _synced;
+    }
+
+    // Sync sub-frame: [FRAME_HOP][slot lo][slot hi][ms into the slot], as
+    // of the end of a packet that takes airtime ms from now
+    size_t buildSync(uint8_t* out, unsigned long now, unsigned long airtime = 0) const {
+        unsigned long elapsed = now - _slotStart + airtime;
+        uint16_t slot = (uint16_t)(_slot.load() + elapsed / _dwellTime);
+        elapsed %= _dwellTime;
+        out[0] = FRAME_HOP;
+        out[1] = (uint8_t)slot;
+        out[2] = (uint8_t)(slot >> 8);
+        out[3] = (uint8_t)(elapsed > 0xFF ? 0xFF : elapsed);
+        return SYNC_LENGTH;
+    }
+
+    // Adopt the sender's slot, age is how many ms ago the packet ended.
+    // Returns how far into the slot the sender is now in ms, so the caller
+    // can shift its timer phase, or -1 for a bad frame.
+    long onSync(const uint8_t* frame, size_t length, unsigned long now, unsigned long age = 0) {
+        if (length < SYNC_LENGTH) {
+            return -1;
+        }
+
+        unsigned long elapsed = frame[3] + age;
+        uint16_t slot = (uint16_t)(((uint16_t)frame[1] | ((uint16_t)frame[2] << 8)) + elapsed / _dwellTime);
+        elapsed %= _dwellTime;
+        // The sender's slot is the one as of now, it replaces a tick that
+        // came in since it was read
+        uint16_t current = _slot.load();
+        while (current != slot && !_slot.compare_exchange_weak(current, slot)) {
+        }
+        if (current != slot) {
+            _pending.store(true);
+        }
+        _synced = true;
+        _lastSync = now;
+        _slotStart = now - elapsed;
+        return (long)elapsed;
+    }
+
+    uint16_t getSlot() const { return _slot.load(); }
+    uint32_t getHopCount() const { return _hops; }
+
+private:
+    float _baseFrequency;
+    float _channelSpacing;
+    uint8_t _channels;
+    unsigned long _dwellTime;
+
+    uint8_t _sequence[MAX_CHANNELS];
+    ChannelRegisters _registers[MAX_CHANNELS];
+
+    std::atomic<uint16_t> _slot;
+    std::atomic<bool> _pending;
+    bool _parked;
+    unsigned long _slotStart;
+    unsigned long _lastSync;
+    bool _synced;
+
+    uint32_t _hops;
+};
+
+#endif
@@ -0,0 +1,419 @@
+#ifndef LINK_ADAPTATION_HPP
+#define LINK_ADAPTATION_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+
+// Modulation settings the link can switch between, most robust first.
+// Sensitivities are typical CC1101 figures at 433 MHz for 1% PER.
+struct RadioProfile {
+    float bitRate;      // kbps
+    float freqDev;      // kHz
+    float rxBandwidth;  // kHz
+    uint8_t codecMode;  // Codec bit rate class that fits the channel
+    int8_t sensitivity; // dBm
+};
+
+static constexpr RadioProfile RADIO_PROFILES[] = {
+    {   1.2,   5.2,  58.0, 0, -112 },
+    {   4.8,   5.0, 135.0, 1, -109 },
+    {  38.4,  20.0, 101.6, 2, -104 },
+    { 100.0,  47.6, 325.0, 3, -100 },
+    { 250.0, 127.0, 541.7, 4,  -95 }
+};
+
+static const uint8_t RADIO_PROFILE_COUNT = sizeof(RADIO_PROFILES) / sizeof(RADIO_PROFILES[0]);
+
+// Link adaptation driven by RSSI/LQI feedback, negotiated between the
+// units on the link.
+//
+// Each side smooths the RSSI/LQI of the packets it hears, per peer, and
+// piggybacks the weakest of them in a FRAME_LINK report along with its
+// current profile (low nibble of the last byte) and the one it proposes
+// (high nibble, the current one if none):
+//
+//   [FRAME_LINK][rssi][lqi][proposed << 4 | current]
+//
+// The link is limited by the weakest direction to any live peer. A side
+// proposes to step down as soon as the fade margin is violated, and to
+// step up once an extra hysteresis margin held for a while. Peers accept
+// a step down right away, a step up once their own measurements agree;
+// accepting means proposing the same profile. A unit switches once every
+// live peer proposes what it proposes and its own report saying so went
+// out (onReportSent()), so the accepting side switches behind its report
+// and the proposing side when that report comes in.
+//
+// The old profile is kept as a fallback until every peer was heard on the
+// new one. If that does not happen within the confirm timeout, e.g. the
+// accepting report got lost, the unit goes back and negotiates again. If
+// nothing is heard for too long the link falls back to the most robust
+// profile, where all ends can meet again.
+//
+// While the modem is set by hand (setManual()) the engine keeps measuring
+// but neither proposes, follows nor falls back.
+class LinkAdaptation {
+public:
+    static const size_t REPORT_LENGTH = 4;
+    static const int8_t FADE_MARGIN = 4;     // dB above sensitivity
+    static const int8_t HYSTERESIS = 3;      // dB extra before stepping up
+    static const uint8_t POOR_LQI = 60;      // CC1101 LQI, lower is better
+    static const uint8_t MAX_PEERS = 4;
+
+    LinkAdaptation(unsigned long holdTime = 2000, unsigned long linkTimeout = 3000,
+                   unsigned long confirmTimeout = 2500)
+        : _holdTime(holdTime),
+          _linkTimeout(linkTimeout),
+          _confirmTimeout(confirmTimeout),
+          _profile(0),
+          _proposal(0),
+          _fallback(0),
+          _maxProfile(RADIO_PROFILE_COUNT - 1),
+          _changed(false),
+          _proposalSent(false),
+          _confirming(false),
+          _manual(false),
+          _lastHeard(0),
+          _upSince(0),
+          _upPending(false),
+          _switchedAt(0),
+          _switches(0),
+          _reverts(0)
+    {
+        memset(_peers, 0, sizeof(_peers));
+    }
+
+    // Metrics of a packet received from a peer, on the current profile
+    void onMeasurement(uint16_t source, float rssi, uint8_t lqi, unsigned long now) {
+        Peer& peer = findPeer(source, now);
+        int16_t sample = (int16_t)(rssi * 16);
+        if (!peer.hasLocal) {
+            peer.localRssi = sample;
+            peer.localLqi = lqi;
+            peer.hasLocal = true;
+        } else {
+            peer.localRssi += (sample - peer.localRssi) / 8;
+            peer.localLqi = (uint8_t)(((uint16_t)peer.localLqi * 7 + lqi) / 8);
+        }
+        peer.lastHeard = now;
+        _lastHeard = now;
+
+        // Heard on the profile we switched to
+        peer.confirmed = true;
+        if (_confirming && allConfirmed(now)) {
+            _confirming = false;
+        }
+        update(now);
+    }
+
+    // Report of how a peer hears its weakest link, and what it proposes
+    void onReport(uint16_t source, const uint8_t* frame, size_t length, unsigned long now) {
+        if (length < REPORT_LENGTH) {
+            return;
+        }
+        Peer& peer = findPeer(source, now);
+        peer.remoteRssi = (int16_t)((int8_t)frame[1]) * 16;
+        peer.remoteLqi = frame[2];
+        peer.hasRemote = true;
+        uint8_t proposal = frame[3] >> 4;
+        peer.proposal = proposal < RADIO_PROFILE_COUNT ? proposal : (uint8_t)(frame[3] & 0x0F);
+        peer.lastHeard = now;
+        update(now);
+    }
+
+    // Build the FRAME_LINK report for the peers
+    size_t buildReport(uint8_t* out) const {
+        int16_t rssi = 0;
+        uint8_t lqi = 0;
+        bool any = false;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            const Peer& peer = _peers[i];
+            if (peer.used && peer.hasLocal && (!any || peer.localRssi < rssi)) {
+                rssi = peer.localRssi;
+            }
+            if (peer.used && peer.hasLocal && peer.localLqi > lqi) {
+                lqi = peer.localLqi;
+            }
+            any = any || (peer.used && peer.hasLocal);
+        }
+        rssi /= 16;
+        out[0] = FRAME_LINK;
+        out[1] = (uint8_t)(int8_t)(rssi < -128 ? -128 : (rssi > 127 ? 127 : rssi));
+        out[2] = lqi;
+        out[3] = (uint8_t)(_proposal << 4 | _profile);
+        return REPORT_LENGTH;
+    }
+
+    // A report built by buildReport() is on air; peers know what we propose
+    void onReportSent(unsigned long now) {
+        if (_proposal != _profile) {
+            _proposalSent = true;
+            trySwitch(now);
+        }
+    }
+
+    // A proposal or an unconfirmed switch needs reports going out even
+    // without traffic to carry them
+    bool negotiating() const { return _proposal != _profile || _confirming; }
+
+    // Undo an unconfirmed switch, fall back to the most robust profile
+    // once all peers have gone quiet
+    void checkTimeout(unsigned long now) {
+        if (_manual) {
+            return;
+        }
+        if (_confirming && now - _switchedAt >= _confirmTimeout) {
+            _confirming = false;
+            _reverts++;
+            setProfile(_fallback);
+            restart();
+        }
+        if (_profile != 0 && now - _lastHeard >= _linkTimeout) {
+            _confirming = false;
+            setProfile(0);
+            memset(_peers, 0, sizeof(_peers));
+            restart();
+        }
+    }
+
+    uint8_t getProfile() const { return _profile; }
+    uint8_t getProposal() const { return _proposal; }
+    bool isConfirming() const { return _confirming; }
+
+    // Cap the fastest profile (and codec mode) the link may step up to.
+    // Lowering it below the current profile switches right away, both
+    // ends are expected to apply the same cap (wake-on-radio).
+    void setMaxProfile(uint8_t profile) {
+        _maxProfile = profile < RADIO_PROFILE_COUNT ? profile : RADIO_PROFILE_COUNT - 1;
+        if (_manual) {
+            return;
+        }
+        if (_profile > _maxProfile) {
+            _confirming = false;
+            setProfile(_maxProfile);
+            restart();
+        } else if (_proposal > _maxProfile) {
+            _proposal = _profile;
+        }
+    }
+
+    uint8_t getMaxProfile() const { return _maxProfile; }
+
+    // Bit rate, deviation or bandwidth were set by hand. Going back to
+    // adaptation restarts on the most robust profile and reports it as a
+    // change, so the caller reconfigures the radio.
+    void setManual(bool manual) {
+        if (manual == _manual) {
+            return;
+        }
+        _manual = manual;
+        _confirming = false;
+        if (!manual) {
+            setProfile(0);
+            _changed = true;
+        }
+        restart();
+    }
+
+    bool isManual() const { return _manual; }
+    const RadioProfile& getRadioProfile() const { return RADIO_PROFILES[_profile]; }
+
+    // True once after every profile switch, the caller then reconfigures the radio
+    bool profileChanged() {
+        bool changed = _changed;
+        _changed = false;
+        return changed;
+    }
+
+    uint32_t getSwitchCount() const { return _switches; }
+    uint32_t getRevertCount() const { return _reverts; }
+
+private:
+    struct Peer {
+        unsigned long lastHeard;
+        uint16_t source;
+        // RSSI in 1/16 dBm
+        int16_t localRssi;
+        int16_t remoteRssi;
+        uint8_t localLqi;
+        uint8_t remoteLqi;
+        uint8_t proposal;
+        bool hasLocal;
+        bool hasRemote;
+        bool confirmed;
+        bool used;
+    };
+
+    bool isLive(const Peer& peer, unsigned long now) const {
+        return peer.used && now - peer.lastHeard < _linkTimeout;
+    }
+
+    // The peer's entry, a free one or the least recently heard
+    Peer& findPeer(uint16_t source, unsigned long now) {
+        Peer* oldest = &_peers[0];
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Peer& peer = _peers[i];
+            if (peer.used && peer.source == source) {
+                return peer;
+            }
+            if (oldest->used && (!peer.used || now - peer.lastHeard > now - oldest->lastHeard)) {
+                oldest = &peer;
+            }
+        }
+        memset(oldest, 0, sizeof(*oldest));
+        oldest->used = true;
+        oldest->source = source;
+        oldest->proposal = _profile;
+        oldest->lastHeard = now;
+        // A newcomer is heard on the current profile already
+        oldest->confirmed = true;
+        return *oldest;
+    }
+
+    bool allConfirmed(unsigned long now) const {
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (isLive(_peers[i], now) && !_peers[i].confirmed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void update(unsigned long now) {
+        // Nothing new until the last switch is confirmed or undone
+        if (_confirming || _manual) {
+            return;
+        }
+
+        // The weakest direction of any live peer limits the link
+        bool any = false;
+        int16_t rssi = 0;
+        uint8_t lqi = 0;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            const Peer& peer = _peers[i];
+            if (!isLive(peer, now) || !peer.hasLocal) {
+                continue;
+            }
+            int16_t weaker = peer.hasRemote && peer.remoteRssi < peer.localRssi ? peer.remoteRssi : peer.localRssi;
+            uint8_t worse = peer.hasRemote && peer.remoteLqi > peer.localLqi ? peer.remoteLqi : peer.localLqi;
+            rssi = !any || weaker < rssi ? weaker : rssi;
+            lqi = worse > lqi ? worse : lqi;
+            any = true;
+        }
+        if (!any) {
+            return;
+        }
+
+        // Step down right away while the fade margin is violated
+        uint8_t proposal = _profile;
+        while (proposal > 0 && rssi < threshold(proposal, 0)) {
+            proposal--;
+        }
+        if (proposal > 0 && lqi > POOR_LQI) {
+            proposal--;
+        }
+
+        // Step up only after the better signal held for a while
+        if (proposal == _profile && _profile < _maxProfile && rssi >= threshold(_profile + 1, HYSTERESIS) &&
+            lqi <= POOR_LQI) {
+            if (!_upPending) {
+                _upPending = true;
+                _upSince = now;
+            } else if (now - _upSince >= _holdTime) {
+                proposal = _profile + 1;
+            }
+        } else {
+            _upPending = false;
+        }
+
+        // A peer asking for a lower profile is followed at once
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (isLive(_peers[i], now) && _peers[i].proposal < _profile && _peers[i].proposal < proposal) {
+                proposal = _peers[i].proposal;
+            }
+        }
+
+        if (proposal != _proposal) {
+            _proposal = proposal;
+            _proposalSent = false;
+        }
+        trySwitch(now);
+    }
+
+    // Switch once our proposal is out and every live peer proposes the same
+    void trySwitch(unsigned long now) {
+        if (_proposal == _profile || !_proposalSent || _manual) {
+            return;
+        }
+        bool agreed = false;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (!isLive(_peers[i], now)) {
+                continue;
+            }
+            if (_peers[i].proposal != _proposal) {
+                return;
+            }
+            agreed = true;
+        }
+        if (!agreed) {
+            return;
+        }
+
+        _fallback = _profile;
+        setProfile(_proposal);
+        _confirming = true;
+        _switchedAt = now;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            _peers[i].confirmed = false;
+            _peers[i].proposal = _profile;
+        }
+        _upPending = false;
+        _proposalSent = false;
+    }
+
+    // Negotiation starts over on the current profile
+    void restart() {
+        _proposal = _profile;
+        _proposalSent = false;
+        _upPending = false;
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            _peers[i].proposal = _profile;
+        }
+    }
+
+    static int16_t threshold(uint8_t profile, int8_t extra) {
+        return (int16_t)(RADIO_PROFILES[profile].sensitivity + FADE_MARGIN + extra) * 16;
+    }
+
+    void setProfile(uint8_t profile) {
+        if (profile != _profile) {
+            _profile = profile;
+            _changed = true;
+            _switches++;
+        }
+    }
+
+    unsigned long _holdTime;
+    unsigned long _linkTimeout;
+    unsigned long _confirmTimeout;
+    uint8_t _profile;
+    uint8_t _proposal;
+    uint8_t _fallback;
+    uint8_t _maxProfile;
+    bool _changed;
+    bool _proposalSent;
+    bool _confirming;
+    bool _manual;
+
+    Peer _peers[MAX_PEERS];
+    unsigned long _lastHeard;
+    unsigned long _upSince;
+    bool _upPending;
+    unsigned long _switchedAt;
+
+    uint32_t _switches;
+    uint32_t _reverts;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LINK_FRAME_HPP
+#define LINK_FRAME_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest packet the CC1101 driver accepts in variable length mode
+static const size_t MAX_FRAME_LENGTH = 255;
+
+// Preamble, sync word, length, address and CRC bytes around every packet
+static const size_t AIR_OVERHEAD = 8;
+
+// Time on air in us of a packet with length bytes behind the address, at
+// a bit rate in kbps
+static inline uint32_t airtimeUs(size_t length, float bitRate) {
+    return (uint32_t)((length + AIR_OVERHEAD) * 8 * 1000.0f / bitRate);
+}
+
+// Every packet a unit originates starts with its 16 bit source, inside
+// the mesh and cipher headers and ahead of its frames:
+//
+//   [source lo][source hi][frame...]
+static const size_t SOURCE_LENGTH = 2;
+
+// First byte of every frame on air, used to dispatch received packets
+enum FrameType : uint8_t {
+    FRAME_DATA      = 0x01,  // ARQ protected data:  [type][seq][base][session lo][hi][payload...]
+    FRAME_ACK       = 0x02,  // Selective ACK:       [type][to lo][hi][session lo][hi][base][bitmap lo][bitmap hi]
+    FRAME_AGGREGATE = 0x03,  // Several frames:      [type][len][frame...][len][frame...]...
+    FRAME_LINK      = 0x04,  // Link report:         [type][rssi][lqi][profile]
+    FRAME_HOP       = 0x05,  // Hop sync:            [type][slot lo][slot hi][ms into slot at packet end]
+    FRAME_WOR       = 0x06,  // Wake interval:       [type][ms lo][ms hi], 0 = awake
+    FRAME_MESH      = 0x07,  // Relayable packet:    [type][src lo][hi][seq lo][hi][hops][frame...]
+    FRAME_SECURE    = 0x08,  // Encrypted frame:     [type][group][src lo][hi][ctr 0..3][frame...][tag 0..3]
+    FRAME_PACKED    = 0x09,  // Compressed data:     [type][seq][base][session lo][hi][MessageCompressor output...]
+    FRAME_FRAGMENT  = 0x0A   // Long message part:   [type][seq][base][session lo][hi][id lo][id hi][index][count][payload...]
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef LOG_EVENTS_HPP
+#define LOG_EVENTS_HPP
+
+#include <stdint.h>
+#include <type_traits>
+
+// Compile-time log filtering. Build flags pick what ends up in the
+// firmware, e.g. -DLOG_LEVEL=LOG_LEVEL_WARN -DLOG_CATEGORIES=LOG_CATEGORY_RADIO.
+// Events above the level or outside the categories compile to nothing,
+// including the evaluation of their arguments.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#define LOG_CATEGORY_SYSTEM 0x01
+#define LOG_CATEGORY_RADIO  0x02
+#define LOG_CATEGORY_LINK   0x04
+#define LOG_CATEGORY_ALL    0xFF
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES LOG_CATEGORY_ALL
+#endif
+
+// Events written to the binary log. The format table below is shared by
+// the firmware's log task and the host decoder (tools/logdecode.cpp), so
+// only ever append new events to keep old captures decodable.
+enum LogEvent : uint16_t {
+    LOG_RX_PACKET,
+    LOG_RX_RSSI,
+    LOG_RX_LQI,
+    LOG_RX_CRC_ERROR,
+    LOG_RX_FAILED,
+    LOG_TX_FAILED,
+    LOG_LISTEN_STARTED,
+    LOG_LISTEN_FAILED,
+    LOG_PROFILE_SWITCH,
+    LOG_RADIO_INIT,
+    LOG_RADIO_INIT_FAILED,
+    LOG_MEM_SRAM,
+    LOG_MEM_PSRAM,
+    LOG_MEM_NO_PSRAM,
+    LOG_MEM_FAILED,
+    LOG_MODE_RECEIVE,
+    LOG_MODE_TRANSMIT,
+    LOG_SETTING_FAILED,
+    LOG_BOOT_READY,
+    LOG_CONFIG_DEFAULTS,
+    LOG_CONFIG_SAVE_FAILED,
+    LOG_POWER_FAILED,
+    LOG_KEY_FAILED,
+    LOG_CRYPTO_EPOCH_FAILED,
+    LOG_CONFIG_NOT_FOUND,
+    LOG_CONFIG_STORAGE_FAILED,
+    LOG_UNIT_MISSING,
+    LOG_UNIT_FAILED,
+    LOG_UNIT_CONFLICT,
+    LOG_EVENT_COUNT
+};
+
+struct LogEventInfo {
+    uint8_t level;
+    uint8_t category;
+};
+
+// Level and category per event, only ever evaluated at compile time
+static constexpr LogEventInfo LOG_EVENT_INFO[LOG_EVENT_COUNT] = {
+    { LOG_LEVEL_DEBUG, LOG_CATEGORY_RADIO },   // LOG_RX_PACKET
+    { LOG_LEVEL_DEBUG, LOG_CATEGORY_RADIO },   // LOG_RX_RSSI
+    { LOG_LEVEL_DEBUG, LOG_CATEGORY_RADIO },   // LOG_RX_LQI
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_RADIO },   // LOG_RX_CRC_ERROR
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_RADIO },   // LOG_RX_FAILED
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_RADIO },   // LOG_TX_FAILED
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_RADIO },   // LOG_LISTEN_STARTED
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_RADIO },   // LOG_LISTEN_FAILED
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_LINK },    // LOG_PROFILE_SWITCH
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_RADIO },   // LOG_RADIO_INIT
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_RADIO },   // LOG_RADIO_INIT_FAILED
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_SYSTEM },  // LOG_MEM_SRAM
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_SYSTEM },  // LOG_MEM_PSRAM
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_SYSTEM },  // LOG_MEM_NO_PSRAM
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_SYSTEM },  // LOG_MEM_FAILED
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_SYSTEM },  // LOG_MODE_RECEIVE
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_SYSTEM },  // LOG_MODE_TRANSMIT
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_RADIO },   // LOG_SETTING_FAILED
+    { LOG_LEVEL_INFO,  LOG_CATEGORY_SYSTEM },  // LOG_BOOT_READY
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_SYSTEM },  // LOG_CONFIG_DEFAULTS
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_SYSTEM },  // LOG_CONFIG_SAVE_FAILED
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_SYSTEM },  // LOG_POWER_FAILED
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_SYSTEM },  // LOG_KEY_FAILED
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_LINK },    // LOG_CRYPTO_EPOCH_FAILED
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_SYSTEM },  // LOG_CONFIG_NOT_FOUND
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_SYSTEM },  // LOG_CONFIG_STORAGE_FAILED
+    { LOG_LEVEL_WARN,  LOG_CATEGORY_SYSTEM },  // LOG_UNIT_MISSING
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_SYSTEM },  // LOG_UNIT_FAILED
+    { LOG_LEVEL_ERROR, LOG_CATEGORY_LINK }     // LOG_UNIT_CONFLICT
+};
+
+constexpr bool logEnabled(LogEvent event) {
+    return LOG_EVENT_INFO[event].level <= LOG_LEVEL && (LOG_EVENT_INFO[event].category & LOG_CATEGORIES) != 0;
+}
+
+// Log an event with up to two arguments through the includer's logWrite()
+// overloads. Events filtered out by LOG_LEVEL / LOG_CATEGORIES compile to
+// nothing, their arguments are not even evaluated. The integral_constant
+// forces the check into a constant expression, so this holds at any
+// optimization level (tools/logstrip.sh checks it).
+#define LOG_EVENT(event, ...) \
+    do { if (std::integral_constant<bool, logEnabled(event)>::value) { logWrite(event, ##__VA_ARGS__); } } while (0)
+
+// Format strings. With deferred formatting (binary log output) nothing
+// references this table on the device, only the event IDs are stored.
+static const char* const LOG_FORMATS[LOG_EVENT_COUNT] = {
+    "[CC1101] Received packet!",
+    "[CC1101] RSSI:\t\t{.2} dBm",
+    "[CC1101] LQI:\t\t{}",
+    "CRC error!",
+    "Failed, code {}",
+    "[CC1101] Transmit failed, code {}",
+    "[CC1101] Starting to listen ... success!",
+    "[CC1101] Starting to listen ... failed, code {}",
+    "[CC1101] Switching to {.2} kbps",
+    "[CC1101] Initializing ... success!",
+    "[CC1101] Initializing ... failed, code {}",
+    "[MEM] SRAM arena:\t{} / {}",
+    "[MEM] PSRAM arena:\t{} / {}",
+    "[MEM] No PSRAM, falling back to SRAM",
+    "[MEM] SRAM arena allocation failed!",
+    "Switched to RECEIVE mode",
+    "Switched to TRANSMIT mode",
+    "[CC1101] Setting {} failed, code {}",
+    "[BOOT] Radio ready after {} us, profile restored: {}",
+    "[CONFIG] Active profile not usable, using defaults",
+    "[CONFIG] Saving profile failed",
+    "[POWER] Frequency scaling unavailable, staying at full speed",
+    "[CRYPTO] Storing the key for address {} failed",
+    "[CRYPTO] No nonce epoch could be reserved, frame not sent",
+    "[CONFIG] No such profile",
+    "[CONFIG] Profile storage failed",
+    "[CRYPTO] No unit ID provisioned, nothing is sealed",
+    "[CONFIG] Unit ID {} already heard or not stored",
+    "[CRYPTO] Another unit uses our ID {}, sealing stopped"
+};
+
+#endif
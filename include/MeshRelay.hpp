@@ -0,0 +1,211 @@
+#ifndef MESH_RELAY_HPP
+#define MESH_RELAY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+#include "DuplicateCache.hpp"
+
+// Store-and-forward relaying for units at the edge of range.
+//
+// Every packet a mesh unit originates is wrapped with its source, a 16 bit
+// sequence number and the relays it may still take:
+//
+//   [FRAME_MESH][source lo][hi][seq lo][hi][hops left][frame...]
+//
+// A unit in relay mode rebroadcasts every packet it hears for the first
+// time with one hop less, after a random delay so neighbours that heard the
+// same packet do not all key up at once. While waiting it counts the copies
+// relayed by others; once enough of the neighbourhood has been covered the
+// own rebroadcast is dropped. Packets already seen are recognised by
+// source and sequence in constant time and handled only once, relaying or
+// not; seenTime has to cover the slowest copy, hops times the delay plus
+// the airtimes.
+class MeshRelay {
+public:
+    static const size_t HEADER_LENGTH = 6;
+    static const uint8_t PENDING_RELAYS = 4;
+    static const size_t SEEN_ENTRIES = 128;
+
+    MeshRelay(uint8_t hops = 3, unsigned long maxDelay = 60, uint8_t suppressCopies = 2,
+              uint32_t seenTime = 2000)
+        : _source(0),
+          _hops(hops),
+          _maxDelay(maxDelay),
+          _suppressCopies(suppressCopies),
+          _enabled(false),
+          _sequence(0),
+          _random(1),
+          _seen(seenTime),
+          _relayed(0),
+          _duplicates(0),
+          _suppressed(0),
+          _overflows(0)
+    {
+        memset(_pending, 0, sizeof(_pending));
+    }
+
+    // Unique per unit, also seeds the relay delays
+    void setSource(uint16_t source) {
+        _source = source;
+        _random = source ? source : 1;
+    }
+
+    uint16_t getSource() const { return _source; }
+
+    void setEnabled(bool enabled) {
+        _enabled = enabled;
+        if (!enabled) {
+            memset(_pending, 0, sizeof(_pending));
+        }
+    }
+
+    bool isEnabled() const { return _enabled; }
+
+    // Wrap an outgoing packet in place, frame needs HEADER_LENGTH bytes of
+    // room behind the payload. Returns the new length.
+    size_t wrap(uint8_t* frame, size_t length) {
+        memmove(frame + HEADER_LENGTH, frame, length);
+        uint16_t sequence = _sequence++;
+        frame[0] = FRAME_MESH;
+        frame[1] = (uint8_t)_source;
+        frame[2] = (uint8_t)(_source >> 8);
+        frame[3] = (uint8_t)sequence;
+        frame[4] = (uint8_t)(sequence >> 8);
+        frame[5] = _hops;
+        return length + HEADER_LENGTH;
+    }
+
+    // A FRAME_MESH packet heard with the given air address. Returns the
+    // frame inside, or NULL for a copy of something seen before (or our
+    // own packet coming back). In relay mode a rebroadcast is queued.
+    const uint8_t* onReceive(const uint8_t* packet, size_t length, uint8_t address,
+                             unsigned long now, size_t& frameLength) {
+        if (length <= HEADER_LENGTH) {
+            return NULL;
+        }
+        uint16_t source = packet[1] | (uint16_t)(packet[2] << 8);
+        uint16_t sequence = packet[3] | (uint16_t)(packet[4] << 8);
+        uint32_t id = key(source, sequence);
+
+        if (source == _source || _seen.check(id, (uint32_t)now)) {
+            _duplicates++;
+            // Another relay covered part of our neighbourhood already
+            Pending* pending = findPending(id);
+            if (pending != NULL && ++pending->copies >= _suppressCopies) {
+                pending->length = 0;
+                _suppressed++;
+            }
+            return NULL;
+        }
+
+        uint8_t hops = packet[5];
+        if (_enabled && hops > 0) {
+            queue(id, packet, length, address, now);
+        }
+
+        frameLength = length - HEADER_LENGTH;
+        return packet + HEADER_LENGTH;
+    }
+
+    // Copy a rebroadcast that is due into out (MAX_FRAME_LENGTH bytes) and
+    // return its length, 0 if none is due
+    size_t nextRelay(unsigned long now, uint8_t* out, uint8_t& address) {
+        for (uint8_t i = 0; i < PENDING_RELAYS; i++) {
+            Pending& pending = _pending[i];
+            if (pending.length == 0 || (long)(now - pending.due) < 0) {
+                continue;
+            }
+            size_t length = pending.length;
+            memcpy(out, pending.packet, length);
+            out[5]--;
+            address = pending.address;
+            pending.length = 0;
+            _relayed++;
+            return length;
+        }
+        return 0;
+    }
+
+    bool hasPending() const {
+        for (uint8_t i = 0; i < PENDING_RELAYS; i++) {
+            if (_pending[i].length != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t getRelayed() const { return _relayed; }
+    uint32_t getDuplicates() const { return _duplicates; }
+    uint32_t getSuppressed() const { return _suppressed; }
+    uint32_t getOverflows() const { return _overflows; }
+    uint32_t getEvictions() const { return _seen.getEvictions(); }
+
+private:
+    struct Pending {
+        uint32_t id;
+        unsigned long due;
+        uint8_t copies;
+        uint8_t address;
+        uint8_t length;  // 0 = free
+        uint8_t packet[MAX_FRAME_LENGTH];
+    };
+
+    static uint32_t key(uint16_t source, uint16_t sequence) {
+        return ((uint32_t)source << 16) | sequence;
+    }
+
+    Pending* findPending(uint32_t id) {
+        for (uint8_t i = 0; i < PENDING_RELAYS; i++) {
+            if (_pending[i].length != 0 && _pending[i].id == id) {
+                return &_pending[i];
+            }
+        }
+        return NULL;
+    }
+
+    void queue(uint32_t id, const uint8_t* packet, size_t length, uint8_t address, unsigned long now) {
+        for (uint8_t i = 0; i < PENDING_RELAYS; i++) {
+            Pending& pending = _pending[i];
+            if (pending.length != 0) {
+                continue;
+            }
+            pending.id = id;
+            pending.due = now + randomDelay();
+            pending.copies = 0;
+            pending.address = address;
+            pending.length = (uint8_t)length;
+            memcpy(pending.packet, packet, length);
+            return;
+        }
+        _overflows++;
+    }
+
+    // xorshift32, uniform enough for spreading relays over the window
+    unsigned long randomDelay() {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        return _random % (_maxDelay + 1);
+    }
+
+    uint16_t _source;
+    uint8_t _hops;
+    unsigned long _maxDelay;
+    uint8_t _suppressCopies;
+    bool _enabled;
+    uint16_t _sequence;
+    uint32_t _random;
+
+    DuplicateCache<SEEN_ENTRIES> _seen;
+    Pending _pending[PENDING_RELAYS];
+
+    uint32_t _relayed;
+    uint32_t _duplicates;
+    uint32_t _suppressed;
+    uint32_t _overflows;
+};
+
+#endif
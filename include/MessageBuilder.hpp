@@ -0,0 +1,161 @@
+#ifndef MESSAGE_BUILDER_HPP
+#define MESSAGE_BUILDER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Fixed-capacity text builder living on the stack.
+//
+// Formats strings, integers and fixed-point floats without printf and
+// without touching the heap. Output that does not fit is cut off and
+// flagged instead of overflowing; the buffer is always NUL terminated.
+//
+//   MessageBuilder<32> msg;
+//   msg.append("Hello World! #").append(count);
+template<size_t CAPACITY>
+class MessageBuilder {
+public:
+    MessageBuilder()
+        : _length(0),
+          _truncated(false)
+    {
+        _buffer[0] = '\0';
+    }
+
+    MessageBuilder& append(const char* str) {
+        return append(str, strlen(str));
+    }
+
+    MessageBuilder& append(const char* str, size_t length) {
+        size_t room = CAPACITY - _length;
+        if (length > room) {
+            length = room;
+            _truncated = true;
+        }
+        memcpy(_buffer + _length, str, length);
+        _length += length;
+        _buffer[_length] = '\0';
+        return *this;
+    }
+
+    MessageBuilder& append(char c) {
+        if (_length < CAPACITY) {
+            _buffer[_length++] = c;
+            _buffer[_length] = '\0';
+        } else {
+            _truncated = true;
+        }
+        return *this;
+    }
+
+    MessageBuilder& append(int value) { return appendSigned(value); }
+    MessageBuilder& append(long value) { return appendSigned((int32_t)value); }
+    MessageBuilder& append(unsigned int value) { return appendUnsigned(value); }
+    MessageBuilder& append(unsigned long value) { return appendUnsigned((uint32_t)value); }
+
+    MessageBuilder& appendUnsigned(uint32_t value) {
+        // Two digits per step from a 200 byte pair table
+        static const char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        char digits[10];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        while (value >= 100) {
+            uint32_t pair = (value % 100) * 2;
+            value /= 100;
+            *--p = pairs[pair + 1];
+            *--p = pairs[pair];
+        }
+        if (value >= 10) {
+            *--p = pairs[value * 2 + 1];
+            *--p = pairs[value * 2];
+        } else {
+            *--p = (char)('0' + value);
+        }
+        return append(p, (size_t)(end - p));
+    }
+
+    MessageBuilder& appendSigned(int32_t value) {
+        if (value < 0) {
+            append('-');
+            return appendUnsigned((uint32_t)0 - (uint32_t)value);
+        }
+        return appendUnsigned((uint32_t)value);
+    }
+
+    // Fixed-point rendering with the given number of decimals (at most 6)
+    MessageBuilder& append(float value, uint8_t decimals = 2) {
+        static const uint32_t scales[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+        if (value != value) {
+            return append("nan");
+        }
+        if (decimals > 6) {
+            decimals = 6;
+        }
+        if (value < 0) {
+            append('-');
+            value = -value;
+        }
+        if (value >= 4294967040.0f) {
+            return append("inf");
+        }
+
+        uint32_t scale = scales[decimals];
+        uint32_t whole = (uint32_t)value;
+        uint32_t fraction = (uint32_t)((value - (float)whole) * scale + 0.5f);
+        if (fraction >= scale) {
+            whole++;
+            fraction -= scale;
+        }
+
+        appendUnsigned(whole);
+        if (decimals > 0) {
+            append('.');
+            // Leading zeros of the fraction
+            for (uint32_t s = scale / 10; s > 1 && fraction < s; s /= 10) {
+                append('0');
+            }
+            appendUnsigned(fraction);
+        }
+        return *this;
+    }
+
+    MessageBuilder& appendHex(uint32_t value, uint8_t width = 2) {
+        static const char hex[] = "0123456789ABCDEF";
+        char digits[8];
+        uint8_t count = 0;
+        do {
+            digits[count++] = hex[value & 0xF];
+            value >>= 4;
+        } while (value != 0 && count < 8);
+        while (count < width && count < 8) {
+            digits[count++] = '0';
+        }
+        while (count > 0) {
+            append(digits[--count]);
+        }
+        return *this;
+    }
+
+    void clear() {
+        _length = 0;
+        _truncated = false;
+        _buffer[0] = '\0';
+    }
+
+    const char* c_str() const { return _buffer; }
+    const uint8_t* data() const { return (const uint8_t*)_buffer; }
+    size_t length() const { return _length; }
+    size_t capacity() const { return CAPACITY; }
+    bool isTruncated() const { return _truncated; }
+
+private:
+    char _buffer[CAPACITY + 1];
+    size_t _length;
+    bool _truncated;
+};
+
+#endif
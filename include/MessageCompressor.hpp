@@ -0,0 +1,160 @@
+#ifndef MESSAGE_COMPRESSOR_HPP
+#define MESSAGE_COMPRESSOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ77 over a preset dictionary, for short text and data messages.
+//
+// Messages are too short to build up any history of their own, so the
+// window starts out filled with a fixed dictionary of phrases seen on the
+// air, and a match may reach back into it from the first byte on. The code
+// is byte oriented to keep decoding to a few instructions per byte:
+//
+//   0xxxxxxx                     literal 0x00..0x7F
+//   1LLLLDDD DDDDDDDD            match, length L + 3 (3..17), distance D + 1
+//   11111xxx xxxxxxxx            L = 15: literal of the second byte
+//
+// Distances count back over the dictionary followed by the output so far,
+// 2048 bytes at most. No state is kept between messages and nothing is
+// allocated; the dictionary lives in flash.
+class MessageCompressor {
+public:
+    static const size_t MIN_MATCH = 3;
+    static const size_t MAX_MATCH = MIN_MATCH + 14;
+    static const size_t WINDOW = 2048;
+
+    // Compress into out (capacity bytes). Returns the compressed length, 0
+    // if it would not be shorter than the input; send it as is then.
+    static size_t compress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+        size_t dictionaryLength;
+        const uint8_t* dictionary = getDictionary(dictionaryLength);
+        size_t limit = capacity < length ? capacity : length - (length > 0 ? 1 : 0);
+        size_t written = 0;
+        size_t position = 0;
+        while (position < length) {
+            // Longest match starting at the position, in the dictionary or
+            // in the input before it
+            size_t bestLength = 0;
+            size_t bestDistance = 0;
+            size_t remaining = length - position;
+            size_t maxLength = remaining < MAX_MATCH ? remaining : MAX_MATCH;
+            if (maxLength >= MIN_MATCH) {
+                size_t total = dictionaryLength + position;
+                size_t start = total > WINDOW ? total - WINDOW : 0;
+                for (size_t candidate = start; candidate < total; candidate++) {
+                    size_t matched = 0;
+                    while (matched < maxLength &&
+                           at(dictionary, dictionaryLength, in, candidate + matched) == in[position + matched]) {
+                        matched++;
+                    }
+                    if (matched > bestLength) {
+                        bestLength = matched;
+                        bestDistance = total - candidate;
+                        if (matched == maxLength) {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (bestLength >= MIN_MATCH) {
+                if (written + 2 > limit) {
+                    return 0;
+                }
+                size_t code = bestDistance - 1;
+                out[written++] = (uint8_t)(0x80 | ((bestLength - MIN_MATCH) << 3) | (code >> 8));
+                out[written++] = (uint8_t)code;
+                position += bestLength;
+            } else {
+                uint8_t c = in[position++];
+                if (c < 0x80) {
+                    if (written + 1 > limit) {
+                        return 0;
+                    }
+                    out[written++] = c;
+                } else {
+                    if (written + 2 > limit) {
+                        return 0;
+                    }
+                    out[written++] = 0xF8;
+                    out[written++] = c;
+                }
+            }
+        }
+        return written;
+    }
+
+    // Returns the original length, -1 if the input is damaged or does not
+    // fit into capacity bytes
+    static int decompress(const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+        size_t dictionaryLength;
+        const uint8_t* dictionary = getDictionary(dictionaryLength);
+        size_t written = 0;
+        size_t position = 0;
+        while (position < length) {
+            uint8_t c = in[position++];
+            if (c < 0x80) {
+                if (written == capacity) {
+                    return -1;
+                }
+                out[written++] = c;
+                continue;
+            }
+            if (position == length) {
+                return -1;
+            }
+            uint8_t low = in[position++];
+            size_t matchLength = ((c >> 3) & 0x0F) + MIN_MATCH;
+            if (matchLength > MAX_MATCH) {
+                if (written == capacity) {
+                    return -1;
+                }
+                out[written++] = low;
+                continue;
+            }
+
+            size_t distance = ((size_t)(c & 0x07) << 8 | low) + 1;
+            size_t total = dictionaryLength + written;
+            if (distance > total || written + matchLength > capacity) {
+                return -1;
+            }
+            // Byte by byte, a match may overlap its own output
+            size_t from = total - distance;
+            for (size_t i = 0; i < matchLength; i++, from++) {
+                out[written] = from < dictionaryLength ? dictionary[from] : out[from - dictionaryLength];
+                written++;
+            }
+        }
+        return (int)written;
+    }
+
+private:
+    static uint8_t at(const uint8_t* dictionary, size_t dictionaryLength, const uint8_t* in, size_t index) {
+        return index < dictionaryLength ? dictionary[index] : in[index - dictionaryLength];
+    }
+
+    // Phrases of the status and chat traffic this radio carries. Changing
+    // it breaks compatibility with units built with the old one, like any
+    // other change to the frame format.
+    static const uint8_t* getDictionary(size_t& length) {
+        static const char DICTIONARY[] =
+            "negative affirmative request permission please repeat say again "
+            "unable to comply standing by stand by copy that roger wilco over and out "
+            "emergency medical assistance required injured evacuate "
+            "north south east west of the at the to the in the on the "
+            "kilometers meters minutes hours seconds "
+            "battery low signal weak strong lost "
+            "arrived leaving returning waiting moving stopped "
+            "position location meeting point checkpoint base camp "
+            "temperature wind rain snow fog clear "
+            "what where when how many is are was will can you do not "
+            "all units message received ok thanks thank you "
+            "status report check in "
+            "Hello World! #";
+        length = sizeof(DICTIONARY) - 1;
+        return (const uint8_t*)DICTIONARY;
+    }
+};
+
+#endif
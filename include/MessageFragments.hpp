@@ -0,0 +1,305 @@
+#ifndef MESSAGE_FRAGMENTS_HPP
+#define MESSAGE_FRAGMENTS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "ArenaAllocator.hpp"
+#include "SelectiveRepeatArq.hpp"
+
+// Messages longer than one ARQ payload, up to 255 fragments.
+//
+// Every fragment travels as an ARQ message of its own (FRAME_FRAGMENT) with
+//
+//   [message id lo][hi][index][count][payload...]
+//
+// All fragments but the last carry exactly PAYLOAD bytes, so a fragment's
+// place in the message follows from its index and the length of the whole
+// from the last one. ARQ normally delivers them in order, but it gives up
+// on a frame after its retries, so the reassembly copes with gaps, any
+// order and duplicates, and drops messages that stop making progress.
+// Message IDs count per sender, so the receiver keys everything on source
+// and ID; a sender starts at a random ID so its first messages after a
+// reboot do not look like copies of the ones before.
+
+// Sending side. The message is read from the caller's buffer fragment by
+// fragment, it has to stay untouched until isBusy() turns false.
+class Fragmenter {
+public:
+    static const size_t HEADER_LENGTH = 4;
+    static const size_t PAYLOAD = SelectiveRepeatArq::MAX_PAYLOAD - HEADER_LENGTH;
+    static const size_t MAX_FRAGMENTS = 255;
+    static const size_t MAX_LENGTH = PAYLOAD * MAX_FRAGMENTS;
+
+    // Pass a random firstId, see above
+    explicit Fragmenter(uint16_t firstId = 0)
+        : _data(NULL), _length(0), _id(firstId), _next(0), _count(0) {}
+
+    // False while the previous message is still going out, or if it is
+    // empty or too long
+    bool start(const uint8_t* data, size_t length) {
+        if (isBusy() || length == 0 || length > MAX_LENGTH) {
+            return false;
+        }
+        _data = data;
+        _length = length;
+        _id++;
+        _next = 0;
+        _count = (uint8_t)((length + PAYLOAD - 1) / PAYLOAD);
+        return true;
+    }
+
+    bool isBusy() const { return _next < _count; }
+
+    // Next fragment into out (HEADER_LENGTH + PAYLOAD bytes), returns its
+    // length, 0 once all are out
+    size_t next(uint8_t* out) {
+        if (!isBusy()) {
+            return 0;
+        }
+        size_t offset = (size_t)_next * PAYLOAD;
+        size_t length = _length - offset < PAYLOAD ? _length - offset : PAYLOAD;
+        out[0] = (uint8_t)_id;
+        out[1] = (uint8_t)(_id >> 8);
+        out[2] = _next++;
+        out[3] = _count;
+        memcpy(out + HEADER_LENGTH, _data + offset, length);
+        return HEADER_LENGTH + length;
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _length;
+    uint16_t _id;
+    uint8_t _next;
+    uint8_t _count;
+};
+
+// Receiving side, reassembling up to MAX_SLOTS messages at once. Fragment
+// payloads are copied once, straight to their place in a slot buffer. A
+// slot takes its buffer from the pool handed over at begin() with its first
+// fragment and gives it back once the message was delivered or timed out.
+class Reassembler {
+public:
+    static const uint8_t MAX_SLOTS = 4;
+
+    explicit Reassembler(unsigned long timeout = 10000)
+        : _pool(NULL),
+          _delivered(NULL),
+          _slotSize(0),
+          _slots(0),
+          _timeout(timeout),
+          _completed(0),
+          _recentNext(0),
+          _timeouts(0),
+          _evictions(0),
+          _rejected(0)
+    {
+        memset(_slot, 0, sizeof(_slot));
+        memset(_recent, 0, sizeof(_recent));
+    }
+
+    // Up to slots messages at once, each in one block of pool; the pool is
+    // used from the caller's task only
+    bool begin(Pool& pool, uint8_t slots) {
+        if (slots == 0 || slots > MAX_SLOTS) {
+            return false;
+        }
+        _pool = &pool;
+        _slotSize = pool.getBlockSize();
+        _slots = slots;
+        memset(_slot, 0, sizeof(_slot));
+        return true;
+    }
+
+    // A FRAME_FRAGMENT payload. Returns the whole message once its last
+    // missing fragment arrived (valid until the next call), otherwise NULL.
+    const uint8_t* add(uint16_t source, const uint8_t* fragment, size_t length, unsigned long now,
+                       size_t& messageLength) {
+        expire(now);
+        if (_pool == NULL) {
+            return NULL;
+        }
+        if (length <= Fragmenter::HEADER_LENGTH || length > Fragmenter::HEADER_LENGTH + Fragmenter::PAYLOAD) {
+            _rejected++;
+            return NULL;
+        }
+        uint16_t id = (uint16_t)(fragment[0] | (fragment[1] << 8));
+        uint8_t index = fragment[2];
+        uint8_t count = fragment[3];
+        size_t payload = length - Fragmenter::HEADER_LENGTH;
+        size_t offset = (size_t)index * Fragmenter::PAYLOAD;
+        // Only the last fragment may be short, and the message has to fit
+        if (index >= count || (index + 1 < count && payload != Fragmenter::PAYLOAD) ||
+            offset + payload > _slotSize) {
+            _rejected++;
+            return NULL;
+        }
+
+        Slot* slot = find(source, id, count);
+        if (slot == NULL && isRecent(source, id)) {
+            // Late copy of a message delivered already
+            return NULL;
+        }
+        if (slot == NULL) {
+            slot = claim(source, id, count, now);
+            if (slot == NULL) {
+                return NULL;
+            }
+        }
+        slot->lastSeen = now;
+
+        uint8_t mask = (uint8_t)(1 << (index % 8));
+        if (slot->received[index / 8] & mask) {
+            return NULL;
+        }
+        slot->received[index / 8] |= mask;
+        slot->missing--;
+        memcpy(slot->buffer + offset, fragment + Fragmenter::HEADER_LENGTH, payload);
+        if (index + 1 == count) {
+            slot->length = offset + payload;
+        }
+
+        if (slot->missing > 0) {
+            return NULL;
+        }
+        slot->active = false;
+        _completed++;
+        Recent& recent = _recent[_recentNext++ % MAX_SLOTS];
+        recent.valid = true;
+        recent.source = source;
+        recent.id = id;
+        recent.completed = now;
+        messageLength = slot->length;
+        // Handed back to the pool on the next call
+        _delivered = slot->buffer;
+        slot->buffer = NULL;
+        return _delivered;
+    }
+
+    // Give up on messages without a new fragment for the timeout, and
+    // forget completed ones no copy can arrive for any more
+    void expire(unsigned long now) {
+        if (_pool == NULL) {
+            return;
+        }
+        _pool->release(_delivered);
+        _delivered = NULL;
+        for (uint8_t i = 0; i < _slots; i++) {
+            if (_slot[i].active && now - _slot[i].lastSeen >= _timeout) {
+                _slot[i].active = false;
+                _pool->release(_slot[i].buffer);
+                _slot[i].buffer = NULL;
+                _timeouts++;
+            }
+        }
+        for (uint8_t i = 0; i < MAX_SLOTS; i++) {
+            if (_recent[i].valid && now - _recent[i].completed >= _timeout) {
+                _recent[i].valid = false;
+            }
+        }
+    }
+
+    uint8_t getActive() const {
+        uint8_t active = 0;
+        for (uint8_t i = 0; i < _slots; i++) {
+            active += _slot[i].active ? 1 : 0;
+        }
+        return active;
+    }
+
+    uint32_t getCompleted() const { return _completed; }
+    uint32_t getTimeouts() const { return _timeouts; }
+    uint32_t getEvictions() const { return _evictions; }
+    uint32_t getRejected() const { return _rejected; }
+
+private:
+    struct Slot {
+        bool active;
+        uint16_t source;
+        uint16_t id;
+        uint8_t count;
+        uint8_t missing;
+        size_t length;
+        unsigned long lastSeen;
+        uint8_t* buffer;       // Pool block while active
+        uint8_t received[32];  // Bitmap by fragment index
+    };
+
+    struct Recent {
+        bool valid;
+        uint16_t source;
+        uint16_t id;
+        unsigned long completed;
+    };
+
+    bool isRecent(uint16_t source, uint16_t id) const {
+        for (uint8_t i = 0; i < MAX_SLOTS; i++) {
+            if (_recent[i].valid && _recent[i].source == source && _recent[i].id == id) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Slot* find(uint16_t source, uint16_t id, uint8_t count) {
+        for (uint8_t i = 0; i < _slots; i++) {
+            if (_slot[i].active && _slot[i].source == source && _slot[i].id == id && _slot[i].count == count) {
+                return &_slot[i];
+            }
+        }
+        return NULL;
+    }
+
+    // A free slot with a new pool block, or the one that waited longest for
+    // a fragment together with its block
+    Slot* claim(uint16_t source, uint16_t id, uint8_t count, unsigned long now) {
+        if (_slots == 0) {
+            return NULL;
+        }
+        Slot* slot = NULL;
+        for (uint8_t i = 0; i < _slots && slot == NULL; i++) {
+            if (!_slot[i].active) {
+                slot = &_slot[i];
+            }
+        }
+        if (slot != NULL) {
+            slot->buffer = (uint8_t*)_pool->allocate();
+            if (slot->buffer == NULL) {
+                return NULL;
+            }
+        } else {
+            slot = &_slot[0];
+            for (uint8_t i = 1; i < _slots; i++) {
+                if (now - _slot[i].lastSeen > now - slot->lastSeen) {
+                    slot = &_slot[i];
+                }
+            }
+            _evictions++;
+        }
+        slot->active = true;
+        slot->source = source;
+        slot->id = id;
+        slot->count = count;
+        slot->missing = count;
+        slot->length = 0;
+        memset(slot->received, 0, sizeof(slot->received));
+        return slot;
+    }
+
+    Pool* _pool;
+    uint8_t* _delivered;  // Last completed message, released on the next call
+    size_t _slotSize;
+    uint8_t _slots;
+    unsigned long _timeout;
+    Slot _slot[MAX_SLOTS];
+    Recent _recent[MAX_SLOTS];  // The last completed messages
+
+    uint32_t _completed;
+    uint8_t _recentNext;
+    uint32_t _timeouts;
+    uint32_t _evictions;
+    uint32_t _rejected;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "MessageBuilder.hpp"
+
+// Event counter, safe to bump from any task or ISR
+class Counter {
+public:
+    Counter() : _value(0) {}
+
+    void add(uint32_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() const { return _value.load(std::memory_order_relaxed); }
+    void reset() { _value.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> _value;
+};
+
+// Last value of something, e.g. a timestamp or a level
+class Gauge {
+public:
+    Gauge() : _value(0) {}
+
+    void set(uint32_t value) { _value.store(value, std::memory_order_relaxed); }
+    uint32_t get() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> _value;
+};
+
+// Log-linear latency histogram over microseconds.
+//
+// Values below 8 get a bucket each, above that every power of two is split
+// into 8 linear sub-buckets, so any value is known to within 12.5% across
+// the whole 32 bit range with 240 counters. Recording is a count-leading-
+// zeros, a shift and one relaxed atomic increment; it may happen from any
+// task or ISR while another task reads.
+class LatencyHistogram {
+public:
+    static constexpr uint8_t SUB_BITS = 3;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BITS;
+    static constexpr size_t BUCKET_COUNT = (32 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram() : _max(0) {
+        reset();
+    }
+
+    void record(uint32_t value) {
+        _buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t max = _max.load(std::memory_order_relaxed);
+        while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static size_t bucketIndex(uint32_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        uint8_t shift = (uint8_t)(31 - __builtin_clz(value) - SUB_BITS);
+        return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+    }
+
+    // Smallest value that falls into a bucket
+    static uint32_t bucketLower(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return (uint32_t)index;
+        }
+        uint8_t shift = (uint8_t)(index / SUB_BUCKETS - 1);
+        return (uint32_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    }
+
+    // Largest value that falls into a bucket
+    static uint32_t bucketUpper(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return (uint32_t)index;
+        }
+        uint8_t shift = (uint8_t)(index / SUB_BUCKETS - 1);
+        return bucketLower(index) + ((1u << shift) - 1);
+    }
+
+    uint32_t getCount() const {
+        uint32_t count = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            count += _buckets[i].load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    uint32_t getMax() const { return _max.load(std::memory_order_relaxed); }
+
+    // Value at the given percentile (0..100), reported as the middle of its
+    // bucket and never above the largest value seen; 0 when empty
+    uint32_t percentile(uint8_t percent) const {
+        uint32_t count = getCount();
+        if (count == 0) {
+            return 0;
+        }
+
+        uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint32_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            seen += _buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint32_t lower = bucketLower(i);
+                uint32_t middle = lower + (bucketUpper(i) - lower) / 2;
+                uint32_t max = getMax();
+                return middle < max ? middle : max;
+            }
+        }
+        return getMax();
+    }
+
+    void reset() {
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            _buckets[i].store(0, std::memory_order_relaxed);
+        }
+        _max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> _buckets[BUCKET_COUNT];
+    std::atomic<uint32_t> _max;
+};
+
+// Named view over the counters, gauges and histograms of the firmware.
+//
+// Metrics are registered once at boot and stay where they are; dump()
+// writes one compact line per metric:
+//
+//   rx_crc_errors 3
+//   rx_handle_us n=120 p50=388 p90=420 p99=452 max=471
+class MetricsRegistry {
+public:
+    static constexpr size_t MAX_METRICS = 48;
+
+    typedef void (*LineCallback)(const char* line, size_t length);
+
+    MetricsRegistry() : _count(0) {}
+
+    bool add(const char* name, Counter& counter) {
+        return addEntry(name, &counter, NULL, NULL);
+    }
+
+    bool add(const char* name, Gauge& gauge) {
+        return addEntry(name, NULL, &gauge, NULL);
+    }
+
+    bool add(const char* name, LatencyHistogram& histogram) {
+        return addEntry(name, NULL, NULL, &histogram);
+    }
+
+    void dump(LineCallback callback) const {
+        for (size_t i = 0; i < _count; i++) {
+            const Entry& entry = _entries[i];
+            MessageBuilder<96> line;
+            line.append(entry.name).append(' ');
+            if (entry.counter != NULL) {
+                line.appendUnsigned(entry.counter->get());
+            } else if (entry.gauge != NULL) {
+                line.appendUnsigned(entry.gauge->get());
+            } else {
+                const LatencyHistogram& h = *entry.histogram;
+                line.append("n=").appendUnsigned(h.getCount())
+                    .append(" p50=").appendUnsigned(h.percentile(50))
+                    .append(" p90=").appendUnsigned(h.percentile(90))
+                    .append(" p99=").appendUnsigned(h.percentile(99))
+                    .append(" max=").appendUnsigned(h.getMax());
+            }
+            line.append("\r\n");
+            callback(line.c_str(), line.length());
+        }
+    }
+
+    void reset() {
+        for (size_t i = 0; i < _count; i++) {
+            // Gauges hold state rather than a count, they are kept
+            if (_entries[i].counter != NULL) {
+                _entries[i].counter->reset();
+            } else if (_entries[i].histogram != NULL) {
+                _entries[i].histogram->reset();
+            }
+        }
+    }
+
+    size_t getCount() const { return _count; }
+
+private:
+    struct Entry {
+        const char* name;
+        Counter* counter;
+        Gauge* gauge;
+        LatencyHistogram* histogram;
+    };
+
+    bool addEntry(const char* name, Counter* counter, Gauge* gauge, LatencyHistogram* histogram) {
+        if (_count >= MAX_METRICS) {
+            return false;
+        }
+        _entries[_count].name = name;
+        _entries[_count].counter = counter;
+        _entries[_count].gauge = gauge;
+        _entries[_count].histogram = histogram;
+        _count++;
+        return true;
+    }
+
+    Entry _entries[MAX_METRICS];
+    size_t _count;
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef POWER_MANAGER_HPP
+#define POWER_MANAGER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#if defined(ESP32)
+#include <Arduino.h>
+#include <sdkconfig.h>
+#include <esp_idf_version.h>
+#include <esp_timer.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+// CPU frequency that follows the work pending.
+//
+// After begin() the CPU idles at minMhz. Code about to do heavy lifting
+// (FEC, codec, FIFO refills) holds a lock for as long as it runs, the CPU
+// is at maxMhz while any lock is held by any task. With IDF power
+// management the switch is made by an ESP_PM_CPU_FREQ_MAX lock, without it
+// by setCpuFrequencyMhz() on the first acquire and the last release.
+//
+// Time spent at each frequency and in light sleep is accumulated, so the
+// saving can be read off a running device.
+class PowerManager {
+public:
+    enum Level : uint8_t {
+        LEVEL_MAX,
+        LEVEL_MIN,
+        LEVEL_SLEEP,
+        LEVEL_COUNT
+    };
+
+    PowerManager()
+        : _maxMhz(0),
+          _minMhz(0),
+          _started(false),
+          _holders(0),
+          _level(LEVEL_MAX),
+          _since(0),
+          _switches(0)
+#if defined(ESP32) && CONFIG_PM_ENABLE
+          , _lock(NULL)
+#endif
+    {
+        for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
+            _residency[i] = 0;
+        }
+    }
+
+    // Before the tasks taking locks start, the CPU runs at its boot
+    // frequency until then
+    bool begin(uint16_t maxMhz, uint16_t minMhz) {
+        _maxMhz = maxMhz;
+        _minMhz = minMhz;
+#if defined(ESP32) && CONFIG_PM_ENABLE
+        if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "cpu_max", &_lock) != ESP_OK) {
+            return false;
+        }
+        // Light sleep is entered explicitly, see onSleep()
+#if ESP_IDF_VERSION_MAJOR >= 5
+        esp_pm_config_t config;
+#else
+        esp_pm_config_esp32s3_t config;
+#endif
+        config.max_freq_mhz = maxMhz;
+        config.min_freq_mhz = minMhz;
+        config.light_sleep_enable = false;
+        if (esp_pm_configure(&config) != ESP_OK) {
+            return false;
+        }
+#endif
+        std::lock_guard<std::mutex> guard(_mutex);
+        _since = clock();
+        _level = LEVEL_MAX;
+        _started = true;
+        update();
+        return true;
+    }
+
+    void acquire() {
+#if defined(ESP32) && CONFIG_PM_ENABLE
+        if (_lock != NULL) {
+            esp_pm_lock_acquire(_lock);
+        }
+#endif
+        if (_holders.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> guard(_mutex);
+            update();
+        }
+    }
+
+    void release() {
+        if (_holders.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> guard(_mutex);
+            update();
+        }
+#if defined(ESP32) && CONFIG_PM_ENABLE
+        if (_lock != NULL) {
+            esp_pm_lock_release(_lock);
+        }
+#endif
+    }
+
+    // Around esp_light_sleep_start(), the sleeping task holds no lock
+    void onSleep() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (_started) {
+            enter(LEVEL_SLEEP);
+        }
+    }
+
+    void onWake() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        update();
+    }
+
+    // Microseconds spent at a level since begin() or the last reset()
+    uint64_t getResidency(Level level) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        uint64_t time = _residency[level];
+        if (_started && level == _level) {
+            time += clock() - _since;
+        }
+        return time;
+    }
+
+    uint32_t getSwitchCount() const { return _switches; }
+
+    uint16_t getMhz(Level level) const {
+        return level == LEVEL_MAX ? _maxMhz : (level == LEVEL_MIN ? _minMhz : 0);
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
+            _residency[i] = 0;
+        }
+        _since = clock();
+        _switches = 0;
+    }
+
+private:
+    static uint64_t clock() {
+#if defined(ESP32)
+        // Keeps counting through light sleep
+        return (uint64_t)esp_timer_get_time();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Called with the mutex held. Whoever changes the lock count last
+    // settles the level, so racing acquire/release pairs end up right.
+    void update() {
+        if (_started) {
+            enter(_holders.load() > 0 ? LEVEL_MAX : LEVEL_MIN);
+        }
+    }
+
+    void enter(Level level) {
+        if (level == _level) {
+            return;
+        }
+        uint64_t now = clock();
+        _residency[_level] += now - _since;
+        _since = now;
+        _level = level;
+        _switches++;
+#if defined(ESP32) && !CONFIG_PM_ENABLE
+        if (level != LEVEL_SLEEP) {
+            setCpuFrequencyMhz(level == LEVEL_MAX ? _maxMhz : _minMhz);
+        }
+#endif
+    }
+
+    uint16_t _maxMhz;
+    uint16_t _minMhz;
+    bool _started;
+    std::atomic<uint8_t> _holders;
+    std::mutex _mutex;
+    Level _level;
+    uint64_t _since;
+    uint64_t _residency[LEVEL_COUNT];
+    uint32_t _switches;
+#if defined(ESP32) && CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t _lock;
+#endif
+};
+
+// Keeps the CPU at full speed while in scope
+class PowerLock {
+public:
+    explicit PowerLock(PowerManager& manager) : _manager(manager) {
+        _manager.acquire();
+    }
+
+    ~PowerLock() {
+        _manager.release();
+    }
+
+private:
+    PowerLock(const PowerLock&);
+    PowerLock& operator=(const PowerLock&);
+
+    PowerManager& _manager;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef REED_SOLOMON_HPP
+#define REED_SOLOMON_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Shortened Reed-Solomon code over GF(256) (polynomial 0x11D, first
+// consecutive root alpha^0). NROOTS parity bytes correct up to NROOTS / 2
+// corrupted bytes anywhere in a codeword of up to 255 bytes.
+//
+// The encoder and the syndrome computation are driven by per-coefficient
+// multiplication tables, so their inner loops are a table lookup and an XOR
+// per byte without any branches. Tables live in the instance (~4.8 KB), keep
+// a single long-lived object around.
+class ReedSolomon {
+public:
+    static const uint8_t NROOTS = 8;
+    static const size_t MAX_CODEWORD = 255;
+    static const size_t MAX_DATA = MAX_CODEWORD - NROOTS;
+
+    ReedSolomon() {
+        // Exponent table is doubled so products never need a modulo
+        uint16_t x = 1;
+        for (uint16_t i = 0; i < 255; i++) {
+            _exp[i] = (uint8_t)x;
+            _exp[i + 255] = (uint8_t)x;
+            _log[x] = (uint8_t)i;
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11D;
+            }
+        }
+        _exp[510] = _exp[0];
+        _exp[511] = _exp[1];
+        _log[0] = 0;
+
+        // Generator polynomial g(x) = (x - a^0)(x - a^1)...(x - a^(NROOTS-1))
+        uint8_t gen[NROOTS + 1];
+        memset(gen, 0, sizeof(gen));
+        gen[0] = 1;
+        for (uint8_t i = 0; i < NROOTS; i++) {
+            for (int j = i + 1; j > 0; j--) {
+                gen[j] = gen[j - 1] ^ mul(gen[j], _exp[i]);
+            }
+            gen[0] = mul(gen[0], _exp[i]);
+        }
+
+        // gen[] is lowest order first, the LFSR needs it highest order first
+        for (uint8_t j = 0; j < NROOTS; j++) {
+            for (uint16_t v = 0; v < 256; v++) {
+                _genMul[j][v] = mul((uint8_t)v, gen[NROOTS - 1 - j]);
+                _rootMul[j][v] = mul((uint8_t)v, _exp[j]);
+            }
+        }
+    }
+
+    // Compute the NROOTS parity bytes for length data bytes
+    void encode(const uint8_t* data, size_t length, uint8_t* parity) const {
+        uint8_t reg[NROOTS];
+        memset(reg, 0, sizeof(reg));
+
+        for (size_t i = 0; i < length; i++) {
+            uint8_t feedback = data[i] ^ reg[0];
+            for (uint8_t j = 0; j < NROOTS - 1; j++) {
+                reg[j] = reg[j + 1] ^ _genMul[j][feedback];
+            }
+            reg[NROOTS - 1] = _genMul[NROOTS - 1][feedback];
+        }
+        memcpy(parity, reg, NROOTS);
+    }
+
+    // Correct a codeword (data followed by parity) in place.
+    // Returns the number of corrected bytes, or -1 if it is beyond repair.
+    int decode(uint8_t* codeword, size_t length) const {
+        if (length <= NROOTS || length > MAX_CODEWORD) {
+            return -1;
+        }
+
+        // Syndromes S_i = r(a^i), Horner's rule through the root tables
+        uint8_t syn[NROOTS];
+        memset(syn, 0, sizeof(syn));
+        for (size_t k = 0; k < length; k++) {
+            for (uint8_t i = 0; i < NROOTS; i++) {
+                syn[i] = _rootMul[i][syn[i]] ^ codeword[k];
+            }
+        }
+
+        uint8_t any = 0;
+        for (uint8_t i = 0; i < NROOTS; i++) {
+            any |= syn[i];
+        }
+        if (any == 0) {
+            return 0;
+        }
+
+        // Berlekamp-Massey: error locator lambda(x)
+        uint8_t lambda[NROOTS + 1];
+        uint8_t prev[NROOTS + 1];
+        uint8_t tmp[NROOTS + 1];
+        memset(lambda, 0, sizeof(lambda));
+        memset(prev, 0, sizeof(prev));
+        lambda[0] = 1;
+        prev[0] = 1;
+        uint8_t errors = 0;
+        uint8_t shift = 1;
+        uint8_t prevDiscrepancy = 1;
+
+        for (uint8_t n = 0; n < NROOTS; n++) {
+            uint8_t d = syn[n];
+            for (uint8_t i = 1; i <= errors; i++) {
+                d ^= mul(lambda[i], syn[n - i]);
+            }
+
+            if (d == 0) {
+                shift++;
+                continue;
+            }
+
+            uint8_t scale = div(d, prevDiscrepancy);
+            memcpy(tmp, lambda, sizeof(lambda));
+            for (uint8_t i = 0; i + shift <= NROOTS; i++) {
+                lambda[i + shift] ^= mul(scale, prev[i]);
+            }
+
+            if (2 * errors <= n) {
+                errors = n + 1 - errors;
+                memcpy(prev, tmp, sizeof(prev));
+                prevDiscrepancy = d;
+                shift = 1;
+            } else {
+                shift++;
+            }
+        }
+
+        if (errors > NROOTS / 2) {
+            return -1;
+        }
+
+        // Chien search over the positions actually present in the shortened code.
+        // Byte k holds the coefficient of x^(length - 1 - k).
+        uint8_t positions[NROOTS / 2];
+        uint8_t found = 0;
+        for (size_t k = 0; k < length && found <= errors; k++) {
+            uint8_t power = (uint8_t)(length - 1 - k);
+            uint8_t xInv = _exp[(255 - power) % 255];
+            if (eval(lambda, errors, xInv) == 0) {
+                if (found == errors) {
+                    return -1;
+                }
+                positions[found++] = (uint8_t)k;
+            }
+        }
+        if (found != errors) {
+            return -1;
+        }
+
+        // Error evaluator omega(x) = S(x) * lambda(x) mod x^NROOTS
+        uint8_t omega[NROOTS];
+        memset(omega, 0, sizeof(omega));
+        for (uint8_t i = 0; i < NROOTS; i++) {
+            for (uint8_t j = 0; j <= i && j <= errors; j++) {
+                omega[i] ^= mul(syn[i - j], lambda[j]);
+            }
+        }
+
+        // Forney: e = X * omega(X^-1) / lambda'(X^-1)
+        for (uint8_t e = 0; e < found; e++) {
+            uint8_t power = (uint8_t)(length - 1 - positions[e]);
+            uint8_t x = _exp[power];
+            uint8_t xInv = _exp[(255 - power) % 255];
+
+            uint8_t derivative = 0;
+            uint8_t xPow = 1;
+            for (uint8_t i = 1; i <= errors; i += 2) {
+                derivative ^= mul(lambda[i], xPow);
+                xPow = mul(xPow, mul(xInv, xInv));
+            }
+            if (derivative == 0) {
+                return -1;
+            }
+
+            codeword[positions[e]] ^= mul(x, div(eval(omega, NROOTS - 1, xInv), derivative));
+        }
+        return found;
+    }
+
+private:
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return (a && b) ? _exp[_log[a] + _log[b]] : 0;
+    }
+
+    uint8_t div(uint8_t a, uint8_t b) const {
+        return a ? _exp[_log[a] + 255 - _log[b]] : 0;
+    }
+
+    uint8_t eval(const uint8_t* poly, uint8_t degree, uint8_t x) const {
+        uint8_t result = 0;
+        for (int i = degree; i >= 0; i--) {
+            result = mul(result, x) ^ poly[i];
+        }
+        return result;
+    }
+
+    uint8_t _exp[512];
+    uint8_t _log[256];
+    uint8_t _genMul[NROOTS][256];
+    uint8_t _rootMul[NROOTS][256];
+};
+
+#endif
@@ -0,0 +1,471 @@
+#ifndef SELECTIVE_REPEAT_ARQ_HPP
+#define SELECTIVE_REPEAT_ARQ_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "LinkFrame.hpp"
+
+// Selective-repeat ARQ for text/data messages.
+//
+// Every data frame carries an 8 bit sequence number, the oldest one the
+// sender still waits for and a 16 bit session:
+//
+//   [type][seq][base][session lo][hi][payload...]
+//
+// Only data for a single unit is confirmed. Its receiver buffers
+// out-of-order frames inside its window and answers with an ACK addressed
+// to the sender's source, holding the next expected sequence number
+// (cumulative base) plus a bitmap of the frames already buffered after it,
+// so the sender only repeats what was actually lost:
+//
+//   [FRAME_ACK][to lo][hi][session lo][hi][base][bitmap lo][hi]
+//
+// Data for a group goes out once with the UNCONFIRMED bit set in its
+// session and is delivered as it arrives: ACKs from several members would
+// collide on air and each claim the sender's window for itself.
+//
+// The session is picked at random by the sender for every boot and starts
+// at sequence 0. Receivers keep a window per sender, told apart by the
+// source the packet came with; the least recently heard one makes room
+// for a new sender. A receiver seeing a new session starts over at the
+// sender's base, so neither side's reboot makes fresh frames look like old
+// ones; ACKs for another unit or session are ignored. The sender's base
+// also tells the receiver which frames were given up on. Retransmit
+// timeouts follow the smoothed RTT (RFC 6298 style, Karn's rule for
+// retransmitted frames). Messages keep the frame type they were sent with
+// (FRAME_DATA or FRAME_PACKED), so the payload encoding is up to the
+// application.
+//
+// Timestamps are plain milliseconds passed in by the caller, so the class
+// does not depend on the Arduino core and runs unchanged on a host.
+class SelectiveRepeatArq {
+public:
+    static const uint8_t WINDOW_SIZE = 16;  // Must stay <= 128 for 8 bit sequence numbers
+    static const size_t HEADER_LENGTH = 5;
+    static const size_t ACK_LENGTH = 8;
+    static const size_t MAX_PAYLOAD = 64;
+    static const uint8_t MAX_RETRIES = 8;
+    static const uint8_t MAX_PEERS = 4;     // Senders with a receive window at a time
+    static const uint16_t UNCONFIRMED = 0x8000;
+
+    static const unsigned long INITIAL_RTO = 500;
+    static const unsigned long MIN_RTO = 50;
+    static const unsigned long MAX_RTO = 4000;
+
+    // Called for every message delivered in order to the application, with
+    // the frame type it came in and the unit that sent it
+    typedef void (*DeliverCallback)(const uint8_t* data, size_t length, uint8_t type, uint16_t source);
+
+    explicit SelectiveRepeatArq(uint16_t source = 0, uint16_t session = 0)
+        : _txBase(0),
+          _txNext(0),
+          _source(source),
+          _session(session & ~UNCONFIRMED),
+          _srtt(0),
+          _rttvar(0),
+          _rto(INITIAL_RTO),
+          _sent(0),
+          _retransmitted(0),
+          _failed(0),
+          _delivered(0),
+          _duplicates(0),
+          _skipped(0)
+    {
+        memset(_tx, 0, sizeof(_tx));
+        memset(_peers, 0, sizeof(_peers));
+    }
+
+    // Sender side
+
+    // Our own address, ACKs for anyone else are ignored
+    void setSource(uint16_t source) { _source = source; }
+
+    // Start a new session, anything still in the window is dropped
+    void setSession(uint16_t session) {
+        _session = session & ~UNCONFIRMED;
+        _txBase = 0;
+        _txNext = 0;
+    }
+
+    uint16_t getSession() const { return _session; }
+
+    // Queue a message, confirmed for a single unit or sent once for a
+    // group; false if the window is full
+    bool send(const uint8_t* data, size_t length, uint8_t type = FRAME_DATA, bool confirmed = true) {
+        if (length > MAX_PAYLOAD || isWindowFull()) {
+            return false;
+        }
+
+        TxSlot& slot = _tx[_txNext % WINDOW_SIZE];
+        memcpy(slot.data, data, length);
+        slot.length = (uint8_t)length;
+        slot.type = type;
+        slot.confirmed = confirmed;
+        slot.sent = false;
+        slot.acked = false;
+        slot.retries = 0;
+        _txNext++;
+        return true;
+    }
+
+    bool isWindowFull() const { return (uint8_t)(_txNext - _txBase) >= WINDOW_SIZE; }
+    bool isIdle() const { return _txNext == _txBase; }
+
+    // Build the next frame that is due (new or timed out) into out.
+    // Returns its length, or 0 if nothing has to be sent right now.
+    size_t nextFrame(unsigned long now, uint8_t* out) {
+        for (uint8_t seq = _txBase; seq != _txNext; seq++) {
+            TxSlot& slot = _tx[seq % WINDOW_SIZE];
+            if (slot.acked || (slot.sent && (long)(now - slot.deadline) < 0)) {
+                continue;
+            }
+
+            if (slot.sent) {
+                if (slot.retries >= MAX_RETRIES) {
+                    // Give up on this message, let the window move on
+                    slot.acked = true;
+                    _failed++;
+                    slideTxWindow();
+                    continue;
+                }
+                slot.retries++;
+                _retransmitted++;
+            } else {
+                _sent++;
+            }
+
+            // Exponential backoff per frame while it keeps getting lost
+            unsigned long timeout = _rto << (slot.retries < 6 ? slot.retries : 6);
+            slot.sent = true;
+            slot.sentAt = now;
+            slot.deadline = now + (timeout > MAX_RTO ? MAX_RTO : timeout);
+
+            uint16_t session = slot.confirmed ? _session : (uint16_t)(_session | UNCONFIRMED);
+            out[0] = slot.type;
+            out[1] = seq;
+            out[2] = _txBase;
+            out[3] = (uint8_t)session;
+            out[4] = (uint8_t)(session >> 8);
+            memcpy(out + HEADER_LENGTH, slot.data, slot.length);
+
+            if (!slot.confirmed) {
+                // Nobody answers group traffic, it is done once on air
+                slot.acked = true;
+                slideTxWindow();
+            }
+            return HEADER_LENGTH + slot.length;
+        }
+        return 0;
+    }
+
+    // Process a received FRAME_ACK; false if it was not meant for us
+    bool onAck(const uint8_t* frame, size_t length, unsigned long now) {
+        if (length < ACK_LENGTH || readWord(frame + 1) != _source || readWord(frame + 3) != _session) {
+            return false;
+        }
+
+        uint8_t base = frame[5];
+        uint16_t bitmap = readWord(frame + 6);
+
+        for (uint8_t seq = _txBase; seq != _txNext; seq++) {
+            TxSlot& slot = _tx[seq % WINDOW_SIZE];
+            if (slot.acked || !slot.sent) {
+                continue;
+            }
+
+            // Everything before base arrived; bit i stands for base + 1 + i
+            uint8_t offset = (uint8_t)(seq - base);
+            bool received = offset >= 0x80 || (offset >= 1 && offset <= 16 && (bitmap & (1u << (offset - 1))));
+            if (!received) {
+                continue;
+            }
+
+            slot.acked = true;
+            // Karn's rule: ambiguous samples from retransmitted frames are ignored
+            if (slot.retries == 0) {
+                updateRtt(now - slot.sentAt);
+            }
+        }
+        slideTxWindow();
+        return true;
+    }
+
+    // Receiver side
+
+    // Process a data frame from source, delivering any messages that
+    // became in-order. Confirmed frames leave an ACK owed to the sender,
+    // see ackPending() and buildAck(); true for those, false for group
+    // traffic and malformed frames.
+    bool onData(const uint8_t* frame, size_t length, uint16_t source, unsigned long now, DeliverCallback deliver) {
+        if (length < HEADER_LENGTH || length - HEADER_LENGTH > MAX_PAYLOAD) {
+            return false;
+        }
+
+        uint8_t seq = frame[1];
+        uint8_t base = frame[2];
+        uint16_t session = readWord(frame + 3);
+        if (session & UNCONFIRMED) {
+            // Group traffic, nothing to put in order or confirm
+            if (deliver) {
+                deliver(frame + HEADER_LENGTH, length - HEADER_LENGTH, frame[0], source);
+            }
+            _delivered++;
+            return false;
+        }
+
+        Peer& peer = findPeer(source, now);
+        if (!peer.used || session != peer.session) {
+            // The sender (re)started, whatever we hold belongs to the old session
+            memset(peer.rx, 0, sizeof(peer.rx));
+            peer.source = source;
+            peer.session = session;
+            peer.base = base;
+            peer.used = true;
+        }
+        peer.lastHeard = now;
+        peer.ackOwed = true;
+
+        // The sender moved on without the frames before its base: it gave
+        // up on them, skip over what is missing so the window can follow
+        while (peer.base != base && (uint8_t)(base - peer.base) < 0x80) {
+            deliverInOrder(peer, deliver);
+            if (peer.base != base && !peer.rx[peer.base % WINDOW_SIZE].filled) {
+                peer.base++;
+                _skipped++;
+            }
+        }
+
+        uint8_t offset = (uint8_t)(seq - peer.base);
+        if (offset >= WINDOW_SIZE) {
+            // Behind the window: already delivered, the ACK got lost
+            _duplicates++;
+            return true;
+        }
+
+        RxSlot& slot = peer.rx[seq % WINDOW_SIZE];
+        if (slot.filled) {
+            _duplicates++;
+            return true;
+        }
+        slot.length = (uint8_t)(length - HEADER_LENGTH);
+        slot.type = frame[0];
+        memcpy(slot.data, frame + HEADER_LENGTH, slot.length);
+        slot.filled = true;
+
+        deliverInOrder(peer, deliver);
+        return true;
+    }
+
+    // A confirmed data frame from source we already hold or delivered,
+    // its ACK got lost: the ACK is owed again and true is returned, the
+    // frame needs no onData(). False for anything else.
+    bool onRepeat(const uint8_t* frame, size_t length, uint16_t source) {
+        if (length < HEADER_LENGTH || (readWord(frame + 3) & UNCONFIRMED)) {
+            return false;
+        }
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Peer& peer = _peers[i];
+            if (!peer.used || peer.source != source || peer.session != readWord(frame + 3)) {
+                continue;
+            }
+            uint8_t seq = frame[1];
+            uint8_t offset = (uint8_t)(seq - peer.base);
+            // Behind the window, or waiting in it
+            if ((offset >= WINDOW_SIZE && (uint8_t)(peer.base - seq) <= 0x80) ||
+                (offset < WINDOW_SIZE && peer.rx[seq % WINDOW_SIZE].filled)) {
+                peer.ackOwed = true;
+                return true;
+            }
+            return false;
+        }
+        return false;
+    }
+
+    // Frame ID for a DuplicateCache: the sender, its session and sequence
+    // number; false for anything but confirmed data
+    static bool frameId(const uint8_t* frame, size_t length, uint16_t source, uint32_t& id) {
+        if ((frame[0] != FRAME_DATA && frame[0] != FRAME_PACKED && frame[0] != FRAME_FRAGMENT) ||
+            length < HEADER_LENGTH || (readWord(frame + 3) & UNCONFIRMED)) {
+            return false;
+        }
+        id = (uint32_t)source << 16 | (uint32_t)frame[3] << 8 | frame[1];
+        return true;
+    }
+
+    bool ackPending() const {
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (_peers[i].used && _peers[i].ackOwed) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // An ACK is owed to this sender
+    bool ackPending(uint16_t source) const {
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (_peers[i].used && _peers[i].source == source) {
+                return _peers[i].ackOwed;
+            }
+        }
+        return false;
+    }
+
+    // Build the next ACK owed to any sender into out, 0 if there is none
+    size_t buildAck(uint8_t* out) {
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (_peers[i].used && _peers[i].ackOwed) {
+                return buildAck(_peers[i], out);
+            }
+        }
+        return 0;
+    }
+
+    // Build the ACK for one sender into out, 0 if we hold no window for it
+    size_t buildAck(uint16_t source, uint8_t* out) {
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            if (_peers[i].used && _peers[i].source == source) {
+                return buildAck(_peers[i], out);
+            }
+        }
+        return 0;
+    }
+
+    // Statistics
+    unsigned long getRto() const { return _rto; }
+    unsigned long getSmoothedRtt() const { return _srtt; }
+    uint32_t getSentCount() const { return _sent; }
+    uint32_t getRetransmittedCount() const { return _retransmitted; }
+    uint32_t getFailedCount() const { return _failed; }
+    uint32_t getDeliveredCount() const { return _delivered; }
+    uint32_t getDuplicateCount() const { return _duplicates; }
+    uint32_t getSkippedCount() const { return _skipped; }
+
+private:
+    struct TxSlot {
+        uint8_t data[MAX_PAYLOAD];
+        uint8_t length;
+        uint8_t type;
+        uint8_t retries;
+        bool confirmed;
+        bool sent;
+        bool acked;
+        unsigned long sentAt;
+        unsigned long deadline;
+    };
+
+    struct RxSlot {
+        uint8_t data[MAX_PAYLOAD];
+        uint8_t length;
+        uint8_t type;
+        bool filled;
+    };
+
+    // Receive window of one sender
+    struct Peer {
+        RxSlot rx[WINDOW_SIZE];
+        unsigned long lastHeard;
+        uint16_t source;
+        uint16_t session;
+        uint8_t base;
+        bool used;
+        bool ackOwed;
+    };
+
+    // The sender's window, a free one or the least recently heard
+    Peer& findPeer(uint16_t source, unsigned long now) {
+        Peer* oldest = &_peers[0];
+        for (uint8_t i = 0; i < MAX_PEERS; i++) {
+            Peer& peer = _peers[i];
+            if (peer.used && peer.source == source) {
+                return peer;
+            }
+            if (oldest->used && (!peer.used || now - peer.lastHeard > now - oldest->lastHeard)) {
+                oldest = &peer;
+            }
+        }
+        oldest->used = false;
+        return *oldest;
+    }
+
+    size_t buildAck(Peer& peer, uint8_t* out) {
+        uint16_t bitmap = 0;
+        for (uint8_t i = 0; i < WINDOW_SIZE - 1; i++) {
+            if (peer.rx[(uint8_t)(peer.base + 1 + i) % WINDOW_SIZE].filled) {
+                bitmap |= (uint16_t)(1u << i);
+            }
+        }
+        peer.ackOwed = false;
+
+        out[0] = FRAME_ACK;
+        out[1] = (uint8_t)peer.source;
+        out[2] = (uint8_t)(peer.source >> 8);
+        out[3] = (uint8_t)peer.session;
+        out[4] = (uint8_t)(peer.session >> 8);
+        out[5] = peer.base;
+        out[6] = (uint8_t)(bitmap & 0xFF);
+        out[7] = (uint8_t)(bitmap >> 8);
+        return ACK_LENGTH;
+    }
+
+    void deliverInOrder(Peer& peer, DeliverCallback deliver) {
+        while (peer.rx[peer.base % WINDOW_SIZE].filled) {
+            RxSlot& next = peer.rx[peer.base % WINDOW_SIZE];
+            if (deliver) {
+                deliver(next.data, next.length, next.type, peer.source);
+            }
+            next.filled = false;
+            _delivered++;
+            peer.base++;
+        }
+    }
+
+    static uint16_t readWord(const uint8_t* in) {
+        return (uint16_t)in[0] | ((uint16_t)in[1] << 8);
+    }
+
+    void slideTxWindow() {
+        while (_txBase != _txNext && _tx[_txBase % WINDOW_SIZE].acked) {
+            _txBase++;
+        }
+    }
+
+    void updateRtt(unsigned long sample) {
+        if (_srtt == 0) {
+            _srtt = sample;
+            _rttvar = sample / 2;
+        } else {
+            unsigned long delta = sample > _srtt ? sample - _srtt : _srtt - sample;
+            _rttvar = (3 * _rttvar + delta) / 4;
+            _srtt = (7 * _srtt + sample) / 8;
+        }
+
+        _rto = _srtt + 4 * _rttvar;
+        if (_rto < MIN_RTO) {
+            _rto = MIN_RTO;
+        } else if (_rto > MAX_RTO) {
+            _rto = MAX_RTO;
+        }
+    }
+
+    TxSlot _tx[WINDOW_SIZE];
+    Peer _peers[MAX_PEERS];
+    uint8_t _txBase;
+    uint8_t _txNext;
+    uint16_t _source;
+    uint16_t _session;
+
+    unsigned long _srtt;
+    unsigned long _rttvar;
+    unsigned long _rto;
+
+    uint32_t _sent;
+    uint32_t _retransmitted;
+    uint32_t _failed;
+    uint32_t _delivered;
+    uint32_t _duplicates;
+    uint32_t _skipped;
+};
+
+#endif
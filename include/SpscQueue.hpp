@@ -0,0 +1,65 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// Exactly one task may push and exactly one other task may pop. Head and
+// tail only ever grow; the acquire/release pairs make the item copy visible
+// before the index that publishes it. CAPACITY must be a power of two.
+template<typename T, size_t CAPACITY>
+class SpscQueue {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    SpscQueue()
+        : _head(0),
+          _tail(0),
+          _dropped(0)
+    {}
+
+    // Producer side; false (and counted) if the queue is full
+    bool push(const T& item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= CAPACITY) {
+            _dropped++;
+            return false;
+        }
+        _items[head & (CAPACITY - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false if the queue is empty
+    bool pop(T& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[tail & (CAPACITY - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    // Written by the producer only
+    uint32_t getDroppedCount() const { return _dropped; }
+
+private:
+    T _items[CAPACITY];
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+    uint32_t _dropped;
+};
+
+#endif
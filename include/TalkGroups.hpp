@@ -0,0 +1,121 @@
+#ifndef TALK_GROUPS_HPP
+#define TALK_GROUPS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Talk-group and unit addressing.
+//
+// Every packet carries one address byte right after the length byte, the
+// one the CC1101 address filter compares against ADDR. Talk groups and
+// individual units share that byte:
+//
+//   0x00         all-call, heard by everyone
+//   0x01..0x7F   talk groups
+//   0x80..0xFE   unit addresses (private calls)
+//
+// A unit listening to a single address lets the radio filter: packets for
+// anybody else end two bytes after the sync word, GDO0 never fires and the
+// CPU keeps sleeping. Listening to several addresses (scanning groups, or
+// a group plus private calls) is beyond the one ADDR register; the filter
+// is switched off then and the address is checked in software, before any
+// FEC work is spent on the packet.
+class TalkGroups {
+public:
+    static const size_t ADDRESS_LENGTH = 1;
+    static const uint8_t ALL_CALL = 0x00;
+    static const uint8_t FIRST_UNIT = 0x80;
+    static const uint8_t MAX_ADDRESS = 0xFE;  // 0xFF is the CC1101's second broadcast address
+    static const size_t BITMAP_LENGTH = 32;
+
+    explicit TalkGroups(uint8_t talkGroup = 1) : _talkGroup(talkGroup) {
+        clear();
+        join(talkGroup);
+    }
+
+    // Listen to an address, the all-call is always heard
+    bool join(uint8_t address) {
+        if (address == ALL_CALL || address > MAX_ADDRESS) {
+            return false;
+        }
+        _members[address / 8] |= (uint8_t)(1 << (address % 8));
+        return true;
+    }
+
+    // The group we talk to is never left
+    bool leave(uint8_t address) {
+        if (address == _talkGroup || !isMember(address)) {
+            return false;
+        }
+        _members[address / 8] &= (uint8_t)~(1 << (address % 8));
+        return true;
+    }
+
+    bool isMember(uint8_t address) const {
+        return (_members[address / 8] & (1 << (address % 8))) != 0;
+    }
+
+    // Packet addressed to us, or to one of our groups
+    bool accepts(uint8_t address) const {
+        return address == ALL_CALL || isMember(address);
+    }
+
+    // Destination of our transmissions, joined as well
+    bool setTalkGroup(uint8_t address) {
+        if (!join(address)) {
+            return false;
+        }
+        _talkGroup = address;
+        return true;
+    }
+
+    uint8_t getTalkGroup() const { return _talkGroup; }
+
+    uint8_t getMemberCount() const {
+        uint8_t count = 0;
+        for (size_t i = 0; i < BITMAP_LENGTH; i++) {
+            count += (uint8_t)__builtin_popcount(_members[i]);
+        }
+        return count;
+    }
+
+    // A single address fits the radio's ADDR register
+    bool hardwareFilter() const { return getMemberCount() == 1; }
+
+    // Where a packet that passed the radio's filter was sent to: its
+    // single member, nobody sends to the all-call
+    uint8_t filteredAddress() const { return nextMember(ALL_CALL); }
+
+    // Next member after the given address, 0 when there is none; for listing
+    uint8_t nextMember(uint8_t after) const {
+        for (uint16_t address = (uint16_t)after + 1; address <= MAX_ADDRESS; address++) {
+            if (isMember((uint8_t)address)) {
+                return (uint8_t)address;
+            }
+        }
+        return 0;
+    }
+
+    static bool isUnit(uint8_t address) { return address >= FIRST_UNIT && address <= MAX_ADDRESS; }
+
+    const uint8_t* getBitmap() const { return _members; }
+
+    // From a stored bitmap, the talk group stays a member
+    void setBitmap(const uint8_t* bitmap) {
+        memcpy(_members, bitmap, BITMAP_LENGTH);
+        _members[0] &= (uint8_t)~1;
+        _members[BITMAP_LENGTH - 1] &= 0x7F;
+        join(_talkGroup);
+    }
+
+    void clear() {
+        memset(_members, 0, sizeof(_members));
+    }
+
+private:
+    uint8_t _talkGroup;
+    uint8_t _members[BITMAP_LENGTH];
+};
+
+#endif
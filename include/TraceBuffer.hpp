@@ -0,0 +1,155 @@
+#ifndef TRACE_BUFFER_HPP
+#define TRACE_BUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "MessageBuilder.hpp"
+
+#if defined(__XTENSA__)
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+// Trace timestamps: esp_timer microseconds on the ESP32-S3, nanoseconds of
+// steady_clock on a host. CCOUNT would be cheaper but counts at whatever
+// frequency the power manager picked, see PowerManager.
+#if defined(__XTENSA__)
+#define TRACE_CLOCK_MHZ 1
+#else
+#define TRACE_CLOCK_MHZ 1000
+#endif
+
+inline uint32_t traceClock() {
+#if defined(__XTENSA__)
+    return (uint32_t)esp_timer_get_time();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint8_t traceCore() {
+#if defined(__XTENSA__)
+    uint32_t prid;
+    __asm__ __volatile__("rsr %0, prid" : "=a"(prid));
+    return (uint8_t)((prid >> 13) & 1);
+#else
+    return 0;
+#endif
+}
+
+enum TracePhase : uint8_t {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i'
+};
+
+struct TraceEvent {
+    uint32_t clock;  // traceClock() when recorded
+    uint8_t point;   // Index into the name table
+    uint8_t phase;   // TracePhase
+    uint8_t core;
+    uint8_t reserved;
+};
+
+// Post-mortem trace ring.
+//
+// A trace point costs one clock read, one atomic increment and an 8 byte
+// store, so it can sit in ISRs and per-packet code. The ring always keeps
+// the most recent CAPACITY events; stop() freezes it and dump() renders
+// it in Chrome trace event JSON, which chrome://tracing and Perfetto load
+// directly. Writers never wait, an event being written while the ring is
+// dumped may come out torn, which a trace can live with.
+template<size_t CAPACITY>
+class TraceBuffer {
+public:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    typedef void (*TextCallback)(const char* text, size_t length);
+
+    TraceBuffer()
+        : _next(0),
+          _enabled(true)
+    {}
+
+    void record(uint8_t point, TracePhase phase) {
+        if (!_enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        TraceEvent& event = _events[_next.fetch_add(1, std::memory_order_relaxed) & (CAPACITY - 1)];
+        event.clock = traceClock();
+        event.point = point;
+        event.phase = phase;
+        event.core = traceCore();
+        event.reserved = 0;
+    }
+
+    void start() { _enabled.store(true, std::memory_order_relaxed); }
+    void stop() { _enabled.store(false, std::memory_order_relaxed); }
+
+    void clear() { _next.store(0, std::memory_order_relaxed); }
+
+    uint32_t getRecordedCount() const { return _next.load(std::memory_order_relaxed); }
+
+    // Oldest to newest as {"traceEvents":[...]}, times in microseconds
+    // relative to the oldest event of each core, one track (tid) per core.
+    void dump(const char* const* names, size_t nameCount, TextCallback callback) const {
+        uint32_t next = _next.load(std::memory_order_relaxed);
+        uint32_t count = next < CAPACITY ? next : (uint32_t)CAPACITY;
+
+        bool seen[2] = { false, false };
+        uint32_t previous[2] = { 0, 0 };
+        uint64_t elapsed[2] = { 0, 0 };
+
+        static const char header[] = "{\"traceEvents\":[\r\n";
+        callback(header, sizeof(header) - 1);
+        for (uint32_t i = 0; i < count; i++) {
+            const TraceEvent& event = _events[(next - count + i) & (CAPACITY - 1)];
+            uint8_t core = event.core & 1;
+
+            // The 32 bit clock wraps, every ~71 minutes on the ESP32-S3
+            if (seen[core]) {
+                elapsed[core] += (uint32_t)(event.clock - previous[core]);
+            }
+            seen[core] = true;
+            previous[core] = event.clock;
+
+            uint64_t nanos = elapsed[core] * 1000 / TRACE_CLOCK_MHZ;
+            uint32_t fraction = (uint32_t)(nanos % 1000);
+
+            MessageBuilder<112> line;
+            line.append("{\"name\":\"");
+            if (event.point < nameCount) {
+                line.append(names[event.point]);
+            } else {
+                line.append("point ").append((unsigned int)event.point);
+            }
+            line.append("\",\"ph\":\"").append((char)event.phase)
+                .append("\",\"ts\":").appendUnsigned((uint32_t)(nanos / 1000)).append('.');
+            if (fraction < 100) {
+                line.append('0');
+            }
+            if (fraction < 10) {
+                line.append('0');
+            }
+            line.appendUnsigned(fraction)
+                .append(",\"pid\":0,\"tid\":").append((unsigned int)core);
+            if (event.phase == TRACE_INSTANT) {
+                line.append(",\"s\":\"t\"");
+            }
+            line.append(i + 1 < count ? "},\r\n" : "}\r\n");
+            callback(line.c_str(), line.length());
+        }
+        static const char footer[] = "]}\r\n";
+        callback(footer, sizeof(footer) - 1);
+    }
+
+private:
+    TraceEvent _events[CAPACITY];
+    std::atomic<uint32_t> _next;
+    std::atomic<bool> _enabled;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TRACE_POINTS_HPP
+#define TRACE_POINTS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Trace points of the firmware, the names show up as slices in the trace
+// viewer. Instants mark ISRs, everything else is a begin/end pair.
+enum TracePoint : uint8_t {
+    TRACE_RX_ISR,
+    TRACE_TX_ISR,
+    TRACE_HOP_ISR,
+    TRACE_RADIO_LOOP,
+    TRACE_HANDLE_RX,
+    TRACE_HANDLE_TX,
+    TRACE_HOP,
+    TRACE_ENCODER,
+    TRACE_MESSAGES,
+    TRACE_POINT_COUNT
+};
+
+static const char* const TRACE_POINT_NAMES[TRACE_POINT_COUNT] = {
+    "rx_isr",
+    "tx_isr",
+    "hop_isr",
+    "radio_loop",
+    "handle_rx",
+    "handle_tx",
+    "hop",
+    "encoder",
+    "messages"
+};
+
+#endif
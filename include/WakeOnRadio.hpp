@@ -0,0 +1,269 @@
+#ifndef WAKE_ON_RADIO_HPP
+#define WAKE_ON_RADIO_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LinkFrame.hpp"
+#include "LinkAdaptation.hpp"
+
+// Duty-cycled receive with the CC1101 Wake-on-Radio timer.
+//
+// An idle receiver announces its wake interval in a FRAME_WOR and lets the
+// CC1101 sleep on its RC oscillator. Every interval the chip wakes by
+// itself, calibrates and listens just long enough to sense a carrier; only
+// a packet's sync word raises GDO0 and wakes the MCU. For that to work a
+// sender has to keep its preamble on air for a whole interval, so peers
+// that heard an announcement stretch their preamble to cover it (and cap
+// the link profile where 24 preamble bytes cannot). The first packet
+// handled wakes the receiver up fully; it announces interval 0 with its
+// next packet and sleeps again after idleTimeout without traffic.
+//
+// Announcements are not acknowledged, so sleepers are tracked per source
+// and a peer that announces awake does not end another one's long
+// preamble. When ARQ has to retransmit, the sleeping announcement may have
+// been lost: senders fall back to the longest interval heard (or their
+// own) until a frame is acknowledged again.
+class WakeOnRadio {
+public:
+    static const size_t ANNOUNCE_LENGTH = 3;
+
+    // CC1101 preamble lengths in bits, 192 (24 bytes) is the longest
+    static const uint8_t MAX_PREAMBLE_BITS = 192;
+    static const uint8_t DEFAULT_PREAMBLE_BITS = 16;
+
+    // Crystal start, synthesizer calibration and RSSI settling per wake
+    static const uint16_t WAKE_OVERHEAD_US = 2000;
+
+    // Sleeping peers remembered at once, the shortest interval goes first
+    static const uint8_t MAX_SLEEPERS = 4;
+
+    WakeOnRadio(uint16_t interval = 100, unsigned long idleTimeout = 2000)
+        : _interval(interval),
+          _idleTimeout(idleTimeout),
+          _state(AWAKE),
+          _announcePending(false),
+          _lastActivity(0),
+          _sleepStart(0),
+          _sleepTime(0),
+          _wakes(0),
+          _sleeperCount(0),
+          _longestInterval(0),
+          _fallback(false),
+          _peerInterval(0),
+          _peerChanged(false)
+    {}
+
+    // EVENT0 period in 750 / 26 MHz steps (WOR_RES = 0), up to ~1.9 s
+    uint16_t event0() const {
+        uint32_t steps = (uint32_t)_interval * 26000 / 750;
+        return steps > 0xFFFF ? 0xFFFF : (uint16_t)steps;
+    }
+
+    // Traffic either way keeps the receiver awake. Once the peer was told
+    // we sleep, it has to hear that we are back.
+    void onActivity(unsigned long now) {
+        _lastActivity = now;
+        if (_state == ASLEEP) {
+            _sleepTime += now - _sleepStart;
+            _wakes++;
+        }
+        if (_state != AWAKE) {
+            _state = AWAKE;
+            _announcePending = true;
+        }
+    }
+
+    // Nothing sent or received for idleTimeout while nothing is pending
+    bool shouldSleep(unsigned long now, bool busy) const {
+        return _state == AWAKE && !busy && now - _lastActivity >= _idleTimeout;
+    }
+
+    // The sleep announcement is on its way, the radio may sleep after it
+    bool readyToSleep() const { return _state == ANNOUNCED; }
+
+    void onSleep(unsigned long now) {
+        _state = ASLEEP;
+        _sleepStart = now;
+    }
+
+    bool isAsleep() const { return _state == ASLEEP; }
+
+    // Interval 0 tells the peer we listen continuously again
+    size_t buildAnnounce(uint8_t* out, bool sleeping) {
+        uint16_t interval = sleeping ? _interval : 0;
+        if (sleeping) {
+            _state = ANNOUNCED;
+        }
+        out[0] = FRAME_WOR;
+        out[1] = (uint8_t)interval;
+        out[2] = (uint8_t)(interval >> 8);
+        _announcePending = false;
+        return ANNOUNCE_LENGTH;
+    }
+
+    bool announcePending() const { return _announcePending; }
+
+    void onAnnounce(uint16_t source, const uint8_t* frame, size_t length) {
+        if (length < ANNOUNCE_LENGTH) {
+            return;
+        }
+        uint16_t interval = frame[1] | (uint16_t)(frame[2] << 8);
+        uint8_t i = findSleeper(source);
+        if (interval == 0) {
+            if (i < _sleeperCount) {
+                _sleepers[i] = _sleepers[--_sleeperCount];
+            }
+        } else {
+            if (i == _sleeperCount) {
+                if (_sleeperCount < MAX_SLEEPERS) {
+                    _sleeperCount++;
+                } else {
+                    i = shortestSleeper();
+                }
+                _sleepers[i].source = source;
+            }
+            _sleepers[i].interval = interval;
+            if (interval > _longestInterval) {
+                _longestInterval = interval;
+            }
+        }
+        updatePeerInterval();
+    }
+
+    // ARQ had to retransmit, the peer may sleep without us having heard
+    void onDeliveryTimeout() {
+        if (!_fallback) {
+            _fallback = true;
+            updatePeerInterval();
+        }
+    }
+
+    // An acknowledgement proves the peer hears the current preamble
+    void onDelivered() {
+        if (_fallback) {
+            _fallback = false;
+            updatePeerInterval();
+        }
+    }
+
+    bool isFallback() const { return _fallback; }
+
+    // Longest interval of all sleeping peers, the one the preamble spans
+    uint16_t getPeerInterval() const { return _peerInterval; }
+
+    // True once after the peer's interval changed
+    bool peerChanged() {
+        bool changed = _peerChanged;
+        _peerChanged = false;
+        return changed;
+    }
+
+    // Preamble that spans a wake interval at the given bit rate (kbps),
+    // 0 if even the longest preamble is too short
+    static uint8_t preambleBits(uint16_t interval, float bitRate) {
+        static const uint8_t lengths[] = { 16, 24, 32, 48, 64, 96, 128, 192 };
+        if (interval == 0) {
+            return DEFAULT_PREAMBLE_BITS;
+        }
+        float needed = ((float)interval + WAKE_OVERHEAD_US / 1000.0f) * bitRate;
+        for (uint8_t i = 0; i < sizeof(lengths); i++) {
+            if (lengths[i] >= needed) {
+                return lengths[i];
+            }
+        }
+        return 0;
+    }
+
+    // The longest preamble spans the interval at the given bit rate (kbps),
+    // for build-time checks against the slowest profile
+    static constexpr bool fitsPreamble(uint16_t interval, float bitRate) {
+        return (interval + WAKE_OVERHEAD_US / 1000.0f) * bitRate <= MAX_PREAMBLE_BITS;
+    }
+
+    // Fastest link profile whose longest preamble still spans the interval
+    static uint8_t maxProfile(uint16_t interval) {
+        uint8_t profile = 0;
+        for (uint8_t p = 1; p < RADIO_PROFILE_COUNT; p++) {
+            if (preambleBits(interval, RADIO_PROFILES[p].bitRate) != 0) {
+                profile = p;
+            }
+        }
+        return profile;
+    }
+
+    uint16_t getInterval() const { return _interval; }
+
+    // Time spent in WOR up to now, for duty cycle statistics
+    unsigned long getSleepTime(unsigned long now) const {
+        return _sleepTime + (_state == ASLEEP ? now - _sleepStart : 0);
+    }
+
+    uint32_t getWakeCount() const { return _wakes; }
+
+private:
+    enum State : uint8_t {
+        AWAKE,
+        ANNOUNCED,
+        ASLEEP
+    };
+
+    uint16_t _interval;
+    unsigned long _idleTimeout;
+    State _state;
+    bool _announcePending;
+    unsigned long _lastActivity;
+    unsigned long _sleepStart;
+    unsigned long _sleepTime;
+    uint32_t _wakes;
+
+    struct Sleeper {
+        uint16_t source;
+        uint16_t interval;
+    };
+
+    uint8_t findSleeper(uint16_t source) const {
+        uint8_t i = 0;
+        while (i < _sleeperCount && _sleepers[i].source != source) {
+            i++;
+        }
+        return i;
+    }
+
+    uint8_t shortestSleeper() const {
+        uint8_t shortest = 0;
+        for (uint8_t i = 1; i < _sleeperCount; i++) {
+            if (_sleepers[i].interval < _sleepers[shortest].interval) {
+                shortest = i;
+            }
+        }
+        return shortest;
+    }
+
+    void updatePeerInterval() {
+        uint16_t interval = 0;
+        for (uint8_t i = 0; i < _sleeperCount; i++) {
+            if (_sleepers[i].interval > interval) {
+                interval = _sleepers[i].interval;
+            }
+        }
+        if (_fallback) {
+            uint16_t longest = _longestInterval != 0 ? _longestInterval : _interval;
+            if (longest > interval) {
+                interval = longest;
+            }
+        }
+        if (interval != _peerInterval) {
+            _peerInterval = interval;
+            _peerChanged = true;
+        }
+    }
+
+    Sleeper _sleepers[MAX_SLEEPERS];
+    uint8_t _sleeperCount;
+    uint16_t _longestInterval;
+    bool _fallback;
+    uint16_t _peerInterval;
+    bool _peerChanged;
+};
+
+#endif
@@ -21,7 +21,37 @@
 
 #include <RadioLib.h>
 #include <SPI.h>
+#include <type_traits>
+#include <esp_sleep.h>
+#include <esp_random.h>
+#include <driver/gpio.h>
 #include "RotatoryEncoder.hpp"
+#include "LinkFrame.hpp"
+#include "SelectiveRepeatArq.hpp"
+#include "FrameFec.hpp"
+#include "FrameAggregator.hpp"
+#include "LinkAdaptation.hpp"
+#include "FrequencyHopper.hpp"
+#include "SpscQueue.hpp"
+#include "ArenaAllocator.hpp"
+#include "MessageBuilder.hpp"
+#include "BinaryLog.hpp"
+#include "LogEvents.hpp"
+#include "Metrics.hpp"
+#include "TraceBuffer.hpp"
+#include "TracePoints.hpp"
+#include "CommandConsole.hpp"
+#include "ConfigProfile.hpp"
+#include "ConfigStore.hpp"
+#include "WakeOnRadio.hpp"
+#include "PowerManager.hpp"
+#include "TalkGroups.hpp"
+#include "DuplicateCache.hpp"
+#include "MeshRelay.hpp"
+#include "FrameCipher.hpp"
+#include "MessageCompressor.hpp"
+#include "MessageFragments.hpp"
+#include "FastTurnaround.hpp"
 
 #define SCK_PIN 47
 #define MISO_PIN 45
@@ -59,201 +89,2583 @@ enum Mode {
   TRANSMIT
 };
 
+// Interval between text messages queued while in TRANSMIT mode
+#define MESSAGE_INTERVAL_MS 1000
+
+// Messages go out compressed against a preset dictionary whenever that
+// makes them shorter; decoding is always built in
+#ifndef COMPRESSION_ENABLED
+#define COMPRESSION_ENABLED 1
+#endif
+
+// Reed-Solomon protect every frame on air; the radio CRC is disabled so
+// partially corrupted frames reach the decoder instead of being dropped
+#ifndef FEC_ENABLED
+#define FEC_ENABLED 1
+#endif
+
+// How long small frames may wait to be packed together into one packet
+#define AGGREGATION_WINDOW_MS 40
+
+// How often RSSI/LQI reports are piggybacked on outgoing packets
+#define LINK_REPORT_INTERVAL_MS 1000
+
+// Hop over HOP_CHANNELS channels HOP_SPACING_MHZ apart, HOP_DWELL_MS on each.
+// Link profiles too slow to fit a full packet into the dwell time stay on
+// the rendezvous channel instead.
+#ifndef HOPPING_ENABLED
+#define HOPPING_ENABLED 1
+#endif
+#define HOP_BASE_MHZ 433.1
+#define HOP_SPACING_MHZ 0.1
+#define HOP_CHANNELS 16
+#define HOP_SEED 0x5A17C0DE
+#define HOP_DWELL_MS 100
+
+// Talk group (or unit address) heard and called until a profile or the
+// console says otherwise
+#define TALK_GROUP 1
+
+// Store-and-forward for units at the edge of range: mesh builds tag their
+// packets with source and sequence, units in relay mode (console "relay
+// on") rebroadcast what they hear. The delay window spans a few airtimes.
+#ifndef MESH_ENABLED
+#define MESH_ENABLED 0
+#endif
+#define RELAY_HOPS 3
+#define RELAY_MAX_DELAY_MS 60
+#define RELAY_SUPPRESS_COPIES 2
+
+// Repeats of confirmed data whose ACK got lost, and copies of sealed
+// packets, are recognised for this long before any work is spent on them
+#define RX_SEEN_MS 2000
+
+// AES-CCM per talk group, for the addresses a key was set for with the
+// console's key command; the others stay in the clear. Sealing or opening
+// a frame should fit into the budget, overruns are counted.
+#ifndef CRYPTO_ENABLED
+#define CRYPTO_ENABLED 1
+#endif
+#define CRYPTO_BUDGET_US 200
+
+// Turn the radio around without passing through IDLE: the CC1101 returns
+// to RX by itself after a packet (TXOFF_MODE), and frames that fit the
+// FIFO are written while it still listens and sent with a bare STX. Both
+// directions skip RadioLib's reconfiguration and the IDLE -> RX/TX
+// synthesizer start.
+#ifndef FAST_TURNAROUND_ENABLED
+#define FAST_TURNAROUND_ENABLED 1
+#endif
+#define TURNAROUND_TIMEOUT_US 100
+
+// Unicast data (to a unit address) is acknowledged right away: the
+// receiver answers ACK_SPACE_US after the end of the packet, and the
+// sender keeps the channel free for that ACK on a hardware timer instead
+// of waiting for it to ride on the receiver's next packet. Group traffic
+// (UNCONFIRMED in its ARQ session) keeps the piggybacked ACKs, members
+// answering at once would collide.
+#ifndef IMMEDIATE_ACK_ENABLED
+#define IMMEDIATE_ACK_ENABLED 1
+#endif
+#define ACK_SPACE_US 2000
+#define ACK_GUARD_US 1500  // Synthesizer start from IDLE and interrupt latency
+#define SPACE_STEP_US 50   // waitForSpace() yields this often in its last tick
+
+// Duty-cycled receive for battery units: after WOR_IDLE_MS without traffic
+// the CC1101 wakes every WOR_INTERVAL_MS on its own and the ESP32-S3 light
+// sleeps until a sync word. Needs a fixed channel, and the interval has to
+// fit into the longest preamble at the slowest profile (160 ms).
+#ifndef WOR_ENABLED
+#define WOR_ENABLED 0
+#endif
+#define WOR_INTERVAL_MS 100
+#define WOR_IDLE_MS 2000
+#define WOR_MIN_AWAKE_MS 50
+
+#if WOR_ENABLED && HOPPING_ENABLED
+#error "Wake-on-Radio needs a fixed channel, build with HOPPING_ENABLED=0"
+#endif
+#if WOR_ENABLED
+static_assert(WakeOnRadio::fitsPreamble(WOR_INTERVAL_MS, RADIO_PROFILES[0].bitRate),
+              "WOR_INTERVAL_MS has to fit into the longest preamble at the slowest profile");
+#endif
+
+// CPU at CPU_MIN_MHZ when idle and at CPU_MAX_MHZ (the board's f_cpu)
+// only while FEC, FIFO or message work is pending
+#ifndef POWER_MANAGEMENT_ENABLED
+#define POWER_MANAGEMENT_ENABLED 1
+#endif
+#define CPU_MAX_MHZ 240
+#define CPU_MIN_MHZ 80
+
+// Radio MAC and audio/application work run on separate cores
+#define RADIO_CORE 0
+#define AUDIO_CORE 1
+#define RADIO_TASK_PRIORITY 5
+#define AUDIO_TASK_PRIORITY 4
+#define LOG_TASK_PRIORITY 1
+
+// Stream raw log records for tools/logdecode instead of formatted text
+// (deferred formatting: the format strings stay out of the firmware)
+#ifndef LOG_BINARY_OUTPUT
+#define LOG_BINARY_OUTPUT 0
+#endif
+
+// Timestamped trace points on the hot path, dumped as Chrome trace JSON
+// by the console's trace command; 0 compiles them out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#define TRACE_EVENTS 1024
+
+// Named configuration profiles in NVS, the active one is restored at boot.
+// A first boot without one saves the defaults as CONFIG_DEFAULT_PROFILE.
+#define CONFIG_NAMESPACE "radio"
+#define CONFIG_DEFAULT_PROFILE "default"
+
+// How often the radio task publishes its state for the console, besides
+// right after a change
+#define STATUS_INTERVAL_MS 200
+
+// Large, latency-tolerant buffers live in PSRAM, hot per-packet buffers in
+// SRAM. The PSRAM arena is sized to the history and the long message pool.
+#define SRAM_ARENA_SIZE (4 * 1024)
+#define MESSAGE_HISTORY 1024
+
+// Messages beyond one ARQ payload go out in fragments; the receiver
+// reassembles this many at once and gives up on one after the timeout
+#define LONG_MESSAGE_MAX 4096
+#define REASSEMBLY_SLOTS 2
+#define REASSEMBLY_TIMEOUT_MS 10000
+
 int transmissionState = RADIOLIB_ERR_NONE;
 
 int countReceivedPackets = 0;
 
-Mode currentMode = RECEIVE;
+// Written by the audio task only, read by the radio task and the console
+std::atomic<Mode> currentMode(RECEIVE);
 Mode previousMode = RECEIVE;
-bool modeChanged = false;
+std::atomic<bool> modeChanged(false);
+
+// Console -> audio task, which owns the mode and the message timer
+SpscQueue<Mode, 2> modeQueue;
+
+// Reliable delivery for text/data messages
+SelectiveRepeatArq arq;
+uint8_t* txFrame = NULL;
+uint8_t* rxFrame = NULL;
+bool transmitting = false;
+
+// Our unit ID (provisioned, or the folded MAC until then), and the unit
+// the frames being handled came from
+uint16_t unitSource = 0;
+bool unitProvisioned = false;
+uint16_t rxSource = 0;
+bool rxConfirmed = false;  // ... and carried data it waits to have confirmed
+unsigned long lastMessageTime = 0;
+
+// Bit rate, deviation and codec mode follow the link quality
+LinkAdaptation linkAdaptation;
+unsigned long lastLinkReport = 0;
+bool linkReportQueued = false;
+
+// Room the source, mesh and cipher headers take in every packet we originate
+static const size_t PACKET_OVERHEAD = SOURCE_LENGTH + (MESH_ENABLED ? MeshRelay::HEADER_LENGTH : 0) +
+                                      (CRYPTO_ENABLED ? FrameCipher::OVERHEAD : 0);
+
+#if FEC_ENABLED
+FrameFec fec;
+uint8_t* airFrame = NULL;
+FrameAggregator aggregator(FrameFec::MAX_PAYLOAD - PACKET_OVERHEAD, AGGREGATION_WINDOW_MS);
+#else
+FrameAggregator aggregator(MAX_FRAME_LENGTH - TalkGroups::ADDRESS_LENGTH - PACKET_OVERHEAD, AGGREGATION_WINDOW_MS);
+#endif
+
+// Addresses we listen to; only the radio task changes them
+TalkGroups talkGroups(TALK_GROUP);
+
+#if MESH_ENABLED
+MeshRelay mesh(RELAY_HOPS, RELAY_MAX_DELAY_MS, RELAY_SUPPRESS_COPIES);
+#endif
+
+// Confirmed data frames by sender, session and sequence number; only the
+// radio task uses them
+DuplicateCache<128> framesSeen(RX_SEEN_MS);
+
+#if CRYPTO_ENABLED
+// Keys and counters, only used by the radio task
+FrameCipher cipher;
+
+// Console -> radio task, which owns the cipher and stores the key
+struct KeyChange {
+  uint8_t address;
+  bool clear;
+  uint8_t key[FrameCipher::KEY_LENGTH];
+};
+
+SpscQueue<KeyChange, 2> keyQueue;
+
+// Sealed packets by sender and counter, taken once authenticated
+DuplicateCache<64> sealedSeen(RX_SEEN_MS);
+#endif
+
+// Messages between the audio task and the radio task, the only shared state
+struct Message {
+  uint32_t queuedAt;  // micros() when it was pushed
+  uint16_t source;    // Sender of a delivered message
+  uint8_t type;       // FRAME_DATA, FRAME_PACKED or FRAME_FRAGMENT
+  uint8_t length;
+  uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+};
+
+SpscQueue<Message, 16> txQueue;  // audio -> radio
+SpscQueue<Message, 16> rxQueue;  // radio -> audio
+TaskHandle_t radioTaskHandle = NULL;
+
+Arena sramArena;
+Arena psramArena;
+
+// Hot paths log compact records, the log task formats them to Serial
+BinaryLog<512> eventLog;
+
+// Runtime metrics, updated from the radio path and ISRs, dumped by the
+// console's metrics command
+Counter radioInterrupts;
+Counter rxPackets;
+Counter rxCrcErrors;
+Counter rxFailures;
+Counter rxForeign;  // Addressed elsewhere, dropped by the software filter
+Counter meshDuplicates;  // Relayed copies of packets handled before
+Counter rxDuplicates;  // Repeated data and sealed packets handled before
+Counter rxRejected;  // Failed authentication, or clear for an encrypted group
+Counter txPackets;
+Counter txFailures;
+Counter txQueueOverflows;
+Counter rxQueueOverflows;
+Counter modeSwitches;
+Counter profileSwitches;
+LatencyHistogram irqLatency;    // Radio interrupt to the radio task handling it
+LatencyHistogram rxHandleTime;  // Read, decode and dispatch of one packet
+LatencyHistogram txQueueDelay;  // Message queued by the audio task until taken over by ARQ
+Counter payloadSaved;           // Message bytes compression kept off the air
+Counter unpackErrors;           // Delivered messages that failed to decompress
+Counter messagesReassembled;    // Long messages put back together
+LatencyHistogram txToRx;         // Transmission end until the radio task has the radio listening
+LatencyHistogram rxToTx;         // Frame encoded until the CC1101 is sending, FIFO sized frames
+Counter turnaroundFallbacks;     // Fast RX -> TX held back (channel busy), sent the slow way
+#if IMMEDIATE_ACK_ENABLED
+Counter immediateAcks;
+LatencyHistogram ackSpace;       // End of a unicast packet until our ACK for it is sent
+LatencyHistogram ackWaitTime;    // End of our unicast packet until the ACK is in
+Counter ackTimeouts;             // ACK windows that passed without one
+#endif
+LatencyHistogram cryptoTime;    // Sealing or opening one frame
+Counter cryptoOverruns;         // ... beyond CRYPTO_BUDGET_US
+Gauge sramUsed;                 // Arena bytes carved at boot
+Gauge psramUsed;
+Gauge poolInUse;                // Long message buffers, set by the audio task
+Gauge poolPeak;
+Gauge poolFailures;
+Gauge reassemblyTimeouts;       // Long messages given up on, set by the audio task
+Gauge reassemblyEvictions;
+MetricsRegistry metrics;
+
+// Frequency scaling, hot paths hold a PowerLock
+PowerManager power;
+
+// Boot phases, each stamped with micros() since reset when it completes
+enum BootPhase {
+  BOOT_SETUP,        // ROM, bootloader and core init up to setup()
+  BOOT_BUFFERS,
+  BOOT_RADIO_INIT,
+  BOOT_CONFIG,       // Profile restored or defaults configured
+  BOOT_RX_READY,     // Listening
+  BOOT_DIAGNOSTICS,  // Serial and the log task up
+  BOOT_DONE,
+  BOOT_PHASE_COUNT
+};
+
+Gauge bootPhases[BOOT_PHASE_COUNT];
+
+#if WOR_ENABLED
+Counter worWakes;
+Gauge worSleepTime;              // ms in Wake-on-Radio since boot
+LatencyHistogram worWakeLatency;  // Light sleep wake until the packet is handled
+#endif
+volatile uint32_t irqTimestamp = 0;
+
+// Radio parameters as last applied by the radio task, shown by the console
+struct RadioSettings {
+  float frequency;    // MHz
+  float bitRate;      // kbps
+  float freqDev;      // kHz
+  float rxBandwidth;  // kHz
+  int8_t power;       // dBm
+  uint16_t syncWord;
+};
+
+// radio.begin() defaults
+RadioSettings radioSettings = { 434.0, 4.8, 5.0, 135.0, 10, 0x12AD };
+
+enum RadioSetting : uint8_t {
+  SETTING_FREQUENCY,
+  SETTING_BIT_RATE,
+  SETTING_DEVIATION,
+  SETTING_BANDWIDTH,
+  SETTING_POWER,
+  SETTING_SYNC_WORD,
+  SETTING_TALK_GROUP,
+  SETTING_JOIN_GROUP,
+  SETTING_LEAVE_GROUP,
+  SETTING_RELAY,
+  SETTING_ADAPTATION, // Back to link adaptation after manual modem settings
+  SETTING_UNIT        // Stored, used from the next boot on
+};
+
+struct SettingChange {
+  RadioSetting setting;
+  float value;
+};
+
+// Console -> radio task, the radio is only ever touched from the radio task
+SpscQueue<SettingChange, 4> settingQueue;
+
+// MAC features of this build, profiles saved with others are not restored
+static const uint8_t BUILD_MAC_FLAGS = (FEC_ENABLED ? MAC_FEC : 0) | (HOPPING_ENABLED ? MAC_HOPPING : 0) | MAC_AGGREGATION |
+                                      (MESH_ENABLED ? MAC_MESH : 0);
+
+ConfigStore configStore;
+ConfigProfile activeProfile;  // Channel plan and settings the radio was started with
+
+// Console -> radio task. The radio task reads the chip registers and is
+// the only one to touch the store after boot.
+enum ProfileAction : uint8_t {
+  PROFILE_SAVE,
+  PROFILE_USE,     // Restore it at the next boot
+  PROFILE_DELETE
+};
+
+struct ProfileRequest {
+  char name[ConfigStore::MAX_NAME + 1];
+  ProfileAction action;
+  bool activate;  // PROFILE_SAVE: restore it at the next boot as well
+};
+
+SpscQueue<ProfileRequest, 2> profileQueue;
+
+// Radio task state the console shows. The radio task publishes a copy
+// every STATUS_INTERVAL_MS and after changes, the log task keeps the
+// latest; neither reads the other's objects.
+struct RadioStatus {
+  RadioSettings settings;
+  uint8_t talkGroup;
+  uint8_t members[TalkGroups::BITMAP_LENGTH];
+  bool radioFilter;
+  bool manualModem;  // Link adaptation pinned off by console settings
+  uint16_t source;
+  bool provisioned;
+#if MESH_ENABLED
+  bool relay;
+  uint32_t relayed;
+  uint32_t duplicates;
+  uint32_t suppressed;
+  uint32_t overflows;
+  uint32_t evictions;
+#endif
+#if CRYPTO_ENABLED
+  uint8_t keys[TalkGroups::BITMAP_LENGTH];
+  uint32_t sealed;
+  uint32_t opened;
+  uint32_t failures;
+  uint32_t replays;
+  uint32_t conflicts;
+#endif
+};
+
+SpscQueue<RadioStatus, 2> statusQueue;  // radio -> log
+RadioStatus radioStatus;                // Owned by the log task
+bool statusChanged = true;              // Radio task
+unsigned long lastStatus = 0;
+
+#if TRACE_ENABLED
+// Written from ISRs, so it stays in internal RAM
+TraceBuffer<TRACE_EVENTS> traceBuffer;
+#define TRACE(point, phase) traceBuffer.record(point, phase)
+#else
+#define TRACE(point, phase) do {} while (0)
+#endif
+
+// Every delivered message is recorded, oldest entries are overwritten
+Message* messageHistory = NULL;
+size_t messageHistoryCapacity = 0;
+uint32_t messageHistoryCount = 0;
+
+// Long messages, both ends owned by the audio task. Their buffers come from
+// a pool of LONG_MESSAGE_MAX blocks, one per reassembly slot and one for the
+// message going out. The console asks for a test message of the given
+// length through bulkRequest and reads their counts from the metrics.
+Pool longMessages;
+uint8_t* longMessage = NULL;  // Being fragmented, NULL when idle
+Fragmenter fragmenter;
+Reassembler reassembler(REASSEMBLY_TIMEOUT_MS);
+std::atomic<uint16_t> bulkRequest(0);
+
+#if WOR_ENABLED
+WakeOnRadio wor(WOR_INTERVAL_MS, WOR_IDLE_MS);
+unsigned long worWokeAt = 0;
+uint32_t worWakeMicros = 0;  // ESP32-S3 left light sleep
+uint32_t worRetransmitted = 0;  // ARQ retransmissions seen so far
+#endif
+
+#if HOPPING_ENABLED
+FrequencyHopper hopper(HOP_BASE_MHZ, HOP_SPACING_MHZ, HOP_CHANNELS, HOP_SEED, HOP_DWELL_MS);
+hw_timer_t* hopTimer = NULL;
+#endif
+
+#if IMMEDIATE_ACK_ENABLED
+hw_timer_t* ackTimer = NULL;
+volatile bool ackTimedOut = false;
+uint32_t ackWindow = 0;     // Set for the unicast packet going out, in us from its end
+bool ackWaiting = false;    // Channel kept free for the receiver's ACK
+uint32_t ackWaitStart = 0;
+bool dataAggregated = false;  // ARQ data frames in the aggregator
+#endif
 
 // Flag to indicate that a packet was received and sent
 volatile bool receivedFlag = false;
 volatile bool transmittedFlag = false;
 
+// Let the radio task run right away instead of at its next poll
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
+void wakeRadioTask(void) {
+  if (radioTaskHandle != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(radioTaskHandle, &woken);
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
 // This function is called when a complete packet is received by the module
 // IMPORTANT: this function MUST be 'void' type and MUST NOT have any arguments!
 #if defined(ESP8266) || defined(ESP32)
   ICACHE_RAM_ATTR
 #endif
 void setReceiveFlag(void) {
+  TRACE(TRACE_RX_ISR, TRACE_INSTANT);
+  irqTimestamp = micros();
+  radioInterrupts.add();
   receivedFlag = true; // We got a packet, set the flag
+  wakeRadioTask();
 }
 
+#if defined(ESP8266) || defined(ESP32)
+  ICACHE_RAM_ATTR
+#endif
 void setSentFlag(void) {
+  TRACE(TRACE_TX_ISR, TRACE_INSTANT);
+  irqTimestamp = micros();
+  radioInterrupts.add();
   transmittedFlag = true; // We sent a packet, set the flag
+  wakeRadioTask();
 }
 
-void setup() {
-  Serial.begin(115200);
-  rotatoryEncoder.begin();
-  
-  spi.begin(SCK_PIN, MISO_PIN, MOSI_PIN, -1);
+#if HOPPING_ENABLED
+// Hop timer interrupt, the retune itself happens in the radio task
+void IRAM_ATTR onHopTimer(void) {
+  TRACE(TRACE_HOP_ISR, TRACE_INSTANT);
+  hopper.tick();
+  wakeRadioTask();
+}
 
-  // Initialize CC1101 with default settings
-  Serial.print(F("[CC1101] Initializing ... "));
-  int state = radio.begin();
-  if (state == RADIOLIB_ERR_NONE) {
-    Serial.println(F("success!"));
-  } else {
-    Serial.print(F("failed, code "));
-    Serial.println(state);
-    while (true) { delay(10); }
+// Calibrate the synthesizer once per channel and keep the results, so hops
+// only need to write the frequency and calibration registers
+void calibrateHopChannels() {
+  Module* mod = radio.getMod();
+  for (uint8_t ch = 0; ch < hopper.getChannelCount(); ch++) {
+    radio.setFrequency(hopper.channelFrequency(ch));
+    radio.startReceive();  // IDLE -> RX runs the automatic calibration
+    delay(1);
+
+    uint8_t fscal[3];
+    fscal[0] = mod->SPIgetRegValue(RADIOLIB_CC1101_REG_FSCAL3);
+    fscal[1] = mod->SPIgetRegValue(RADIOLIB_CC1101_REG_FSCAL2);
+    fscal[2] = mod->SPIgetRegValue(RADIOLIB_CC1101_REG_FSCAL1);
+    hopper.setCalibration(ch, fscal);
+    radio.standby();
   }
 
-  // Set callback for packet reception and transmission
-  radio.setPacketReceivedAction(setReceiveFlag);
-  radio.setPacketSentAction(setSentFlag);
+  // Stored calibration values are used from now on
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_MCSM0, RADIOLIB_CC1101_FS_AUTOCAL_NEVER, 5, 4);
+}
 
-  // Start listening for packets
-  Serial.print(F("[CC1101] Starting to listen ... "));
-  state = radio.startReceive();
-  if (state == RADIOLIB_ERR_NONE) {
-    Serial.println(F("success!"));
-  } else {
-    Serial.print(F("failed, code "));
-    Serial.println(state);
-    while (true) { delay(10); }
+// Retune to the channel of the current hop slot
+void applyHop() {
+  TRACE(TRACE_HOP, TRACE_BEGIN);
+  const FrequencyHopper::ChannelRegisters& regs = hopper.currentRegisters();
+  Module* mod = radio.getMod();
+  radio.standby();
+  mod->SPIwriteRegisterBurst(RADIOLIB_CC1101_REG_FREQ2 | RADIOLIB_CC1101_CMD_BURST, regs.freq, 3);
+  mod->SPIwriteRegisterBurst(RADIOLIB_CC1101_REG_FSCAL3 | RADIOLIB_CC1101_CMD_BURST, regs.fscal, 3);
+  radio.startReceive();
+  hopper.onHop(millis());
+  radioSettings.frequency = hopper.channelFrequency(hopper.currentChannel());
+  TRACE(TRACE_HOP, TRACE_END);
+}
+
+// Hop only while a full packet fits the dwell time at the current bit
+// rate, slower ones park on the rendezvous channel
+void applyHopParking() {
+  bool park = airtimeUs(MAX_FRAME_LENGTH, radioSettings.bitRate) > hopper.getDwellTime() * 1000UL;
+  if (hopper.setParked(park)) {
+    applyHop();
   }
 }
 
-void handleReceivedPacket() {
-  if (modeChanged) {
-    // Start listening for packets
-    Serial.print(F("[CC1101] Starting to listen ... "));
-    int state = radio.startReceive();
-    if (state == RADIOLIB_ERR_NONE) {
-      Serial.println(F("Success!"));
-    } else {
-      Serial.print(F("Failed, code "));
-      Serial.println(state);
-      while (true) { delay(10); }
-    }
+void startHopTimer() {
+  // 1 MHz timer ticks, alarm once per dwell period
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  hopTimer = timerBegin(1000000);
+  timerAttachInterrupt(hopTimer, onHopTimer);
+  timerAlarm(hopTimer, hopper.getDwellTime() * 1000ULL, true, 0);
+#else
+  hopTimer = timerBegin(0, 80, true);
+  timerAttachInterrupt(hopTimer, onHopTimer, true);
+  timerAlarmWrite(hopTimer, hopper.getDwellTime() * 1000ULL, true);
+  timerAlarmEnable(hopTimer);
+#endif
+}
+#endif
+
+#if IMMEDIATE_ACK_ENABLED
+// End of the ACK window, the channel is ours again
+void IRAM_ATTR onAckTimer(void) {
+  ackTimedOut = true;
+  wakeRadioTask();
+}
+
+// 1 MHz one-shot timer, armed per unicast packet
+void startAckTimer() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ackTimer = timerBegin(1000000);
+  timerAttachInterrupt(ackTimer, onAckTimer);
+  timerStop(ackTimer);
+#else
+  ackTimer = timerBegin(1, 80, true);
+  timerAttachInterrupt(ackTimer, onAckTimer, true);
+#endif
+}
+
+void armAckTimer(uint32_t timeout) {
+  ackTimedOut = false;
+  timerWrite(ackTimer, 0);
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  timerAlarm(ackTimer, timeout, false, 0);
+  timerStart(ackTimer);
+#else
+  timerAlarmWrite(ackTimer, timeout, false);
+  timerAlarmEnable(ackTimer);
+#endif
+}
+
+void cancelAckTimer() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  timerStop(ackTimer);
+#else
+  timerAlarmDisable(ackTimer);
+#endif
+}
+#endif
+
+void radioTask(void* parameter);
+void audioTask(void* parameter);
+
+// Diagnostic lines are formatted on the stack and written in one go
+typedef MessageBuilder<96> LogLine;
+
+void printLine(LogLine& line) {
+  line.append("\r\n");
+  Serial.write(line.data(), line.length());
+}
+
+// Where LOG_EVENT() records go
+void logWrite(LogEvent event) {
+  eventLog.write(event, micros());
+}
+
+void logWrite(LogEvent event, int32_t a) {
+  eventLog.write(event, micros(), 1, a);
+}
+
+void logWrite(LogEvent event, int32_t a, int32_t b) {
+  eventLog.write(event, micros(), 2, a, b);
+}
+
+void logTask(void* parameter);
+
+void markBootPhase(BootPhase phase) {
+  bootPhases[phase].set(micros());
+}
+
+void registerMetrics() {
+  metrics.add("radio_irqs", radioInterrupts);
+  metrics.add("rx_packets", rxPackets);
+  metrics.add("rx_crc_errors", rxCrcErrors);
+  metrics.add("rx_failures", rxFailures);
+  metrics.add("rx_foreign", rxForeign);
+  metrics.add("mesh_duplicates", meshDuplicates);
+  metrics.add("rx_duplicates", rxDuplicates);
+  metrics.add("rx_rejected", rxRejected);
+  metrics.add("tx_packets", txPackets);
+  metrics.add("tx_failures", txFailures);
+  metrics.add("tx_queue_overflows", txQueueOverflows);
+  metrics.add("rx_queue_overflows", rxQueueOverflows);
+  metrics.add("mode_switches", modeSwitches);
+  metrics.add("profile_switches", profileSwitches);
+  metrics.add("irq_latency_us", irqLatency);
+  metrics.add("rx_handle_us", rxHandleTime);
+  metrics.add("tx_queue_delay_us", txQueueDelay);
+  metrics.add("tx_to_rx_us", txToRx);
+  metrics.add("rx_to_tx_us", rxToTx);
+  metrics.add("turnaround_fallbacks", turnaroundFallbacks);
+#if IMMEDIATE_ACK_ENABLED
+  metrics.add("acks_immediate", immediateAcks);
+  metrics.add("ack_space_us", ackSpace);
+  metrics.add("ack_wait_us", ackWaitTime);
+  metrics.add("ack_timeouts", ackTimeouts);
+#endif
+  metrics.add("payload_saved_bytes", payloadSaved);
+  metrics.add("unpack_errors", unpackErrors);
+  metrics.add("messages_reassembled", messagesReassembled);
+  metrics.add("sram_used_bytes", sramUsed);
+  metrics.add("psram_used_bytes", psramUsed);
+  metrics.add("pool_in_use", poolInUse);
+  metrics.add("pool_peak", poolPeak);
+  metrics.add("pool_failures", poolFailures);
+  metrics.add("reassembly_timeouts", reassemblyTimeouts);
+  metrics.add("reassembly_evictions", reassemblyEvictions);
+#if CRYPTO_ENABLED
+  metrics.add("crypto_us", cryptoTime);
+  metrics.add("crypto_overruns", cryptoOverruns);
+#endif
+  metrics.add("boot_setup_us", bootPhases[BOOT_SETUP]);
+  metrics.add("boot_buffers_us", bootPhases[BOOT_BUFFERS]);
+  metrics.add("boot_radio_init_us", bootPhases[BOOT_RADIO_INIT]);
+  metrics.add("boot_config_us", bootPhases[BOOT_CONFIG]);
+  metrics.add("boot_rx_ready_us", bootPhases[BOOT_RX_READY]);
+  metrics.add("boot_diagnostics_us", bootPhases[BOOT_DIAGNOSTICS]);
+  metrics.add("boot_done_us", bootPhases[BOOT_DONE]);
+#if WOR_ENABLED
+  metrics.add("wor_wakes", worWakes);
+  metrics.add("wor_sleep_ms", worSleepTime);
+  metrics.add("wor_wake_us", worWakeLatency);
+#endif
+}
+
+// Serial and the log task come up after the radio listens; events logged
+// before that wait in the ring
+void startDiagnostics() {
+  static bool started = false;
+  if (started) {
+    return;
   }
+  started = true;
+  Serial.begin(115200);
+  xTaskCreatePinnedToCore(logTask, "log", 4096, NULL, LOG_TASK_PRIORITY, NULL, AUDIO_CORE);
+}
 
-  if(receivedFlag) {
-    receivedFlag = false;
+// Unrecoverable error: get the log out, then stop
+void halt() {
+  startDiagnostics();
+  while (true) { delay(10); }
+}
+
+void writeSerial(const char* text, size_t length) {
+  Serial.write((const uint8_t*)text, length);
+}
 
-    // You can read received data as an Arduino String
-    String str;
-    int state = radio.readData(str);
+// Set callback for packet reception and transmission
+void attachRadioInterrupts() {
+  radio.setPacketReceivedAction(setReceiveFlag);
+  radio.setPacketSentAction(setSentFlag);
+}
 
-    // You can also read received data as byte array
-    /*
-      byte byteArr[8];
-      int numBytes = radio.getPacketLength();
-      int state = radio.readData(byteArr, numBytes);
-    */
+// Switch modulation, the radio has to be out of transmit
+void applyRadioProfile(const RadioProfile& profile) {
+  radio.setBitRate(profile.bitRate);
+  radio.setFrequencyDeviation(profile.freqDev);
+  radio.setRxBandwidth(profile.rxBandwidth);
+  radioSettings.bitRate = profile.bitRate;
+  radioSettings.freqDev = profile.freqDev;
+  radioSettings.rxBandwidth = profile.rxBandwidth;
+#if HOPPING_ENABLED
+  applyHopParking();
+#endif
+}
 
-    if (state == RADIOLIB_ERR_NONE) {
-      // Packet was successfully received
-      Serial.println(F("[CC1101] Received packet!"));
+// Snapshot of the running configuration, chip registers included
+void captureProfile(ConfigProfile& profile) {
+  profile = activeProfile;
+  profile.frequency = radioSettings.frequency;
+  profile.bitRate = radioSettings.bitRate;
+  profile.freqDev = radioSettings.freqDev;
+  profile.rxBandwidth = radioSettings.rxBandwidth;
+  profile.power = radioSettings.power;
+  profile.syncWord = radioSettings.syncWord;
+  profile.maxLinkProfile = linkAdaptation.getMaxProfile();
+  profile.macFlags = BUILD_MAC_FLAGS;
+  profile.talkGroup = talkGroups.getTalkGroup();
+  memcpy(profile.talkGroups, talkGroups.getBitmap(), sizeof(profile.talkGroups));
+  profile.manualModem = linkAdaptation.isManual() ? 1 : 0;
+  if (!profile.manualModem) {
+    // Adapted rates are negotiated again after a boot, from the bottom
+    const RadioProfile& base = RADIO_PROFILES[0];
+    profile.bitRate = base.bitRate;
+    profile.freqDev = base.freqDev;
+    profile.rxBandwidth = base.rxBandwidth;
+  }
 
-      // Print data of the packet
-      Serial.print(F("[CC1101] Data:\t\t"));
-      Serial.println(str);
+  Module* mod = radio.getMod();
+  mod->SPIreadRegisterBurst(RADIOLIB_CC1101_REG_IOCFG2 | RADIOLIB_CC1101_CMD_BURST, CC1101_CONFIG_REGISTERS, profile.registers);
+  profile.registersValid = 1;
 
-      // Print RSSI (Received Signal Strength Indicator) of the last received packet
-      Serial.print(F("[CC1101] RSSI:\t\t"));
-      Serial.print(radio.getRSSI());
-      Serial.println(F(" dBm"));
+#if HOPPING_ENABLED
+  for (uint8_t ch = 0; ch < hopper.getChannelCount(); ch++) {
+    memcpy(profile.fscal[ch], hopper.registers(ch).fscal, 3);
+  }
+  profile.calibrated = 1;
+#endif
+}
 
-      // Print LQI (Link Quality Indicator) of the last received packet, lower is better
-      Serial.print(F("[CC1101] LQI:\t\t"));
-      Serial.println(radio.getLQI());
+// Bring the radio to a stored profile right after radio.begin(). With a
+// register snapshot this is a single burst instead of one verified
+// read-modify-write per setting. Unless the modem was set by hand, link
+// adaptation then puts it on the profile it starts from, like the peers.
+// False (radio untouched) if the profile was saved by a build with
+// different MAC features.
+bool restoreProfile(const ConfigProfile& profile) {
+  if (profile.macFlags != BUILD_MAC_FLAGS) {
+    return false;
+  }
 
-    } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
-      // Packet was received, but is malformed
-      Serial.println(F("CRC error!"));
+  if (profile.registersValid) {
+    Module* mod = radio.getMod();
+    radio.standby();
+    mod->SPIwriteRegisterBurst(RADIOLIB_CC1101_REG_IOCFG2 | RADIOLIB_CC1101_CMD_BURST, profile.registers, CC1101_CONFIG_REGISTERS);
+  } else {
+    radio.setFrequency(profile.frequency);
+    radio.setBitRate(profile.bitRate);
+    radio.setFrequencyDeviation(profile.freqDev);
+    radio.setRxBandwidth(profile.rxBandwidth);
+    radio.setSyncWord((uint8_t)(profile.syncWord >> 8), (uint8_t)profile.syncWord);
+  }
+  // PATABLE is not part of the burst; this also keeps RadioLib's cached power
+  radio.setOutputPower(profile.power);
 
-    } else {
-      // Some other error occurred
-      Serial.print(F("Failed, code "));
-      Serial.println(state);
+  radioSettings.frequency = profile.frequency;
+  radioSettings.bitRate = profile.bitRate;
+  radioSettings.freqDev = profile.freqDev;
+  radioSettings.rxBandwidth = profile.rxBandwidth;
+  radioSettings.power = profile.power;
+  radioSettings.syncWord = profile.syncWord;
+  linkAdaptation.setMaxProfile(profile.maxLinkProfile);
+  if (talkGroups.setTalkGroup(profile.talkGroup)) {
+    talkGroups.setBitmap(profile.talkGroups);
+  }
 
+#if HOPPING_ENABLED
+  hopper.setChannelPlan(profile.hopBase, profile.hopSpacing, profile.hopChannels, profile.hopSeed, profile.hopDwell);
+  if (profile.calibrated) {
+    for (uint8_t ch = 0; ch < hopper.getChannelCount(); ch++) {
+      hopper.setCalibration(ch, profile.fscal[ch]);
     }
+  }
+#endif
+  if (profile.manualModem) {
+    linkAdaptation.setManual(true);
+#if HOPPING_ENABLED
+    applyHopParking();
+#endif
+  } else {
+    applyRadioProfile(linkAdaptation.getRadioProfile());
+  }
+  activeProfile = profile;
+  return true;
+}
 
-    // Put module back to listen mode
-    radio.startReceive();
+// Profile commands from the console, run in the radio task
+void handleProfileRequest(const ProfileRequest& request) {
+  ConfigProfile profile;
+  switch (request.action) {
+    case PROFILE_SAVE:
+      captureProfile(profile);
+      if (!configStore.save(request.name, profile) || (request.activate && !configStore.setActive(request.name))) {
+        LOG_EVENT(LOG_CONFIG_SAVE_FAILED);
+      }
+      break;
+    case PROFILE_USE:
+      // Takes effect with the next boot
+      if (!configStore.load(request.name, profile)) {
+        LOG_EVENT(LOG_CONFIG_NOT_FOUND);
+      } else if (!configStore.setActive(request.name)) {
+        LOG_EVENT(LOG_CONFIG_STORAGE_FAILED);
+      }
+      break;
+    case PROFILE_DELETE:
+      if (!configStore.remove(request.name)) {
+        LOG_EVENT(LOG_CONFIG_NOT_FOUND);
+      }
+      break;
   }
 }
 
-void handleSentPacket() {
-  transmissionState = RADIOLIB_ERR_NONE;
+// Single command strobe, RadioLib keeps its own helper for this private
+void strobe(uint8_t command) {
+  digitalWrite(CS_PIN, LOW);
+  spi.beginTransaction(spiSettings);
+  spi.transfer(command);
+  spi.endTransaction();
+  digitalWrite(CS_PIN, HIGH);
+}
 
-  if (modeChanged) {
-    // Start transmitting the first packet
-    Serial.print(F("[CC1101] Sending first packet ... "));
+#if WOR_ENABLED
+// Preamble long enough to wake the peer at the current profile, and the
+// profile cap that makes this possible at all
+void applyWakePreamble() {
+  uint16_t interval = wor.getPeerInterval();
+  uint8_t cap = activeProfile.maxLinkProfile;
+  if (interval != 0 && WakeOnRadio::maxProfile(interval) < cap) {
+    cap = WakeOnRadio::maxProfile(interval);
+  }
+  linkAdaptation.setMaxProfile(cap);
+
+  uint8_t bits = WakeOnRadio::preambleBits(interval, linkAdaptation.getRadioProfile().bitRate);
+  radio.setPreambleLength(bits != 0 ? bits : WakeOnRadio::MAX_PREAMBLE_BITS, 0);
+}
 
-    // You can transmit C-string or Arduino string up to 255 characters long
-    transmissionState = radio.startTransmit("Hello World!");
+// GDO0 set up for sync/end of packet, then from IDLE into WOR
+void resumeWakeOnRadio() {
+  radio.startReceive();
+  strobe(RADIOLIB_CC1101_CMD_IDLE);
+  strobe(RADIOLIB_CC1101_CMD_WOR);
+}
 
-    // You can also transmit byte array up to 255 bytes long
-    // When transmitting more than 64 bytes startTransmit blocks to refill the FIFO.
-    // Blocking ceases once the last bytes have been placed in the FIFO
-    /*
-      byte byteArr[] = {0x01, 0x23, 0x45, 0x56,
-                        0x78, 0xAB, 0xCD, 0xEF};
-      state = radio.startTransmit(byteArr, 8);
-    */
+// Hand receiving over to the CC1101 WOR timer, after the announcement
+// went out. Both ends drop to the profile the wake preamble allows.
+void enterWakeOnRadio(unsigned long now) {
+  linkAdaptation.setMaxProfile(WakeOnRadio::maxProfile(wor.getInterval()));
+  if (linkAdaptation.profileChanged()) {
+    applyRadioProfile(linkAdaptation.getRadioProfile());
   }
 
-  // Check if the previous transmission finished
-  if(transmittedFlag) {
-    transmittedFlag = false;
+  Module* mod = radio.getMod();
+  uint16_t event0 = wor.event0();
+  radio.standby();
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_WOREVT1, event0 >> 8);
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_WOREVT0, event0 & 0xFF);
+  // RC oscillator on, EVENT1 = 7 (1.3 ms crystal start), RC calibration, WOR_RES = 0
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_WORCTRL, 0x78);
+  // RX_TIME_RSSI: leave RX right away without carrier, else stay to the packet end
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_MCSM2, 0x17);
 
-    if (transmissionState == RADIOLIB_ERR_NONE) {
-      // Packet was successfully sent
-      Serial.println(F("Transmission finished!"));
+  resumeWakeOnRadio();
+  wor.onSleep(now);
+}
 
-      // NOTE: When using interrupt-driven transmit method,
-      //       it is not possible to automatically measure
-      //       transmission data rate using getDataRate()
+// Back to continuous receive, SIDLE in startReceive() stops the WOR timer
+void exitWakeOnRadio() {
+  Module* mod = radio.getMod();
+  mod->SPIsetRegValue(RADIOLIB_CC1101_REG_MCSM2, 0x07);
+  linkAdaptation.setMaxProfile(activeProfile.maxLinkProfile);
+  radio.startReceive();
+}
 
-    } else {
-      Serial.print(F("Failed, code "));
-      Serial.println(transmissionState);
-    }
+// Both cores stop until the CC1101 raises GDO0 on a sync word or the
+// button is pressed. Level wakeup reprograms the pin interrupts, so they
+// are attached again afterwards.
+void lightSleepUntilRadio() {
+  gpio_wakeup_enable((gpio_num_t)GDO0_PIN, GPIO_INTR_HIGH_LEVEL);
+  gpio_wakeup_enable((gpio_num_t)SWITCH_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  power.onSleep();
+  esp_light_sleep_start();
+  power.onWake();
+  worWakeMicros = micros();
+  worWokeAt = millis();
+  gpio_wakeup_disable((gpio_num_t)GDO0_PIN);
+  gpio_wakeup_disable((gpio_num_t)SWITCH_PIN);
+  attachRadioInterrupts();
+}
+#endif
 
-    // Clean up after transmission is finished
-    // This will ensure transmitter is disabled,
-    // RF switch is powered down etc.
-    radio.finishTransmit();
+// One address is filtered by the radio, more are checked in software. A
+// relay has to hear everything.
+bool radioAddressFilter() {
+#if MESH_ENABLED
+  if (mesh.isEnabled()) {
+    return false;
+  }
+#endif
+  return talkGroups.hardwareFilter();
+}
+
+void applyAddressFilter() {
+  if (radioAddressFilter()) {
+    // ADDR plus the 0x00 all-call
+    radio.setNodeAddress(talkGroups.nextMember(TalkGroups::ALL_CALL), 1);
+  } else {
+    radio.disableAddressFiltering();
+  }
+}
+
+// The CC1101 as FastTurnaround sees it, through RadioLib's module
+struct RadioChip {
+  void setRegister(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb) {
+    radio.getMod()->SPIsetRegValue(reg, value, msb, lsb);
+  }
+  uint8_t readRegister(uint8_t reg) {
+    return radio.getMod()->SPIgetRegValue(reg);
+  }
+  void writeBurst(uint8_t reg, const uint8_t* data, size_t length) {
+    radio.getMod()->SPIwriteRegisterBurst(reg, data, length);
+  }
+  void strobe(uint8_t command) { ::strobe(command); }
+  uint32_t micros() { return ::micros(); }
+};
 
-    delay(1000);
+// TX and RX FIFOs hold 64 bytes each
+static const size_t CC1101_FIFO_SIZE = FastTurnaround<RadioChip>::FIFO_SIZE;
 
-    Serial.print(F("[CC1101] Sending another packet ... "));
+#if FAST_TURNAROUND_ENABLED
+RadioChip radioChip;
+
+// Ready once RadioLib has sent a packet and mapped GDO0 for it
+FastTurnaround<RadioChip> turnaround(radioChip, TURNAROUND_TIMEOUT_US);
+#endif
+
+// Apply a console change, the radio has to be out of transmit
+void applySetting(const SettingChange& change) {
+  int state = RADIOLIB_ERR_NONE;
+  switch (change.setting) {
+    case SETTING_FREQUENCY:
+      state = radio.setFrequency(change.value);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.frequency = change.value;
+      }
+      break;
+    // Modem settings by hand pin link adaptation off, it would undo them
+    case SETTING_BIT_RATE:
+      state = radio.setBitRate(change.value);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.bitRate = change.value;
+        linkAdaptation.setManual(true);
+#if HOPPING_ENABLED
+        applyHopParking();
+#endif
+      }
+      break;
+    case SETTING_DEVIATION:
+      state = radio.setFrequencyDeviation(change.value);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.freqDev = change.value;
+        linkAdaptation.setManual(true);
+      }
+      break;
+    case SETTING_BANDWIDTH:
+      state = radio.setRxBandwidth(change.value);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.rxBandwidth = change.value;
+        linkAdaptation.setManual(true);
+      }
+      break;
+    case SETTING_ADAPTATION:
+      // The profile change is applied with the next link check
+      linkAdaptation.setManual(false);
+      break;
+    case SETTING_POWER:
+      state = radio.setOutputPower((int8_t)change.value);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.power = (int8_t)change.value;
+      }
+      break;
+    case SETTING_SYNC_WORD: {
+      uint16_t word = (uint16_t)change.value;
+      state = radio.setSyncWord((uint8_t)(word >> 8), (uint8_t)word);
+      if (state == RADIOLIB_ERR_NONE) {
+        radioSettings.syncWord = word;
+      }
+      break;
+    }
+    case SETTING_TALK_GROUP:
+      if (talkGroups.setTalkGroup((uint8_t)change.value)) {
+        // What still waits for an ACK was meant for the old destination
+        arq.setSession((uint16_t)esp_random());
+      }
+      applyAddressFilter();
+      break;
+    case SETTING_JOIN_GROUP:
+      talkGroups.join((uint8_t)change.value);
+      applyAddressFilter();
+      break;
+    case SETTING_LEAVE_GROUP:
+      talkGroups.leave((uint8_t)change.value);
+      applyAddressFilter();
+      break;
+    case SETTING_RELAY:
+#if MESH_ENABLED
+      mesh.setEnabled(change.value != 0);
+      applyAddressFilter();
+#endif
+      break;
+    case SETTING_UNIT: {
+      // An ID some other unit is heard with is taken
+      uint16_t unit = (uint16_t)change.value;
+      bool taken = unit != unitSource && rxSource == unit;
+#if CRYPTO_ENABLED
+      taken |= unit != unitSource && cipher.hasHeard(unit);
+#endif
+      if (taken || !configStore.saveUnit(unit)) {
+        LOG_EVENT(LOG_UNIT_FAILED, unit);
+      }
+      break;
+    }
+  }
 
-    // You can transmit C-string or Arduino string up to 255 characters long
-    String str = "Hello World! #" + String(countReceivedPackets++);
-    transmissionState = radio.startTransmit(str);
+  if (state != RADIOLIB_ERR_NONE) {
+    LOG_EVENT(LOG_SETTING_FAILED, change.setting, state);
+  }
+}
 
-    // You can also transmit byte array up to 255 bytes long with limitations https://github.com/jgromes/RadioLib/discussions/1138
-    /*
-      byte byteArr[] = {0x01, 0x23, 0x45, 0x67,
-                        0x89, 0xAB, 0xCD, 0xEF};
-      int state = radio.startTransmit(byteArr, 8);
-    */
+#if CRYPTO_ENABLED
+void recordCryptoTime(uint32_t start) {
+  uint32_t elapsed = micros() - start;
+  cryptoTime.record(elapsed);
+  if (elapsed > CRYPTO_BUDGET_US) {
+    cryptoOverruns.add();
   }
 }
 
-void handleRotatoryEncoder() {
-  rotatoryEncoder.update();
+void loadKeys() {
+  ConfigStore::KeyEntry entries[ConfigStore::MAX_KEYS];
+  uint8_t count = configStore.loadKeys(entries);
+  for (uint8_t i = 0; i < count; i++) {
+    cipher.setKey(entries[i].address, entries[i].key);
+  }
+  memset(entries, 0, sizeof(entries));
+}
 
-  // Check for button press to toggle mode
-  if (rotatoryEncoder.wasPressed()) {
-    currentMode = currentMode == Mode::RECEIVE ? Mode::TRANSMIT : Mode::RECEIVE;
-    modeChanged = true;
-    Serial.print(F("Switched to "));
-    Serial.println(currentMode == Mode::RECEIVE ? F("RECEIVE mode") : F("TRANSMIT mode"));
+// Set or clear a key from the console, in the cipher and in flash
+void applyKeyChange(KeyChange& change) {
+  bool ok;
+  if (change.clear) {
+    cipher.clearKey(change.address);
+    ok = configStore.removeKey(change.address);
   } else {
-    modeChanged = false;
+    ok = cipher.setKey(change.address, change.key) && configStore.saveKey(change.address, change.key);
+  }
+  memset(change.key, 0, sizeof(change.key));
+  if (!ok) {
+    LOG_EVENT(LOG_KEY_FAILED, change.address);
+  }
+}
+
+// Encrypt for the address if we hold its key, frame needs room for the
+// overhead. Returns the new length, 0 if the frame must not go out.
+size_t sealFrame(uint8_t* frame, size_t length, uint8_t address) {
+  if (!cipher.hasKey(address)) {
+    return length;
+  }
+  if (cipher.needsEpoch()) {
+    uint16_t epoch;
+    if (!configStore.nextEpoch(epoch)) {
+      LOG_EVENT(LOG_CRYPTO_EPOCH_FAILED);
+      return 0;
+    }
+    cipher.setEpoch(epoch);
+  }
+  uint32_t start = micros();
+  length = cipher.seal(address, frame, length);
+  recordCryptoTime(start);
+  return length;
+}
+#endif
+
+// Hand a copy of what the console shows to the log task, skipped while it
+// still has two unread ones
+void publishStatus(unsigned long now) {
+  if (!statusChanged && now - lastStatus < STATUS_INTERVAL_MS) {
+    return;
+  }
+  RadioStatus status;
+  status.settings = radioSettings;
+  status.talkGroup = talkGroups.getTalkGroup();
+  memcpy(status.members, talkGroups.getBitmap(), sizeof(status.members));
+  status.radioFilter = radioAddressFilter();
+  status.manualModem = linkAdaptation.isManual();
+  status.source = unitSource;
+  status.provisioned = unitProvisioned;
+#if MESH_ENABLED
+  status.relay = mesh.isEnabled();
+  status.relayed = mesh.getRelayed();
+  status.duplicates = mesh.getDuplicates();
+  status.suppressed = mesh.getSuppressed();
+  status.overflows = mesh.getOverflows();
+  status.evictions = mesh.getEvictions();
+#endif
+#if CRYPTO_ENABLED
+  memset(status.keys, 0, sizeof(status.keys));
+  for (uint16_t address = 0; address <= TalkGroups::MAX_ADDRESS; address++) {
+    if (cipher.hasKey((uint8_t)address)) {
+      status.keys[address / 8] |= (uint8_t)(1 << (address % 8));
+    }
+  }
+  status.sealed = cipher.getSealed();
+  status.opened = cipher.getOpened();
+  status.failures = cipher.getFailures();
+  status.replays = cipher.getReplays();
+  status.conflicts = cipher.getConflicts();
+#endif
+  if (statusQueue.push(status)) {
+    statusChanged = false;
+    lastStatus = now;
   }
+}
+
+// Static buffers are carved out once at boot, nothing is allocated afterwards
+void allocateBuffers() {
+  if (!sramArena.begin(SRAM_ARENA_SIZE, MEMORY_INTERNAL)) {
+    LOG_EVENT(LOG_MEM_FAILED);
+    halt();
+  }
+  txFrame = sramArena.allocateArray<uint8_t>(MAX_FRAME_LENGTH);
+  rxFrame = sramArena.allocateArray<uint8_t>(MAX_FRAME_LENGTH);
+#if FEC_ENABLED
+  airFrame = sramArena.allocateArray<uint8_t>(MAX_FRAME_LENGTH);
+#endif
 
-  auto fn = currentMode == Mode::RECEIVE ? handleReceivedPacket : handleSentPacket;
-  fn();
+  messageHistoryCapacity = MESSAGE_HISTORY;
+  size_t poolSize = Pool::footprint(LONG_MESSAGE_MAX, 1 + REASSEMBLY_SLOTS);
+  if (!psramArena.begin(messageHistoryCapacity * sizeof(Message) + poolSize, MEMORY_PSRAM)) {
+    // Without PSRAM keep a short history in internal memory
+    LOG_EVENT(LOG_MEM_NO_PSRAM);
+    messageHistoryCapacity = 16;
+    psramArena.begin(messageHistoryCapacity * sizeof(Message) + poolSize, MEMORY_INTERNAL);
+  }
+  messageHistory = psramArena.allocateArray<Message>(messageHistoryCapacity);
+  if (longMessages.begin(psramArena, LONG_MESSAGE_MAX, 1 + REASSEMBLY_SLOTS)) {
+    reassembler.begin(longMessages, REASSEMBLY_SLOTS);
+  }
+
+  sramUsed.set(sramArena.getUsed());
+  psramUsed.set(psramArena.getUsed());
+  LOG_EVENT(LOG_MEM_SRAM, sramArena.getUsed(), sramArena.getSize());
+  LOG_EVENT(LOG_MEM_PSRAM, psramArena.getUsed(), psramArena.getSize());
+}
+
+// Boot order puts the radio first: it listens before Serial, the encoder or
+// any diagnostics are brought up, all of which only log into the ring.
+void setup() {
+  markBootPhase(BOOT_SETUP);
+  allocateBuffers();
+  markBootPhase(BOOT_BUFFERS);
+
+  spi.begin(SCK_PIN, MISO_PIN, MOSI_PIN, -1);
+
+  // Initialize CC1101 with default settings
+  int state = radio.begin();
+  if (state == RADIOLIB_ERR_NONE) {
+    LOG_EVENT(LOG_RADIO_INIT);
+  } else {
+    LOG_EVENT(LOG_RADIO_INIT_FAILED, state);
+    halt();
+  }
+  markBootPhase(BOOT_RADIO_INIT);
+
+  // Restore the active profile, or configure from the compiled-in defaults
+  char profileName[ConfigStore::MAX_NAME + 1];
+  ConfigProfile profile;
+  bool haveProfile = configStore.begin(CONFIG_NAMESPACE) && configStore.getActive(profileName, sizeof(profileName));
+  bool restored = haveProfile && configStore.load(profileName, profile) && restoreProfile(profile);
+  if (!restored) {
+    if (haveProfile) {
+      LOG_EVENT(LOG_CONFIG_DEFAULTS);
+    }
+    activeProfile.hopBase = HOP_BASE_MHZ;
+    activeProfile.hopSpacing = HOP_SPACING_MHZ;
+    activeProfile.hopChannels = HOP_CHANNELS;
+    activeProfile.hopSeed = HOP_SEED;
+    activeProfile.hopDwell = HOP_DWELL_MS;
+
+    // Start out with the most robust profile, link adaptation steps up from there
+    applyRadioProfile(linkAdaptation.getRadioProfile());
+  }
+  // The unit ID tells senders apart for ARQ, mesh and the cipher's nonces,
+  // which must never repeat between units sharing a key. Until one is
+  // provisioned the folded factory MAC stands in, which may collide, so
+  // nothing is sealed with it.
+  uint16_t source;
+  unitProvisioned = configStore.loadUnit(source);
+  if (!unitProvisioned) {
+    uint64_t mac = ESP.getEfuseMac();
+    source = (uint16_t)(mac ^ (mac >> 16) ^ (mac >> 32));
+  }
+  unitSource = source;
+  arq.setSource(source);
+  // A fresh ARQ session per boot, receivers drop what they held from the last one
+  arq.setSession((uint16_t)esp_random());
+  // Receivers still remember our last long messages by ID
+  fragmenter = Fragmenter((uint16_t)esp_random());
+#if MESH_ENABLED
+  mesh.setSource(source);
+#endif
+#if CRYPTO_ENABLED
+  if (unitProvisioned) {
+    cipher.setSource(source);
+  } else {
+    LOG_EVENT(LOG_UNIT_MISSING);
+  }
+  loadKeys();
+#endif
+  applyAddressFilter();
+#if FAST_TURNAROUND_ENABLED
+  turnaround.configure();
+#endif
+  markBootPhase(BOOT_CONFIG);
+
+#if FEC_ENABLED
+  // Let corrupted packets through, FEC decides whether they can be repaired
+  radio.setCrcFiltering(false);
+#endif
+
+#if HOPPING_ENABLED
+  if (!restored || !activeProfile.calibrated) {
+    calibrateHopChannels();
+  }
+  applyHop();
+  startHopTimer();
+#endif
+#if IMMEDIATE_ACK_ENABLED
+  startAckTimer();
+#endif
+
+  attachRadioInterrupts();
+
+  // Start listening for packets
+  state = radio.startReceive();
+  if (state == RADIOLIB_ERR_NONE) {
+    LOG_EVENT(LOG_LISTEN_STARTED);
+  } else {
+    LOG_EVENT(LOG_LISTEN_FAILED, state);
+    halt();
+  }
+  markBootPhase(BOOT_RX_READY);
+
+  // Since reset, micros() starts with the first boot stage
+  LOG_EVENT(LOG_BOOT_READY, bootPhases[BOOT_RX_READY].get(), restored);
+
+#if POWER_MANAGEMENT_ENABLED
+  // Boot ran at full speed, from here on only pending work does
+  if (!power.begin(CPU_MAX_MHZ, CPU_MIN_MHZ)) {
+    LOG_EVENT(LOG_POWER_FAILED);
+  }
+#endif
+  xTaskCreatePinnedToCore(radioTask, "radio", 8192, NULL, RADIO_TASK_PRIORITY, &radioTaskHandle, RADIO_CORE);
+
+  // Snapshot the defaults so the next boot takes the fast path; the radio
+  // task reads the registers and does the (slow) flash write
+  if (!haveProfile) {
+    ProfileRequest request;
+    strcpy(request.name, CONFIG_DEFAULT_PROFILE);
+    request.action = PROFILE_SAVE;
+    request.activate = true;
+    profileQueue.push(request);
+  }
+
+  // Everything else may come up while the radio already listens
+  startDiagnostics();
+  markBootPhase(BOOT_DIAGNOSTICS);
+  registerMetrics();
+  rotatoryEncoder.begin();
+  xTaskCreatePinnedToCore(audioTask, "audio", 4096, NULL, AUDIO_TASK_PRIORITY, NULL, AUDIO_CORE);
+  markBootPhase(BOOT_DONE);
+}
+
+
+// Hold a packet until space us after the last radio interrupt. Whole
+// ticks are slept, so the other tasks on the core get them; the rest is
+// waited out in short steps that let tasks of the same priority run.
+void waitForSpace(uint32_t space) {
+  const uint32_t tick = portTICK_PERIOD_MS * 1000;
+  uint32_t end = irqTimestamp;
+  uint32_t waited;
+  while ((waited = micros() - end) < space) {
+    uint32_t left = space - waited;
+    if (left > tick) {
+      // Wakes at the next tick, before the space is over
+      vTaskDelay(1);
+    } else {
+      delayMicroseconds(left < SPACE_STEP_US ? left : SPACE_STEP_US);
+      taskYIELD();
+    }
+  }
+}
+
+// Bytes behind the address a packet of frames we originate takes on air
+size_t packetLength(size_t frames, uint8_t address) {
+  size_t length = PACKET_OVERHEAD + frames;
+#if CRYPTO_ENABLED
+  if (!cipher.hasKey(address)) {
+    length -= FrameCipher::OVERHEAD;
+  }
+#else
+  (void)address;
+#endif
+#if FEC_ENABLED
+  length = FrameFec::encodedLength(length);
+#endif
+  return length;
+}
+
+// Put our source in front of the frames already at packet + SOURCE_LENGTH,
+// returns the packet length
+size_t stampSource(uint8_t* packet, size_t length) {
+  packet[0] = (uint8_t)unitSource;
+  packet[1] = (uint8_t)(unitSource >> 8);
+  return SOURCE_LENGTH + length;
+}
+
+// Start sending a frame, the radio goes back to receive once it is done.
+// With a space it goes out that long after the last radio interrupt at
+// the earliest, for immediate ACKs.
+void sendFrame(const uint8_t* frame, size_t length, uint8_t address, uint32_t space = 0) {
+  // FEC encoding and the FIFO refills of startTransmit()
+  PowerLock lock(power);
+
+  // With the radio's filter on RadioLib writes the address byte, without
+  // it the byte goes in front of the frame here. Either way it is sent in
+  // the clear, ahead of the FEC blocks.
+  size_t offset = radioAddressFilter() ? 0 : TalkGroups::ADDRESS_LENGTH;
+#if FEC_ENABLED
+  uint8_t* packet = airFrame;
+  length = fec.encode(frame, length, packet + offset);
+#else
+  // Frames are always built in txFrame, which has room for the address
+  uint8_t* packet = txFrame;
+  memmove(packet + offset, frame, length);
+#endif
+  if (offset != 0) {
+    packet[0] = address;
+    length += offset;
+  }
+  frame = packet;
+
+  uint32_t turnaroundStart = micros();
+#if FAST_TURNAROUND_ENABLED
+  // The FIFO is loaded ahead of the space, only the strobe waits for it
+  bool loaded = turnaround.load(frame, length, address, radioAddressFilter());
+  waitForSpace(space);
+  if (loaded) {
+    transmittedFlag = false;
+    if (turnaround.transmit()) {
+      rxToTx.record(micros() - turnaroundStart);
+      transmitting = true;
+      return;
+    }
+    turnaroundFallbacks.add();
+  }
+#else
+  waitForSpace(space);
+#endif
+
+  // You can transmit byte array up to 255 bytes long
+  // When transmitting more than 64 bytes startTransmit blocks to refill the FIFO.
+  // Blocking ceases once the last bytes have been placed in the FIFO
+  transmissionState = radio.startTransmit(frame, length, address);
+  if (transmissionState == RADIOLIB_ERR_NONE) {
+    // Larger frames block for the FIFO refills, they are not a turnaround
+    if (length + 2 <= CC1101_FIFO_SIZE) {
+      rxToTx.record(micros() - turnaroundStart);
+    }
+    transmitting = true;
+#if FAST_TURNAROUND_ENABLED
+    turnaround.setReady();
+#endif
+  } else {
+    txFailures.add();
+    LOG_EVENT(LOG_TX_FAILED, transmissionState);
+    radio.startReceive();
+  }
+}
+
+// Called by the ARQ layer for every message delivered in order,
+// hands it over to the audio task
+void deliverMessage(const uint8_t* data, size_t length, uint8_t type, uint16_t source) {
+  Message message;
+  message.source = source;
+  message.type = type;
+  message.length = (uint8_t)length;
+  memcpy(message.data, data, length);
+  message.queuedAt = micros();
+  if (!rxQueue.push(message)) {
+    rxQueueOverflows.add();
+  }
+}
+
+#if IMMEDIATE_ACK_ENABLED
+// Answer unicast data on the address it came in on, which the sender
+// listens to as the one it talks to. Replaces the piggybacked ACK unless
+// it cannot be sealed.
+void sendImmediateAck(uint8_t address) {
+  uint32_t end = irqTimestamp;
+  size_t length = arq.buildAck(rxSource, txFrame + SOURCE_LENGTH);
+  if (length == 0) {
+    return;
+  }
+  length = stampSource(txFrame, length);
+#if CRYPTO_ENABLED
+  length = sealFrame(txFrame, length, address);
+  if (length == 0) {
+    return;
+  }
+#endif
+  sendFrame(txFrame, length, address, ACK_SPACE_US);
+  if (transmitting) {
+    ackSpace.record(micros() - end);
+    immediateAcks.add();
+  }
+}
+
+// Time from the end of our packet until the receiver's ACK is in, it
+// goes out directly, without a mesh header
+uint32_t ackWindowFor(uint8_t address) {
+  size_t length = SOURCE_LENGTH + SelectiveRepeatArq::ACK_LENGTH;
+#if CRYPTO_ENABLED
+  if (cipher.hasKey(address)) {
+    length += FrameCipher::OVERHEAD;
+  }
+#else
+  (void)address;
+#endif
+#if FEC_ENABLED
+  length = FrameFec::encodedLength(length);
+#endif
+  return ACK_SPACE_US + airtimeUs(length, radioSettings.bitRate) + ACK_GUARD_US;
+}
+#endif
+
+// Dispatch a single frame, aggregates are unpacked recursively
+void handleFrame(const uint8_t* frame, size_t length) {
+  if (frame[0] == FRAME_DATA || frame[0] == FRAME_PACKED || frame[0] == FRAME_FRAGMENT) {
+    // Deliver what became in-order, the ACK goes out with the next packet
+    if (arq.onData(frame, length, rxSource, millis(), deliverMessage)) {
+      rxConfirmed = true;
+    }
+  } else if (frame[0] == FRAME_ACK) {
+    bool ours = arq.onAck(frame, length, millis());
+    (void)ours;
+#if WOR_ENABLED
+    if (ours) {
+      wor.onDelivered();
+    }
+#endif
+#if IMMEDIATE_ACK_ENABLED
+    if (ours && ackWaiting) {
+      cancelAckTimer();
+      ackWaiting = false;
+      ackWaitTime.record(micros() - ackWaitStart);
+    }
+#endif
+  } else if (frame[0] == FRAME_AGGREGATE) {
+    FrameAggregator::unpack(frame, length, handleFrame);
+  } else if (frame[0] == FRAME_LINK) {
+    linkAdaptation.onReport(rxSource, frame, length, millis());
+#if WOR_ENABLED
+  } else if (frame[0] == FRAME_WOR) {
+    wor.onAnnounce(rxSource, frame, length);
+#endif
+#if HOPPING_ENABLED
+  } else if (frame[0] == FRAME_HOP) {
+    // Line our timer phase up with the sender's slot, as of the end of its packet
+    long elapsed = hopper.onSync(frame, length, millis(), (micros() - irqTimestamp) / 1000);
+    if (elapsed >= 0) {
+      timerWrite(hopTimer, elapsed * 1000ULL);
+    }
+#endif
+  }
+}
+
+// Whether every frame of a packet is confirmed data we hold already,
+// cleared by the first one that is not; each is remembered from now on
+bool rxRepeat = false;
+
+void checkRepeat(const uint8_t* frame, size_t length) {
+  uint32_t id = 0;
+  if (frame[0] == FRAME_AGGREGATE) {
+    if (FrameAggregator::unpack(frame, length, checkRepeat) <= 0) {
+      rxRepeat = false;
+    }
+  } else if (!SelectiveRepeatArq::frameId(frame, length, rxSource, id) || !framesSeen.check(id, millis()) ||
+             !arq.onRepeat(frame, length, rxSource)) {
+    rxRepeat = false;
+  }
+}
+
+#if WOR_ENABLED
+// A packet wakes a sleeping receiver up for good
+void wakeOnPacket() {
+  bool wasAsleep = wor.isAsleep();
+  wor.onActivity(millis());
+  if (wasAsleep) {
+    worWakeLatency.record(micros() - worWakeMicros);
+    worWakes.add();
+    worSleepTime.set(wor.getSleepTime(millis()));
+    exitWakeOnRadio();
+  }
+}
+#endif
+
+void handleReceivedPacket(bool changed) {
+#if FAST_TURNAROUND_ENABLED
+  // Usually still listening since the last packet went out, restarting
+  // would drop a frame coming in
+  if (changed && turnaround.isListening()) {
+    changed = false;
+  }
+#endif
+  if (changed && currentMode == Mode::RECEIVE && !transmitting) {
+    // Start listening for packets
+    int state = radio.startReceive();
+    if (state == RADIOLIB_ERR_NONE) {
+      LOG_EVENT(LOG_LISTEN_STARTED);
+    } else {
+      LOG_EVENT(LOG_LISTEN_FAILED, state);
+      halt();
+    }
+  }
+
+  // Ignore the flag while transmitting, both actions may share the GDO0 interrupt
+  if(receivedFlag && !transmitting) {
+    receivedFlag = false;
+    PowerLock lock(power);
+    TRACE(TRACE_HANDLE_RX, TRACE_BEGIN);
+    uint32_t start = micros();
+    irqLatency.record(start - irqTimestamp);
+
+    size_t length = radio.getPacketLength();
+#if FEC_ENABLED
+    uint8_t* packet = airFrame;
+#else
+    uint8_t* packet = rxFrame;
+#endif
+    int state = radio.readData(packet, length);
+
+    // The radio's filter strips the address, otherwise it is checked here,
+    // before any FEC work is spent on the packet
+    bool foreign = false;
+    uint8_t address = talkGroups.filteredAddress();
+    if (state == RADIOLIB_ERR_NONE && !radioAddressFilter()) {
+      if (length < TalkGroups::ADDRESS_LENGTH) {
+        state = RADIOLIB_ERR_CRC_MISMATCH;
+      } else {
+        address = packet[0];
+        foreign = !talkGroups.accepts(address);
+        packet += TalkGroups::ADDRESS_LENGTH;
+        length -= TalkGroups::ADDRESS_LENGTH;
+      }
+    }
+#if MESH_ENABLED
+    // A relay passes on what it is not addressed by itself
+    bool relay = mesh.isEnabled();
+#else
+    bool relay = false;
+#endif
+
+#if FEC_ENABLED
+    if (state == RADIOLIB_ERR_NONE && (!foreign || relay)) {
+      int decoded = fec.decode(packet, length, rxFrame);
+      length = decoded > 0 ? decoded : 0;
+      if (decoded < 0) {
+        state = RADIOLIB_ERR_CRC_MISMATCH;
+      }
+    }
+    const uint8_t* frame = rxFrame;
+#else
+    const uint8_t* frame = packet;
+#endif
+
+    // Copies of relayed packets are dropped before anything looks at
+    // them, first sightings queue a rebroadcast
+    bool duplicate = false;
+    // Heard straight from the sender, not through a relay
+    bool direct = true;
+    (void)direct;
+#if MESH_ENABLED
+    if (state == RADIOLIB_ERR_NONE && (!foreign || relay) && length > 0 && frame[0] == FRAME_MESH) {
+      // Hop budget still untouched
+      direct = length > MeshRelay::HEADER_LENGTH && frame[5] == RELAY_HOPS;
+      size_t innerLength = 0;
+      frame = mesh.onReceive(frame, length, address, millis(), innerLength);
+      duplicate = frame == NULL;
+      length = innerLength;
+    }
+#endif
+
+    // Nothing acts on a frame for an encrypted group before it has been
+    // authenticated, frames sent to it in the clear are dropped
+    bool rejected = false;
+    bool sealedCopy = false;
+#if CRYPTO_ENABLED
+    if (state == RADIOLIB_ERR_NONE && !foreign && !duplicate && length > 0) {
+      uint32_t sealedId = 0;
+      if (frame[0] == FRAME_SECURE && FrameCipher::packetId(frame, length, sealedId) &&
+          sealedSeen.peek(sealedId, millis())) {
+        // A copy of a packet opened before, told by its clear header
+        duplicate = true;
+        sealedCopy = true;
+      } else if (frame[0] == FRAME_SECURE) {
+        uint32_t cryptoStart = micros();
+        uint32_t conflicts = cipher.getConflicts();
+        size_t plainLength = 0;
+        frame = cipher.open(frame, length, plainLength);
+        recordCryptoTime(cryptoStart);
+        rejected = frame == NULL;
+        if (!rejected) {
+          sealedSeen.check(sealedId, millis());
+        }
+        if (cipher.getConflicts() != conflicts) {
+          LOG_EVENT(LOG_UNIT_CONFLICT, unitSource);
+          statusChanged = true;
+        }
+        length = plainLength;
+      } else {
+        rejected = cipher.hasKey(address);
+      }
+    }
+#endif
+
+    // Every packet starts with the unit that originated it
+    if (state == RADIOLIB_ERR_NONE && !foreign && !duplicate && !rejected && length > 0) {
+      if (length <= SOURCE_LENGTH) {
+        state = RADIOLIB_ERR_CRC_MISMATCH;
+      } else {
+        rxSource = (uint16_t)frame[0] | (uint16_t)(frame[1] << 8);
+        frame += SOURCE_LENGTH;
+        length -= SOURCE_LENGTH;
+      }
+    }
+
+    // Confirmed data we hold already is a repeat after a lost ACK: the ACK
+    // is owed again, nothing else is done with the packet
+    rxRepeat = false;
+    if (state == RADIOLIB_ERR_NONE && !foreign && !duplicate && !rejected && length > 0) {
+      rxRepeat = true;
+      checkRepeat(frame, length);
+    }
+
+    if (foreign && !relay) {
+      // Meant for another group or unit
+      rxForeign.add();
+
+    } else if (duplicate) {
+      (sealedCopy ? rxDuplicates : meshDuplicates).add();
+
+    } else if (rxRepeat) {
+      rxDuplicates.add();
+#if WOR_ENABLED
+      wakeOnPacket();
+#endif
+#if IMMEDIATE_ACK_ENABLED
+      if (direct && TalkGroups::isUnit(address) && arq.ackPending(rxSource)) {
+        sendImmediateAck(address);
+      }
+#endif
+
+    } else if (rejected) {
+      rxRejected.add();
+
+    } else if (state == RADIOLIB_ERR_NONE && length > 0) {
+      // Packet was successfully received
+      rxPackets.add();
+      LOG_EVENT(LOG_RX_PACKET);
+
+      // Log RSSI (Received Signal Strength Indicator) of the last received packet
+      float rssi = radio.getRSSI();
+      LOG_EVENT(LOG_RX_RSSI, (int32_t)(rssi * 100));
+
+      // Log LQI (Link Quality Indicator) of the last received packet, lower is better
+      uint8_t lqi = radio.getLQI();
+      LOG_EVENT(LOG_RX_LQI, lqi);
+
+      linkAdaptation.onMeasurement(rxSource, rssi, lqi, millis());
+
+#if WOR_ENABLED
+      wakeOnPacket();
+#endif
+
+      if (foreign) {
+        rxForeign.add();
+      } else {
+        rxConfirmed = false;
+        handleFrame(frame, length);
+#if IMMEDIATE_ACK_ENABLED
+        // Only unicast data is confirmed, the sender waits for this ACK
+        if (rxConfirmed && direct && TalkGroups::isUnit(address) && arq.ackPending(rxSource)) {
+          sendImmediateAck(address);
+        }
+#endif
+      }
+
+    } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+      // Packet was received, but is malformed (or beyond FEC repair),
+      // the sender repeats it on timeout
+      rxCrcErrors.add();
+      LOG_EVENT(LOG_RX_CRC_ERROR);
+
+    } else {
+      // Some other error occurred
+      rxFailures.add();
+      LOG_EVENT(LOG_RX_FAILED, state);
+
+    }
+
+    // Put module back to listen mode, unless an ACK is going out; a packet
+    // that did not wake us up (foreign or broken) leaves the CC1101 polling
+#if WOR_ENABLED
+    if (wor.isAsleep()) {
+      resumeWakeOnRadio();
+    } else if (!transmitting) {
+      radio.startReceive();
+    }
+#else
+    if (!transmitting) {
+      radio.startReceive();
+    }
+#endif
+    rxHandleTime.record(micros() - start);
+    TRACE(TRACE_HANDLE_RX, TRACE_END);
+  }
+}
+
+void handleSentPacket() {
+  // Check if the previous transmission finished
+  if(transmittedFlag && transmitting) {
+    transmittedFlag = false;
+    transmitting = false;
+    irqLatency.record(micros() - irqTimestamp);
+    txPackets.add();
+
+    // NOTE: When using interrupt-driven transmit method,
+    //       it is not possible to automatically measure
+    //       transmission data rate using getDataRate()
+
+    // Nothing can have been received while sending, a flag raised by
+    // our own packet is stale
+    receivedFlag = false;
+
+#if FAST_TURNAROUND_ENABLED
+    // TXOFF_MODE has the CC1101 listening again already
+    bool listening = turnaround.isListening();
+#else
+    bool listening = false;
+#endif
+    if (!listening) {
+      // Clean up after transmission is finished
+      // This will ensure transmitter is disabled,
+      // RF switch is powered down etc.
+      radio.finishTransmit();
+
+      // Listen for ACKs and data between our own frames
+      radio.startReceive();
+    }
+    txToRx.record(micros() - irqTimestamp);
+
+#if IMMEDIATE_ACK_ENABLED
+    // Keep the channel free until the receiver's ACK is in
+    if (ackWindow != 0) {
+      uint32_t spent = micros() - irqTimestamp;
+      armAckTimer(spent < ackWindow ? ackWindow - spent : 1);
+      ackWaitStart = irqTimestamp;
+      ackWaiting = true;
+      ackWindow = 0;
+    }
+#endif
+  }
+
+  // Take over messages queued by the audio task while the window has room
+  Message message;
+  while (!arq.isWindowFull() && txQueue.pop(message)) {
+    txQueueDelay.record(micros() - message.queuedAt);
+    // Only a single unit confirms what it got, a group is sent to once
+    arq.send(message.data, message.length, message.type, talkGroups.getTalkGroup() >= TalkGroups::FIRST_UNIT);
+#if WOR_ENABLED
+    wor.onActivity(millis());
+#endif
+  }
+
+  if (transmitting) {
+    return;
+  }
+
+#if IMMEDIATE_ACK_ENABLED
+  if (ackWaiting && ackTimedOut) {
+    // Lost either way, the ARQ timeout takes care of the data
+    ackWaiting = false;
+    ackTimeouts.add();
+  }
+  if (ackWaiting) {
+    return;
+  }
+#endif
+
+  unsigned long now = millis();
+
+#if WOR_ENABLED
+  // Our sleep announcement is out, hand over to the WOR timer
+  if (wor.readyToSleep() && aggregator.isEmpty()) {
+    enterWakeOnRadio(now);
+  }
+  if (wor.isAsleep()) {
+    // Leaving RECEIVE mode wakes us up, everything else waits for a packet
+    if (currentMode != Mode::RECEIVE) {
+      wor.onActivity(now);
+      worSleepTime.set(wor.getSleepTime(now));
+      exitWakeOnRadio();
+    } else {
+      return;
+    }
+  }
+
+  // A retransmission went out unanswered, the peer may sleep unannounced
+  if (arq.getRetransmittedCount() != worRetransmitted) {
+    worRetransmitted = arq.getRetransmittedCount();
+    wor.onDeliveryTimeout();
+  }
+
+  // Stretch our preamble while the peer sleeps
+  if (wor.peerChanged()) {
+    applyWakePreamble();
+  }
+#endif
+
+  // Parameter changes from the console, applied between packets
+  SettingChange change;
+  if (settingQueue.pop(change)) {
+    do {
+      applySetting(change);
+    } while (settingQueue.pop(change));
+    radio.startReceive();
+    statusChanged = true;
+  }
+
+  ProfileRequest request;
+  while (profileQueue.pop(request)) {
+    handleProfileRequest(request);
+  }
+
+#if CRYPTO_ENABLED
+  KeyChange keyChange;
+  while (keyQueue.pop(keyChange)) {
+    applyKeyChange(keyChange);
+    statusChanged = true;
+  }
+#endif
+
+  // Follow link quality changes while the radio is not sending
+  linkAdaptation.checkTimeout(now);
+  if (linkAdaptation.profileChanged()) {
+    const RadioProfile& profile = linkAdaptation.getRadioProfile();
+    profileSwitches.add();
+    LOG_EVENT(LOG_PROFILE_SWITCH, (int32_t)(profile.bitRate * 100));
+    applyRadioProfile(profile);
+#if WOR_ENABLED
+    applyWakePreamble();
+#endif
+    radio.startReceive();
+    statusChanged = true;
+  }
+  publishStatus(now);
+
+#if HOPPING_ENABLED
+  // The sender always hops, receivers only once they follow a sender
+  if (hopper.hopPending() && (currentMode == Mode::TRANSMIT || hopper.isSynced(now))) {
+    applyHop();
+  }
+#endif
+
+#if MESH_ENABLED
+  // Rebroadcasts go out on their own, ahead of our traffic
+  uint8_t relayAddress;
+  size_t relayLength = mesh.nextRelay(now, txFrame, relayAddress);
+  if (relayLength > 0) {
+    sendFrame(txFrame, relayLength, relayAddress);
+    return;
+  }
+#endif
+
+  // Tell the senders what we hold, piggybacked on our own traffic if possible
+  while (arq.ackPending() && aggregator.canFit(SelectiveRepeatArq::ACK_LENGTH)) {
+    aggregator.add(txFrame, arq.buildAck(txFrame), now);
+  }
+
+  // New messages and retransmissions that are due
+  while (aggregator.canFit(SelectiveRepeatArq::HEADER_LENGTH + SelectiveRepeatArq::MAX_PAYLOAD)) {
+    size_t length = arq.nextFrame(now, txFrame);
+    if (length == 0) {
+      break;
+    }
+    aggregator.add(txFrame, length, now);
+#if IMMEDIATE_ACK_ENABLED
+    dataAggregated = true;
+#endif
+  }
+
+#if WOR_ENABLED
+  // Idle receivers tell the peer how long they will sleep; a woken one
+  // tells it to drop the long preamble with its next packet
+  bool busy = currentMode != Mode::RECEIVE || !arq.isIdle() || !txQueue.isEmpty() ||
+              !aggregator.isEmpty() || receivedFlag;
+#if MESH_ENABLED
+  busy = busy || mesh.hasPending();
+#endif
+  bool sleep = wor.shouldSleep(now, busy);
+  if ((sleep || (wor.announcePending() && !aggregator.isEmpty())) &&
+      aggregator.canFit(WakeOnRadio::ANNOUNCE_LENGTH)) {
+    uint8_t announce[WakeOnRadio::ANNOUNCE_LENGTH];
+    aggregator.add(announce, wor.buildAnnounce(announce, sleep), now);
+  }
+#endif
+
+  // Piggyback how we hear the peers on whatever goes out anyway; while a
+  // profile switch is negotiated the report goes out on its own
+  if ((!aggregator.isEmpty() || linkAdaptation.negotiating()) && now - lastLinkReport >= LINK_REPORT_INTERVAL_MS &&
+      aggregator.canFit(LinkAdaptation::REPORT_LENGTH)) {
+    aggregator.add(txFrame, linkAdaptation.buildReport(txFrame), now);
+    lastLinkReport = now;
+    linkReportQueued = true;
+  }
+
+  if (aggregator.isDue(now)) {
+#if HOPPING_ENABLED
+    // Every packet tells listeners where we are in the hop sequence by
+    // the time it has been sent
+    uint8_t sync[FrequencyHopper::SYNC_LENGTH];
+    if (aggregator.canFit(sizeof(sync))) {
+      size_t onAir = packetLength(aggregator.lengthWith(sizeof(sync)), talkGroups.getTalkGroup());
+      unsigned long airtime = (airtimeUs(onAir, radioSettings.bitRate) + 999) / 1000;
+      aggregator.add(sync, hopper.buildSync(sync, now, airtime), now);
+    }
+#endif
+    size_t length = stampSource(txFrame, aggregator.flush(txFrame + SOURCE_LENGTH));
+    uint8_t address = talkGroups.getTalkGroup();
+    bool reportFlushed = linkReportQueued;
+    linkReportQueued = false;
+#if IMMEDIATE_ACK_ENABLED
+    // Data to a single unit is answered right away
+    bool unicastData = dataAggregated && address >= TalkGroups::FIRST_UNIT;
+    dataAggregated = false;
+#endif
+#if CRYPTO_ENABLED
+    // Inside the mesh header, relays pass it on without the key
+    length = sealFrame(txFrame, length, address);
+    if (length == 0) {
+      return;
+    }
+#endif
+#if MESH_ENABLED
+    length = mesh.wrap(txFrame, length);
+#endif
+    sendFrame(txFrame, length, address);
+    if (transmitting && reportFlushed) {
+      // A switch we agreed to happens behind this packet
+      linkAdaptation.onReportSent(now);
+    }
+#if IMMEDIATE_ACK_ENABLED
+    if (transmitting && unicastData) {
+      ackWindow = ackWindowFor(address);
+    }
+#endif
+  }
+}
+
+void setMode(Mode mode) {
+  currentMode = mode;
+  modeChanged = true;
+  modeSwitches.add();
+  if (mode == Mode::RECEIVE) {
+    LOG_EVENT(LOG_MODE_RECEIVE);
+  } else {
+    LOG_EVENT(LOG_MODE_TRANSMIT);
+  }
+
+  // First message goes out right away
+  lastMessageTime = millis() - MESSAGE_INTERVAL_MS;
+}
+
+void handleRotatoryEncoder() {
+  rotatoryEncoder.update();
+
+  // Check for button press to toggle mode
+  if (rotatoryEncoder.wasPressed()) {
+    setMode(currentMode == Mode::RECEIVE ? Mode::TRANSMIT : Mode::RECEIVE);
+  }
+
+  // Mode changes asked for on the console
+  Mode mode;
+  while (modeQueue.pop(mode)) {
+    setMode(mode);
+  }
+}
+
+// Serial console commands, run from the log task
+
+bool commandGet(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  (void)argv;
+  if (argc != 1) {
+    return false;
+  }
+  const RadioSettings& settings = radioStatus.settings;
+  reply.append("freq=").append(settings.frequency, 3)
+       .append(" rate=").append(settings.bitRate)
+       .append(" dev=").append(settings.freqDev)
+       .append(" bw=").append(settings.rxBandwidth)
+       .append(" power=").append((int)settings.power)
+       .append(" sync=").appendHex(settings.syncWord, 4)
+       .append(" link=").append(radioStatus.manualModem ? "manual" : "auto")
+       .append(" mode=").append(currentMode == Mode::RECEIVE ? "rx" : "tx");
+  return true;
+}
+
+bool commandSet(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc != 3) {
+    return false;
+  }
+
+  SettingChange change;
+  const char* name = argv[1];
+  bool modem = strcmp(name, "rate") == 0 || strcmp(name, "dev") == 0 || strcmp(name, "bw") == 0;
+  if (strcmp(name, "rate") == 0 && strcmp(argv[2], "auto") == 0) {
+    change.setting = SETTING_ADAPTATION;
+    change.value = 1;
+    reply.append(settingQueue.push(change) ? "ok, link adaptation on" : "error: busy");
+    return true;
+  }
+  if (strcmp(name, "sync") == 0) {
+    long word;
+    if (!CommandConsole::parseLong(argv[2], word) || word < 0 || word > 0xFFFF) {
+      return false;
+    }
+    change.setting = SETTING_SYNC_WORD;
+    change.value = (float)word;
+  } else {
+    if (!CommandConsole::parseFloat(argv[2], change.value)) {
+      return false;
+    }
+    if (strcmp(name, "freq") == 0) {
+#if HOPPING_ENABLED
+      reply.append("error: frequency hopping is active");
+      return true;
+#endif
+      change.setting = SETTING_FREQUENCY;
+    } else if (strcmp(name, "rate") == 0) {
+      change.setting = SETTING_BIT_RATE;
+    } else if (strcmp(name, "dev") == 0) {
+      change.setting = SETTING_DEVIATION;
+    } else if (strcmp(name, "bw") == 0) {
+      change.setting = SETTING_BANDWIDTH;
+    } else if (strcmp(name, "power") == 0) {
+      change.setting = SETTING_POWER;
+    } else {
+      return false;
+    }
+  }
+
+  // Failures are reported by the radio task once it applies the change
+  if (!settingQueue.push(change)) {
+    reply.append("error: busy");
+  } else {
+    reply.append(modem ? "ok, link adaptation off" : "ok");
+  }
+  return true;
+}
+
+bool commandMode(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc != 2) {
+    return false;
+  }
+  Mode mode;
+  if (strcmp(argv[1], "rx") == 0) {
+    mode = Mode::RECEIVE;
+  } else if (strcmp(argv[1], "tx") == 0) {
+    mode = Mode::TRANSMIT;
+  } else {
+    return false;
+  }
+  // The audio task switches, it owns the message timer
+  reply.append(modeQueue.push(mode) ? "ok" : "error: busy");
+  return true;
+}
+
+bool commandMetrics(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+    metrics.reset();
+    reply.append("ok");
+    return true;
+  }
+  if (argc != 1) {
+    return false;
+  }
+  metrics.dump(writeSerial);
+  return true;
+}
+
+// Talk groups are changed by the radio task, which owns the address filter
+bool commandGroup(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 1) {
+    reply.append("talk=").append((unsigned int)radioStatus.talkGroup).append(" listen=");
+    for (uint16_t address = TalkGroups::ALL_CALL + 1; address <= TalkGroups::MAX_ADDRESS; address++) {
+      if (radioStatus.members[address / 8] & (1 << (address % 8))) {
+        reply.append((unsigned int)address).append(',');
+      }
+    }
+    reply.append("0 filter=").append(radioStatus.radioFilter ? "radio" : "software");
+    return true;
+  }
+
+  long address;
+  if (argc != 3 || !CommandConsole::parseLong(argv[2], address) ||
+      address <= TalkGroups::ALL_CALL || address > TalkGroups::MAX_ADDRESS) {
+    return false;
+  }
+  SettingChange change;
+  change.value = (float)address;
+  if (strcmp(argv[1], "talk") == 0) {
+    change.setting = SETTING_TALK_GROUP;
+  } else if (strcmp(argv[1], "join") == 0) {
+    change.setting = SETTING_JOIN_GROUP;
+  } else if (strcmp(argv[1], "leave") == 0) {
+    if (address == radioStatus.talkGroup) {
+      reply.append("error: talking to this group");
+      return true;
+    }
+    change.setting = SETTING_LEAVE_GROUP;
+  } else {
+    return false;
+  }
+  reply.append(settingQueue.push(change) ? "ok" : "error: busy");
+  return true;
+}
+
+// The unit ID is stored by the radio task, which refuses one it hears
+// another unit use; the outcome shows after the next boot
+bool commandUnit(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 1) {
+    reply.append("unit=").appendHex(radioStatus.source, 4)
+         .append(radioStatus.provisioned ? " provisioned" : " folded");
+#if CRYPTO_ENABLED
+    reply.append(" conflicts=").appendUnsigned(radioStatus.conflicts);
+#endif
+    return true;
+  }
+  long unit;
+  if (argc != 2 || !CommandConsole::parseLong(argv[1], unit) || unit < 1 || unit > 0xFFFF) {
+    return false;
+  }
+  SettingChange change;
+  change.setting = SETTING_UNIT;
+  change.value = (float)unit;
+  reply.append(settingQueue.push(change) ? "ok, active after reboot" : "error: busy");
+  return true;
+}
+
+#if MESH_ENABLED
+bool commandRelay(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 1) {
+    reply.append(radioStatus.relay ? "on" : "off")
+         .append(" source=").appendHex(radioStatus.source, 4)
+         .append(" relayed=").appendUnsigned(radioStatus.relayed)
+         .append(" duplicates=").appendUnsigned(radioStatus.duplicates)
+         .append(" suppressed=").appendUnsigned(radioStatus.suppressed)
+         .append(" overflows=").appendUnsigned(radioStatus.overflows)
+         .append(" evictions=").appendUnsigned(radioStatus.evictions);
+    return true;
+  }
+  if (argc != 2 || (strcmp(argv[1], "on") != 0 && strcmp(argv[1], "off") != 0)) {
+    return false;
+  }
+  SettingChange change;
+  change.setting = SETTING_RELAY;
+  change.value = strcmp(argv[1], "on") == 0 ? 1.0f : 0.0f;
+  reply.append(settingQueue.push(change) ? "ok" : "error: busy");
+  return true;
+}
+#endif
+
+#if CRYPTO_ENABLED
+int8_t hexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = (char)(c | 0x20);
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Keys are set or cleared, never shown. The radio task stores them.
+bool commandKey(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 1) {
+    reply.append(FrameCipher::isHardware() ? "aes=hardware" : "aes=software").append(" keys=");
+    for (uint16_t address = 0; address <= TalkGroups::MAX_ADDRESS; address++) {
+      if (radioStatus.keys[address / 8] & (1 << (address % 8))) {
+        reply.append((unsigned int)address).append(',');
+      }
+    }
+    reply.append(" sealed=").appendUnsigned(radioStatus.sealed)
+         .append(" opened=").appendUnsigned(radioStatus.opened)
+         .append(" failed=").appendUnsigned(radioStatus.failures)
+         .append(" replayed=").appendUnsigned(radioStatus.replays);
+    return true;
+  }
+
+  long address;
+  if (argc != 3 || !CommandConsole::parseLong(argv[1], address) ||
+      address < TalkGroups::ALL_CALL || address > TalkGroups::MAX_ADDRESS) {
+    return false;
+  }
+  KeyChange change;
+  change.address = (uint8_t)address;
+  change.clear = strcmp(argv[2], "clear") == 0;
+  if (!change.clear) {
+    const char* hex = argv[2];
+    if (strlen(hex) != 2 * FrameCipher::KEY_LENGTH) {
+      return false;
+    }
+    for (size_t i = 0; i < FrameCipher::KEY_LENGTH; i++) {
+      int8_t high = hexDigit(hex[2 * i]);
+      int8_t low = hexDigit(hex[2 * i + 1]);
+      if (high < 0 || low < 0) {
+        return false;
+      }
+      change.key[i] = (uint8_t)(high << 4 | low);
+    }
+  }
+  reply.append(keyQueue.push(change) ? "ok" : "error: busy");
+  memset(&change, 0, sizeof(change));
+  memset(argv[2], 0, strlen(argv[2]));
+  return true;
+}
+#endif
+
+// Saving reads the chip registers, so the radio task does it
+bool commandProfile(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc != 3 || strlen(argv[2]) > ConfigStore::MAX_NAME) {
+    return false;
+  }
+  // The radio task owns the store; a missing profile or a storage error
+  // shows up in the log once it handled the request
+  ProfileRequest request;
+  strcpy(request.name, argv[2]);
+  request.activate = false;
+  const char* done = "ok";
+  if (strcmp(argv[1], "save") == 0) {
+    request.action = PROFILE_SAVE;
+  } else if (strcmp(argv[1], "use") == 0) {
+    request.action = PROFILE_USE;
+    done = "ok, active after reboot";
+  } else if (strcmp(argv[1], "delete") == 0) {
+    request.action = PROFILE_DELETE;
+  } else {
+    return false;
+  }
+  reply.append(profileQueue.push(request) ? done : "error: busy");
+  return true;
+}
+
+// Queue a test message of the given length, sent in fragments once the
+// audio task is done with the one before; the counts are its metrics
+bool commandBulk(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  long length;
+  if (argc != 2 || !CommandConsole::parseLong(argv[1], length) || length < 1 || length > LONG_MESSAGE_MAX) {
+    return false;
+  }
+  uint16_t idle = 0;
+  reply.append(bulkRequest.compare_exchange_strong(idle, (uint16_t)length) ? "ok" : "error: busy");
+  reply.append(" reassembled=").appendUnsigned(messagesReassembled.get())
+       .append(" timeouts=").appendUnsigned(reassemblyTimeouts.get())
+       .append(" evictions=").appendUnsigned(reassemblyEvictions.get());
+  return true;
+}
+
+#if TRACE_ENABLED
+bool commandTrace(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  (void)argv;
+  (void)reply;
+  if (argc != 1) {
+    return false;
+  }
+  // Freeze the ring so the dump shows what led up to the request
+  traceBuffer.stop();
+  traceBuffer.dump(TRACE_POINT_NAMES, TRACE_POINT_COUNT, writeSerial);
+  traceBuffer.clear();
+  traceBuffer.start();
+  return true;
+}
+#endif
+
+// Residency per CPU frequency, to weigh the saving against the latencies
+// in metrics
+bool commandPower(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+  if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+    power.reset();
+    reply.append("ok");
+    return true;
+  }
+  if (argc != 1) {
+    return false;
+  }
+
+  uint64_t residency[PowerManager::LEVEL_COUNT];
+  uint64_t total = 0;
+  for (uint8_t level = 0; level < PowerManager::LEVEL_COUNT; level++) {
+    residency[level] = power.getResidency((PowerManager::Level)level);
+    total += residency[level];
+  }
+  for (uint8_t level = 0; level < PowerManager::LEVEL_COUNT; level++) {
+    CommandConsole::Reply line;
+    if (level == PowerManager::LEVEL_SLEEP) {
+      line.append("light_sleep");
+    } else {
+      line.append("cpu_").appendUnsigned(power.getMhz((PowerManager::Level)level)).append("mhz");
+    }
+    line.append("_ms ").appendUnsigned((uint32_t)(residency[level] / 1000))
+        .append(' ').append(total > 0 ? 100.0f * residency[level] / total : 0.0f, 1).append("%\r\n");
+    writeSerial(line.c_str(), line.length());
+  }
+  reply.append("cpu_switches ").appendUnsigned(power.getSwitchCount());
+  return true;
+}
+
+static const CommandConsole::Command CONSOLE_COMMANDS[] = {
+  { "get", "get", commandGet },
+  { "set", "set freq|rate|dev|bw|power|sync <value>, set rate auto", commandSet },
+  { "mode", "mode rx|tx", commandMode },
+  { "metrics", "metrics [reset]", commandMetrics },
+  { "profile", "profile save|use|delete <name>", commandProfile },
+  { "power", "power [reset]", commandPower },
+  { "group", "group [talk|join|leave <address>]", commandGroup },
+  { "bulk", "bulk <bytes>", commandBulk },
+  { "unit", "unit [<id>]", commandUnit },
+#if MESH_ENABLED
+  { "relay", "relay [on|off]", commandRelay },
+#endif
+#if CRYPTO_ENABLED
+  { "key", "key [<address> <32 hex digits>|clear]", commandKey },
+#endif
+#if TRACE_ENABLED
+  { "trace", "trace", commandTrace },
+#endif
+};
+
+CommandConsole console(CONSOLE_COMMANDS, sizeof(CONSOLE_COMMANDS) / sizeof(CONSOLE_COMMANDS[0]), writeSerial);
+
+// Start a requested test message and queue its fragments while the queue
+// has room; half of it stays free for short messages
+void sendFragments() {
+  if (longMessage != NULL && !fragmenter.isBusy()) {
+    longMessages.release(longMessage);
+    longMessage = NULL;
+  }
+  uint16_t bulk = bulkRequest.load();
+  if (bulk != 0 && longMessage == NULL) {
+    longMessage = (uint8_t*)longMessages.allocate();
+    if (longMessage == NULL) {
+      // All blocks busy reassembling, try again on the next pass
+      return;
+    }
+    bulkRequest = 0;
+    MessageBuilder<32> head;
+    head.append("Bulk message of ").append(bulk).append(" bytes: ");
+    size_t length = head.length() < bulk ? head.length() : bulk;
+    memcpy(longMessage, head.data(), length);
+    for (size_t i = length; i < bulk; i++) {
+      longMessage[i] = (uint8_t)('0' + i % 10);
+    }
+    fragmenter.start(longMessage, bulk);
+  }
+
+  while (fragmenter.isBusy() && txQueue.size() < 8) {
+    Message message;
+    message.type = FRAME_FRAGMENT;
+    message.length = (uint8_t)fragmenter.next(message.data);
+    message.queuedAt = micros();
+    txQueue.push(message);
+  }
+}
+
+void receiveFragment(const Message& message, unsigned long now) {
+  size_t length = 0;
+  const uint8_t* data = reassembler.add(message.source, message.data, message.length, now, length);
+  if (data == NULL) {
+    return;
+  }
+  messagesReassembled.add();
+  LogLine line;
+  line.append("[CC1101] Long message, ").append((uint32_t)length).append(" bytes:\t")
+      .append((const char*)data, length < 32 ? length : 32).append(length > 32 ? "..." : "");
+  printLine(line);
+}
+
+// Produce outgoing messages and consume delivered ones
+void handleMessages() {
+  unsigned long now = millis();
+  if (currentMode == Mode::TRANSMIT && now - lastMessageTime >= MESSAGE_INTERVAL_MS) {
+    PowerLock lock(power);
+    lastMessageTime = now;
+
+    MessageBuilder<SelectiveRepeatArq::MAX_PAYLOAD> text;
+    text.append("Hello World! #").append(countReceivedPackets++);
+
+    Message message;
+    message.type = FRAME_DATA;
+    message.length = (uint8_t)text.length();
+#if COMPRESSION_ENABLED
+    size_t packed = MessageCompressor::compress(text.data(), text.length(), message.data, sizeof(message.data));
+    if (packed > 0) {
+      payloadSaved.add(text.length() - packed);
+      message.type = FRAME_PACKED;
+      message.length = (uint8_t)packed;
+    }
+#endif
+    if (message.type == FRAME_DATA) {
+      memcpy(message.data, text.data(), text.length());
+    }
+    message.queuedAt = micros();
+    if (!txQueue.push(message)) {
+      txQueueOverflows.add();
+    }
+  }
+
+  sendFragments();
+  reassembler.expire(now);
+  poolInUse.set(longMessages.getInUse());
+  poolPeak.set(longMessages.getPeakInUse());
+  poolFailures.set(longMessages.getFailureCount());
+  reassemblyTimeouts.set(reassembler.getTimeouts());
+  reassemblyEvictions.set(reassembler.getEvictions());
+
+  if (rxQueue.isEmpty()) {
+    return;
+  }
+  PowerLock lock(power);
+  Message message;
+  while (rxQueue.pop(message)) {
+    if (message.type == FRAME_FRAGMENT) {
+      receiveFragment(message, now);
+      continue;
+    }
+
+    // The history keeps messages as they were written
+    if (message.type == FRAME_PACKED) {
+      uint8_t packed[sizeof(message.data)];
+      memcpy(packed, message.data, message.length);
+      int length = MessageCompressor::decompress(packed, message.length, message.data, sizeof(message.data));
+      if (length < 0) {
+        unpackErrors.add();
+        continue;
+      }
+      message.length = (uint8_t)length;
+      message.type = FRAME_DATA;
+    }
+
+    if (messageHistory != NULL) {
+      messageHistory[messageHistoryCount++ % messageHistoryCapacity] = message;
+    }
+
+    LogLine line;
+    line.append("[CC1101] Data:\t\t").append((const char*)message.data, message.length);
+    printLine(line);
+  }
+}
+
+// Radio MAC: interrupt flags, ARQ, FEC, aggregation, hopping
+void radioTask(void* parameter) {
+  (void)parameter;
+  while (true) {
+#if WOR_ENABLED
+    // Nothing to do until the CC1101 hears a sync word. GDO0 still high
+    // means a packet is coming in; a button wake gets time to be handled.
+    if (wor.isAsleep() && !receivedFlag && digitalRead(GDO0_PIN) == LOW &&
+        currentMode == Mode::RECEIVE && millis() - worWokeAt >= WOR_MIN_AWAKE_MS) {
+      lightSleepUntilRadio();
+    }
+#endif
+
+    // Woken by the radio and hop timer interrupts, timers are polled every tick
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1));
+
+    bool changed = modeChanged.exchange(false);
+
+    // Both modes keep receiving so data frames can be acknowledged
+    TRACE(TRACE_RADIO_LOOP, TRACE_BEGIN);
+    TRACE(TRACE_HANDLE_TX, TRACE_BEGIN);
+    handleSentPacket();
+    TRACE(TRACE_HANDLE_TX, TRACE_END);
+    handleReceivedPacket(changed);
+    TRACE(TRACE_RADIO_LOOP, TRACE_END);
+  }
+}
+
+// Audio capture/codec/playback and user interface
+void audioTask(void* parameter) {
+  (void)parameter;
+  while (true) {
+    TRACE(TRACE_ENCODER, TRACE_BEGIN);
+    handleRotatoryEncoder();
+    TRACE(TRACE_ENCODER, TRACE_END);
+    TRACE(TRACE_MESSAGES, TRACE_BEGIN);
+    handleMessages();
+    TRACE(TRACE_MESSAGES, TRACE_END);
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+}
+
+// Drain the binary log to Serial whenever nothing more urgent runs
+void logTask(void* parameter) {
+  (void)parameter;
+  LogRecord record;
+  while (true) {
+    // Commands see the latest state the radio task published
+    while (statusQueue.pop(radioStatus)) {
+    }
+    while (Serial.available() > 0) {
+      console.feed((char)Serial.read());
+    }
+
+    if (!eventLog.read(record)) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+#if LOG_BINARY_OUTPUT
+    // printLine() from other tasks may interleave, but never within a write
+    uint8_t frame[LOG_FRAME_LENGTH];
+    logFrame(record, frame);
+    Serial.write(frame, sizeof(frame));
+#else
+    LogLine line;
+    line.append('[').append(record.timestamp / 1000).append("] ");
+    if (record.event < LOG_EVENT_COUNT) {
+      BinaryLog<512>::format(record, LOG_FORMATS[record.event], line);
+    } else {
+      line.append("unknown event ").append(record.event);
+    }
+    printLine(line);
+#endif
+  }
 }
 
 void loop() {
-  handleRotatoryEncoder();
+  // All work happens in the pinned tasks
+  vTaskDelete(NULL);
 }
\ No newline at end of file
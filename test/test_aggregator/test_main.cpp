@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "FrameAggregator.hpp"
+
+static uint8_t seen[8][MAX_FRAME_LENGTH];
+static size_t seenLength[8];
+static int seenCount;
+
+static void collect(const uint8_t* frame, size_t length) {
+    if (seenCount < 8) {
+        memcpy(seen[seenCount], frame, length);
+        seenLength[seenCount] = length;
+    }
+    seenCount++;
+}
+
+void setUp(void) {
+    seenCount = 0;
+}
+
+void tearDown(void) {}
+
+void test_single_frame_goes_out_bare(void) {
+    FrameAggregator aggregator(MAX_FRAME_LENGTH, 40);
+    uint8_t frame[3] = { FRAME_LINK, 1, 2 };
+    TEST_ASSERT_TRUE(aggregator.add(frame, sizeof(frame), 0));
+    uint8_t out[MAX_FRAME_LENGTH];
+    TEST_ASSERT_EQUAL_size_t(sizeof(frame), aggregator.flush(out));
+    TEST_ASSERT_EQUAL_MEMORY(frame, out, sizeof(frame));
+    TEST_ASSERT_TRUE(aggregator.isEmpty());
+}
+
+void test_frames_round_trip_through_unpack(void) {
+    FrameAggregator aggregator(MAX_FRAME_LENGTH, 40);
+    uint8_t a[2] = { FRAME_WOR, 7 };
+    uint8_t b[5] = { FRAME_DATA, 1, 2, 3, 4 };
+    aggregator.add(a, sizeof(a), 0);
+    aggregator.add(b, sizeof(b), 1);
+    uint8_t out[MAX_FRAME_LENGTH];
+    size_t length = aggregator.flush(out);
+    TEST_ASSERT_EQUAL_size_t(1 + 1 + sizeof(a) + 1 + sizeof(b), length);
+    TEST_ASSERT_EQUAL_INT(2, FrameAggregator::unpack(out, length, collect));
+    TEST_ASSERT_EQUAL_MEMORY(a, seen[0], sizeof(a));
+    TEST_ASSERT_EQUAL_MEMORY(b, seen[1], sizeof(b));
+    TEST_ASSERT_EQUAL_UINT32(1, aggregator.getPacketCount());
+    TEST_ASSERT_EQUAL_UINT32(2, aggregator.getFrameCount());
+}
+
+void test_malformed_aggregates_are_rejected(void) {
+    uint8_t truncated[] = { FRAME_AGGREGATE, 2, 0xAA, 5, 0xBB };
+    TEST_ASSERT_EQUAL_INT(-1, FrameAggregator::unpack(truncated, sizeof(truncated), collect));
+    uint8_t empty[] = { FRAME_AGGREGATE, 0 };
+    TEST_ASSERT_EQUAL_INT(-1, FrameAggregator::unpack(empty, sizeof(empty), collect));
+    uint8_t other[] = { FRAME_DATA, 1 };
+    TEST_ASSERT_EQUAL_INT(-1, FrameAggregator::unpack(other, sizeof(other), collect));
+}
+
+void test_due_after_the_budget_or_when_full(void) {
+    FrameAggregator aggregator(32, 40);
+    uint8_t frame[10] = { FRAME_DATA };
+    TEST_ASSERT_FALSE(aggregator.isDue(0));
+    aggregator.add(frame, sizeof(frame), 100);
+    TEST_ASSERT_FALSE(aggregator.isDue(139));
+    TEST_ASSERT_TRUE(aggregator.isDue(140));
+
+    aggregator.add(frame, sizeof(frame), 101);
+    TEST_ASSERT_FALSE(aggregator.canFit(sizeof(frame)));
+    TEST_ASSERT_FALSE(aggregator.add(frame, sizeof(frame), 102));
+    TEST_ASSERT_TRUE(aggregator.canFit(8));
+    aggregator.add(frame, 8, 102);
+    TEST_ASSERT_TRUE(aggregator.isDue(103));
+}
+
+// Airtime efficiency against added latency for a codec frame every 20 ms,
+// 11 bytes of preamble, sync word, length and CRC per packet
+void test_window_sweep(void) {
+    static const size_t voiceLengths[] = { 8, 16 };
+    static const unsigned long windows[] = { 0, 20, 40, 60, 80, 100 };
+    const double overhead = 4 + 4 + 1 + 2;
+    for (size_t v = 0; v < 2; v++) {
+        double previous = 0;
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            FrameAggregator aggregator(MAX_FRAME_LENGTH, windows[w]);
+            uint8_t frame[32] = { 0 };
+            uint8_t out[MAX_FRAME_LENGTH];
+            double air = 0;
+            double payload = 0;
+            double latency = 0;
+            int frames = 0;
+            unsigned long queued[64];
+            int pending = 0;
+            for (unsigned long t = 0; t < 60000; t++) {
+                if (t % 20 == 0) {
+                    if (!aggregator.canFit(voiceLengths[v])) {
+                        air += aggregator.flush(out) + overhead;
+                        for (int i = 0; i < pending; i++) {
+                            latency += t - queued[i];
+                            frames++;
+                        }
+                        pending = 0;
+                    }
+                    aggregator.add(frame, voiceLengths[v], t);
+                    queued[pending++] = t;
+                    payload += voiceLengths[v];
+                }
+                if (aggregator.isDue(t)) {
+                    air += aggregator.flush(out) + overhead;
+                    for (int i = 0; i < pending; i++) {
+                        latency += t - queued[i];
+                        frames++;
+                    }
+                    pending = 0;
+                }
+            }
+            double efficiency = 100 * payload / air;
+            char line[96];
+            snprintf(line, sizeof(line), "codec frame %2u B, window %3lu ms: efficiency %.1f%%, mean added latency %.1f ms",
+                     (unsigned)voiceLengths[v], windows[w], efficiency, latency / frames);
+            TEST_MESSAGE(line);
+            TEST_ASSERT_TRUE(latency / frames <= windows[w]);
+            TEST_ASSERT_TRUE(efficiency >= previous);
+            previous = efficiency;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_single_frame_goes_out_bare);
+    RUN_TEST(test_frames_round_trip_through_unpack);
+    RUN_TEST(test_malformed_aggregates_are_rejected);
+    RUN_TEST(test_due_after_the_budget_or_when_full);
+    RUN_TEST(test_window_sweep);
+    return UNITY_END();
+}
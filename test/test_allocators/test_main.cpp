@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <chrono>
+#include <unity.h>
+#include "ArenaAllocator.hpp"
+#include "MessageFragments.hpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_arena_aligns_and_runs_out(void) {
+    Arena arena;
+    TEST_ASSERT_TRUE(arena.begin(64, MEMORY_PSRAM));
+    uint8_t* first = (uint8_t*)arena.allocate(3, 1);
+    uint32_t* second = arena.allocateArray<uint32_t>(4);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t)second % alignof(uint32_t));
+    TEST_ASSERT_EQUAL_UINT32(20, arena.getUsed());
+
+    TEST_ASSERT_NULL(arena.allocate(64));
+    TEST_ASSERT_EQUAL_UINT32(1, arena.getFailureCount());
+    TEST_ASSERT_EQUAL_UINT32(2, arena.getAllocationCount());
+
+    arena.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, arena.getUsed());
+    TEST_ASSERT_EQUAL_UINT32(20, arena.getPeak());
+    TEST_ASSERT_NOT_NULL(arena.allocate(64));
+    arena.end();
+}
+
+void test_pool_recycles_blocks(void) {
+    Arena arena;
+    arena.begin(Pool::footprint(68, 8), MEMORY_INTERNAL);
+    Pool pool;
+    TEST_ASSERT_TRUE(pool.begin(arena, 68, 8));
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getBlockSize() % sizeof(void*));
+    TEST_ASSERT_TRUE(pool.getBlockSize() >= 68);
+
+    void* blocks[8];
+    for (int i = 0; i < 8; i++) {
+        blocks[i] = pool.allocate();
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+    }
+    TEST_ASSERT_NULL(pool.allocate());
+    TEST_ASSERT_EQUAL_UINT32(1, pool.getFailureCount());
+    TEST_ASSERT_EQUAL_UINT32(8, pool.getPeakInUse());
+
+    // The block released last is handed out first
+    pool.release(blocks[3]);
+    pool.release(blocks[5]);
+    TEST_ASSERT_EQUAL_PTR(blocks[5], pool.allocate());
+    TEST_ASSERT_EQUAL_PTR(blocks[3], pool.allocate());
+    for (int i = 0; i < 8; i++) {
+        pool.release(blocks[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+    arena.end();
+}
+
+void test_footprint_fits_any_arena_start(void) {
+    // The pool is carved after an oddly sized array, as after the history
+    Arena arena;
+    arena.begin(13 + Pool::footprint(4096, 3), MEMORY_PSRAM);
+    TEST_ASSERT_NOT_NULL(arena.allocate(13, 1));
+    Pool pool;
+    TEST_ASSERT_TRUE(pool.begin(arena, 4096, 3));
+    TEST_ASSERT_EQUAL_UINT32(0, arena.getFailureCount());
+    arena.end();
+}
+
+void test_reassembler_returns_blocks(void) {
+    Arena arena;
+    arena.begin(Pool::footprint(1024, 2), MEMORY_PSRAM);
+    Pool pool;
+    pool.begin(arena, 1024, 2);
+    Reassembler reassembler(100);
+    TEST_ASSERT_TRUE(reassembler.begin(pool, 2));
+
+    // A short fragment that is not the last is rejected without a block
+    uint8_t fragment[Fragmenter::HEADER_LENGTH + 4] = { 1, 0, 0, 2, 'a', 'b', 'c', 'd' };
+    size_t length = 0;
+    TEST_ASSERT_NULL(reassembler.add(7, fragment, sizeof(fragment), 0, length));
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+    TEST_ASSERT_EQUAL_UINT32(1, reassembler.getRejected());
+
+    // An incomplete message holds a block until it times out
+    uint8_t first[Fragmenter::HEADER_LENGTH + Fragmenter::PAYLOAD];
+    memset(first, 'x', sizeof(first));
+    first[0] = 2;
+    first[1] = 0;
+    first[2] = 0;
+    first[3] = 2;
+    TEST_ASSERT_NULL(reassembler.add(7, first, sizeof(first), 0, length));
+    TEST_ASSERT_EQUAL_UINT32(1, pool.getInUse());
+    reassembler.expire(100);
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+    TEST_ASSERT_EQUAL_UINT32(1, reassembler.getTimeouts());
+
+    // A delivered one stays valid until the next call
+    TEST_ASSERT_NULL(reassembler.add(7, first, sizeof(first), 200, length));
+    first[2] = 1;
+    const uint8_t* message = reassembler.add(7, first, Fragmenter::HEADER_LENGTH + 1, 200, length);
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_UINT32(Fragmenter::PAYLOAD + 1, length);
+    TEST_ASSERT_EQUAL_UINT32(1, pool.getInUse());
+    reassembler.expire(200);
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+    arena.end();
+}
+
+// Allocation cost against the arena's pointer bump
+void test_pool_timing(void) {
+    Arena arena;
+    arena.begin(1 << 20, MEMORY_PSRAM);
+    Pool pool;
+    pool.begin(arena, 68, 256);
+
+    const int rounds = 200000;
+    void* blocks[8];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 8; i++) {
+            blocks[i] = pool.allocate();
+        }
+        for (int i = 7; i >= 0; i--) {
+            pool.release(blocks[(i * 3) % 8]);
+        }
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    volatile uintptr_t sink = 0;
+    for (int round = 0; round < rounds; round++) {
+        arena.reset();
+        for (int i = 0; i < 8; i++) {
+            sink += (uintptr_t)arena.allocate(68);
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[96];
+    snprintf(line, sizeof(line), "pool allocate+release %.1f ns, arena allocate %.1f ns",
+             std::chrono::duration<double, std::nano>(middle - start).count() / (rounds * 8),
+             std::chrono::duration<double, std::nano>(end - middle).count() / (rounds * 8));
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getFailureCount());
+    arena.end();
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_arena_aligns_and_runs_out);
+    RUN_TEST(test_pool_recycles_blocks);
+    RUN_TEST(test_footprint_fits_any_arena_start);
+    RUN_TEST(test_reassembler_returns_blocks);
+    RUN_TEST(test_pool_timing);
+    return UNITY_END();
+}
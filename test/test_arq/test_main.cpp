@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <unity.h>
+#include "SelectiveRepeatArq.hpp"
+
+// Sources of the senders
+static const uint16_t A = 0x00A1;
+static const uint16_t C = 0x00C3;
+
+// Messages are "<n> padding..." and have to come out in order, without
+// gaps unless the sender gave up on one
+static int delivered;
+static int expected;
+static bool inOrder;
+static bool gapless;
+
+// Simulated time, when each message was queued and how long each one
+// took until it was delivered (ms)
+static unsigned long clockNow;
+static std::vector<unsigned long> queuedAt;
+static std::vector<unsigned long> latencies;
+
+static void deliver(const uint8_t* data, size_t length, uint8_t type, uint16_t source) {
+    (void)type;
+    (void)source;
+    char text[SelectiveRepeatArq::MAX_PAYLOAD + 1];
+    memcpy(text, data, length);
+    text[length] = '\0';
+    int value = -1;
+    sscanf(text, "%d", &value);
+    if (value < expected) {
+        inOrder = false;
+    } else if (value > expected) {
+        gapless = false;
+    }
+    expected = value + 1;
+    delivered++;
+    if (value >= 0 && (size_t)value < queuedAt.size()) {
+        latencies.push_back(clockNow - queuedAt[value]);
+    }
+}
+
+static size_t message(int n, uint8_t* out) {
+    return (size_t)snprintf((char*)out, SelectiveRepeatArq::MAX_PAYLOAD, "%d padding-padding-padding", n);
+}
+
+// xorshift32, deterministic loss pattern
+static uint32_t lossState;
+
+static bool lost(uint32_t percent) {
+    lossState ^= lossState << 13;
+    lossState ^= lossState >> 17;
+    lossState ^= lossState << 5;
+    return lossState % 100 < percent;
+}
+
+struct Result {
+    unsigned long time;
+    uint32_t retransmitted;
+};
+
+// One sender, one receiver, 10 ms per frame and 3 ms per ACK on air
+static Result run(SelectiveRepeatArq& a, SelectiveRepeatArq& b, int count, uint32_t loss) {
+    uint8_t frame[MAX_FRAME_LENGTH];
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    int queued = 0;
+    unsigned long now = 0;
+    queuedAt.assign(count, 0);
+    while (delivered < count && !(queued == count && a.isIdle())) {
+        while (queued < count && a.send(data, message(queued, data), FRAME_DATA)) {
+            queuedAt[queued] = now;
+            queued++;
+        }
+        size_t length = a.nextFrame(now, frame);
+        now += 10;
+        if (length > 0 && !lost(loss)) {
+            clockNow = now;
+            b.onData(frame, length, A, now, deliver);
+            b.buildAck(ack);
+            now += 3;
+            if (!lost(loss)) {
+                a.onAck(ack, sizeof(ack), now);
+            }
+        }
+    }
+    Result result = { now, a.getRetransmittedCount() };
+    return result;
+}
+
+void setUp(void) {
+    delivered = 0;
+    expected = 0;
+    inOrder = true;
+    gapless = true;
+    lossState = 1;
+    queuedAt.clear();
+    latencies.clear();
+}
+
+void tearDown(void) {}
+
+void test_delivers_in_order_without_loss(void) {
+    SelectiveRepeatArq a(A, 0x1234), b;
+    run(a, b, 100, 0);
+    TEST_ASSERT_EQUAL(100, delivered);
+    TEST_ASSERT_TRUE(inOrder);
+    TEST_ASSERT_TRUE(gapless);
+    TEST_ASSERT_EQUAL_UINT32(0, a.getRetransmittedCount());
+    TEST_ASSERT_TRUE(a.isIdle());
+}
+
+void test_repeats_only_what_was_lost(void) {
+    SelectiveRepeatArq a(A, 1), b;
+    uint8_t data[8] = { '0' };
+    uint8_t frames[3][MAX_FRAME_LENGTH];
+    size_t lengths[3];
+    for (int i = 0; i < 3; i++) {
+        data[0] = (uint8_t)('0' + i);
+        TEST_ASSERT_TRUE(a.send(data, 1));
+        lengths[i] = a.nextFrame(0, frames[i]);
+        TEST_ASSERT_EQUAL_size_t(SelectiveRepeatArq::HEADER_LENGTH + 1, lengths[i]);
+    }
+
+    // Frame 1 is lost, 0 and 2 arrive
+    b.onData(frames[0], lengths[0], A, 0, deliver);
+    b.onData(frames[2], lengths[2], A, 0, deliver);
+    TEST_ASSERT_EQUAL(1, delivered);
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    TEST_ASSERT_EQUAL_size_t(SelectiveRepeatArq::ACK_LENGTH, b.buildAck(ack));
+    TEST_ASSERT_EQUAL_UINT8(FRAME_ACK, ack[0]);
+    TEST_ASSERT_EQUAL_UINT16(A, ack[1] | (ack[2] << 8));
+    TEST_ASSERT_EQUAL_UINT8(1, ack[5]);       // Next expected
+    TEST_ASSERT_EQUAL_UINT8(0x01, ack[6]);    // 2 is held
+    a.onAck(ack, sizeof(ack), 20);
+
+    // Only frame 1 comes again, once its timer ran out
+    uint8_t frame[MAX_FRAME_LENGTH];
+    TEST_ASSERT_EQUAL_size_t(0, a.nextFrame(21, frame));
+    size_t length = a.nextFrame(10000, frame);
+    TEST_ASSERT_EQUAL_size_t(lengths[1], length);
+    TEST_ASSERT_EQUAL_UINT8(1, frame[1]);
+    TEST_ASSERT_EQUAL_size_t(0, a.nextFrame(10000, frame));
+    b.onData(frame, length, A, 0, deliver);
+    TEST_ASSERT_EQUAL(3, delivered);
+    TEST_ASSERT_TRUE(inOrder);
+}
+
+// The sweep behind the goodput figures: up to 40% loss in both directions
+// everything arrives in order, except what ran out of retries
+void test_loss_sweep(void) {
+    static const uint32_t losses[] = { 0, 5, 10, 20, 30, 40 };
+    for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+        setUp();
+        SelectiveRepeatArq a(A, 7), b;
+        Result result = run(a, b, 2000, losses[i]);
+        // Queued until delivered in order, behind whatever was lost before
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (size_t l = 0; l < latencies.size(); l++) {
+            mean += (double)latencies[l] / latencies.size();
+        }
+        unsigned long p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "loss %2u%%: %d/2000 delivered, %.1f msg/s, %u retransmissions, %u given up, latency mean %.0f ms p99 %lu ms",
+                 (unsigned)losses[i], delivered, delivered * 1000.0 / result.time,
+                 (unsigned)result.retransmitted, (unsigned)a.getFailedCount(), mean, p99);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_GREATER_OR_EQUAL(2000, delivered + (int)a.getFailedCount());
+        TEST_ASSERT_TRUE(inOrder);
+        TEST_ASSERT_EQUAL(delivered, latencies.size());
+        if (losses[i] <= 20) {
+            TEST_ASSERT_EQUAL(2000, delivered);
+        }
+    }
+}
+
+// A rebooted sender starts again at sequence 0; with the old session the
+// receiver would have taken its frames for duplicates and ACKed them
+void test_sender_reboot_starts_a_new_session(void) {
+    SelectiveRepeatArq a(A, 0x1111), b;
+    run(a, b, 40, 0);
+    TEST_ASSERT_EQUAL(40, delivered);
+
+    SelectiveRepeatArq rebooted(A, 0x2222);
+    expected = 0;
+    delivered = 0;
+    run(rebooted, b, 5, 0);
+    TEST_ASSERT_EQUAL(5, delivered);
+    TEST_ASSERT_TRUE(inOrder);
+    TEST_ASSERT_EQUAL_UINT32(0, b.getDuplicateCount());
+}
+
+void test_ack_of_another_session_is_ignored(void) {
+    SelectiveRepeatArq a(A, 0x1111), b(0), stale;
+    uint8_t data[4] = { '0' };
+    uint8_t frame[MAX_FRAME_LENGTH];
+    a.send(data, 1);
+    size_t length = a.nextFrame(0, frame);
+
+    // A receiver still in an old session of ours claims everything arrived
+    uint8_t old[MAX_FRAME_LENGTH];
+    SelectiveRepeatArq previous(A, 0x0999);
+    previous.send(data, 1);
+    stale.onData(old, previous.nextFrame(0, old), A, 0, NULL);
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    stale.buildAck(ack);
+    a.onAck(ack, sizeof(ack), 5);
+    TEST_ASSERT_FALSE(a.isIdle());
+
+    b.onData(frame, length, A, 0, deliver);
+    b.buildAck(ack);
+    a.onAck(ack, sizeof(ack), 5);
+    TEST_ASSERT_TRUE(a.isIdle());
+}
+
+// A receiver that lost its state mid-stream starts at the sender's base
+// instead of waiting for frames that were ACKed long ago
+void test_receiver_reboot_follows_the_sender(void) {
+    SelectiveRepeatArq a(A, 0x4242), b;
+    run(a, b, 50, 0);
+
+    SelectiveRepeatArq rebooted;
+    expected = 50;
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_LENGTH];
+    for (int n = 50; n < 53; n++) {
+        a.send(data, message(n, data));
+    }
+    for (size_t length; (length = a.nextFrame(100000, frame)) > 0;) {
+        rebooted.onData(frame, length, A, 0, deliver);
+    }
+    TEST_ASSERT_EQUAL(53, delivered);
+    TEST_ASSERT_TRUE(inOrder);
+}
+
+// Frames the sender gave up on are skipped once its base moves past them
+void test_receiver_skips_frames_given_up(void) {
+    SelectiveRepeatArq a(A, 3), b;
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_LENGTH];
+    a.send(data, message(0, data));
+    b.onData(frame, a.nextFrame(0, frame), A, 0, deliver);
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    a.onAck(ack, b.buildAck(ack), 1);
+
+    // Message 1 never makes it
+    a.send(data, message(1, data));
+    unsigned long now = 1;
+    for (uint8_t i = 0; i <= SelectiveRepeatArq::MAX_RETRIES; i++) {
+        TEST_ASSERT_GREATER_THAN(0, a.nextFrame(now, frame));
+        now += SelectiveRepeatArq::MAX_RTO;
+    }
+    TEST_ASSERT_EQUAL_size_t(0, a.nextFrame(now, frame));
+    TEST_ASSERT_EQUAL_UINT32(1, a.getFailedCount());
+    TEST_ASSERT_TRUE(a.isIdle());
+
+    a.send(data, message(2, data));
+    b.onData(frame, a.nextFrame(now, frame), A, 0, deliver);
+    TEST_ASSERT_EQUAL(2, delivered);
+    TEST_ASSERT_FALSE(gapless);
+    TEST_ASSERT_EQUAL_UINT32(1, b.getSkippedCount());
+}
+
+void test_rto_follows_the_round_trip(void) {
+    SelectiveRepeatArq a(A, 5), b;
+    run(a, b, 200, 0);
+    // 13 ms per exchange, the RTO settles at the lower clamp
+    TEST_ASSERT_EQUAL_UINT32(SelectiveRepeatArq::MIN_RTO, a.getRto());
+    TEST_ASSERT_UINT32_WITHIN(2, 13, a.getSmoothedRtt());
+}
+
+// Two units talking to the same receiver each keep their own window; with
+// a single one they would reset each other's session on every frame
+static int deliveredFrom[2];
+static int expectedFrom[2];
+static bool inOrderFrom[2];
+
+static void deliverTwo(const uint8_t* data, size_t length, uint8_t type, uint16_t source) {
+    (void)type;
+    char text[SelectiveRepeatArq::MAX_PAYLOAD + 1];
+    memcpy(text, data, length);
+    text[length] = '\0';
+    int value = -1;
+    sscanf(text, "%d", &value);
+    int from = source == C ? 1 : 0;
+    inOrderFrom[from] = inOrderFrom[from] && value == expectedFrom[from];
+    expectedFrom[from] = value + 1;
+    deliveredFrom[from]++;
+}
+
+void test_senders_keep_their_own_windows(void) {
+    SelectiveRepeatArq senders[2] = { SelectiveRepeatArq(A, 0x0101), SelectiveRepeatArq(C, 0x0101) };
+    const uint16_t sources[2] = { A, C };
+    SelectiveRepeatArq b;
+    memset(deliveredFrom, 0, sizeof(deliveredFrom));
+    memset(expectedFrom, 0, sizeof(expectedFrom));
+    inOrderFrom[0] = inOrderFrom[1] = true;
+
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_LENGTH];
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    int queued[2] = { 0, 0 };
+    unsigned long now = 0;
+    while (deliveredFrom[0] < 200 || deliveredFrom[1] < 200) {
+        for (int i = 0; i < 2; i++) {
+            while (queued[i] < 200 && senders[i].send(data, message(queued[i], data))) {
+                queued[i]++;
+            }
+            size_t length = senders[i].nextFrame(now, frame);
+            now += 10;
+            if (length > 0 && !lost(10)) {
+                b.onData(frame, length, sources[i], now, deliverTwo);
+            }
+            // Both senders hear every ACK, each takes only its own
+            while (b.ackPending()) {
+                size_t ackLength = b.buildAck(ack);
+                now += 3;
+                if (!lost(10)) {
+                    bool first = senders[0].onAck(ack, ackLength, now);
+                    bool second = senders[1].onAck(ack, ackLength, now);
+                    TEST_ASSERT_TRUE(first != second);
+                }
+            }
+        }
+        TEST_ASSERT_LESS_THAN(1000000, now);
+    }
+    TEST_ASSERT_EQUAL(200, deliveredFrom[0]);
+    TEST_ASSERT_EQUAL(200, deliveredFrom[1]);
+    TEST_ASSERT_TRUE(inOrderFrom[0]);
+    TEST_ASSERT_TRUE(inOrderFrom[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, b.getSkippedCount());
+}
+
+// Group members do not answer, the frame goes out once and is delivered
+// as it comes
+void test_group_traffic_is_sent_once(void) {
+    SelectiveRepeatArq a(A, 9), b, c;
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_LENGTH];
+    TEST_ASSERT_TRUE(a.send(data, message(0, data), FRAME_DATA, false));
+    size_t length = a.nextFrame(0, frame);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_TRUE(a.isIdle());
+    TEST_ASSERT_EQUAL_size_t(0, a.nextFrame(SelectiveRepeatArq::MAX_RTO * 10, frame));
+
+    b.onData(frame, length, A, 0, deliver);
+    expected = 0;
+    c.onData(frame, length, A, 0, deliver);
+    TEST_ASSERT_EQUAL(2, delivered);
+    TEST_ASSERT_FALSE(b.ackPending());
+    TEST_ASSERT_FALSE(c.ackPending());
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    TEST_ASSERT_EQUAL_size_t(0, b.buildAck(ack));
+}
+
+// Even with the same session, an ACK addressed to another unit is ignored
+void test_ack_for_another_unit_is_ignored(void) {
+    SelectiveRepeatArq a(A, 0x0777), c(C, 0x0777), b;
+    uint8_t data[4] = { '0' };
+    uint8_t frame[MAX_FRAME_LENGTH];
+    a.send(data, 1);
+    c.send(data, 1);
+    c.nextFrame(0, frame);
+    b.onData(frame, a.nextFrame(0, frame), A, 0, deliver);
+
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    TEST_ASSERT_EQUAL_size_t(SelectiveRepeatArq::ACK_LENGTH, b.buildAck(A, ack));
+    TEST_ASSERT_FALSE(c.onAck(ack, sizeof(ack), 1));
+    TEST_ASSERT_FALSE(c.isIdle());
+    TEST_ASSERT_TRUE(a.onAck(ack, sizeof(ack), 1));
+    TEST_ASSERT_TRUE(a.isIdle());
+}
+
+// The least recently heard sender loses its window to a new one and
+// starts over at its base when it comes back
+void test_least_recently_heard_sender_makes_room(void) {
+    SelectiveRepeatArq b;
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+    uint8_t frame[MAX_FRAME_LENGTH];
+    uint8_t ack[SelectiveRepeatArq::ACK_LENGTH];
+    SelectiveRepeatArq first(A, 1);
+    first.send(data, message(0, data));
+    b.onData(frame, first.nextFrame(0, frame), A, 0, deliver);
+    TEST_ASSERT_TRUE(first.onAck(ack, b.buildAck(A, ack), 1));
+
+    for (uint16_t i = 0; i < SelectiveRepeatArq::MAX_PEERS; i++) {
+        SelectiveRepeatArq other((uint16_t)(0x100 + i), 2);
+        other.send(data, message(0, data));
+        b.onData(frame, other.nextFrame(0, frame), (uint16_t)(0x100 + i), 10 + i, NULL);
+        TEST_ASSERT_EQUAL_size_t(SelectiveRepeatArq::ACK_LENGTH, b.buildAck((uint16_t)(0x100 + i), ack));
+    }
+    TEST_ASSERT_EQUAL_size_t(0, b.buildAck(A, ack));
+
+    first.send(data, message(1, data));
+    b.onData(frame, first.nextFrame(100, frame), A, 100, deliver);
+    TEST_ASSERT_EQUAL(2, delivered);
+    TEST_ASSERT_TRUE(gapless);
+    TEST_ASSERT_TRUE(first.onAck(ack, b.buildAck(A, ack), 101));
+    TEST_ASSERT_TRUE(first.isIdle());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_delivers_in_order_without_loss);
+    RUN_TEST(test_repeats_only_what_was_lost);
+    RUN_TEST(test_loss_sweep);
+    RUN_TEST(test_sender_reboot_starts_a_new_session);
+    RUN_TEST(test_ack_of_another_session_is_ignored);
+    RUN_TEST(test_receiver_reboot_follows_the_sender);
+    RUN_TEST(test_receiver_skips_frames_given_up);
+    RUN_TEST(test_rto_follows_the_round_trip);
+    RUN_TEST(test_senders_keep_their_own_windows);
+    RUN_TEST(test_group_traffic_is_sent_once);
+    RUN_TEST(test_ack_for_another_unit_is_ignored);
+    RUN_TEST(test_least_recently_heard_sender_makes_room);
+    return UNITY_END();
+}
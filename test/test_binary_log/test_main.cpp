@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unity.h>
+#include "BinaryLog.hpp"
+#include "LogEvents.hpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_write_read_and_drop(void) {
+    BinaryLog<4> log;
+    LogRecord record;
+    TEST_ASSERT_FALSE(log.read(record));
+    for (int32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(log.write(LOG_RX_LQI, 100 + i, 1, i));
+    }
+    TEST_ASSERT_FALSE(log.write(LOG_RX_LQI, 200, 1, 9));
+    TEST_ASSERT_EQUAL_UINT32(1, log.getDroppedCount());
+
+    for (int32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(log.read(record));
+        TEST_ASSERT_EQUAL_UINT32(100 + i, record.timestamp);
+        TEST_ASSERT_EQUAL_INT(i, record.args[0]);
+    }
+    TEST_ASSERT_FALSE(log.read(record));
+}
+
+void test_format_placeholders(void) {
+    LogRecord record = { 0, LOG_RX_RSSI, 3, 0, { -9850, 42, 0xAB } };
+    MessageBuilder<64> line;
+    BinaryLog<2>::format(record, "rssi {.2} lqi {} id {x} none {}", line);
+    TEST_ASSERT_EQUAL_STRING("rssi -98.50 lqi 42 id AB none 0", line.c_str());
+
+    line.clear();
+    BinaryLog<2>::format(record, LOG_FORMATS[LOG_RX_RSSI], line);
+    TEST_ASSERT_EQUAL_STRING("[CC1101] RSSI:\t\t-98.50 dBm", line.c_str());
+}
+
+// Text printed by other tasks lands between whole frames, the decoder's
+// scan for the marker finds every record again
+void test_frames_survive_interleaved_text(void) {
+    uint8_t capture[256];
+    size_t length = 0;
+    const char* noise = "[CC1101] Data:\t\tHello\r\n";
+    for (int32_t i = 0; i < 3; i++) {
+        memcpy(capture + length, noise, strlen(noise));
+        length += strlen(noise);
+        LogRecord record = { (uint32_t)i, LOG_RX_LQI, 1, 0, { i * 7, 0, 0 } };
+        logFrame(record, capture + length);
+        length += LOG_FRAME_LENGTH;
+    }
+
+    int32_t decoded = 0;
+    for (size_t i = 1; i + sizeof(LogRecord) < length; i++) {
+        if (capture[i - 1] != LOG_SYNC[0] || capture[i] != LOG_SYNC[1]) {
+            continue;
+        }
+        LogRecord record;
+        memcpy(&record, capture + i + 1, sizeof(record));
+        TEST_ASSERT_EQUAL_UINT32(LOG_RX_LQI, record.event);
+        TEST_ASSERT_EQUAL_INT(decoded * 7, record.args[0]);
+        decoded++;
+        i += sizeof(record);
+    }
+    TEST_ASSERT_EQUAL_INT(3, decoded);
+}
+
+// Two writers, as the radio task and an ISR, and the log task draining
+void test_concurrent_writers_keep_their_order(void) {
+    static BinaryLog<512> log;
+    const int32_t count = 100000;
+    std::atomic<int> done(0);
+    std::thread first([&]() {
+        for (int32_t i = 0; i < count;) {
+            if (log.write(1, 0, 1, i)) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        done++;
+    });
+    std::thread second([&]() {
+        for (int32_t i = 0; i < count;) {
+            if (log.write(2, 0, 1, i)) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        done++;
+    });
+
+    int32_t last[3] = { -1, -1, -1 };
+    bool ordered = true;
+    long received = 0;
+    LogRecord record;
+    while (received < 2L * count) {
+        if (log.read(record)) {
+            ordered = ordered && record.args[0] == last[record.event] + 1;
+            last[record.event] = record.args[0];
+            received++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    first.join();
+    second.join();
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_INT(2, done.load());
+}
+
+// What a hot path pays per record against formatting a line in place
+void test_write_timing(void) {
+    static BinaryLog<512> log;
+    const int rounds = 1000000;
+    LogRecord record;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        log.write(LOG_RX_RSSI, i, 1, -9850);
+        log.read(record);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    volatile size_t sink = 0;
+    for (int i = 0; i < rounds; i++) {
+        MessageBuilder<96> line;
+        line.append("[CC1101] RSSI:\t\t").append(-98.5f).append(" dBm");
+        sink += line.length();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[96];
+    snprintf(line, sizeof(line), "log write+read %.1f ns, formatting in place %.1f ns",
+             std::chrono::duration<double, std::nano>(middle - start).count() / rounds,
+             std::chrono::duration<double, std::nano>(end - middle).count() / rounds);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(0, log.getDroppedCount());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_write_read_and_drop);
+    RUN_TEST(test_format_placeholders);
+    RUN_TEST(test_frames_survive_interleaved_text);
+    RUN_TEST(test_concurrent_writers_keep_their_order);
+    RUN_TEST(test_write_timing);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unity.h>
+#include "FrameCipher.hpp"
+
+static const uint8_t KEY[FrameCipher::KEY_LENGTH] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+};
+
+// The ciphers are large, one pair shared by all tests
+static FrameCipher sender;
+static FrameCipher receiver;
+
+static size_t sealed(uint8_t* frame, uint8_t fill, size_t length = 20) {
+    if (sender.needsEpoch()) {
+        sender.setEpoch(1);
+    }
+    memset(frame, fill, length);
+    return sender.seal(5, frame, length);
+}
+
+void setUp(void) {
+    sender = FrameCipher();
+    receiver = FrameCipher();
+    sender.setSource(0xBEEF);
+    receiver.setSource(0x1234);
+    sender.setKey(5, KEY);
+    receiver.setKey(5, KEY);
+}
+
+void tearDown(void) {}
+
+// AES-128-CCM, 7 byte nonce, 8 bytes associated data, 4 byte tag;
+// expected output from OpenSSL's EVP_aes_128_ccm
+void test_seal_matches_reference_ccm(void) {
+    static const uint8_t expected[FrameCipher::HEADER_LENGTH + 20 + FrameCipher::TAG_LENGTH] = {
+        FRAME_SECURE, 0x05, 0xEF, 0xBE, 0x00, 0x00, 0x07, 0x00,
+        0x49, 0x9E, 0x70, 0x4C, 0x9C, 0x2F, 0x6C, 0xDB, 0xFB, 0x1B,
+        0xD9, 0x43, 0xC7, 0xF6, 0x2A, 0xD7, 0x0B, 0x17, 0xC0, 0x55,
+        0x0A, 0xBB, 0x13, 0xA9
+    };
+    uint8_t frame[MAX_FRAME_LENGTH];
+    for (uint8_t i = 0; i < 20; i++) {
+        frame[i] = i;
+    }
+    sender.setEpoch(7);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(expected), sender.seal(5, frame, 20));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, frame, sizeof(expected));
+
+    size_t length = 0;
+    const uint8_t* plain = receiver.open(frame, sizeof(expected), length);
+    TEST_ASSERT_NOT_NULL(plain);
+    TEST_ASSERT_EQUAL_UINT32(20, length);
+    for (uint8_t i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL_UINT8(i, plain[i]);
+    }
+}
+
+void test_tampered_frames_fail(void) {
+    srand(1);
+    uint8_t frame[MAX_FRAME_LENGTH];
+    for (int i = 0; i < 500; i++) {
+        size_t plainLength = 1 + rand() % (MAX_FRAME_LENGTH - FrameCipher::OVERHEAD);
+        size_t length = sealed(frame, (uint8_t)i, plainLength);
+        frame[rand() % length] ^= (uint8_t)(1 << (rand() % 8));
+        size_t out;
+        TEST_ASSERT_NULL(receiver.open(frame, length, out));
+    }
+    TEST_ASSERT_EQUAL_UINT32(500, receiver.getFailures());
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.getOpened());
+
+    // Unknown group, too short
+    size_t length = sealed(frame, 0);
+    receiver.clearKey(5);
+    size_t out;
+    TEST_ASSERT_NULL(receiver.open(frame, length, out));
+    TEST_ASSERT_NULL(receiver.open(frame, FrameCipher::OVERHEAD, out));
+}
+
+void test_needs_key_and_epoch(void) {
+    uint8_t frame[MAX_FRAME_LENGTH] = { 0 };
+    TEST_ASSERT_EQUAL_UINT32(0, sender.seal(6, frame, 10));
+    TEST_ASSERT_TRUE(sender.needsEpoch());
+    TEST_ASSERT_EQUAL_UINT32(0, sender.seal(5, frame, 10));
+    TEST_ASSERT_EQUAL_UINT32(0, sender.seal(5, frame, MAX_FRAME_LENGTH - FrameCipher::OVERHEAD + 1));
+
+    // A new epoch every 65536 frames
+    sender.setEpoch(1);
+    for (uint32_t i = 0; i < 65535; i++) {
+        sender.seal(5, frame, 10);
+    }
+    TEST_ASSERT_FALSE(sender.needsEpoch());
+    TEST_ASSERT_EQUAL_UINT32(10 + FrameCipher::OVERHEAD, sender.seal(5, frame, 10));
+    TEST_ASSERT_TRUE(sender.needsEpoch());
+    TEST_ASSERT_EQUAL_UINT32(0, sender.seal(5, frame, 10));
+}
+
+void test_replays_rejected(void) {
+    uint8_t first[MAX_FRAME_LENGTH];
+    size_t firstLength = sealed(first, 0x11);
+    uint8_t copy[MAX_FRAME_LENGTH];
+    memcpy(copy, first, firstLength);
+
+    size_t out;
+    TEST_ASSERT_NOT_NULL(receiver.open(first, firstLength, out));
+    TEST_ASSERT_NULL(receiver.open(copy, firstLength, out));
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.getReplays());
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.getFailures());
+
+    // Out of order within the window is fine, once
+    uint8_t frames[4][MAX_FRAME_LENGTH];
+    size_t lengths[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        lengths[i] = sealed(frames[i], i);
+    }
+    uint8_t held[MAX_FRAME_LENGTH];
+    memcpy(held, frames[1], lengths[1]);
+    TEST_ASSERT_NOT_NULL(receiver.open(frames[3], lengths[3], out));
+    TEST_ASSERT_NOT_NULL(receiver.open(frames[0], lengths[0], out));
+    TEST_ASSERT_NOT_NULL(receiver.open(frames[1], lengths[1], out));
+    TEST_ASSERT_NULL(receiver.open(held, lengths[1], out));
+    TEST_ASSERT_NOT_NULL(receiver.open(frames[2], lengths[2], out));
+
+    // Anything older than the window, recorded long ago
+    uint8_t old[MAX_FRAME_LENGTH];
+    size_t oldLength = sealed(old, 0x22);
+    for (uint32_t i = 0; i < FrameCipher::REPLAY_WINDOW; i++) {
+        size_t length = sealed(copy, 0x33);
+        TEST_ASSERT_NOT_NULL(receiver.open(copy, length, out));
+    }
+    TEST_ASSERT_NULL(receiver.open(old, oldLength, out));
+    TEST_ASSERT_EQUAL_UINT32(3, receiver.getReplays());
+
+    // A reboot continues in a later epoch
+    sender.setEpoch(2);
+    size_t length = sealed(copy, 0x44);
+    TEST_ASSERT_NOT_NULL(receiver.open(copy, length, out));
+}
+
+void test_replay_window_per_source(void) {
+    static FrameCipher other;
+    other = FrameCipher();
+    other.setSource(0xCAFE);
+    other.setKey(5, KEY);
+    other.setEpoch(1);
+
+    uint8_t frame[MAX_FRAME_LENGTH];
+    size_t out;
+    // Both start at the same counter, neither is a replay of the other
+    size_t length = sealed(frame, 0x55);
+    TEST_ASSERT_NOT_NULL(receiver.open(frame, length, out));
+    memset(frame, 0x55, 20);
+    length = other.seal(5, frame, 20);
+    TEST_ASSERT_NOT_NULL(receiver.open(frame, length, out));
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.getReplays());
+}
+
+// Nothing is sealed without a unit ID, nor once another unit turns up
+// sealing with ours: their nonces would repeat
+void test_unit_id_required_and_unique(void) {
+    uint8_t frame[MAX_FRAME_LENGTH] = { 0 };
+    sender.setSource(0);
+    sender.setEpoch(1);
+    TEST_ASSERT_FALSE(sender.hasSource());
+    TEST_ASSERT_EQUAL_UINT32(0, sender.seal(5, frame, 10));
+
+    // The other unit was given the receiver's ID
+    sender.setSource(0x1234);
+    size_t length = sealed(frame, 0x66);
+    TEST_ASSERT_TRUE(length > 0);
+    size_t out;
+    TEST_ASSERT_NULL(receiver.open(frame, length, out));
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.getConflicts());
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.getFailures());
+    TEST_ASSERT_TRUE(receiver.hasConflict());
+    receiver.setEpoch(1);
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.seal(5, frame, 10));
+
+    // Reprovisioned, and the ID it was heard with is known
+    sender.setSource(0xBEEF);
+    receiver.setSource(0x4321);
+    TEST_ASSERT_FALSE(receiver.hasConflict());
+    TEST_ASSERT_EQUAL_UINT32(10 + FrameCipher::OVERHEAD, receiver.seal(5, frame, 10));
+    length = sealed(frame, 0x77);
+    TEST_ASSERT_NOT_NULL(receiver.open(frame, length, out));
+    TEST_ASSERT_TRUE(receiver.hasHeard(0xBEEF));
+    TEST_ASSERT_FALSE(receiver.hasHeard(0x1234));
+}
+
+void test_seal_open_cost(void) {
+    static const size_t sizes[] = { 16, 64, 128, MAX_FRAME_LENGTH - FrameCipher::OVERHEAD };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint8_t frame[MAX_FRAME_LENGTH];
+        const int frames = 2000;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            size_t length = sealed(frame, (uint8_t)i, sizes[s]);
+            size_t out;
+            TEST_ASSERT_NOT_NULL(receiver.open(frame, length, out));
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        char line[80];
+        snprintf(line, sizeof(line), "%3u bytes: seal and open %.2f us",
+                 (unsigned int)sizes[s], std::chrono::duration<double, std::micro>(end - start).count() / frames);
+        TEST_MESSAGE(line);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_seal_matches_reference_ccm);
+    RUN_TEST(test_tampered_frames_fail);
+    RUN_TEST(test_needs_key_and_epoch);
+    RUN_TEST(test_replays_rejected);
+    RUN_TEST(test_replay_window_per_source);
+    RUN_TEST(test_unit_id_required_and_unique);
+    RUN_TEST(test_seal_open_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unity.h>
+#include "MessageCompressor.hpp"
+
+static const char* const FIELD_TEXT[] = {
+    "roger, on my way to the meeting point", "copy that, standing by", "battery low, 20 percent left",
+    "arrived at checkpoint 3", "where are you?", "signal weak, please repeat", "status report: all units ok",
+    "leaving base camp in 10 minutes", "wind strong from the north, rain", "need medical assistance at position 4",
+    "thanks, over and out", "request permission to move east 2 kilometers", "negative, hold position",
+    "waiting at the bridge", "how many people are with you?", "temperature dropping fast, fog coming in",
+    "check in every 30 minutes please", "lost contact with team B", "returning to base", "ok",
+    "ETA 15 min", "GPS 47.3769N 8.5417E", "Can you bring water?", "we stopped for lunch at the hut",
+    "say again, message received garbled", "all clear on the east side", "moving to the south ridge",
+    "unable to comply, path blocked by snow", "Evacuate the west slope now", "will do, wilco"
+};
+static const size_t FIELD_COUNT = sizeof(FIELD_TEXT) / sizeof(FIELD_TEXT[0]);
+
+// Compresses, decompresses and compares; the compressed length, or the
+// original one if it was sent as is
+static size_t roundTrip(const uint8_t* in, size_t length) {
+    uint8_t packed[64];
+    uint8_t unpacked[64];
+    size_t packedLength = MessageCompressor::compress(in, length, packed, sizeof(packed));
+    if (packedLength == 0) {
+        return length;
+    }
+    TEST_ASSERT_TRUE(packedLength < length);
+    int unpackedLength = MessageCompressor::decompress(packed, packedLength, unpacked, sizeof(unpacked));
+    TEST_ASSERT_EQUAL_INT(length, unpackedLength);
+    TEST_ASSERT_EQUAL_MEMORY(in, unpacked, length);
+    return packedLength;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_field_text_round_trip(void) {
+    size_t in = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < FIELD_COUNT; i++) {
+        size_t length = strlen(FIELD_TEXT[i]);
+        in += length;
+        out += roundTrip((const uint8_t*)FIELD_TEXT[i], length);
+    }
+    char line[80];
+    snprintf(line, sizeof(line), "field text: %u -> %u bytes, ratio %.2f",
+             (unsigned int)in, (unsigned int)out, (double)in / out);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(out * 5 < in * 4);
+}
+
+void test_repeats_and_high_bytes(void) {
+    // The firmware's own test message, matched from the dictionary
+    const char* hello = "Hello World! #42";
+    TEST_ASSERT_TRUE(roundTrip((const uint8_t*)hello, strlen(hello)) < strlen(hello));
+
+    // A match overlapping its own output
+    const char* run = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+    TEST_ASSERT_TRUE(roundTrip((const uint8_t*)run, strlen(run)) <= 8);
+
+    // Bytes above 0x7F go out escaped
+    const char* umlauts = "Gr\xC3\xBC\xC3\x9F""e aus Z\xC3\xBCrich, Gr\xC3\xBC\xC3\x9F""e";
+    roundTrip((const uint8_t*)umlauts, strlen(umlauts));
+}
+
+void test_incompressible_sent_as_is(void) {
+    uint8_t packed[64];
+    TEST_ASSERT_EQUAL_UINT32(0, MessageCompressor::compress(NULL, 0, packed, sizeof(packed)));
+    TEST_ASSERT_EQUAL_UINT32(0, MessageCompressor::compress((const uint8_t*)"ok", 2, packed, sizeof(packed)));
+
+    srand(3);
+    for (int i = 0; i < 50; i++) {
+        uint8_t random[48];
+        for (size_t j = 0; j < sizeof(random); j++) {
+            random[j] = (uint8_t)rand();
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, MessageCompressor::compress(random, sizeof(random), packed, sizeof(packed)));
+    }
+
+    // Not enough room is the same as not shorter
+    const char* text = FIELD_TEXT[0];
+    TEST_ASSERT_EQUAL_UINT32(0, MessageCompressor::compress((const uint8_t*)text, strlen(text), packed, 4));
+}
+
+void test_damaged_input_stays_in_bounds(void) {
+    uint8_t packed[64];
+    uint8_t unpacked[64];
+    const char* text = FIELD_TEXT[9];
+    size_t length = MessageCompressor::compress((const uint8_t*)text, strlen(text), packed, sizeof(packed));
+    TEST_ASSERT_TRUE(length > 0);
+    // Too little room, and a match cut off after its first byte
+    TEST_ASSERT_EQUAL_INT(-1, MessageCompressor::decompress(packed, length, unpacked, strlen(text) - 1));
+    const uint8_t truncated[] = { 'a', 0x80 };
+    TEST_ASSERT_EQUAL_INT(-1, MessageCompressor::decompress(truncated, sizeof(truncated), unpacked, sizeof(unpacked)));
+
+    // Random input never writes past capacity (ASan watches the buffer)
+    srand(9);
+    for (int i = 0; i < 20000; i++) {
+        uint8_t junk[40];
+        for (size_t j = 0; j < sizeof(junk); j++) {
+            junk[j] = (uint8_t)rand();
+        }
+        uint8_t* out = new uint8_t[16];
+        int result = MessageCompressor::decompress(junk, 1 + rand() % sizeof(junk), out, 16);
+        delete[] out;
+        TEST_ASSERT_TRUE(result >= -1 && result <= 16);
+    }
+}
+
+void test_throughput(void) {
+    uint8_t packed[64];
+    uint8_t unpacked[64];
+    size_t lengths[FIELD_COUNT];
+    uint8_t encoded[FIELD_COUNT][64];
+    size_t bytes = 0;
+    for (size_t i = 0; i < FIELD_COUNT; i++) {
+        lengths[i] = MessageCompressor::compress((const uint8_t*)FIELD_TEXT[i], strlen(FIELD_TEXT[i]),
+                                                 encoded[i], sizeof(encoded[i]));
+        bytes += strlen(FIELD_TEXT[i]);
+    }
+
+    const int rounds = 200;
+    volatile size_t sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < FIELD_COUNT; i++) {
+            sink += MessageCompressor::compress((const uint8_t*)FIELD_TEXT[i], strlen(FIELD_TEXT[i]),
+                                                packed, sizeof(packed));
+        }
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < FIELD_COUNT; i++) {
+            if (lengths[i] != 0) {
+                sink += MessageCompressor::decompress(encoded[i], lengths[i], unpacked, sizeof(unpacked));
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double megabytes = (double)bytes * rounds / 1e6;
+    char line[80];
+    snprintf(line, sizeof(line), "encode %.2f MB/s, decode %.1f MB/s",
+             megabytes / std::chrono::duration<double>(middle - start).count(),
+             megabytes / std::chrono::duration<double>(end - middle).count());
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(sink > 0);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_field_text_round_trip);
+    RUN_TEST(test_repeats_and_high_bytes);
+    RUN_TEST(test_incompressible_sent_as_is);
+    RUN_TEST(test_damaged_input_stays_in_bounds);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
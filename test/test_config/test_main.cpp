@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <unity.h>
+#include "ConfigStore.hpp"
+
+static char directory[] = "/tmp/config_test_XXXXXX";
+
+static ConfigProfile fieldProfile() {
+    ConfigProfile profile;
+    profile.frequency = 433.92f;
+    profile.bitRate = 38.4f;
+    profile.power = -5;
+    profile.syncWord = 0xD391;
+    profile.hopSeed = 0x5A17C0DE;
+    profile.macFlags = MAC_FEC | MAC_HOPPING;
+    profile.registersValid = 1;
+    for (int i = 0; i < CC1101_CONFIG_REGISTERS; i++) {
+        profile.registers[i] = (uint8_t)(i * 7);
+    }
+    profile.calibrated = 1;
+    profile.fscal[5][1] = 0x2A;
+    profile.maxLinkProfile = 3;
+    profile.manualModem = 1;
+    return profile;
+}
+
+// The blob with its payload cut (or extended) to the given length
+static size_t resize(const uint8_t* blob, size_t length, size_t payload, uint8_t* out) {
+    size_t stored = length - ConfigProfile::HEADER_LENGTH - 2;
+    memcpy(out, blob, ConfigProfile::HEADER_LENGTH + (payload < stored ? payload : stored));
+    if (payload > stored) {
+        memset(out + ConfigProfile::HEADER_LENGTH + stored, 0xEE, payload - stored);
+    }
+    out[4] = (uint8_t)payload;
+    out[5] = (uint8_t)(payload >> 8);
+    uint16_t crc = ConfigProfile::crc16(out, ConfigProfile::HEADER_LENGTH + payload);
+    out[ConfigProfile::HEADER_LENGTH + payload] = (uint8_t)crc;
+    out[ConfigProfile::HEADER_LENGTH + payload + 1] = (uint8_t)(crc >> 8);
+    return ConfigProfile::HEADER_LENGTH + payload + 2;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_store_round_trip(void) {
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(directory));
+    ConfigProfile saved = fieldProfile();
+    TEST_ASSERT_TRUE(store.save("field", saved));
+    TEST_ASSERT_TRUE(store.setActive("field"));
+
+    char name[16];
+    TEST_ASSERT_TRUE(store.getActive(name, sizeof(name)));
+    TEST_ASSERT_EQUAL_STRING("field", name);
+
+    ConfigProfile loaded;
+    TEST_ASSERT_TRUE(store.load("field", loaded));
+    TEST_ASSERT_EQUAL_FLOAT(433.92f, loaded.frequency);
+    TEST_ASSERT_EQUAL_INT(-5, loaded.power);
+    TEST_ASSERT_EQUAL_UINT32(0xD391, loaded.syncWord);
+    TEST_ASSERT_EQUAL_UINT8(46 * 7, loaded.registers[46]);
+    TEST_ASSERT_EQUAL_UINT8(0x2A, loaded.fscal[5][1]);
+    TEST_ASSERT_EQUAL_UINT8(3, loaded.maxLinkProfile);
+    TEST_ASSERT_EQUAL_UINT8(1, loaded.manualModem);
+
+    TEST_ASSERT_FALSE(store.load("missing", loaded));
+    TEST_ASSERT_FALSE(store.load("waytoolongname_x", loaded));
+    TEST_ASSERT_TRUE(store.remove("field"));
+    TEST_ASSERT_FALSE(store.load("field", loaded));
+}
+
+void test_damaged_blob_is_rejected(void) {
+    uint8_t blob[ConfigProfile::MAX_LENGTH];
+    ConfigProfile saved = fieldProfile();
+    size_t length = saved.serialize(blob);
+    TEST_ASSERT_TRUE(length <= ConfigProfile::MAX_LENGTH);
+
+    blob[20] ^= 1;
+    ConfigProfile loaded;
+    loaded.bitRate = 1.2f;
+    TEST_ASSERT_FALSE(loaded.deserialize(blob, length));
+    TEST_ASSERT_EQUAL_FLOAT(1.2f, loaded.bitRate);
+    blob[20] ^= 1;
+    TEST_ASSERT_FALSE(loaded.deserialize(blob, length - 1));
+    TEST_ASSERT_TRUE(loaded.deserialize(blob, length));
+}
+
+// A version 2 blob predates manualModem: whatever rates it holds, the
+// link adapts from the bottom after the boot
+void test_older_layouts_default_the_new_fields(void) {
+    uint8_t blob[ConfigProfile::MAX_LENGTH];
+    ConfigProfile saved = fieldProfile();
+    size_t length = saved.serialize(blob);
+    size_t payload = length - ConfigProfile::HEADER_LENGTH - 2;
+
+    uint8_t old[ConfigProfile::MAX_LENGTH];
+    ConfigProfile version2;
+    TEST_ASSERT_TRUE(version2.deserialize(old, resize(blob, length, payload - 1, old)));
+    TEST_ASSERT_EQUAL_UINT8(0, version2.manualModem);
+    TEST_ASSERT_EQUAL_FLOAT(38.4f, version2.bitRate);
+    TEST_ASSERT_EQUAL_UINT8(0x2A, version2.fscal[5][1]);
+
+    // Cut before the calibration table and everything after it
+    size_t before = payload - 1 - TalkGroups::BITMAP_LENGTH - 1 - sizeof(saved.fscal) - 1;
+    ConfigProfile version1;
+    TEST_ASSERT_TRUE(version1.deserialize(old, resize(blob, length, before, old)));
+    TEST_ASSERT_EQUAL_UINT8(1, version1.registersValid);
+    TEST_ASSERT_EQUAL_UINT8(0, version1.calibrated);
+    TEST_ASSERT_EQUAL_UINT8(0, version1.fscal[5][1]);
+    TEST_ASSERT_EQUAL_UINT8(1, version1.talkGroup);
+}
+
+void test_newer_layouts_read_the_known_fields(void) {
+    uint8_t blob[ConfigProfile::MAX_LENGTH];
+    ConfigProfile saved = fieldProfile();
+    size_t length = saved.serialize(blob);
+    size_t payload = length - ConfigProfile::HEADER_LENGTH - 2;
+
+    uint8_t newer[ConfigProfile::MAX_LENGTH];
+    size_t newerLength = resize(blob, length, payload + 5, newer);
+    newer[2] = ConfigProfile::VERSION + 1;
+    newer[newerLength - 2] = 0;
+    newer[newerLength - 1] = 0;
+    uint16_t crc = ConfigProfile::crc16(newer, newerLength - 2);
+    newer[newerLength - 2] = (uint8_t)crc;
+    newer[newerLength - 1] = (uint8_t)(crc >> 8);
+
+    ConfigProfile loaded;
+    TEST_ASSERT_TRUE(loaded.deserialize(newer, newerLength));
+    TEST_ASSERT_EQUAL_UINT8(0x2A, loaded.fscal[5][1]);
+    TEST_ASSERT_EQUAL_UINT8(1, loaded.manualModem);
+}
+
+void test_keys_and_epochs(void) {
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(directory));
+    uint8_t key[ConfigStore::KEY_LENGTH];
+    memset(key, 0x11, sizeof(key));
+    TEST_ASSERT_TRUE(store.saveKey(5, key));
+    memset(key, 0x22, sizeof(key));
+    TEST_ASSERT_TRUE(store.saveKey(9, key));
+    TEST_ASSERT_TRUE(store.saveKey(5, key));
+
+    ConfigStore::KeyEntry entries[ConfigStore::MAX_KEYS];
+    TEST_ASSERT_EQUAL_UINT8(2, store.loadKeys(entries));
+    TEST_ASSERT_EQUAL_UINT8(5, entries[0].address);
+    TEST_ASSERT_EQUAL_UINT8(0x22, entries[0].key[0]);
+    TEST_ASSERT_TRUE(store.removeKey(5));
+    TEST_ASSERT_EQUAL_UINT8(1, store.loadKeys(entries));
+    TEST_ASSERT_TRUE(store.removeKey(9));
+    TEST_ASSERT_EQUAL_UINT8(0, store.loadKeys(entries));
+
+    uint16_t first;
+    uint16_t second;
+    TEST_ASSERT_TRUE(store.nextEpoch(first));
+    TEST_ASSERT_TRUE(store.nextEpoch(second));
+    TEST_ASSERT_EQUAL_UINT32((uint16_t)(first + 1), second);
+
+    // The unit ID outlives the store object, 0 is no ID
+    uint16_t unit = 0;
+    TEST_ASSERT_FALSE(store.saveUnit(0));
+    TEST_ASSERT_TRUE(store.saveUnit(0x2345));
+    ConfigStore reopened;
+    TEST_ASSERT_TRUE(reopened.begin(directory));
+    TEST_ASSERT_TRUE(reopened.loadUnit(unit));
+    TEST_ASSERT_EQUAL_HEX16(0x2345, unit);
+}
+
+void test_load_timing(void) {
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin(directory));
+    ConfigProfile saved = fieldProfile();
+    TEST_ASSERT_TRUE(store.save("timing", saved));
+    uint8_t blob[ConfigProfile::MAX_LENGTH];
+    size_t length = saved.serialize(blob);
+
+    const int loads = 2000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loads; i++) {
+        ConfigProfile loaded;
+        store.load("timing", loaded);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < loads * 50; i++) {
+        ConfigProfile loaded;
+        loaded.deserialize(blob, length);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[96];
+    snprintf(line, sizeof(line), "blob %u bytes, load from file %.1f us, deserialize and CRC %.2f us",
+             (unsigned)length, std::chrono::duration<double, std::micro>(middle - start).count() / loads,
+             std::chrono::duration<double, std::micro>(end - middle).count() / (loads * 50));
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(store.remove("timing"));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    if (mkdtemp(directory) == NULL) {
+        return 1;
+    }
+    UNITY_BEGIN();
+    RUN_TEST(test_store_round_trip);
+    RUN_TEST(test_damaged_blob_is_rejected);
+    RUN_TEST(test_older_layouts_default_the_new_fields);
+    RUN_TEST(test_newer_layouts_read_the_known_fields);
+    RUN_TEST(test_keys_and_epochs);
+    RUN_TEST(test_load_timing);
+    int failures = UNITY_END();
+    char path[64];
+    snprintf(path, sizeof(path), "%s/epoch.bin", directory);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/active.bin", directory);
+    remove(path);
+    rmdir(directory);
+    return failures;
+}
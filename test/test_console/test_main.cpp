@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <unity.h>
+#include "CommandConsole.hpp"
+
+static std::string output;
+static float rate = 0;
+static bool manual = false;
+
+static void collect(const char* text, size_t length) {
+    output.append(text, length);
+}
+
+// Shaped like the firmware's set/get, which pin link adaptation off
+static bool commandSet(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+    if (argc != 3 || strcmp(argv[1], "rate") != 0) {
+        return false;
+    }
+    if (strcmp(argv[2], "auto") == 0) {
+        manual = false;
+        reply.append("ok, link adaptation on");
+        return true;
+    }
+    float value;
+    if (!CommandConsole::parseFloat(argv[2], value)) {
+        return false;
+    }
+    rate = value;
+    manual = true;
+    reply.append("ok, link adaptation off");
+    return true;
+}
+
+static bool commandGet(uint8_t argc, char** argv, CommandConsole::Reply& reply) {
+    (void)argv;
+    if (argc != 1) {
+        return false;
+    }
+    reply.append("rate=").append(rate).append(" link=").append(manual ? "manual" : "auto");
+    return true;
+}
+
+static const CommandConsole::Command COMMANDS[] = {
+    { "set", "set rate <value>|auto", commandSet },
+    { "get", "get", commandGet }
+};
+
+static void expect(CommandConsole& console, const std::string& input, const char* expected) {
+    output.clear();
+    console.feed(input.data(), input.size());
+    TEST_ASSERT_EQUAL_STRING(expected, output.c_str());
+}
+
+void setUp(void) {
+    rate = 0;
+    manual = false;
+}
+
+void tearDown(void) {}
+
+void test_commands_and_replies(void) {
+    CommandConsole console(COMMANDS, 2, collect);
+    expect(console, "set rate 38.4\r\n", "ok, link adaptation off\r\n");
+    expect(console, "get\n", "rate=38.40 link=manual\r\n");
+    expect(console, "  get   \r", "rate=38.40 link=manual\r\n");
+    expect(console, "set rate auto\n", "ok, link adaptation on\r\n");
+    expect(console, "get\n", "rate=38.40 link=auto\r\n");
+    expect(console, "help\n", "set rate <value>|auto\r\nget\r\n");
+}
+
+void test_errors(void) {
+    CommandConsole console(COMMANDS, 2, collect);
+    expect(console, "set rate abc\n", "usage: set rate <value>|auto\r\n");
+    expect(console, "bogus\n", "error: unknown command 'bogus', try help\r\n");
+    expect(console, "set a b c d\n", "error: too many arguments\r\n");
+    expect(console, std::string(100, 'x') + "\n", "error: line too long\r\n");
+    expect(console, "\r\n\r\n", "");
+    TEST_ASSERT_EQUAL_UINT32(0, rate);
+    TEST_ASSERT_TRUE(console.getErrorCount() >= 4);
+}
+
+// Terminals send backspace, and lines arrive a byte at a time
+void test_editing_and_split_input(void) {
+    CommandConsole console(COMMANDS, 2, collect);
+    expect(console, "gex\bt\n", "rate=0.00 link=auto\r\n");
+
+    output.clear();
+    const char* line = "set rate 1.2\n";
+    for (const char* p = line; *p != '\0'; p++) {
+        console.feed(*p);
+    }
+    TEST_ASSERT_EQUAL_STRING("ok, link adaptation off\r\n", output.c_str());
+    TEST_ASSERT_EQUAL_UINT32(2, console.getLineCount());
+}
+
+void test_throughput(void) {
+    CommandConsole console(COMMANDS, 2, collect);
+    std::string script;
+    for (int i = 0; i < 1000; i++) {
+        script += (i & 1) ? "get\r\n" : "set rate 4.8\r\n";
+    }
+    const int rounds = 200;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        output.clear();
+        console.feed(script.data(), script.size());
+    }
+    double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    char line[64];
+    snprintf(line, sizeof(line), "%.1f MB/s, %.0f ns per command",
+             script.size() * (double)rounds / nanos * 1000, nanos / (rounds * 1000.0));
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(0, console.getErrorCount());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_commands_and_replies);
+    RUN_TEST(test_errors);
+    RUN_TEST(test_editing_and_split_input);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
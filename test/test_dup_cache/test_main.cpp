@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+#include <unity.h>
+#include "DuplicateCache.hpp"
+#include "FrameCipher.hpp"
+#include "SelectiveRepeatArq.hpp"
+
+static uint32_t frameId(uint16_t source, uint16_t sequence) {
+    return ((uint32_t)source << 16) | sequence;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_seen_until_lifetime(void) {
+    DuplicateCache<16> cache(2000);
+    TEST_ASSERT_FALSE(cache.check(frameId(1, 1), 100));
+    TEST_ASSERT_TRUE(cache.check(frameId(1, 1), 100));
+    TEST_ASSERT_TRUE(cache.check(frameId(1, 1), 2099));
+    TEST_ASSERT_FALSE(cache.check(frameId(1, 1), 2100));
+    // Same sequence from another source is another frame
+    TEST_ASSERT_FALSE(cache.check(frameId(2, 1), 2100));
+    TEST_ASSERT_EQUAL_UINT32(5, cache.getLookups());
+    TEST_ASSERT_EQUAL_UINT32(2, cache.getHits());
+
+    cache.clear();
+    TEST_ASSERT_FALSE(cache.check(frameId(2, 1), 2100));
+}
+
+void test_clock_wrap(void) {
+    DuplicateCache<16> cache(2000);
+    uint32_t now = UINT32_MAX - 500;
+    TEST_ASSERT_FALSE(cache.check(frameId(3, 7), now));
+    TEST_ASSERT_TRUE(cache.check(frameId(3, 7), now + 1000));
+    TEST_ASSERT_FALSE(cache.check(frameId(3, 7), now + 2000));
+}
+
+void test_overload_evicts_closest_to_expiry(void) {
+    DuplicateCache<16> cache(2000);
+    // More live IDs than the table holds
+    for (uint16_t i = 0; i < 64; i++) {
+        TEST_ASSERT_FALSE(cache.check(frameId(1, i), i));
+    }
+    TEST_ASSERT_TRUE(cache.getEvictions() >= 64 - 16);
+    // The newest one stays, never a false positive for unseen IDs
+    TEST_ASSERT_TRUE(cache.check(frameId(1, 63), 64));
+    for (uint16_t i = 64; i < 128; i++) {
+        TEST_ASSERT_FALSE(cache.check(frameId(1, i), 65));
+    }
+}
+
+// Frames from 50 sources, each heard once plus up to 4 relayed copies
+// spread over 500 ms; the 128 entry cache of MeshRelay
+void test_mesh_traffic(void) {
+    const int rates[] = { 10, 60, 250 };
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        int rate = rates[r];
+        DuplicateCache<128> cache(2000);
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> sources(1, 50);
+        std::uniform_int_distribution<int> delays(0, 500);
+        std::uniform_int_distribution<int> copies(0, 4);
+
+        struct Arrival {
+            uint32_t time;
+            uint32_t id;
+            bool first;
+            bool operator<(const Arrival& other) const {
+                return time < other.time || (time == other.time && first > other.first);
+            }
+        };
+        std::vector<Arrival> arrivals;
+        std::vector<uint16_t> sequences(51, 0);
+        for (int frame = 0; frame < rate * 60; frame++) {
+            uint32_t time = (uint32_t)(frame * 1000 / rate);
+            int source = sources(rng);
+            uint32_t id = frameId((uint16_t)source, sequences[source]++);
+            Arrival first = { time, id, true };
+            arrivals.push_back(first);
+            for (int k = copies(rng); k > 0; k--) {
+                Arrival copy = { time + 1 + (uint32_t)delays(rng), id, false };
+                arrivals.push_back(copy);
+            }
+        }
+        std::sort(arrivals.begin(), arrivals.end());
+
+        long falsePositives = 0;
+        long missed = 0;
+        long duplicates = 0;
+        std::set<uint32_t> seen;
+        for (size_t i = 0; i < arrivals.size(); i++) {
+            bool hit = cache.check(arrivals[i].id, arrivals[i].time);
+            bool duplicate = !seen.insert(arrivals[i].id).second;
+            falsePositives += hit && !duplicate;
+            missed += !hit && duplicate;
+            duplicates += duplicate;
+        }
+
+        char line[100];
+        snprintf(line, sizeof(line), "%3d frames/s: %ld copies, %.2f%% missed, %u evictions",
+                 rate, duplicates, 100.0 * missed / duplicates, (unsigned int)cache.getEvictions());
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_INT32(0, falsePositives);
+        if (rate <= 60) {
+            TEST_ASSERT_EQUAL_INT32(0, missed);
+        }
+    }
+}
+
+// Without relays the copies are ARQ retransmissions after a lost ACK:
+// recognised by sender, session and sequence number, they only owe the
+// ACK again and never reach onData()
+void test_arq_repeats(void) {
+    DuplicateCache<128> cache(2000);
+    SelectiveRepeatArq sender(0x0A0A, 0x1234);
+    SelectiveRepeatArq receiver(0x0B0B, 1);
+    uint8_t payload[10] = { 0 };
+    uint8_t frame[80];
+    uint8_t again[80];
+    uint32_t id = 0;
+
+    sender.send(payload, sizeof(payload));
+    size_t length = sender.nextFrame(0, frame);
+    TEST_ASSERT_TRUE(SelectiveRepeatArq::frameId(frame, length, 0x0A0A, id));
+    TEST_ASSERT_FALSE(cache.check(id, 0));
+    TEST_ASSERT_TRUE(receiver.onData(frame, length, 0x0A0A, 0, NULL));
+    receiver.buildAck(frame);
+    TEST_ASSERT_FALSE(receiver.ackPending(0x0A0A));
+
+    // The ACK got lost, the same frame comes again
+    TEST_ASSERT_EQUAL(length, sender.nextFrame(1000, again));
+    TEST_ASSERT_TRUE(SelectiveRepeatArq::frameId(again, length, 0x0A0A, id));
+    TEST_ASSERT_TRUE(cache.check(id, 1000));
+    TEST_ASSERT_TRUE(receiver.onRepeat(again, length, 0x0A0A));
+    TEST_ASSERT_TRUE(receiver.ackPending(0x0A0A));
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.getDeliveredCount());
+
+    // Another sender with the same sequence number is news to the window
+    TEST_ASSERT_FALSE(receiver.onRepeat(again, length, 0x0C0C));
+    // So is the next frame, and group data has no ID at all
+    sender.send(payload, sizeof(payload));
+    length = sender.nextFrame(1000, frame);
+    TEST_ASSERT_FALSE(receiver.onRepeat(frame, length, 0x0A0A));
+    sender.send(payload, sizeof(payload), FRAME_DATA, false);
+    length = sender.nextFrame(1000, frame);
+    TEST_ASSERT_FALSE(SelectiveRepeatArq::frameId(frame, length, 0x0A0A, id));
+}
+
+// Copies of a sealed packet are told by the clear header before any AES
+// work, but only taken once the packet proved authentic
+void test_sealed_copies(void) {
+    const uint8_t key[FrameCipher::KEY_LENGTH] = { 1, 2, 3, 4 };
+    FrameCipher sender;
+    FrameCipher receiver;
+    sender.setKey(1, key);
+    sender.setEpoch(7);
+    sender.setSource(0x0A0A);
+    receiver.setKey(1, key);
+    receiver.setSource(0x0B0B);
+    DuplicateCache<64> cache(2000);
+
+    uint8_t packet[64] = { 0x0A, 0x0A, FRAME_DATA, 'h', 'i' };
+    size_t length = sender.seal(1, packet, 5);
+    TEST_ASSERT_TRUE(length > 0);
+    uint32_t id = 0;
+    TEST_ASSERT_TRUE(FrameCipher::packetId(packet, length, id));
+
+    // A forgery with the same header takes nothing away from the real one
+    uint8_t forged[64];
+    memcpy(forged, packet, length);
+    forged[length - 1] ^= 1;
+    size_t plainLength = 0;
+    TEST_ASSERT_FALSE(cache.peek(id, 0));
+    TEST_ASSERT_NULL(receiver.open(forged, length, plainLength));
+
+    TEST_ASSERT_FALSE(cache.peek(id, 10));
+    TEST_ASSERT_NOT_NULL(receiver.open(packet, length, plainLength));
+    TEST_ASSERT_FALSE(cache.check(id, 10));
+    TEST_ASSERT_TRUE(cache.peek(id, 20));
+
+    // The next packet has the next counter
+    uint8_t next[64] = { 0x0A, 0x0A, FRAME_DATA, 'h', 'i' };
+    uint32_t nextId = 0;
+    TEST_ASSERT_TRUE(FrameCipher::packetId(next, sender.seal(1, next, 5), nextId));
+    TEST_ASSERT_FALSE(cache.peek(nextId, 20));
+}
+
+void test_lookup_cost(void) {
+    DuplicateCache<128> cache(2000);
+    const int lookups = 5000000;
+    volatile int sink = 0;
+    uint32_t now = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        now += (i & 15) == 0;
+        sink += cache.check(frameId((uint16_t)(i % 40), (uint16_t)(i / 40)), now);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[80];
+    snprintf(line, sizeof(line), "check() %.1f ns per lookup",
+             std::chrono::duration<double, std::nano>(end - start).count() / lookups);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(lookups, cache.getLookups());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_seen_until_lifetime);
+    RUN_TEST(test_clock_wrap);
+    RUN_TEST(test_overload_evicts_closest_to_expiry);
+    RUN_TEST(test_mesh_traffic);
+    RUN_TEST(test_arq_repeats);
+    RUN_TEST(test_sealed_copies);
+    RUN_TEST(test_lookup_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <unity.h>
+#include "FrameFec.hpp"
+
+static FrameFec fec;
+static uint8_t in[MAX_FRAME_LENGTH];
+static uint8_t air[MAX_FRAME_LENGTH];
+static uint8_t out[MAX_FRAME_LENGTH];
+
+static uint32_t randomState;
+
+static uint32_t nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static void fill(size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        in[i] = (uint8_t)nextRandom();
+    }
+}
+
+void setUp(void) {
+    randomState = 7;
+}
+
+void tearDown(void) {}
+
+void test_round_trip_every_length(void) {
+    for (size_t length = 1; length <= FrameFec::MAX_PAYLOAD; length++) {
+        fill(length);
+        size_t encoded = fec.encode(in, length, air);
+        TEST_ASSERT_EQUAL_size_t(FrameFec::encodedLength(length), encoded);
+        TEST_ASSERT_LESS_OR_EQUAL(MAX_FRAME_LENGTH, encoded);
+        TEST_ASSERT_EQUAL_INT((int)length, fec.decode(air, encoded, out));
+        TEST_ASSERT_EQUAL_MEMORY(in, out, length);
+    }
+}
+
+void test_rejects_what_it_cannot_carry(void) {
+    TEST_ASSERT_EQUAL_size_t(0, fec.encode(in, 0, air));
+    TEST_ASSERT_EQUAL_size_t(0, fec.encode(in, FrameFec::MAX_PAYLOAD + 1, air));
+    // No payload length encodes to this many bytes
+    TEST_ASSERT_EQUAL_INT(-1, fec.decode(air, ReedSolomon::NROOTS, out));
+    TEST_ASSERT_EQUAL_INT(-1, fec.decode(air, FrameFec::encodedLength(40) + 1, out));
+}
+
+// Interleaving spreads a burst over all blocks, each repairs NROOTS / 2
+void test_repairs_a_burst_across_blocks(void) {
+    for (size_t length = 32; length <= FrameFec::MAX_PAYLOAD; length += 32) {
+        fill(length);
+        size_t encoded = fec.encode(in, length, air);
+        size_t blocks = (length + FrameFec::BLOCK_DATA - 1) / FrameFec::BLOCK_DATA;
+        size_t burst = blocks * ReedSolomon::NROOTS / 2;
+        size_t start = nextRandom() % (encoded - burst);
+        for (size_t i = 0; i < burst; i++) {
+            air[start + i] ^= (uint8_t)(1 + nextRandom() % 255);
+        }
+        TEST_ASSERT_EQUAL_INT((int)length, fec.decode(air, encoded, out));
+        TEST_ASSERT_EQUAL_MEMORY(in, out, length);
+    }
+}
+
+void test_fails_loudly_beyond_repair(void) {
+    fill(32);
+    size_t encoded = fec.encode(in, 32, air);
+    uint32_t failed = fec.getFailedCount();
+    // One block, twice what it can correct
+    for (size_t i = 0; i < ReedSolomon::NROOTS; i++) {
+        air[i * 3] ^= 0xA5;
+    }
+    int decoded = fec.decode(air, encoded, out);
+    TEST_ASSERT_TRUE(decoded < 0 || memcmp(in, out, 32) != 0);
+    TEST_ASSERT_TRUE(decoded >= 0 || fec.getFailedCount() == failed + 1);
+}
+
+// Frames that survive random byte errors, with and without FEC
+void test_byte_error_sweep(void) {
+    static const uint32_t perMille[] = { 5, 10, 20, 40, 80 };
+    const int frames = 2000;
+    const size_t length = 64;
+    for (size_t r = 0; r < sizeof(perMille) / sizeof(perMille[0]); r++) {
+        int clean = 0;
+        int repaired = 0;
+        for (int f = 0; f < frames; f++) {
+            fill(length);
+            size_t encoded = fec.encode(in, length, air);
+            bool raw = true;
+            for (size_t i = 0; i < encoded; i++) {
+                if (nextRandom() % 1000 < perMille[r]) {
+                    air[i] ^= (uint8_t)(1 + nextRandom() % 255);
+                    raw = raw && i >= length;
+                }
+            }
+            clean += raw ? 1 : 0;
+            if (fec.decode(air, encoded, out) == (int)length && memcmp(in, out, length) == 0) {
+                repaired++;
+            }
+        }
+        char line[96];
+        snprintf(line, sizeof(line), "byte errors %.1f%%: %.1f%% of frames intact without FEC, %.1f%% with",
+                 perMille[r] / 10.0, clean * 100.0 / frames, repaired * 100.0 / frames);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_GREATER_OR_EQUAL(clean, repaired);
+    }
+}
+
+// Payload bytes per second through encode, a clean decode and a decode
+// repairing NROOTS / 2 byte errors in every block
+void test_encode_decode_cost(void) {
+    static const size_t sizes[] = { 32, 64, FrameFec::MAX_PAYLOAD };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const size_t length = sizes[s];
+        const int frames = 2000;
+        fill(length);
+        size_t encoded = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            in[0] = (uint8_t)i;
+            encoded = fec.encode(in, length, air);
+        }
+        double encodeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            TEST_ASSERT_EQUAL_INT((int)length, fec.decode(air, encoded, out));
+        }
+        double cleanTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        TEST_ASSERT_EQUAL_MEMORY(in, out, length);
+
+        // The same errors every time, the copy is timed along with the repair
+        static uint8_t damaged[MAX_FRAME_LENGTH];
+        memcpy(damaged, air, encoded);
+        size_t blocks = (length + FrameFec::BLOCK_DATA - 1) / FrameFec::BLOCK_DATA;
+        for (size_t i = 0; i < blocks * ReedSolomon::NROOTS / 2; i++) {
+            damaged[(i * 7) % encoded] ^= (uint8_t)(1 + nextRandom() % 255);
+        }
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            memcpy(air, damaged, encoded);
+            TEST_ASSERT_EQUAL_INT((int)length, fec.decode(air, encoded, out));
+        }
+        double repairTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        TEST_ASSERT_EQUAL_MEMORY(in, out, length);
+
+        char line[120];
+        snprintf(line, sizeof(line), "%3u bytes: encode %.2f MB/s, clean decode %.2f MB/s, %u errors decode %.2f MB/s",
+                 (unsigned int)length, frames * length / encodeTime / 1e6, frames * length / cleanTime / 1e6,
+                 (unsigned int)(blocks * ReedSolomon::NROOTS / 2), frames * length / repairTime / 1e6);
+        TEST_MESSAGE(line);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_every_length);
+    RUN_TEST(test_rejects_what_it_cannot_carry);
+    RUN_TEST(test_repairs_a_burst_across_blocks);
+    RUN_TEST(test_fails_loudly_beyond_repair);
+    RUN_TEST(test_byte_error_sweep);
+    RUN_TEST(test_encode_decode_cost);
+    return UNITY_END();
+}
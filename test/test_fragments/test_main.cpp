@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "MessageFragments.hpp"
+
+static const size_t MESSAGE_MAX = 4096;
+
+static Arena arena;
+static Pool pool;
+static std::mt19937 rng;
+
+typedef std::vector<uint8_t> Bytes;
+
+// All fragments of a message, in order
+static std::vector<Bytes> fragment(Fragmenter& fragmenter, const Bytes& message) {
+    std::vector<Bytes> fragments;
+    TEST_ASSERT_TRUE(fragmenter.start(message.data(), message.size()));
+    uint8_t out[Fragmenter::HEADER_LENGTH + Fragmenter::PAYLOAD];
+    size_t length;
+    while ((length = fragmenter.next(out)) != 0) {
+        fragments.push_back(Bytes(out, out + length));
+    }
+    return fragments;
+}
+
+static Bytes randomMessage(size_t length) {
+    Bytes message(length);
+    for (size_t i = 0; i < length; i++) {
+        message[i] = (uint8_t)rng();
+    }
+    return message;
+}
+
+// Feeds the fragments, true if exactly the last one completed the message
+static bool deliver(Reassembler& reassembler, uint16_t source, const std::vector<Bytes>& fragments,
+                    unsigned long now, const Bytes& expected) {
+    for (size_t i = 0; i < fragments.size(); i++) {
+        size_t length = 0;
+        const uint8_t* message = reassembler.add(source, fragments[i].data(), fragments[i].size(), now, length);
+        if (i + 1 < fragments.size()) {
+            if (message != NULL) {
+                return false;
+            }
+        } else {
+            return message != NULL && length == expected.size() && memcmp(message, expected.data(), length) == 0;
+        }
+    }
+    return false;
+}
+
+void setUp(void) {
+    rng.seed(5);
+    arena.begin(Pool::footprint(MESSAGE_MAX, Reassembler::MAX_SLOTS), MEMORY_PSRAM);
+    pool.begin(arena, MESSAGE_MAX, Reassembler::MAX_SLOTS);
+}
+
+void tearDown(void) {
+    pool = Pool();
+    arena.end();
+}
+
+void test_round_trip_sizes(void) {
+    Reassembler reassembler(1000);
+    TEST_ASSERT_TRUE(reassembler.begin(pool, 2));
+    Fragmenter fragmenter(100);
+    const size_t sizes[] = { 1, Fragmenter::PAYLOAD - 1, Fragmenter::PAYLOAD, Fragmenter::PAYLOAD + 1, 1000, MESSAGE_MAX };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        Bytes message = randomMessage(sizes[i]);
+        std::vector<Bytes> fragments = fragment(fragmenter, message);
+        TEST_ASSERT_EQUAL_UINT32((sizes[i] + Fragmenter::PAYLOAD - 1) / Fragmenter::PAYLOAD, fragments.size());
+        TEST_ASSERT_FALSE(fragmenter.isBusy());
+        TEST_ASSERT_TRUE(deliver(reassembler, 1, fragments, i, message));
+    }
+    TEST_ASSERT_EQUAL_UINT32(6, reassembler.getCompleted());
+
+    uint8_t data[1] = { 0 };
+    TEST_ASSERT_FALSE(fragmenter.start(data, 0));
+    TEST_ASSERT_FALSE(fragmenter.start(data, Fragmenter::MAX_LENGTH + 1));
+}
+
+void test_senders_with_the_same_id(void) {
+    Reassembler reassembler(1000);
+    reassembler.begin(pool, 2);
+    // Two group members that both start counting at the same ID
+    Fragmenter first(0);
+    Fragmenter second(0);
+    Bytes a = randomMessage(300);
+    Bytes b = randomMessage(300);
+    std::vector<Bytes> fa = fragment(first, a);
+    std::vector<Bytes> fb = fragment(second, b);
+
+    // Interleaved on the air, each ends up in its own slot
+    size_t length;
+    const uint8_t* done[2] = { NULL, NULL };
+    for (size_t i = 0; i < fa.size(); i++) {
+        const uint8_t* message = reassembler.add(0x0101, fa[i].data(), fa[i].size(), 0, length);
+        if (message != NULL) {
+            TEST_ASSERT_EQUAL_MEMORY(a.data(), message, a.size());
+            done[0] = message;
+        }
+        message = reassembler.add(0x0202, fb[i].data(), fb[i].size(), 0, length);
+        if (message != NULL) {
+            TEST_ASSERT_EQUAL_MEMORY(b.data(), message, b.size());
+            done[1] = message;
+        }
+    }
+    TEST_ASSERT_NOT_NULL(done[0]);
+    TEST_ASSERT_NOT_NULL(done[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, reassembler.getEvictions());
+}
+
+void test_late_copies_and_reboot(void) {
+    Reassembler reassembler(1000);
+    reassembler.begin(pool, 2);
+    Fragmenter before(0);
+    std::vector<Bytes> sent[4];
+    for (int i = 0; i < 4; i++) {
+        Bytes message = randomMessage(200);
+        sent[i] = fragment(before, message);
+        TEST_ASSERT_TRUE(deliver(reassembler, 7, sent[i], 0, message));
+    }
+
+    // A copy that ARQ let through late is dropped, from another sender it is new
+    size_t length;
+    TEST_ASSERT_NULL(reassembler.add(7, sent[3][0].data(), sent[3][0].size(), 500, length));
+    TEST_ASSERT_EQUAL_UINT8(0, reassembler.getActive());
+    TEST_ASSERT_NULL(reassembler.add(8, sent[3][0].data(), sent[3][0].size(), 500, length));
+    TEST_ASSERT_EQUAL_UINT8(1, reassembler.getActive());
+
+    // Rebooted after the timeout with the same first ID, nothing is held
+    // against it any more
+    Fragmenter after(0);
+    Bytes message = randomMessage(200);
+    reassembler.expire(1500);
+    TEST_ASSERT_TRUE(deliver(reassembler, 7, fragment(after, message), 1500, message));
+}
+
+// Three senders, every tenth fragment duplicated, reordered within eight
+// and lost at random; each round's leftovers time out
+void test_interleaved_with_loss(void) {
+    const size_t sizes[] = { 1, 59, 60, 61, 300, 1000, MESSAGE_MAX };
+    const double losses[] = { 0.0, 0.01, 0.05 };
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        Reassembler reassembler(1000);
+        reassembler.begin(pool, 3);
+        Fragmenter fragmenters[3] = { Fragmenter(100), Fragmenter(100), Fragmenter(30000) };
+        int complete = 0;
+        int corrupt = 0;
+        int sent = 0;
+        unsigned long now = 0;
+        for (int round = 0; round < 100; round++) {
+            std::vector<std::pair<uint16_t, Bytes> > air;
+            Bytes messages[3];
+            for (uint16_t k = 0; k < 3; k++) {
+                messages[k] = randomMessage(sizes[rng() % (sizeof(sizes) / sizeof(sizes[0]))]);
+                std::vector<Bytes> fragments = fragment(fragmenters[k], messages[k]);
+                sent++;
+                for (size_t i = 0; i < fragments.size(); i++) {
+                    air.push_back(std::make_pair(k, fragments[i]));
+                    if (rng() % 10 == 0) {
+                        air.push_back(air.back());
+                    }
+                }
+            }
+            for (size_t i = 0; i < air.size(); i++) {
+                std::swap(air[i], air[std::min(air.size() - 1, i + rng() % 8)]);
+            }
+            for (size_t i = 0; i < air.size(); i++) {
+                if (std::uniform_real_distribution<double>(0, 1)(rng) < losses[l]) {
+                    continue;
+                }
+                size_t length;
+                const uint8_t* message = reassembler.add(air[i].first, air[i].second.data(), air[i].second.size(),
+                                                         now++, length);
+                if (message != NULL) {
+                    const Bytes& expected = messages[air[i].first];
+                    bool match = length == expected.size() && memcmp(message, expected.data(), length) == 0;
+                    complete += match ? 1 : 0;
+                    corrupt += match ? 0 : 1;
+                }
+            }
+            now += 2000;
+            reassembler.expire(now);
+            TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+        }
+
+        char line[100];
+        snprintf(line, sizeof(line), "loss %.2f: %d/%d reassembled, %u timeouts, %u evictions",
+                 losses[l], complete, sent, (unsigned int)reassembler.getTimeouts(),
+                 (unsigned int)reassembler.getEvictions());
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_INT(0, corrupt);
+        if (losses[l] == 0) {
+            TEST_ASSERT_EQUAL_INT(sent, complete);
+        }
+    }
+}
+
+void test_malformed_fragments(void) {
+    Reassembler reassembler(1000);
+    reassembler.begin(pool, 2);
+    uint8_t junk[Fragmenter::HEADER_LENGTH + Fragmenter::PAYLOAD + 4];
+    int completed = 0;
+    for (int i = 0; i < 20000; i++) {
+        for (size_t j = 0; j < sizeof(junk); j++) {
+            junk[j] = (uint8_t)rng();
+        }
+        size_t length;
+        if (reassembler.add((uint16_t)(rng() % 4), junk, 1 + rng() % sizeof(junk), i, length) != NULL) {
+            // Only single fragment messages can complete by chance
+            TEST_ASSERT_TRUE(length <= Fragmenter::PAYLOAD);
+            completed++;
+        }
+    }
+    TEST_ASSERT_TRUE(reassembler.getRejected() > 0);
+    reassembler.expire(1000000);
+    TEST_ASSERT_EQUAL_UINT32(0, pool.getInUse());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_sizes);
+    RUN_TEST(test_senders_with_the_same_id);
+    RUN_TEST(test_late_copies_and_reboot);
+    RUN_TEST(test_interleaved_with_loss);
+    RUN_TEST(test_malformed_fragments);
+    return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "TalkGroups.hpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_single_address_uses_the_radio_filter(void) {
+    TalkGroups groups(3);
+    TEST_ASSERT_TRUE(groups.hardwareFilter());
+    TEST_ASSERT_TRUE(groups.accepts(3));
+    TEST_ASSERT_TRUE(groups.accepts(TalkGroups::ALL_CALL));
+    TEST_ASSERT_FALSE(groups.accepts(4));
+
+    TEST_ASSERT_TRUE(groups.join(0x90));
+    TEST_ASSERT_FALSE(groups.hardwareFilter());
+    TEST_ASSERT_TRUE(groups.accepts(0x90));
+    TEST_ASSERT_TRUE(groups.leave(0x90));
+    TEST_ASSERT_TRUE(groups.hardwareFilter());
+}
+
+void test_talk_group_is_never_left(void) {
+    TalkGroups groups(3);
+    TEST_ASSERT_FALSE(groups.leave(3));
+    TEST_ASSERT_FALSE(groups.join(TalkGroups::ALL_CALL));
+    TEST_ASSERT_FALSE(groups.setTalkGroup(0xFF));
+    TEST_ASSERT_EQUAL_UINT8(3, groups.getTalkGroup());
+
+    TEST_ASSERT_TRUE(groups.setTalkGroup(0x81));
+    TEST_ASSERT_TRUE(groups.isMember(0x81));
+    TEST_ASSERT_TRUE(groups.isMember(3));
+    TEST_ASSERT_TRUE(groups.leave(3));
+    TEST_ASSERT_TRUE(TalkGroups::isUnit(groups.getTalkGroup()));
+}
+
+void test_bitmap_round_trip(void) {
+    TalkGroups groups(3);
+    groups.join(5);
+    groups.join(0xFE);
+    TalkGroups restored(3);
+    uint8_t bitmap[TalkGroups::BITMAP_LENGTH];
+    memcpy(bitmap, groups.getBitmap(), sizeof(bitmap));
+    // All-call and 0xFF never end up as members
+    bitmap[0] |= 1;
+    bitmap[TalkGroups::BITMAP_LENGTH - 1] |= 0x80;
+    restored.setBitmap(bitmap);
+    TEST_ASSERT_EQUAL_MEMORY(groups.getBitmap(), restored.getBitmap(), TalkGroups::BITMAP_LENGTH);
+    TEST_ASSERT_EQUAL_UINT8(3, restored.getMemberCount());
+    TEST_ASSERT_EQUAL_UINT8(3, restored.nextMember(TalkGroups::ALL_CALL));
+    TEST_ASSERT_EQUAL_UINT8(5, restored.nextMember(3));
+    TEST_ASSERT_EQUAL_UINT8(0xFE, restored.nextMember(5));
+    TEST_ASSERT_EQUAL_UINT8(0, restored.nextMember(0xFE));
+}
+
+// xorshift32, deterministic channel traffic
+static uint32_t state = 1;
+
+static uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// A busy channel with eight groups and some private calls: how often one
+// unit is woken up and has to decode, radio filter against scanning
+void test_wakeups_on_a_busy_channel(void) {
+    TalkGroups single(3);
+    TalkGroups scan(3);
+    scan.join(5);
+    scan.join(0x90);
+    TEST_ASSERT_TRUE(single.hardwareFilter());
+    TEST_ASSERT_FALSE(scan.hardwareFilter());
+
+    const int packets = 24000;
+    int filtered = 0;
+    int decoded = 0;
+    for (int i = 0; i < packets; i++) {
+        uint32_t pick = next() % 100;
+        uint8_t group = (uint8_t)(1 + next() % 8);
+        uint8_t address = pick < 2 ? TalkGroups::ALL_CALL : (pick < 10 ? (uint8_t)(0x80 + group * 4) : group);
+        // Anything else ends in the radio, GDO0 never fires
+        filtered += single.accepts(address);
+        // Every packet wakes the CPU, only accepted ones are decoded
+        decoded += scan.accepts(address);
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "radio filter: %.1f%% of packets wake the CPU", 100.0 * filtered / packets);
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "software filter: 100%% wake the CPU, %.1f%% are decoded", 100.0 * decoded / packets);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN(packets / 6, filtered);
+    TEST_ASSERT_LESS_THAN(packets / 3, decoded);
+    TEST_ASSERT_GREATER_THAN(filtered, decoded);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_single_address_uses_the_radio_filter);
+    RUN_TEST(test_talk_group_is_never_left);
+    RUN_TEST(test_bitmap_round_trip);
+    RUN_TEST(test_wakeups_on_a_busy_channel);
+    return UNITY_END();
+}
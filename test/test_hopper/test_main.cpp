@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <unity.h>
+#include "FrequencyHopper.hpp"
+#include "LinkAdaptation.hpp"
+
+static const unsigned long DWELL = 100;
+
+static FrequencyHopper makeHopper() {
+    return FrequencyHopper(433.1f, 0.1f, 16, 0x5A17C0DE, DWELL);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_sequence_is_a_shared_permutation(void) {
+    FrequencyHopper a = makeHopper();
+    FrequencyHopper b = makeHopper();
+    bool seen[16] = { false };
+    for (uint16_t slot = 0; slot < 16; slot++) {
+        uint8_t channel = a.channelAt(slot);
+        TEST_ASSERT_LESS_THAN(16, channel);
+        TEST_ASSERT_FALSE(seen[channel]);
+        seen[channel] = true;
+        TEST_ASSERT_EQUAL_UINT8(channel, b.channelAt(slot));
+        TEST_ASSERT_EQUAL_UINT8(channel, a.channelAt(slot + 16));
+    }
+
+    uint8_t word[3];
+    FrequencyHopper::frequencyWord(433.1f, word);
+    TEST_ASSERT_EQUAL_UINT8(0x10, word[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xA8, word[1]);
+    TEST_ASSERT_EQUAL_UINT8(0x5F, word[2]);
+}
+
+// The offset holds for the end of the packet, rolling over into the next slot
+void test_sync_covers_the_airtime(void) {
+    FrequencyHopper sender = makeHopper();
+    for (int i = 0; i < 5; i++) {
+        sender.tick();
+    }
+    sender.onHop(1000);
+
+    uint8_t sync[FrequencyHopper::SYNC_LENGTH];
+    sender.buildSync(sync, 1070, 50);
+    TEST_ASSERT_EQUAL_UINT8(FRAME_HOP, sync[0]);
+    TEST_ASSERT_EQUAL_UINT16(6, sync[1] | (sync[2] << 8));
+    TEST_ASSERT_EQUAL_UINT8(20, sync[3]);
+
+    // Handled 3 ms after the packet ended
+    FrequencyHopper receiver = makeHopper();
+    TEST_ASSERT_EQUAL(23, receiver.onSync(sync, sizeof(sync), 1123, 3));
+    TEST_ASSERT_EQUAL_UINT16(6, receiver.getSlot());
+    TEST_ASSERT_TRUE(receiver.hopPending());
+    TEST_ASSERT_TRUE(receiver.isSynced(1123));
+    TEST_ASSERT_EQUAL(-1, receiver.onSync(sync, 2, 1123, 0));
+}
+
+// Phase error a receiver adopts from a full packet at every profile, with
+// and without the airtime in the offset
+void test_phase_error_per_profile(void) {
+    for (uint8_t profile = 0; profile < RADIO_PROFILE_COUNT; profile++) {
+        unsigned long airtime = (airtimeUs(MAX_FRAME_LENGTH, RADIO_PROFILES[profile].bitRate) + 999) / 1000;
+        long errors[2];
+        for (int compensated = 0; compensated < 2; compensated++) {
+            FrequencyHopper sender = makeHopper();
+            sender.onHop(0);
+            unsigned long sent = 30;
+            uint8_t sync[FrequencyHopper::SYNC_LENGTH];
+            sender.buildSync(sync, sent, compensated ? airtime : 0);
+
+            // Received at the packet end, handled 2 ms later
+            unsigned long end = sent + airtime;
+            FrequencyHopper receiver = makeHopper();
+            long elapsed = receiver.onSync(sync, sizeof(sync), end + 2, 2);
+            long truth = (long)(end + 2);
+            errors[compensated] = truth - ((long)receiver.getSlot() * (long)DWELL + elapsed);
+        }
+        char line[96];
+        snprintf(line, sizeof(line), "%6.1f kbps: full packet %4lu ms, phase error %5ld ms uncompensated, %ld ms compensated",
+                 RADIO_PROFILES[profile].bitRate, airtime, errors[0], errors[1]);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_INT_WITHIN(1, 0, errors[1]);
+    }
+}
+
+// Slow profiles park on the rendezvous channel, the slot count goes on
+void test_parked_hopper_stays_on_rendezvous(void) {
+    FrequencyHopper hopper = makeHopper();
+    TEST_ASSERT_TRUE(hopper.setParked(true));
+    TEST_ASSERT_FALSE(hopper.setParked(true));
+    for (int i = 0; i < 3; i++) {
+        hopper.tick();
+        TEST_ASSERT_FALSE(hopper.hopPending());
+        TEST_ASSERT_EQUAL_UINT8(hopper.channelAt(0), hopper.currentChannel());
+    }
+    TEST_ASSERT_EQUAL_UINT16(3, hopper.getSlot());
+    TEST_ASSERT_TRUE(hopper.setParked(false));
+    TEST_ASSERT_EQUAL_UINT8(hopper.channelAt(3), hopper.currentChannel());
+    hopper.tick();
+    TEST_ASSERT_TRUE(hopper.hopPending());
+
+    // With the default dwell the two slowest profiles do not hop
+    for (uint8_t profile = 0; profile < RADIO_PROFILE_COUNT; profile++) {
+        bool parked = airtimeUs(MAX_FRAME_LENGTH, RADIO_PROFILES[profile].bitRate) > DWELL * 1000;
+        TEST_ASSERT_EQUAL(profile < 2, parked);
+    }
+}
+
+// The timer interrupt on one core, the radio task on the other: no tick
+// is lost to a poll or a sync running at the same time
+void test_ticks_from_another_core(void) {
+    static FrequencyHopper hopper = makeHopper();
+    const int TICKS = 200000;
+    std::atomic<bool> done(false);
+    std::thread timer([&]() {
+        for (int i = 0; i < TICKS; i++) {
+            hopper.tick();
+        }
+        done = true;
+    });
+    int hops = 0;
+    while (!done) {
+        hops += hopper.hopPending() ? 1 : 0;
+    }
+    timer.join();
+    hops += hopper.hopPending() ? 1 : 0;
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)TICKS, hopper.getSlot());
+    TEST_ASSERT_TRUE(hops > 0);
+    TEST_ASSERT_FALSE(hopper.hopPending());
+
+    // A sync lands while the timer keeps ticking: the slot ends up at the
+    // sender's plus whatever ticked after it
+    uint8_t sync[FrequencyHopper::SYNC_LENGTH] = { FRAME_HOP, 0x00, 0x80, 0 };
+    done = false;
+    std::thread ticking([&]() {
+        for (int i = 0; i < 1000; i++) {
+            hopper.tick();
+        }
+        done = true;
+    });
+    hopper.onSync(sync, sizeof(sync), 0);
+    while (!done) {
+    }
+    ticking.join();
+    TEST_ASSERT_TRUE((uint16_t)(hopper.getSlot() - 0x8000) <= 1000);
+    TEST_ASSERT_TRUE(hopper.hopPending());
+}
+
+// xorshift32, deterministic interferer duty
+static uint32_t state = 1;
+
+static bool jammed() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % 100 < 90;
+}
+
+// Narrowband interferers on k channels at 90% duty; the fixed link sits on
+// channel 0, which is always among the jammed ones
+void test_interferer_sweep(void) {
+    FrequencyHopper hopper = makeHopper();
+    static const int counts[] = { 0, 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        int k = counts[i];
+        const int packets = 100000;
+        int fixed = 0;
+        int hopping = 0;
+        for (int slot = 0; slot < packets; slot++) {
+            fixed += !(k > 0 && jammed());
+            hopping += !(hopper.channelAt((uint16_t)slot) < k && jammed());
+        }
+        char line[96];
+        snprintf(line, sizeof(line), "%d interferers: fixed channel %.1f%%, hopping %.1f%% delivered",
+                 k, 100.0 * fixed / packets, 100.0 * hopping / packets);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_TRUE(hopping >= fixed);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_sequence_is_a_shared_permutation);
+    RUN_TEST(test_sync_covers_the_airtime);
+    RUN_TEST(test_phase_error_per_profile);
+    RUN_TEST(test_parked_hopper_stays_on_rendezvous);
+    RUN_TEST(test_ticks_from_another_core);
+    RUN_TEST(test_interferer_sweep);
+    return UNITY_END();
+}
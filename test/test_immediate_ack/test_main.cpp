@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <unity.h>
+#include "FrameFec.hpp"
+#include "SelectiveRepeatArq.hpp"
+#include "TalkGroups.hpp"
+
+// Half-duplex two unit simulation of unicast ARQ traffic at 38.4 kbps,
+// 10 us steps. With the immediate ACK the receiver answers ACK_SPACE_US
+// after the data packet (later if handling it overran the space) and the
+// sender keeps the channel free for the ACK window; otherwise the ACK
+// rides on a packet within the aggregation budget. The receiver listens
+// to its unit address and a group (address checked in software), or to
+// its unit address alone (filtered by the radio, the address byte is
+// gone); it decides on the immediate ACK the way the firmware does.
+enum AckMode {
+    PIGGYBACKED,
+    IMMEDIATE,
+    FILTERED
+};
+
+static const double BIT_RATE = 38.4;  // kbps
+static const uint32_t SPACE = 2000;
+static const uint32_t GUARD = 1500;
+static const uint32_t IDLE_TO_TX = 800;
+static const uint32_t STEP = 10;
+static const uint32_t AGGREGATION_BUDGET = 40000;
+static const uint8_t UNIT = 0x81;
+
+static uint64_t seed;
+
+static uint32_t random32() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (uint32_t)seed;
+}
+
+static double uniform() {
+    return (random32() & 0xFFFFFF) / (double)0x1000000;
+}
+
+// Microseconds on air with preamble, sync word, length and CRC
+static uint32_t airtime(size_t length) {
+    return (uint32_t)((FrameFec::encodedLength(length) + 8) * 8 * 1000.0 / BIT_RATE);
+}
+
+static int delivered;
+
+static void deliver(const uint8_t*, size_t, uint8_t, uint16_t) {
+    delivered++;
+}
+
+struct Transmission {
+    uint64_t start;
+    uint64_t end;
+    int from;
+    bool done;
+    std::vector<uint8_t> frame;
+};
+
+struct AckResult {
+    double seconds;
+    uint32_t retransmitted;
+    uint32_t acksSent;
+    uint32_t acksHeard;
+    uint32_t windowTimeouts;
+    std::vector<uint32_t> waits;
+};
+
+// handleReceivedPacket(): where the packet was sent to, and whether it is
+// answered right away
+static bool answersAtOnce(const TalkGroups& groups, uint8_t packetAddress, bool confirmed,
+                          const SelectiveRepeatArq& arq, uint16_t source) {
+    uint8_t address = groups.hardwareFilter() ? groups.filteredAddress() : packetAddress;
+    return confirmed && TalkGroups::isUnit(address) && arq.ackPending(source);
+}
+
+static AckResult simulate(AckMode mode, double loss, int messages) {
+    const uint16_t SENDER = 0x0A0A;
+    const uint16_t RECEIVER = 0x0B0B;
+    SelectiveRepeatArq sender(SENDER, 1);
+    SelectiveRepeatArq receiver(RECEIVER, 2);
+    TalkGroups groups(UNIT);
+    if (mode != FILTERED) {
+        groups.join(1);
+    }
+    seed = 88172645463325252ull;
+    delivered = 0;
+
+    std::vector<Transmission> air;
+    uint64_t now = 0;
+    uint64_t busy[2] = { 0, 0 };
+    uint64_t ackDue = 0;
+    uint64_t windowEnd = 0;
+    uint64_t lastDataEnd = 0;
+    bool ackOwed = false;
+    bool waiting = false;
+    AckResult result = AckResult();
+    int queued = 0;
+    uint8_t frame[80];
+    uint8_t payload[60];
+    memset(payload, 'x', sizeof(payload));
+
+    while (delivered < messages && now < 300ull * 1000000) {
+        while (queued < messages && !sender.isWindowFull()) {
+            sender.send(payload, sizeof(payload));
+            queued++;
+        }
+        if (waiting && now >= windowEnd) {
+            waiting = false;
+            result.windowTimeouts++;
+        }
+        for (int from = 0; from < 2; from++) {
+            size_t length = 0;
+            if (from == 0 && now >= busy[0] && !waiting) {
+                length = sender.nextFrame((unsigned long)(now / 1000), frame);
+            } else if (from == 1 && mode == PIGGYBACKED && ackOwed && now >= ackDue && now >= busy[1]) {
+                length = receiver.buildAck(frame);
+                ackOwed = false;
+                result.acksSent++;
+            }
+            if (length == 0) {
+                continue;
+            }
+            Transmission tx = { now + IDLE_TO_TX, now + IDLE_TO_TX + airtime(length), from, false,
+                                std::vector<uint8_t>(frame, frame + length) };
+            air.push_back(tx);
+            busy[from] = tx.end;
+            if (from == 0 && mode != PIGGYBACKED) {
+                lastDataEnd = tx.end;
+                waiting = true;
+                windowEnd = tx.end + SPACE + airtime(SelectiveRepeatArq::ACK_LENGTH) + GUARD;
+            }
+        }
+
+        for (size_t i = 0; i < air.size(); i++) {
+            if (air[i].done || air[i].end > now) {
+                continue;
+            }
+            air[i].done = true;
+            Transmission tx = air[i];
+            // Half duplex: the other side was sending meanwhile
+            bool deaf = false;
+            for (size_t j = 0; j < air.size(); j++) {
+                deaf |= air[j].from != tx.from && air[j].start < tx.end && air[j].end > tx.start;
+            }
+            if (deaf || uniform() < loss) {
+                continue;
+            }
+            if (tx.from == 0) {
+                bool confirmed = receiver.onData(tx.frame.data(), tx.frame.size(), SENDER,
+                                                 (unsigned long)(now / 1000), deliver);
+                if (mode != PIGGYBACKED && answersAtOnce(groups, UNIT, confirmed, receiver, SENDER)) {
+                    // Read, FEC decode and dispatch take 300..2300 us
+                    uint32_t handling = 300 + random32() % 2000;
+                    uint64_t start = tx.end + std::max(handling, SPACE) + IDLE_TO_TX;
+                    size_t length = receiver.buildAck(SENDER, frame);
+                    Transmission ack = { start, start + airtime(length), 1, false,
+                                         std::vector<uint8_t>(frame, frame + length) };
+                    air.push_back(ack);
+                    result.acksSent++;
+                } else if (!ackOwed) {
+                    ackOwed = true;
+                    ackDue = now + random32() % AGGREGATION_BUDGET;
+                }
+            } else if (sender.onAck(tx.frame.data(), tx.frame.size(), (unsigned long)(now / 1000))) {
+                result.acksHeard++;
+                if (waiting && mode != PIGGYBACKED) {
+                    waiting = false;
+                    result.waits.push_back((uint32_t)(now - lastDataEnd));
+                }
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < air.size(); i++) {
+            if (!air[i].done || air[i].end + 100000 >= now) {
+                air[kept++] = air[i];
+            }
+        }
+        air.resize(kept);
+        now += STEP;
+    }
+
+    result.seconds = now / 1e6;
+    result.retransmitted = sender.getRetransmittedCount();
+    std::sort(result.waits.begin(), result.waits.end());
+    return result;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_immediate_ack_speeds_up_unicast(void) {
+    const double losses[] = { 0.0, 0.05, 0.2 };
+    const char* const names[] = { "piggybacked", "immediate", "filtered" };
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        AckResult results[3];
+        for (int mode = PIGGYBACKED; mode <= FILTERED; mode++) {
+            results[mode] = simulate((AckMode)mode, losses[l], 200);
+            TEST_ASSERT_EQUAL_INT(200, delivered);
+
+            const AckResult& r = results[mode];
+            char line[140];
+            int used = snprintf(line, sizeof(line), "loss %2.0f%% %-11s %5.2f s, %3u retransmitted, ACKs %3u/%3u",
+                                losses[l] * 100, names[mode], r.seconds, (unsigned int)r.retransmitted,
+                                (unsigned int)r.acksHeard, (unsigned int)r.acksSent);
+            if (!r.waits.empty()) {
+                snprintf(line + used, sizeof(line) - used, ", wait p50 %u max %u us",
+                         (unsigned int)r.waits[r.waits.size() / 2], (unsigned int)r.waits.back());
+            }
+            TEST_MESSAGE(line);
+        }
+        for (int mode = IMMEDIATE; mode <= FILTERED; mode++) {
+            TEST_ASSERT_TRUE(results[mode].seconds < results[PIGGYBACKED].seconds);
+            // An ACK in time always lands inside the window
+            const std::vector<uint32_t>& waits = results[mode].waits;
+            TEST_ASSERT_FALSE(waits.empty());
+            TEST_ASSERT_TRUE(waits.back() <= SPACE + airtime(SelectiveRepeatArq::ACK_LENGTH) + GUARD + IDLE_TO_TX);
+        }
+    }
+}
+
+// A unit that joined only its own address has the radio filter for it,
+// the address byte never reaches the firmware; unicast is still answered
+// at once, as fast as with the address checked in software
+void test_filtered_unicast_acked_at_once(void) {
+    TalkGroups groups(1);
+    TEST_ASSERT_TRUE(groups.setTalkGroup(UNIT));
+    TEST_ASSERT_TRUE(groups.leave(1));
+    TEST_ASSERT_TRUE(groups.hardwareFilter());
+    TEST_ASSERT_EQUAL_HEX8(UNIT, groups.filteredAddress());
+
+    AckResult immediate = simulate(IMMEDIATE, 0, 100);
+    AckResult filtered = simulate(FILTERED, 0, 100);
+    TEST_ASSERT_EQUAL_INT(100, delivered);
+    // One ACK per packet, each in time
+    TEST_ASSERT_EQUAL_UINT32(100, filtered.acksSent);
+    TEST_ASSERT_EQUAL_UINT32(0, filtered.windowTimeouts);
+    TEST_ASSERT_TRUE(filtered.seconds < immediate.seconds * 1.1);
+}
+
+// Group data leaves no ACK owed, even from a sender we still owe one for
+// earlier unicast data; ACKs are only built for the sender of the packet
+void test_group_data_not_acked_at_once(void) {
+    const uint16_t FIRST = 0x0A0A;
+    const uint16_t SECOND = 0x0C0C;
+    SelectiveRepeatArq first(FIRST, 1);
+    SelectiveRepeatArq second(SECOND, 3);
+    SelectiveRepeatArq receiver(0x0B0B, 2);
+    TalkGroups groups(UNIT);
+    groups.join(1);
+    uint8_t payload[10] = { 0 };
+    uint8_t frame[80];
+
+    first.send(payload, sizeof(payload), FRAME_DATA, false);
+    size_t length = first.nextFrame(0, frame);
+    bool confirmed = receiver.onData(frame, length, FIRST, 0, NULL);
+    TEST_ASSERT_FALSE(confirmed);
+    TEST_ASSERT_FALSE(answersAtOnce(groups, 1, confirmed, receiver, FIRST));
+
+    // Unicast from the second sender, then group data from the first
+    second.send(payload, sizeof(payload));
+    length = second.nextFrame(0, frame);
+    confirmed = receiver.onData(frame, length, SECOND, 0, NULL);
+    TEST_ASSERT_TRUE(answersAtOnce(groups, UNIT, confirmed, receiver, SECOND));
+    TEST_ASSERT_FALSE(answersAtOnce(groups, UNIT, confirmed, receiver, FIRST));
+    first.send(payload, sizeof(payload), FRAME_DATA, false);
+    length = first.nextFrame(0, frame);
+    confirmed = receiver.onData(frame, length, FIRST, 0, NULL);
+    TEST_ASSERT_FALSE(answersAtOnce(groups, 1, confirmed, receiver, FIRST));
+    TEST_ASSERT_TRUE(receiver.ackPending(SECOND));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_immediate_ack_speeds_up_unicast);
+    RUN_TEST(test_filtered_unicast_acked_at_once);
+    RUN_TEST(test_group_data_not_acked_at_once);
+    return UNITY_END();
+}
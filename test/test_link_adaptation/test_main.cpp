@@ -0,0 +1,253 @@
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <unity.h>
+#include "LinkAdaptation.hpp"
+
+// Two units on one link, packets alternate every 50 ms and carry a report
+// once a second. A packet is only heard while both ends run the same profile.
+struct Unit {
+    LinkAdaptation la;
+    uint16_t source;
+    unsigned long lastReport;
+};
+
+static std::mt19937 rng;
+
+static bool chance(double p) {
+    return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+// Packet error rate at a given RSSI and profile
+static double packetErrorRate(double rssi, uint8_t profile) {
+    double margin = rssi - RADIO_PROFILES[profile].sensitivity;
+    return 1 / (1 + exp(margin * 1.2));
+}
+
+// One packet from one unit to the other; with dropSwitching the packet
+// behind which the sender switches profile is lost. True if it was heard.
+static bool exchange(Unit& from, Unit& to, double rssi, double loss, unsigned long now, bool dropSwitching = false) {
+    uint8_t profile = from.la.getProfile();
+    uint8_t report[LinkAdaptation::REPORT_LENGTH];
+    bool withReport = from.la.negotiating() || now - from.lastReport >= 1000;
+    if (withReport) {
+        from.la.buildReport(report);
+        from.lastReport = now;
+        from.la.onReportSent(now);
+    }
+    bool switched = from.la.getProfile() != profile;
+    from.la.profileChanged();
+
+    bool heard = profile == to.la.getProfile() && !chance(loss) && !(dropSwitching && switched);
+    if (heard) {
+        to.la.onMeasurement(from.source, (float)rssi, 30, now);
+        if (withReport) {
+            to.la.onReport(from.source, report, sizeof(report), now);
+        }
+    }
+    to.la.profileChanged();
+    return heard;
+}
+
+static void tick(Unit& a, Unit& b, unsigned long now) {
+    a.la.checkTimeout(now);
+    b.la.checkTimeout(now);
+    a.la.profileChanged();
+    b.la.profileChanged();
+}
+
+void setUp(void) {
+    rng.seed(3);
+}
+
+void tearDown(void) {}
+
+// A strong link climbs to the top profile, both ends switching together
+void test_step_up_is_negotiated(void) {
+    Unit a = { LinkAdaptation(), 0x0A, 0 };
+    Unit b = { LinkAdaptation(), 0x0B, 0 };
+    int apart = 0;
+    unsigned long now = 0;
+    for (int i = 0; i < 1200; i++) {
+        now += 50;
+        if (i % 2 == 0) {
+            exchange(a, b, -60, 0, now);
+        } else {
+            exchange(b, a, -60, 0, now);
+        }
+        tick(a, b, now);
+        apart += a.la.getProfile() != b.la.getProfile();
+    }
+    TEST_ASSERT_EQUAL_UINT8(RADIO_PROFILE_COUNT - 1, a.la.getProfile());
+    TEST_ASSERT_EQUAL_UINT8(RADIO_PROFILE_COUNT - 1, b.la.getProfile());
+    TEST_ASSERT_EQUAL(0, apart);
+    TEST_ASSERT_EQUAL_UINT32(0, a.la.getRevertCount() + b.la.getRevertCount());
+}
+
+// Without an agreeing peer nobody moves
+void test_no_switch_without_agreement(void) {
+    LinkAdaptation la;
+    uint8_t report[LinkAdaptation::REPORT_LENGTH];
+    unsigned long now = 0;
+    for (int i = 0; i < 200; i++) {
+        now += 50;
+        la.onMeasurement(0x0B, -60, 30, now);
+        la.buildReport(report);
+        la.onReportSent(now);
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, la.getProposal());
+    TEST_ASSERT_EQUAL_UINT8(0, la.getProfile());
+    TEST_ASSERT_EQUAL_UINT8(0x10, report[3]);
+}
+
+// The report that carries the acceptance is lost: the side that switched
+// behind it hears nothing on the new profile, goes back and they try again
+void test_lost_accept_is_undone(void) {
+    Unit a = { LinkAdaptation(), 0x0A, 0 };
+    Unit b = { LinkAdaptation(), 0x0B, 0 };
+    bool dropped = false;
+    unsigned long now = 0;
+    for (int i = 0; i < 600; i++) {
+        now += 50;
+        Unit& from = i % 2 == 0 ? a : b;
+        Unit& to = i % 2 == 0 ? b : a;
+        uint8_t before = from.la.getProfile();
+        exchange(from, to, -60, 0, now, !dropped);
+        dropped = dropped || from.la.getProfile() != before;
+        tick(a, b, now);
+    }
+    TEST_ASSERT_TRUE(dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, a.la.getRevertCount() + b.la.getRevertCount());
+    TEST_ASSERT_EQUAL_UINT8(a.la.getProfile(), b.la.getProfile());
+    TEST_ASSERT_GREATER_THAN(0, a.la.getProfile());
+}
+
+// A peer whose margin is violated proposes a lower profile, we follow
+void test_step_down_follows_the_peer(void) {
+    Unit a = { LinkAdaptation(), 0x0A, 0 };
+    Unit b = { LinkAdaptation(), 0x0B, 0 };
+    unsigned long now = 0;
+    for (int i = 0; i < 600; i++) {
+        now += 50;
+        exchange(i % 2 == 0 ? a : b, i % 2 == 0 ? b : a, -60, 0, now);
+        tick(a, b, now);
+    }
+    uint8_t top = a.la.getProfile();
+    TEST_ASSERT_GREATER_THAN(1, top);
+
+    // Only b hears the link fade, a's own measurements stay fine
+    for (int i = 0; i < 200; i++) {
+        now += 50;
+        if (i % 2 == 0) {
+            exchange(a, b, -107, 0, now);
+        } else {
+            exchange(b, a, -60, 0, now);
+        }
+        tick(a, b, now);
+    }
+    TEST_ASSERT_LESS_THAN(top, a.la.getProfile());
+    TEST_ASSERT_EQUAL_UINT8(a.la.getProfile(), b.la.getProfile());
+}
+
+void test_silence_falls_back_to_the_robust_profile(void) {
+    Unit a = { LinkAdaptation(), 0x0A, 0 };
+    Unit b = { LinkAdaptation(), 0x0B, 0 };
+    unsigned long now = 0;
+    for (int i = 0; i < 600; i++) {
+        now += 50;
+        exchange(i % 2 == 0 ? a : b, i % 2 == 0 ? b : a, -60, 0, now);
+        tick(a, b, now);
+    }
+    TEST_ASSERT_GREATER_THAN(0, a.la.getProfile());
+    a.la.checkTimeout(now + 3000);
+    TEST_ASSERT_EQUAL_UINT8(0, a.la.getProfile());
+    TEST_ASSERT_TRUE(a.la.profileChanged());
+}
+
+// Console settings pin the modem, nothing the peer proposes or a timeout
+// changes it until adaptation is turned back on
+void test_manual_settings_pin_the_profile(void) {
+    Unit a = { LinkAdaptation(), 0x0A, 0 };
+    Unit b = { LinkAdaptation(), 0x0B, 0 };
+    unsigned long now = 0;
+    for (int i = 0; i < 600; i++) {
+        now += 50;
+        exchange(i % 2 == 0 ? a : b, i % 2 == 0 ? b : a, -60, 0, now);
+        tick(a, b, now);
+    }
+    uint8_t top = a.la.getProfile();
+    TEST_ASSERT_GREATER_THAN(0, top);
+
+    a.la.setManual(true);
+    TEST_ASSERT_TRUE(a.la.isManual());
+    for (int i = 0; i < 200; i++) {
+        now += 50;
+        exchange(i % 2 == 0 ? a : b, i % 2 == 0 ? b : a, -107, 0, now);
+        tick(a, b, now);
+    }
+    TEST_ASSERT_EQUAL_UINT8(top, a.la.getProfile());
+    TEST_ASSERT_EQUAL_UINT8(top, a.la.getProposal());
+    a.la.setMaxProfile(0);
+    a.la.checkTimeout(now + 10000);
+    TEST_ASSERT_EQUAL_UINT8(top, a.la.getProfile());
+    TEST_ASSERT_FALSE(a.la.profileChanged());
+
+    a.la.setManual(false);
+    TEST_ASSERT_FALSE(a.la.isManual());
+    TEST_ASSERT_EQUAL_UINT8(0, a.la.getProfile());
+    TEST_ASSERT_TRUE(a.la.profileChanged());
+}
+
+// Log-distance path loss with shadowing: goodput against the fixed 1.2 kbps
+// boot profile and the share of time the two ends spend on different profiles
+void test_distance_sweep(void) {
+    static const double distances[] = { 50, 100, 200, 400, 800, 1500 };
+    std::normal_distribution<double> shadow(0, 4);
+    for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+        Unit a = { LinkAdaptation(), 0x0A, 0 };
+        Unit b = { LinkAdaptation(), 0x0B, 0 };
+        double mean = 10 - (40 + 30 * log10(distances[d]));
+        double adaptive = 0;
+        double fixed = 0;
+        int apart = 0;
+        const int steps = 20000;
+        unsigned long now = 0;
+        for (int i = 0; i < steps; i++) {
+            now += 50;
+            double rssi = mean + shadow(rng);
+            Unit& from = i % 2 == 0 ? a : b;
+            Unit& to = i % 2 == 0 ? b : a;
+            uint8_t profile = from.la.getProfile();
+            if (exchange(from, to, rssi, packetErrorRate(rssi, profile), now)) {
+                adaptive += RADIO_PROFILES[profile].bitRate * 50;
+            }
+            if (!chance(packetErrorRate(rssi, 0))) {
+                fixed += RADIO_PROFILES[0].bitRate * 50;
+            }
+            tick(a, b, now);
+            apart += a.la.getProfile() != b.la.getProfile();
+        }
+        char line[128];
+        snprintf(line, sizeof(line),
+                 "%5.0f m, %6.1f dBm: fixed %5.2f kbps, adaptive %6.2f kbps, apart %.2f%%, %u switches, %u reverts",
+                 distances[d], mean, fixed / now, adaptive / now, 100.0 * apart / steps,
+                 (unsigned)a.la.getSwitchCount(), (unsigned)(a.la.getRevertCount() + b.la.getRevertCount()));
+        TEST_MESSAGE(line);
+        TEST_ASSERT_TRUE(adaptive >= fixed * 0.9);
+        TEST_ASSERT_LESS_THAN(steps / 20, apart);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_step_up_is_negotiated);
+    RUN_TEST(test_no_switch_without_agreement);
+    RUN_TEST(test_lost_accept_is_undone);
+    RUN_TEST(test_step_down_follows_the_peer);
+    RUN_TEST(test_silence_falls_back_to_the_robust_profile);
+    RUN_TEST(test_manual_settings_pin_the_profile);
+    RUN_TEST(test_distance_sweep);
+    return UNITY_END();
+}
@@ -0,0 +1,273 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "MeshRelay.hpp"
+
+static size_t wrapped(MeshRelay& relay, uint8_t* packet, uint8_t fill) {
+    memset(packet, fill, 20);
+    return relay.wrap(packet, 20);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_wrap_and_receive(void) {
+    MeshRelay sender(3);
+    MeshRelay receiver(3);
+    sender.setSource(0x0102);
+    receiver.setSource(0x0304);
+
+    uint8_t packet[MAX_FRAME_LENGTH];
+    size_t length = wrapped(sender, packet, 0xAB);
+    TEST_ASSERT_EQUAL_UINT32(20 + MeshRelay::HEADER_LENGTH, length);
+    TEST_ASSERT_EQUAL_HEX8(FRAME_MESH, packet[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, packet[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, packet[2]);
+    TEST_ASSERT_EQUAL_UINT8(3, packet[5]);
+
+    size_t frameLength = 0;
+    const uint8_t* frame = receiver.onReceive(packet, length, 1, 0, frameLength);
+    TEST_ASSERT_EQUAL_PTR(packet + MeshRelay::HEADER_LENGTH, frame);
+    TEST_ASSERT_EQUAL_UINT32(20, frameLength);
+    TEST_ASSERT_EQUAL_HEX8(0xAB, frame[0]);
+
+    // The same packet again, and our own packet coming back
+    TEST_ASSERT_NULL(receiver.onReceive(packet, length, 1, 10, frameLength));
+    TEST_ASSERT_NULL(sender.onReceive(packet, length, 1, 10, frameLength));
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.getDuplicates());
+    TEST_ASSERT_EQUAL_UINT32(1, sender.getDuplicates());
+
+    // The next sequence number is a new packet; a bare header is not
+    length = wrapped(sender, packet, 0xCD);
+    TEST_ASSERT_NOT_NULL(receiver.onReceive(packet, length, 1, 20, frameLength));
+    TEST_ASSERT_NULL(receiver.onReceive(packet, MeshRelay::HEADER_LENGTH, 1, 20, frameLength));
+    // Not relaying, nothing queued
+    TEST_ASSERT_FALSE(receiver.hasPending());
+}
+
+void test_relay_after_delay_with_one_hop_less(void) {
+    MeshRelay sender(2, 60);
+    MeshRelay relay(2, 60);
+    sender.setSource(1);
+    relay.setSource(2);
+    relay.setEnabled(true);
+
+    uint8_t packet[MAX_FRAME_LENGTH];
+    size_t length = wrapped(sender, packet, 0x11);
+    size_t frameLength;
+    relay.onReceive(packet, length, 7, 1000, frameLength);
+    TEST_ASSERT_TRUE(relay.hasPending());
+
+    uint8_t out[MAX_FRAME_LENGTH];
+    uint8_t address = 0;
+    unsigned long now = 1000;
+    size_t relayedLength = 0;
+    while (relayedLength == 0 && now <= 1060) {
+        relayedLength = relay.nextRelay(now++, out, address);
+    }
+    TEST_ASSERT_EQUAL_UINT32(length, relayedLength);
+    TEST_ASSERT_EQUAL_UINT8(7, address);
+    TEST_ASSERT_EQUAL_UINT8(1, out[5]);
+    TEST_ASSERT_EQUAL_MEMORY(packet + MeshRelay::HEADER_LENGTH, out + MeshRelay::HEADER_LENGTH, 20);
+    TEST_ASSERT_EQUAL_UINT32(1, relay.getRelayed());
+
+    // A packet without hops left is delivered but not relayed
+    MeshRelay last(2, 60);
+    last.setSource(3);
+    last.setEnabled(true);
+    out[5] = 0;
+    TEST_ASSERT_NOT_NULL(last.onReceive(out, relayedLength, 7, now, frameLength));
+    TEST_ASSERT_FALSE(last.hasPending());
+}
+
+void test_copies_suppress_and_overflow(void) {
+    MeshRelay sender(3, 1000, 2);
+    MeshRelay relay(3, 1000, 2);
+    sender.setSource(1);
+    relay.setSource(2);
+    relay.setEnabled(true);
+
+    uint8_t packet[MAX_FRAME_LENGTH];
+    size_t length = wrapped(sender, packet, 0x22);
+    size_t frameLength;
+    relay.onReceive(packet, length, 1, 0, frameLength);
+    // Two neighbours relayed it before our delay ran out
+    relay.onReceive(packet, length, 1, 1, frameLength);
+    TEST_ASSERT_TRUE(relay.hasPending());
+    relay.onReceive(packet, length, 1, 2, frameLength);
+    TEST_ASSERT_FALSE(relay.hasPending());
+    TEST_ASSERT_EQUAL_UINT32(1, relay.getSuppressed());
+
+    // More new packets than pending slots
+    for (uint8_t i = 0; i < MeshRelay::PENDING_RELAYS + 2; i++) {
+        length = wrapped(sender, packet, i);
+        relay.onReceive(packet, length, 1, 3, frameLength);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, relay.getOverflows());
+
+    // Leaving relay mode drops what is queued
+    relay.setEnabled(false);
+    TEST_ASSERT_FALSE(relay.hasPending());
+}
+
+// Time-stepped (1 ms) square grid, the source in one corner sends to the
+// opposite one. No carrier sense: transmissions overlapping in range of a
+// receiver collide there, and a unit cannot hear while it transmits.
+struct Transmission {
+    int node;
+    unsigned long start;
+    unsigned long end;
+    uint8_t packet[MAX_FRAME_LENGTH];
+    size_t length;
+};
+
+struct MeshResult {
+    double delivery;
+    double transmissions;
+    double latency;
+    double duplicates;  // Copies dropped by the duplicate caches, all nodes
+};
+
+static MeshResult simulateGrid(int side, double range, uint8_t hops, unsigned long delay, uint8_t suppress,
+                               bool relaying, int packets) {
+    const unsigned long AIRTIME = 20;
+    const unsigned long PERIOD = 500;
+    int count = side * side;
+    std::vector<MeshRelay> nodes;
+    nodes.reserve(count);
+    for (int i = 0; i < count; i++) {
+        nodes.push_back(MeshRelay(hops, delay, suppress));
+        nodes.back().setSource((uint16_t)(i + 1));
+        nodes.back().setEnabled(relaying);
+    }
+    struct Grid {
+        int side;
+        double range;
+        bool inRange(int a, int b) const {
+            double dx = a % side - b % side;
+            double dy = a / side - b / side;
+            return a != b && sqrt(dx * dx + dy * dy) <= range + 1e-9;
+        }
+    } grid = { side, range };
+
+    int source = 0;
+    int destination = count - 1;
+    std::vector<Transmission> active;
+    std::vector<unsigned long> busyUntil(count, 0);
+    std::vector<long> deliveredAt(packets, -1);
+    long transmissions = 0;
+    for (unsigned long t = 0; t < packets * PERIOD + 2000; t++) {
+        std::vector<Transmission> ending;
+        std::vector<Transmission> still;
+        for (size_t i = 0; i < active.size(); i++) {
+            (active[i].end == t ? ending : still).push_back(active[i]);
+        }
+        for (size_t i = 0; i < ending.size(); i++) {
+            const Transmission& tx = ending[i];
+            for (int r = 0; r < count; r++) {
+                if (!grid.inRange(tx.node, r)) {
+                    continue;
+                }
+                bool collided = busyUntil[r] > tx.start;
+                for (size_t j = 0; j < still.size(); j++) {
+                    collided |= (grid.inRange(still[j].node, r) || still[j].node == r) && still[j].start < tx.end;
+                }
+                for (size_t j = 0; j < ending.size(); j++) {
+                    collided |= j != i && grid.inRange(ending[j].node, r);
+                }
+                if (collided) {
+                    continue;
+                }
+                size_t frameLength;
+                const uint8_t* frame = nodes[r].onReceive(tx.packet, tx.length, 1, t, frameLength);
+                if (frame != NULL && r == destination) {
+                    int sequence = frame[0] | frame[1] << 8;
+                    if (deliveredAt[sequence] < 0) {
+                        deliveredAt[sequence] = (long)(t - sequence * PERIOD);
+                    }
+                }
+            }
+        }
+        active = still;
+
+        for (int n = 0; n < count; n++) {
+            if (busyUntil[n] > t) {
+                continue;
+            }
+            Transmission tx;
+            tx.node = n;
+            tx.start = t;
+            tx.end = t + AIRTIME;
+            uint8_t address;
+            if (n == source && t % PERIOD == 0 && t / PERIOD < (unsigned long)packets) {
+                unsigned long sequence = t / PERIOD;
+                memset(tx.packet, 0x55, 40);
+                tx.packet[0] = (uint8_t)sequence;
+                tx.packet[1] = (uint8_t)(sequence >> 8);
+                tx.length = nodes[n].wrap(tx.packet, 40);
+            } else if ((tx.length = nodes[n].nextRelay(t, tx.packet, address)) == 0) {
+                continue;
+            }
+            busyUntil[n] = tx.end;
+            active.push_back(tx);
+            transmissions++;
+        }
+    }
+
+    uint32_t duplicates = 0;
+    for (int n = 0; n < count; n++) {
+        duplicates += nodes[n].getDuplicates();
+    }
+
+    int delivered = 0;
+    double latency = 0;
+    for (int i = 0; i < packets; i++) {
+        if (deliveredAt[i] >= 0) {
+            delivered++;
+            latency += deliveredAt[i];
+        }
+    }
+    MeshResult result = {
+        (double)delivered / packets,
+        (double)transmissions / packets,
+        delivered ? latency / delivered - AIRTIME : 0,
+        (double)duplicates / packets
+    };
+    return result;
+}
+
+void test_grid_delivery(void) {
+    const double ranges[] = { 1.0, 1.5, 2.3 };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        uint8_t hops = ranges[i] < 1.2 ? 10 : 6;
+        MeshResult direct = simulateGrid(5, ranges[i], hops, 60, 2, false, 50);
+        MeshResult relayed = simulateGrid(5, ranges[i], hops, 60, 1, true, 50);
+        MeshResult flooded = simulateGrid(5, ranges[i], hops, 60, 255, true, 50);
+
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "5x5 range %.1f: direct %.2f, relayed %.2f (%.1f tx, %.1f dup, +%.0f ms), flooded %.2f (%.1f tx, %.1f dup)",
+                 ranges[i], direct.delivery, relayed.delivery, relayed.transmissions, relayed.duplicates,
+                 relayed.latency, flooded.delivery, flooded.transmissions, flooded.duplicates);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_FLOAT(0, direct.delivery);
+        TEST_ASSERT_TRUE(relayed.delivery >= 0.9);
+        // Suppression saves airtime over plain flooding
+        TEST_ASSERT_TRUE(relayed.transmissions < flooded.transmissions);
+        TEST_ASSERT_TRUE(relayed.duplicates < flooded.duplicates);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_wrap_and_receive);
+    RUN_TEST(test_relay_after_delay_with_one_hop_less);
+    RUN_TEST(test_copies_suppress_and_overflow);
+    RUN_TEST(test_grid_delivery);
+    return UNITY_END();
+}
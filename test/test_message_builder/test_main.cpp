@@ -0,0 +1,126 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <unity.h>
+#include "MessageBuilder.hpp"
+
+// Counts heap allocations, the builder must not make any
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* block = malloc(size);
+    if (block == NULL) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_formats_like_the_diagnostics(void) {
+    MessageBuilder<96> message;
+    message.append("Hello World! #").append(42).append(' ').append(-7)
+           .append(' ').append(-98.5f, 1).append(' ').append(3.14159f, 3)
+           .append(' ').append(0.05f, 2).append(' ').append(4294967295ul)
+           .append(' ').appendHex(0xAB).append(' ').appendHex(0x2D4, 4)
+           .append(' ').append(12.0f, 0);
+    TEST_ASSERT_EQUAL_STRING("Hello World! #42 -7 -98.5 3.142 0.05 4294967295 AB 02D4 12", message.c_str());
+    TEST_ASSERT_EQUAL_UINT32(strlen(message.c_str()), message.length());
+    TEST_ASSERT_FALSE(message.isTruncated());
+}
+
+void test_truncates_and_terminates(void) {
+    MessageBuilder<8> message;
+    message.append("123456789");
+    TEST_ASSERT_EQUAL_STRING("12345678", message.c_str());
+    TEST_ASSERT_TRUE(message.isTruncated());
+    message.append('x').append(1);
+    TEST_ASSERT_EQUAL_UINT32(8, message.length());
+
+    message.clear();
+    TEST_ASSERT_FALSE(message.isTruncated());
+    message.append(-2147483647 - 1);
+    TEST_ASSERT_EQUAL_STRING("-2147483", message.c_str());
+}
+
+void test_integers_match_snprintf(void) {
+    for (int32_t value = -100000; value < 100000; value += 7) {
+        MessageBuilder<16> message;
+        message.append((int)value);
+        char reference[16];
+        snprintf(reference, sizeof(reference), "%d", (int)value);
+        TEST_ASSERT_EQUAL_STRING(reference, message.c_str());
+    }
+    uint32_t edges[] = { 0, 9, 10, 99, 100, 999999999, 1000000000, 4294967295u };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        MessageBuilder<16> message;
+        message.appendUnsigned(edges[i]);
+        TEST_ASSERT_EQUAL_UINT32(edges[i], strtoul(message.c_str(), NULL, 10));
+    }
+}
+
+// Fixed point rounds in float, so it may differ from printf in the last
+// digit but never by more than half a unit of it plus the float error
+void test_floats_within_half_a_digit(void) {
+    srand(1);
+    for (int i = 0; i < 100000; i++) {
+        float value = (rand() % 2000000 - 1000000) / 1000.0f;
+        MessageBuilder<32> message;
+        message.append(value, 2);
+        double parsed = strtod(message.c_str(), NULL);
+        TEST_ASSERT_TRUE(fabs(parsed - value) <= 0.005 + fabs(value) * 1e-7);
+        const char* point = strchr(message.c_str(), '.');
+        TEST_ASSERT_NOT_NULL(point);
+        TEST_ASSERT_EQUAL_UINT32(2, strlen(point + 1));
+    }
+}
+
+void test_no_heap_and_timing(void) {
+    const int rounds = 1000000;
+    volatile size_t sink = 0;
+    size_t before = allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        MessageBuilder<32> message;
+        message.append("Hello World! #").append(i);
+        sink += message.length();
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        char buffer[32];
+        sink += snprintf(buffer, sizeof(buffer), "Hello World! #%d", i);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[96];
+    snprintf(line, sizeof(line), "builder %.1f ns/message, snprintf %.1f ns/message",
+             std::chrono::duration<double, std::nano>(middle - start).count() / rounds,
+             std::chrono::duration<double, std::nano>(end - middle).count() / rounds);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(before, allocations);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_formats_like_the_diagnostics);
+    RUN_TEST(test_truncates_and_terminates);
+    RUN_TEST(test_integers_match_snprintf);
+    RUN_TEST(test_floats_within_half_a_digit);
+    RUN_TEST(test_no_heap_and_timing);
+    return UNITY_END();
+}
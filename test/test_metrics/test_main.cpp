@@ -0,0 +1,148 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "Metrics.hpp"
+
+static std::string dumped;
+
+static void collect(const char* line, size_t length) {
+    dumped.append(line, length);
+}
+
+void setUp(void) {
+    dumped.clear();
+}
+
+void tearDown(void) {}
+
+void test_buckets_cover_the_range(void) {
+    for (uint64_t value = 0; value <= 0xFFFFFFFFull; value = value < 100000 ? value + 1 : value * 1.001 + 1) {
+        size_t index = LatencyHistogram::bucketIndex((uint32_t)value);
+        TEST_ASSERT_LESS_THAN(LatencyHistogram::BUCKET_COUNT, index);
+        TEST_ASSERT_TRUE(value >= LatencyHistogram::bucketLower(index));
+        TEST_ASSERT_TRUE(value <= LatencyHistogram::bucketUpper(index));
+    }
+    TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::bucketIndex(0xFFFFFFFFu));
+}
+
+// Percentiles of a latency-like distribution stay within the bucket width
+void test_percentiles_within_an_eighth(void) {
+    static LatencyHistogram histogram;
+    histogram.reset();
+    std::mt19937 random(1);
+    std::lognormal_distribution<double> latency(5.5, 1.0);
+    std::vector<uint32_t> values;
+    for (int i = 0; i < 100000; i++) {
+        uint32_t value = (uint32_t)latency(random);
+        values.push_back(value);
+        histogram.record(value);
+    }
+    std::sort(values.begin(), values.end());
+
+    const uint8_t percentiles[] = { 50, 90, 99 };
+    for (size_t i = 0; i < sizeof(percentiles); i++) {
+        uint32_t exact = values[(size_t)ceil(values.size() * percentiles[i] / 100.0) - 1];
+        uint32_t estimate = histogram.percentile(percentiles[i]);
+        double error = fabs((double)estimate - exact) / exact;
+        char line[64];
+        snprintf(line, sizeof(line), "p%u exact %u estimate %u error %.2f%%",
+                 percentiles[i], exact, estimate, error * 100);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_TRUE(error <= 0.125);
+    }
+    TEST_ASSERT_EQUAL_UINT32(100000, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(values.back(), histogram.getMax());
+}
+
+void test_concurrent_records_are_counted(void) {
+    static LatencyHistogram histogram;
+    static Counter counter;
+    histogram.reset();
+    counter.reset();
+    std::thread first([]() {
+        for (int i = 0; i < 500000; i++) {
+            histogram.record(i & 1023);
+            counter.add();
+        }
+    });
+    std::thread second([]() {
+        for (int i = 0; i < 500000; i++) {
+            histogram.record(i & 1023);
+            counter.add();
+        }
+    });
+    first.join();
+    second.join();
+    TEST_ASSERT_EQUAL_UINT32(1000000, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(1000000, counter.get());
+    TEST_ASSERT_EQUAL_UINT32(1023, histogram.getMax());
+}
+
+void test_registry_dump_and_reset(void) {
+    Counter errors;
+    Gauge level;
+    LatencyHistogram latency;
+    errors.add(3);
+    level.set(7);
+    latency.record(100);  // Reported as the middle of 96..103
+
+    MetricsRegistry registry;
+    TEST_ASSERT_TRUE(registry.add("rx_crc_errors", errors));
+    TEST_ASSERT_TRUE(registry.add("level", level));
+    TEST_ASSERT_TRUE(registry.add("rx_handle_us", latency));
+    registry.dump(collect);
+    TEST_ASSERT_EQUAL_STRING("rx_crc_errors 3\r\nlevel 7\r\n"
+                             "rx_handle_us n=1 p50=99 p90=99 p99=99 max=100\r\n", dumped.c_str());
+
+    // Gauges keep their value across a reset
+    registry.reset();
+    dumped.clear();
+    registry.dump(collect);
+    TEST_ASSERT_EQUAL_STRING("rx_crc_errors 0\r\nlevel 7\r\n"
+                             "rx_handle_us n=0 p50=0 p90=0 p99=0 max=0\r\n", dumped.c_str());
+
+    for (size_t i = registry.getCount(); i < MetricsRegistry::MAX_METRICS; i++) {
+        TEST_ASSERT_TRUE(registry.add("filler", errors));
+    }
+    TEST_ASSERT_FALSE(registry.add("one_too_many", errors));
+}
+
+void test_update_cost(void) {
+    static LatencyHistogram histogram;
+    static Counter counter;
+    const int updates = 10000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; i++) {
+        histogram.record((uint32_t)(i * 2654435761u) >> 12);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; i++) {
+        counter.add();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[80];
+    snprintf(line, sizeof(line), "histogram %.2f ns, counter %.2f ns per update",
+             std::chrono::duration<double, std::nano>(middle - start).count() / updates,
+             std::chrono::duration<double, std::nano>(end - middle).count() / updates);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(updates, counter.get());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_buckets_cover_the_range);
+    RUN_TEST(test_percentiles_within_an_eighth);
+    RUN_TEST(test_concurrent_records_are_counted);
+    RUN_TEST(test_registry_dump_and_reset);
+    RUN_TEST(test_update_cost);
+    return UNITY_END();
+}
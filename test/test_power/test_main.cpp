@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <unity.h>
+#include "PowerManager.hpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_locks_switch_on_first_and_last(void) {
+    PowerManager power;
+    TEST_ASSERT_TRUE(power.begin(240, 80));
+    TEST_ASSERT_EQUAL_UINT16(240, power.getMhz(PowerManager::LEVEL_MAX));
+    TEST_ASSERT_EQUAL_UINT16(80, power.getMhz(PowerManager::LEVEL_MIN));
+    // Idles at the low frequency after begin()
+    TEST_ASSERT_EQUAL_UINT32(1, power.getSwitchCount());
+    {
+        PowerLock outer(power);
+        TEST_ASSERT_EQUAL_UINT32(2, power.getSwitchCount());
+        {
+            PowerLock inner(power);
+            TEST_ASSERT_EQUAL_UINT32(2, power.getSwitchCount());
+        }
+        TEST_ASSERT_EQUAL_UINT32(2, power.getSwitchCount());
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, power.getSwitchCount());
+}
+
+void test_racing_locks_end_at_min(void) {
+    PowerManager power;
+    power.begin(240, 80);
+    std::thread a([&power] { for (int i = 0; i < 100000; i++) { PowerLock lock(power); } });
+    std::thread b([&power] { for (int i = 0; i < 100000; i++) { PowerLock lock(power); } });
+    a.join();
+    b.join();
+
+    uint64_t min = power.getResidency(PowerManager::LEVEL_MIN);
+    uint64_t max = power.getResidency(PowerManager::LEVEL_MAX);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    TEST_ASSERT_TRUE(power.getResidency(PowerManager::LEVEL_MIN) >= min + 10000);
+    TEST_ASSERT_EQUAL_UINT64(max, power.getResidency(PowerManager::LEVEL_MAX));
+}
+
+void test_sleep_residency(void) {
+    PowerManager power;
+    power.begin(240, 80);
+    power.onSleep();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    power.onWake();
+    TEST_ASSERT_TRUE(power.getResidency(PowerManager::LEVEL_SLEEP) >= 5000);
+
+    power.reset();
+    TEST_ASSERT_EQUAL_UINT64(0, power.getResidency(PowerManager::LEVEL_SLEEP));
+    TEST_ASSERT_EQUAL_UINT32(0, power.getSwitchCount());
+}
+
+// Ten packets a second, each handled in 0.4 ms at full speed
+void test_burst_residency(void) {
+    PowerManager power;
+    power.begin(240, 80);
+    for (int i = 0; i < 20; i++) {
+        {
+            PowerLock lock(power);
+            std::this_thread::sleep_for(std::chrono::microseconds(400));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double max = (double)power.getResidency(PowerManager::LEVEL_MAX);
+    double min = (double)power.getResidency(PowerManager::LEVEL_MIN);
+    char line[80];
+    snprintf(line, sizeof(line), "burst: %.1f%% at max, %.1f%% at min", 100 * max / (max + min), 100 * min / (max + min));
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(min > max);
+}
+
+void test_lock_cost(void) {
+    PowerManager power;
+    power.begin(240, 80);
+    const int locks = 1000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < locks; i++) {
+        PowerLock lock(power);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    {
+        PowerLock outer(power);
+        for (int i = 0; i < locks; i++) {
+            PowerLock lock(power);
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[80];
+    snprintf(line, sizeof(line), "lock with switch %.1f ns, nested %.1f ns",
+             std::chrono::duration<double, std::nano>(middle - start).count() / locks,
+             std::chrono::duration<double, std::nano>(end - middle).count() / locks);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(2 * locks + 3, power.getSwitchCount());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_locks_switch_on_first_and_last);
+    RUN_TEST(test_racing_locks_end_at_min);
+    RUN_TEST(test_sleep_residency);
+    RUN_TEST(test_burst_residency);
+    RUN_TEST(test_lock_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <unity.h>
+#include "SpscQueue.hpp"
+
+struct Item {
+    uint8_t length;
+    uint8_t data[64];
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_push_pop_in_order(void) {
+    SpscQueue<int, 4> queue;
+    TEST_ASSERT_TRUE(queue.isEmpty());
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(queue.push(i));
+    }
+    TEST_ASSERT_EQUAL_UINT32(4, queue.size());
+
+    int value;
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(queue.pop(value));
+        TEST_ASSERT_EQUAL_INT(i, value);
+    }
+    TEST_ASSERT_FALSE(queue.pop(value));
+    TEST_ASSERT_TRUE(queue.isEmpty());
+}
+
+void test_full_queue_counts_drops(void) {
+    SpscQueue<int, 2> queue;
+    TEST_ASSERT_TRUE(queue.push(1));
+    TEST_ASSERT_TRUE(queue.push(2));
+    TEST_ASSERT_FALSE(queue.push(3));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getDroppedCount());
+
+    // Room again once the consumer caught up, and the indices wrap
+    int value;
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_TRUE(queue.push(3));
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_TRUE(queue.pop(value));
+    TEST_ASSERT_EQUAL_INT(3, value);
+}
+
+// A producer and a consumer thread, as the radio and log tasks use it
+void test_two_threads_keep_order(void) {
+    static SpscQueue<Item, 16> queue;
+    const uint32_t count = 200000;
+    bool ordered = true;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        Item item;
+        memset(&item, 0, sizeof(item));
+        for (uint32_t i = 0; i < count;) {
+            memcpy(item.data, &i, sizeof(i));
+            item.data[sizeof(item.data) - 1] = (uint8_t)i;
+            if (queue.push(item)) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::thread consumer([&]() {
+        Item item;
+        for (uint32_t i = 0; i < count;) {
+            if (!queue.pop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            uint32_t value;
+            memcpy(&value, item.data, sizeof(value));
+            if (value != i || item.data[sizeof(item.data) - 1] != (uint8_t)i) {
+                ordered = false;
+            }
+            i++;
+        }
+    });
+    producer.join();
+    consumer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char line[64];
+    snprintf(line, sizeof(line), "%.1f M messages/s", count / seconds / 1e6);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_TRUE(queue.isEmpty());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop_in_order);
+    RUN_TEST(test_full_queue_counts_drops);
+    RUN_TEST(test_two_threads_keep_order);
+    return UNITY_END();
+}
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "FrameAggregator.hpp"
+#include "MessageFragments.hpp"
+#include "SelectiveRepeatArq.hpp"
+#include "SpscQueue.hpp"
+
+// The firmware's task split on the host. One thread runs the radio task's
+// loop for two units: ARQ, aggregation and a loopback channel between them
+// that loses packets at random. The other runs the audio task's loop:
+// mode changes from the console, a unit in transmit mode fragmenting bulk
+// messages into its txQueue, the other one reassembling what comes out of
+// its rxQueue. The test itself is the log task, it asks for the mode
+// change and follows the radio status. The threads share nothing but the
+// queues, as the tasks on the two cores of the ESP32-S3.
+enum Mode : uint8_t {
+    RECEIVE,
+    TRANSMIT
+};
+
+struct Message {
+    uint32_t queuedAt;
+    uint16_t source;
+    uint8_t type;
+    uint8_t length;
+    uint8_t data[SelectiveRepeatArq::MAX_PAYLOAD];
+};
+
+// What the radio task publishes for the console
+struct RadioStatus {
+    uint32_t sent;
+    uint32_t retransmitted;
+    uint32_t delivered;
+    uint32_t packets;
+};
+
+struct Packet {
+    size_t length;
+    uint8_t data[MAX_FRAME_LENGTH];
+};
+
+static const unsigned long AGGREGATION_WINDOW_MS = 40;
+static const size_t MESSAGE_LENGTH = 2000;
+static const int MESSAGES = 8;
+
+struct Unit {
+    SelectiveRepeatArq arq;
+    FrameAggregator aggregator;
+    SpscQueue<Mode, 2> modeQueue;           // console -> audio
+    SpscQueue<Message, 16> txQueue;         // audio -> radio
+    SpscQueue<Message, 16> rxQueue;         // radio -> audio
+    SpscQueue<RadioStatus, 2> statusQueue;  // radio -> log
+    std::atomic<Mode> mode;
+    uint16_t source;
+    uint32_t rxOverflows;
+
+    Unit(uint16_t source, uint16_t session)
+        : arq(source, session),
+          aggregator(MAX_FRAME_LENGTH - SOURCE_LENGTH, AGGREGATION_WINDOW_MS),
+          mode(RECEIVE),
+          source(source),
+          rxOverflows(0) {}
+};
+
+static std::chrono::steady_clock::time_point epoch;
+
+static unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+static uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Radio thread
+
+static Unit* receiving;
+static uint16_t rxSource;
+
+static void deliverMessage(const uint8_t* data, size_t length, uint8_t type, uint16_t source) {
+    Message message;
+    message.source = source;
+    message.type = type;
+    message.length = (uint8_t)length;
+    memcpy(message.data, data, length);
+    message.queuedAt = micros();
+    if (!receiving->rxQueue.push(message)) {
+        receiving->rxOverflows++;
+    }
+}
+
+static void handleFrame(const uint8_t* frame, size_t length) {
+    if (frame[0] == FRAME_DATA || frame[0] == FRAME_FRAGMENT) {
+        receiving->arq.onData(frame, length, rxSource, millis(), deliverMessage);
+    } else if (frame[0] == FRAME_ACK) {
+        receiving->arq.onAck(frame, length, millis());
+    } else if (frame[0] == FRAME_AGGREGATE) {
+        FrameAggregator::unpack(frame, length, handleFrame);
+    }
+}
+
+static uint32_t lossState;
+
+static bool lost(double loss) {
+    lossState ^= lossState << 13;
+    lossState ^= lossState >> 17;
+    lossState ^= lossState << 5;
+    return (lossState & 0xFFFF) < loss * 0x10000;
+}
+
+// One pass of the radio task for a unit: what came in, then what is due
+static void radioLoop(Unit& unit, SpscQueue<Packet, 4>& in, SpscQueue<Packet, 4>& out, double loss) {
+    static Packet packet;
+    while (in.pop(packet)) {
+        if (packet.length <= SOURCE_LENGTH) {
+            continue;
+        }
+        receiving = &unit;
+        rxSource = (uint16_t)(packet.data[0] | packet.data[1] << 8);
+        handleFrame(packet.data + SOURCE_LENGTH, packet.length - SOURCE_LENGTH);
+    }
+
+    Message message;
+    while (!unit.arq.isWindowFull() && unit.txQueue.pop(message)) {
+        unit.arq.send(message.data, message.length, message.type);
+    }
+
+    unsigned long now = millis();
+    uint8_t frame[MAX_FRAME_LENGTH];
+    while (unit.arq.ackPending() && unit.aggregator.canFit(SelectiveRepeatArq::ACK_LENGTH)) {
+        unit.aggregator.add(frame, unit.arq.buildAck(frame), now);
+    }
+    while (unit.aggregator.canFit(SelectiveRepeatArq::HEADER_LENGTH + SelectiveRepeatArq::MAX_PAYLOAD)) {
+        size_t length = unit.arq.nextFrame(now, frame);
+        if (length == 0) {
+            break;
+        }
+        unit.aggregator.add(frame, length, now);
+    }
+    if (unit.aggregator.isDue(now)) {
+        packet.data[0] = (uint8_t)unit.source;
+        packet.data[1] = (uint8_t)(unit.source >> 8);
+        packet.length = SOURCE_LENGTH + unit.aggregator.flush(packet.data + SOURCE_LENGTH);
+        // A full channel is a collision
+        if (!lost(loss)) {
+            out.push(packet);
+        }
+    }
+
+    RadioStatus status;
+    status.sent = unit.arq.getSentCount();
+    status.retransmitted = unit.arq.getRetransmittedCount();
+    status.delivered = unit.arq.getDeliveredCount();
+    status.packets = unit.aggregator.getPacketCount();
+    unit.statusQueue.push(status);
+}
+
+// Audio thread
+
+struct Transfer {
+    int completed;
+    int corrupt;
+    std::vector<uint32_t> latencies;  // us, fragmenting started until reassembled
+};
+
+static void fill(uint8_t* message, int index) {
+    for (size_t i = 0; i < MESSAGE_LENGTH; i++) {
+        message[i] = (uint8_t)(index * 31 + i * 7);
+    }
+    message[0] = (uint8_t)index;
+}
+
+static void audioLoop(Unit& sender, Unit& receiver, Fragmenter& fragmenter, Reassembler& reassembler,
+                      uint8_t* outgoing, int& started, uint32_t* startedAt, Transfer& transfer) {
+    Mode mode;
+    while (sender.modeQueue.pop(mode)) {
+        sender.mode = mode;
+    }
+
+    // sendFragments(): half the queue stays free for short messages
+    if (sender.mode == TRANSMIT && !fragmenter.isBusy() && started < MESSAGES) {
+        fill(outgoing, started);
+        startedAt[started++] = micros();
+        fragmenter.start(outgoing, MESSAGE_LENGTH);
+    }
+    while (fragmenter.isBusy() && sender.txQueue.size() < 8) {
+        Message message;
+        message.type = FRAME_FRAGMENT;
+        message.length = (uint8_t)fragmenter.next(message.data);
+        message.queuedAt = micros();
+        sender.txQueue.push(message);
+    }
+
+    unsigned long now = millis();
+    Message message;
+    while (receiver.rxQueue.pop(message)) {
+        size_t length = 0;
+        const uint8_t* data = reassembler.add(message.source, message.data, message.length, now, length);
+        if (data == NULL) {
+            continue;
+        }
+        uint8_t expected[MESSAGE_LENGTH];
+        fill(expected, data[0]);
+        if (length == MESSAGE_LENGTH && data[0] < started && memcmp(data, expected, length) == 0) {
+            transfer.latencies.push_back(micros() - startedAt[data[0]]);
+            transfer.completed++;
+        } else {
+            transfer.corrupt++;
+        }
+    }
+    reassembler.expire(now);
+}
+
+struct TaskResult {
+    double seconds;
+    Transfer transfer;
+    RadioStatus sender;
+    uint32_t rxOverflows;
+};
+
+static TaskResult runTasks(double loss) {
+    static Arena arena;
+    static Pool pool;
+    arena.begin(Pool::footprint(MESSAGE_LENGTH, 2), MEMORY_PSRAM);
+    pool.begin(arena, MESSAGE_LENGTH, 2);
+    Reassembler reassembler(2000);
+    reassembler.begin(pool, 2);
+    Fragmenter fragmenter(0x1234);
+
+    Unit* sender = new Unit(0x0A0A, 1);
+    Unit* receiver = new Unit(0x0B0B, 2);
+    SpscQueue<Packet, 4>* air = new SpscQueue<Packet, 4>[2];
+    std::atomic<bool> done(false);
+    lossState = 2463534242u;
+    epoch = std::chrono::steady_clock::now();
+
+    TaskResult result;
+    result.transfer.completed = 0;
+    result.transfer.corrupt = 0;
+    memset(&result.sender, 0, sizeof(result.sender));
+
+    std::thread radio([&]() {
+        while (!done) {
+            radioLoop(*sender, air[1], air[0], loss);
+            radioLoop(*receiver, air[0], air[1], loss);
+            std::this_thread::yield();
+        }
+    });
+    std::thread audio([&]() {
+        static uint8_t outgoing[MESSAGE_LENGTH];
+        uint32_t startedAt[MESSAGES];
+        int started = 0;
+        while (!done) {
+            audioLoop(*sender, *receiver, fragmenter, reassembler, outgoing, started, startedAt, result.transfer);
+            if (result.transfer.completed + result.transfer.corrupt == MESSAGES) {
+                done = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // The console switches the sender to transmit, then follows its status
+    sender->modeQueue.push(TRANSMIT);
+    while (!done && millis() < 30000) {
+        RadioStatus status;
+        while (sender->statusQueue.pop(status)) {
+            result.sender = status;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    done = true;
+    radio.join();
+    audio.join();
+    result.seconds = millis() / 1000.0;
+    result.rxOverflows = receiver->rxOverflows;
+
+    delete sender;
+    delete receiver;
+    delete[] air;
+    pool = Pool();
+    arena.end();
+    return result;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_bulk_transfer_between_tasks(void) {
+    const double losses[] = { 0.0, 0.1 };
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        TaskResult r = runTasks(losses[l]);
+        std::vector<uint32_t>& latencies = r.transfer.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (size_t i = 0; i < latencies.size(); i++) {
+            mean += latencies[i] / 1000.0 / latencies.size();
+        }
+
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "loss %2.0f%%: %d x %u B in %.2f s, %.1f kB/s, message %.0f ms mean %.0f ms max, "
+                 "%u sent %u retransmitted in %u packets",
+                 losses[l] * 100, r.transfer.completed, (unsigned int)MESSAGE_LENGTH, r.seconds,
+                 r.transfer.completed * MESSAGE_LENGTH / r.seconds / 1000, mean,
+                 latencies.empty() ? 0.0 : latencies.back() / 1000.0, (unsigned int)r.sender.sent,
+                 (unsigned int)r.sender.retransmitted, (unsigned int)r.sender.packets);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_INT(0, r.transfer.corrupt);
+        TEST_ASSERT_EQUAL_INT(MESSAGES, r.transfer.completed);
+        TEST_ASSERT_EQUAL_UINT32(0, r.rxOverflows);
+        if (losses[l] > 0) {
+            TEST_ASSERT_TRUE(r.sender.retransmitted > 0);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_bulk_transfer_between_tasks);
+    return UNITY_END();
+}
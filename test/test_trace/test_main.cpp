@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include "TraceBuffer.hpp"
+#include "TracePoints.hpp"
+
+static std::string dumped;
+
+static void collect(const char* text, size_t length) {
+    dumped.append(text, length);
+}
+
+static size_t countOf(const char* needle) {
+    size_t count = 0;
+    for (size_t at = dumped.find(needle); at != std::string::npos; at = dumped.find(needle, at + 1)) {
+        count++;
+    }
+    return count;
+}
+
+void setUp(void) {
+    dumped.clear();
+}
+
+void tearDown(void) {}
+
+void test_dump_is_chrome_trace_json(void) {
+    static TraceBuffer<16> trace;
+    for (int i = 0; i < 3; i++) {
+        trace.record(TRACE_HANDLE_RX, TRACE_BEGIN);
+        trace.record(TRACE_RX_ISR, TRACE_INSTANT);
+        trace.record(TRACE_HANDLE_RX, TRACE_END);
+    }
+    trace.record(200, TRACE_INSTANT);
+    trace.stop();
+    trace.dump(TRACE_POINT_NAMES, TRACE_POINT_COUNT, collect);
+
+    TEST_ASSERT_EQUAL_UINT32(0, dumped.find("{\"traceEvents\":[\r\n"));
+    TEST_ASSERT_EQUAL_UINT32(dumped.size() - 4, dumped.rfind("]}\r\n"));
+    TEST_ASSERT_EQUAL_UINT32(3, countOf("{\"name\":\"handle_rx\",\"ph\":\"B\""));
+    TEST_ASSERT_EQUAL_UINT32(3, countOf("{\"name\":\"handle_rx\",\"ph\":\"E\""));
+    TEST_ASSERT_EQUAL_UINT32(3, countOf("\"name\":\"rx_isr\",\"ph\":\"i\""));
+    TEST_ASSERT_EQUAL_UINT32(4, countOf(",\"s\":\"t\""));
+    TEST_ASSERT_EQUAL_UINT32(1, countOf("\"name\":\"point 200\""));
+    // Separators between the events only
+    TEST_ASSERT_EQUAL_UINT32(9, countOf("},\r\n"));
+    TEST_ASSERT_TRUE(dumped.find("\"ts\":0.000,") != std::string::npos);
+}
+
+void test_timestamps_increase(void) {
+    static TraceBuffer<64> trace;
+    for (int i = 0; i < 10; i++) {
+        trace.record(TRACE_HOP, TRACE_BEGIN);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        trace.record(TRACE_HOP, TRACE_END);
+    }
+    trace.dump(TRACE_POINT_NAMES, TRACE_POINT_COUNT, collect);
+
+    double previous = -1;
+    size_t events = 0;
+    for (size_t at = dumped.find("\"ts\":"); at != std::string::npos; at = dumped.find("\"ts\":", at + 1)) {
+        double ts = strtod(dumped.c_str() + at + 5, NULL);
+        TEST_ASSERT_TRUE(ts >= previous);
+        previous = ts;
+        events++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(20, events);
+    // Ten sleeps of at least 200 us between the first and the last event
+    TEST_ASSERT_TRUE(previous >= 9 * 200);
+}
+
+void test_ring_keeps_the_latest_and_stop_freezes(void) {
+    static TraceBuffer<8> trace;
+    for (int i = 0; i < 20; i++) {
+        trace.record(i < 12 ? TRACE_ENCODER : TRACE_MESSAGES, TRACE_INSTANT);
+    }
+    TEST_ASSERT_EQUAL_UINT32(20, trace.getRecordedCount());
+    trace.stop();
+    trace.record(TRACE_HOP, TRACE_INSTANT);
+    TEST_ASSERT_EQUAL_UINT32(20, trace.getRecordedCount());
+
+    trace.dump(TRACE_POINT_NAMES, TRACE_POINT_COUNT, collect);
+    TEST_ASSERT_EQUAL_UINT32(8, countOf("\"name\":\"messages\""));
+    TEST_ASSERT_EQUAL_UINT32(0, countOf("\"name\":\"encoder\""));
+
+    trace.clear();
+    trace.start();
+    dumped.clear();
+    trace.dump(TRACE_POINT_NAMES, TRACE_POINT_COUNT, collect);
+    TEST_ASSERT_EQUAL_STRING("{\"traceEvents\":[\r\n]}\r\n", dumped.c_str());
+}
+
+void test_record_cost(void) {
+    static TraceBuffer<1024> trace;
+    const int events = 5000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < events; i++) {
+        trace.record(TRACE_HANDLE_RX, (i & 1) ? TRACE_END : TRACE_BEGIN);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    volatile uint32_t sink = 0;
+    for (int i = 0; i < events; i++) {
+        sink += traceClock();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    char line[80];
+    snprintf(line, sizeof(line), "record %.2f ns per event, of which the clock %.2f ns",
+             std::chrono::duration<double, std::nano>(middle - start).count() / events,
+             std::chrono::duration<double, std::nano>(end - middle).count() / events);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(events, trace.getRecordedCount());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_dump_is_chrome_trace_json);
+    RUN_TEST(test_timestamps_increase);
+    RUN_TEST(test_ring_keeps_the_latest_and_stop_freezes);
+    RUN_TEST(test_record_cost);
+    return UNITY_END();
+}
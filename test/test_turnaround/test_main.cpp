@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "FastTurnaround.hpp"
+#include "Metrics.hpp"
+
+// The CC1101 turnaround against a mock of the chip on its SPI bus, the
+// fast path of FastTurnaround next to RadioLib's path through IDLE
+// replayed as the same register and strobe calls. SPI at 2 MHz with ~6 us
+// per transaction for chip select and beginTransaction; transitions from
+// the datasheet (26 MHz crystal): IDLE -> RX/TX 799 us with synthesizer
+// calibration, 88.4 us without; RX -> TX with the synthesizer running
+// ~10 us; TX -> RX by TXOFF_MODE 21.5 us. All timing below is read off the
+// mock's clock, which only moves with the bus and the chip.
+static const double SPI_TRANSACTION_US = 6.0;
+static const double SPI_BYTE_US = 8 / 2.0;
+static const double RX_TO_TX_US = 10.0;
+static const double TXOFF_TO_RX_US = 21.5;
+
+static const uint8_t STROBE_SRX = 0x34;
+static const uint8_t STROBE_SIDLE = 0x36;
+static const uint8_t STROBE_SFRX = 0x3A;
+static const uint8_t STROBE_SFTX = 0x3B;
+static const uint8_t REG_IOCFG0 = 0x02;
+static const uint8_t REG_PKTLEN = 0x06;
+static const uint8_t STATE_IDLE = 0x01;
+static const uint8_t STATE_TX = 0x13;
+
+class MockCc1101 {
+public:
+    enum Kind {
+        READ,
+        WRITE,
+        BURST,
+        STROBE
+    };
+
+    struct Transaction {
+        Kind kind;
+        uint8_t reg;
+        size_t bytes;
+        double at;
+    };
+
+    typedef FastTurnaround<MockCc1101> Turnaround;
+
+    std::vector<Transaction> log;
+    std::vector<uint8_t> fifo;
+    uint8_t registers[0x40];
+    double now;
+    double fromIdle;
+    bool channelBusy;
+
+    explicit MockCc1101(bool calibrate)
+        : now(0),
+          fromIdle(calibrate ? 799.0 : 88.4),
+          channelBusy(false),
+          _state(Turnaround::STATE_RX),
+          _next(Turnaround::STATE_RX),
+          _nextAt(0) {
+        memset(registers, 0, sizeof(registers));
+        // Reset value, TXOFF_MODE to IDLE
+        registers[Turnaround::REG_MCSM1] = 0x30;
+    }
+
+    // RadioLib's SPIsetRegValue(): read, modify and write, read back
+    void setRegister(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb) {
+        uint8_t mask = (uint8_t)(((0xFF << (msb + 1)) | (0xFF >> (8 - lsb))) & 0xFF);
+        uint8_t current = readRegister(reg);
+        transaction(WRITE, reg, 2);
+        registers[reg] = (uint8_t)((current & mask) | (value & ~mask));
+        readRegister(reg);
+    }
+
+    uint8_t readRegister(uint8_t reg) {
+        if (reg == Turnaround::REG_MARCSTATE) {
+            // Without the burst bit the address is the STX strobe
+            strobe(Turnaround::STROBE_TX);
+            return 0;
+        }
+        transaction(READ, reg, 2);
+        if (reg == (Turnaround::REG_MARCSTATE | Turnaround::BURST)) {
+            return state();
+        }
+        return registers[reg & 0x3F];
+    }
+
+    void writeBurst(uint8_t reg, const uint8_t* data, size_t length) {
+        transaction(BURST, reg, 1 + length);
+        if (reg == (Turnaround::REG_FIFO | Turnaround::BURST)) {
+            fifo.insert(fifo.end(), data, data + length);
+        }
+    }
+
+    void strobe(uint8_t command) {
+        transaction(STROBE, command, 1);
+        uint8_t current = state();
+        if (command == Turnaround::STROBE_TX) {
+            // Clear channel assessment holds a busy channel in RX
+            if (current == STATE_IDLE) {
+                moveTo(STATE_TX, fromIdle);
+            } else if (current == Turnaround::STATE_RX && !channelBusy) {
+                moveTo(STATE_TX, RX_TO_TX_US);
+            }
+        } else if (command == STROBE_SRX && current == STATE_IDLE) {
+            moveTo(Turnaround::STATE_RX, fromIdle);
+        } else if (command == STROBE_SIDLE) {
+            moveTo(STATE_IDLE, 0);
+        } else if (command == STROBE_SFTX) {
+            fifo.clear();
+        }
+    }
+
+    uint32_t micros() { return (uint32_t)now; }
+
+    // The packet is out, TXOFF_MODE picks the next state
+    void endPacket() {
+        fifo.clear();
+        bool toRx = (registers[Turnaround::REG_MCSM1] & 0x03) == Turnaround::TXOFF_RX;
+        _state = STATE_TX;
+        moveTo(toRx ? Turnaround::STATE_RX : STATE_IDLE, toRx ? TXOFF_TO_RX_US : 0);
+    }
+
+    // When the chip reaches the state it was sent to
+    double settledAt() const { return _nextAt; }
+
+    uint8_t state() {
+        if (now >= _nextAt) {
+            _state = _next;
+        }
+        return _state;
+    }
+
+    size_t count(Kind kind, uint8_t reg) const {
+        size_t n = 0;
+        for (size_t i = 0; i < log.size(); i++) {
+            n += log[i].kind == kind && log[i].reg == reg;
+        }
+        return n;
+    }
+
+private:
+    void transaction(Kind kind, uint8_t reg, size_t bytes) {
+        Transaction t = { kind, reg, bytes, now };
+        log.push_back(t);
+        now += SPI_TRANSACTION_US + bytes * SPI_BYTE_US;
+    }
+
+    void moveTo(uint8_t next, double delay) {
+        _next = next;
+        _nextAt = now + delay;
+        state();
+    }
+
+    uint8_t _state;
+    uint8_t _next;
+    double _nextAt;
+};
+
+typedef MockCc1101::Turnaround Turnaround;
+
+struct TurnaroundTimes {
+    double slowRxToTx;
+    double fastRxToTx;
+    double slowTxToRx;
+    double fastTxToRx;
+};
+
+// RadioLib's startTransmit() from RX: SIDLE, SFTX, IOCFG0 and PKTLEN,
+// FIFO burst, STX from IDLE
+static double slowRxToTx(MockCc1101& chip, const uint8_t* frame, size_t length) {
+    double start = chip.now;
+    chip.strobe(STROBE_SIDLE);
+    chip.strobe(STROBE_SFTX);
+    chip.setRegister(REG_IOCFG0, 0x06, 5, 0);
+    chip.setRegister(REG_PKTLEN, (uint8_t)length, 7, 0);
+    uint8_t fifo[Turnaround::FIFO_SIZE];
+    fifo[0] = (uint8_t)length;
+    memcpy(fifo + 1, frame, length);
+    chip.writeBurst(Turnaround::REG_FIFO | Turnaround::BURST, fifo, length + 1);
+    chip.strobe(Turnaround::STROBE_TX);
+    return chip.settledAt() - start;
+}
+
+// finishTransmit() SIDLE, SFTX; startReceive() SIDLE, SFRX, IOCFG0, SRX
+static double slowTxToRx(MockCc1101& chip) {
+    double start = chip.now;
+    chip.strobe(STROBE_SIDLE);
+    chip.strobe(STROBE_SFTX);
+    chip.strobe(STROBE_SIDLE);
+    chip.strobe(STROBE_SFRX);
+    chip.setRegister(REG_IOCFG0, 0x06, 5, 0);
+    chip.strobe(STROBE_SRX);
+    return chip.settledAt() - start;
+}
+
+static TurnaroundTimes measure(size_t length, bool calibrate) {
+    uint8_t frame[Turnaround::FIFO_SIZE];
+    memset(frame, 0x5A, sizeof(frame));
+    TurnaroundTimes t;
+
+    MockCc1101 slow(calibrate);
+    t.slowRxToTx = slowRxToTx(slow, frame, length);
+    slow.now = slow.settledAt();
+    slow.endPacket();
+    t.slowTxToRx = slowTxToRx(slow);
+
+    MockCc1101 chip(calibrate);
+    Turnaround turnaround(chip, 100);
+    turnaround.configure();
+    turnaround.setReady();
+    double start = chip.now;
+    TEST_ASSERT_TRUE(turnaround.load(frame, length, 0, false));
+    TEST_ASSERT_TRUE(turnaround.transmit());
+    t.fastRxToTx = chip.now - start;
+
+    // The radio task looks once TXOFF_MODE had the time to act
+    chip.endPacket();
+    start = chip.now;
+    chip.now += TXOFF_TO_RX_US;
+    size_t before = chip.log.size();
+    TEST_ASSERT_TRUE(turnaround.isListening());
+    TEST_ASSERT_EQUAL(before + 1, chip.log.size());
+    t.fastTxToRx = chip.now - start;
+    return t;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// TXOFF_MODE goes to RX, the other MCSM1 bits stay
+void test_configure_sets_txoff_rx(void) {
+    MockCc1101 chip(true);
+    Turnaround turnaround(chip, 100);
+    turnaround.configure();
+    TEST_ASSERT_EQUAL_HEX8(0x33, chip.registers[Turnaround::REG_MCSM1]);
+    TEST_ASSERT_EQUAL(1, chip.count(MockCc1101::WRITE, Turnaround::REG_MCSM1));
+
+    chip.endPacket();
+    chip.now = chip.settledAt();
+    TEST_ASSERT_TRUE(turnaround.isListening());
+}
+
+void test_fifo_loaded_while_receiving(void) {
+    MockCc1101 chip(true);
+    Turnaround turnaround(chip, 100);
+    uint8_t frame[Turnaround::FIFO_SIZE];
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = (uint8_t)i;
+    }
+
+    // Not before RadioLib sent a packet and mapped GDO0
+    TEST_ASSERT_FALSE(turnaround.load(frame, 30, 0x81, true));
+    TEST_ASSERT_TRUE(chip.log.empty());
+    turnaround.setReady();
+
+    // [length][address][frame] with the radio's address filter
+    TEST_ASSERT_TRUE(turnaround.load(frame, 30, 0x81, true));
+    TEST_ASSERT_EQUAL(1, chip.log.size());
+    TEST_ASSERT_EQUAL(MockCc1101::BURST, chip.log[0].kind);
+    TEST_ASSERT_EQUAL_HEX8(Turnaround::REG_FIFO | Turnaround::BURST, chip.log[0].reg);
+    TEST_ASSERT_EQUAL(32, chip.fifo.size());
+    TEST_ASSERT_EQUAL_UINT8(31, chip.fifo[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x81, chip.fifo[1]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame, &chip.fifo[2], 30);
+    TEST_ASSERT_EQUAL_HEX8(Turnaround::STATE_RX, chip.state());
+
+    // Without it the address is part of the frame
+    chip.fifo.clear();
+    TEST_ASSERT_TRUE(turnaround.load(frame, 30, 0x81, false));
+    TEST_ASSERT_EQUAL(31, chip.fifo.size());
+    TEST_ASSERT_EQUAL_UINT8(30, chip.fifo[0]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(frame, &chip.fifo[1], 30);
+
+    // What does not fit goes the slow way, the FIFO stays untouched
+    size_t logged = chip.log.size();
+    TEST_ASSERT_FALSE(turnaround.load(frame, Turnaround::FIFO_SIZE - 1, 0x81, true));
+    TEST_ASSERT_TRUE(turnaround.load(frame, Turnaround::FIFO_SIZE - 1, 0x81, false));
+    TEST_ASSERT_EQUAL(logged + 1, chip.log.size());
+}
+
+// A bare STX, then MARCSTATE (burst bit set) polled until the chip left RX
+void test_strobe_sequence(void) {
+    MockCc1101 chip(true);
+    Turnaround turnaround(chip, 100);
+    turnaround.setReady();
+    uint8_t frame[30] = { 0 };
+    TEST_ASSERT_TRUE(turnaround.load(frame, sizeof(frame), 0, false));
+    TEST_ASSERT_TRUE(turnaround.transmit());
+    TEST_ASSERT_EQUAL_HEX8(STATE_TX, chip.state());
+
+    TEST_ASSERT_EQUAL(MockCc1101::STROBE, chip.log[1].kind);
+    TEST_ASSERT_EQUAL_HEX8(Turnaround::STROBE_TX, chip.log[1].reg);
+    TEST_ASSERT_TRUE(chip.log.size() >= 3);
+    for (size_t i = 2; i < chip.log.size(); i++) {
+        TEST_ASSERT_EQUAL(MockCc1101::READ, chip.log[i].kind);
+        TEST_ASSERT_EQUAL_HEX8(Turnaround::REG_MARCSTATE | Turnaround::BURST, chip.log[i].reg);
+    }
+    TEST_ASSERT_EQUAL(1, chip.count(MockCc1101::STROBE, Turnaround::STROBE_TX));
+    TEST_ASSERT_EQUAL(0, chip.count(MockCc1101::STROBE, STROBE_SIDLE));
+}
+
+// Clear channel assessment keeps the chip in RX, the caller sends the
+// slow way after the timeout
+void test_busy_channel_falls_back(void) {
+    MockCc1101 chip(true);
+    chip.channelBusy = true;
+    Turnaround turnaround(chip, 100);
+    turnaround.setReady();
+    uint8_t frame[10] = { 0 };
+    TEST_ASSERT_TRUE(turnaround.load(frame, sizeof(frame), 0, false));
+    double start = chip.now;
+    TEST_ASSERT_FALSE(turnaround.transmit());
+    TEST_ASSERT_EQUAL_HEX8(Turnaround::STATE_RX, chip.state());
+    TEST_ASSERT_TRUE(chip.now - start >= 100);
+    TEST_ASSERT_TRUE(chip.count(MockCc1101::READ, Turnaround::REG_MARCSTATE | Turnaround::BURST) >= 100 / 14);
+}
+
+void test_fast_path_timing(void) {
+    const size_t lengths[] = { 8, 30, 62 };
+    for (int calibrate = 1; calibrate >= 0; calibrate--) {
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            TurnaroundTimes t = measure(lengths[i], calibrate != 0);
+            char line[100];
+            snprintf(line, sizeof(line), "%s %2u B: RX->TX %6.1f -> %5.1f us, deaf after TX %6.1f -> %5.1f us",
+                     calibrate ? "autocal" : "hopping", (unsigned int)lengths[i],
+                     t.slowRxToTx, t.fastRxToTx, t.slowTxToRx, t.fastTxToRx);
+            TEST_MESSAGE(line);
+            TEST_ASSERT_TRUE(t.fastRxToTx < t.slowRxToTx);
+            TEST_ASSERT_TRUE(t.fastTxToRx * 4 < t.slowTxToRx);
+        }
+    }
+}
+
+// tx_to_rx_us and rx_to_tx_us tell the two paths apart
+void test_histograms_resolve_the_paths(void) {
+    static LatencyHistogram fast;
+    static LatencyHistogram slow;
+    for (int calibrate = 1; calibrate >= 0; calibrate--) {
+        TurnaroundTimes t = measure(30, calibrate != 0);
+        fast.reset();
+        slow.reset();
+        for (int i = 0; i < 100; i++) {
+            fast.record((uint32_t)t.fastTxToRx + i % 4);
+            slow.record((uint32_t)t.slowTxToRx + i % 4);
+        }
+        TEST_ASSERT_UINT32_WITHIN((uint32_t)t.fastTxToRx / 8 + 1, (uint32_t)t.fastTxToRx, fast.percentile(50));
+        TEST_ASSERT_UINT32_WITHIN((uint32_t)t.slowTxToRx / 8 + 1, (uint32_t)t.slowTxToRx, slow.percentile(50));
+        TEST_ASSERT_TRUE(fast.percentile(99) < slow.percentile(1));
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_configure_sets_txoff_rx);
+    RUN_TEST(test_fifo_loaded_while_receiving);
+    RUN_TEST(test_strobe_sequence);
+    RUN_TEST(test_busy_channel_falls_back);
+    RUN_TEST(test_fast_path_timing);
+    RUN_TEST(test_histograms_resolve_the_paths);
+    return UNITY_END();
+}
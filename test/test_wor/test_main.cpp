@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <algorithm>
+#include <unity.h>
+#include "WakeOnRadio.hpp"
+
+static void announce(WakeOnRadio& wor, uint16_t source, uint16_t interval) {
+    uint8_t frame[WakeOnRadio::ANNOUNCE_LENGTH] = { FRAME_WOR, (uint8_t)interval, (uint8_t)(interval >> 8) };
+    wor.onAnnounce(source, frame, sizeof(frame));
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_preamble_spans_the_interval(void) {
+    WakeOnRadio wor(100, 2000);
+    // 100 ms in 750 / 26 MHz steps
+    TEST_ASSERT_EQUAL_UINT16(3466, wor.event0());
+    TEST_ASSERT_EQUAL_UINT8(WakeOnRadio::DEFAULT_PREAMBLE_BITS, WakeOnRadio::preambleBits(0, RADIO_PROFILES[0].bitRate));
+    for (uint8_t p = 0; p < RADIO_PROFILE_COUNT; p++) {
+        uint8_t bits = WakeOnRadio::preambleBits(100, RADIO_PROFILES[p].bitRate);
+        if (p <= WakeOnRadio::maxProfile(100)) {
+            TEST_ASSERT_TRUE(bits >= (100 + WakeOnRadio::WAKE_OVERHEAD_US / 1000.0f) * RADIO_PROFILES[p].bitRate);
+            TEST_ASSERT_TRUE(bits <= WakeOnRadio::MAX_PREAMBLE_BITS);
+        } else {
+            TEST_ASSERT_EQUAL_UINT8(0, bits);
+        }
+    }
+    TEST_ASSERT_TRUE(WakeOnRadio::maxProfile(50) >= WakeOnRadio::maxProfile(100));
+}
+
+void test_sleep_cycle(void) {
+    WakeOnRadio wor(100, 2000);
+    wor.onActivity(0);
+    TEST_ASSERT_FALSE(wor.shouldSleep(1999, false));
+    TEST_ASSERT_FALSE(wor.shouldSleep(2000, true));
+    TEST_ASSERT_TRUE(wor.shouldSleep(2000, false));
+
+    uint8_t frame[WakeOnRadio::ANNOUNCE_LENGTH];
+    TEST_ASSERT_EQUAL_UINT32(WakeOnRadio::ANNOUNCE_LENGTH, wor.buildAnnounce(frame, true));
+    TEST_ASSERT_EQUAL_UINT8(100, frame[1] | frame[2] << 8);
+    TEST_ASSERT_TRUE(wor.readyToSleep());
+    wor.onSleep(2000);
+    TEST_ASSERT_TRUE(wor.isAsleep());
+    TEST_ASSERT_EQUAL_UINT32(500, wor.getSleepTime(2500));
+
+    // Woken by a packet, the peers have to hear we are back
+    wor.onActivity(3000);
+    TEST_ASSERT_FALSE(wor.isAsleep());
+    TEST_ASSERT_TRUE(wor.announcePending());
+    TEST_ASSERT_EQUAL_UINT32(1, wor.getWakeCount());
+    TEST_ASSERT_EQUAL_UINT32(1000, wor.getSleepTime(3500));
+    wor.buildAnnounce(frame, false);
+    TEST_ASSERT_EQUAL_UINT16(0, frame[1] | frame[2] << 8);
+    TEST_ASSERT_FALSE(wor.announcePending());
+}
+
+void test_sleepers_tracked_per_source(void) {
+    WakeOnRadio wor(100, 2000);
+    announce(wor, 0x0101, 100);
+    TEST_ASSERT_TRUE(wor.peerChanged());
+    TEST_ASSERT_FALSE(wor.peerChanged());
+    TEST_ASSERT_EQUAL_UINT16(100, wor.getPeerInterval());
+
+    // Another group member listening does not wake the sleeper
+    announce(wor, 0x0202, 0);
+    TEST_ASSERT_FALSE(wor.peerChanged());
+    TEST_ASSERT_EQUAL_UINT16(100, wor.getPeerInterval());
+
+    // The longest interval of all sleepers wins until that one wakes
+    announce(wor, 0x0303, 250);
+    TEST_ASSERT_EQUAL_UINT16(250, wor.getPeerInterval());
+    announce(wor, 0x0303, 0);
+    TEST_ASSERT_EQUAL_UINT16(100, wor.getPeerInterval());
+    announce(wor, 0x0101, 0);
+    TEST_ASSERT_EQUAL_UINT16(0, wor.getPeerInterval());
+    TEST_ASSERT_TRUE(wor.peerChanged());
+
+    // A full table drops the shortest interval
+    for (uint16_t source = 1; source <= WakeOnRadio::MAX_SLEEPERS; source++) {
+        announce(wor, source, 100 + source);
+    }
+    announce(wor, 0x0500, 500);
+    TEST_ASSERT_EQUAL_UINT16(500, wor.getPeerInterval());
+    announce(wor, 0x0500, 0);
+    TEST_ASSERT_EQUAL_UINT16(100 + WakeOnRadio::MAX_SLEEPERS, wor.getPeerInterval());
+
+    // Short frames are ignored
+    uint8_t frame[] = { FRAME_WOR, 0 };
+    wor.onAnnounce(WakeOnRadio::MAX_SLEEPERS, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_UINT16(100 + WakeOnRadio::MAX_SLEEPERS, wor.getPeerInterval());
+}
+
+void test_lost_announce_falls_back_after_timeout(void) {
+    WakeOnRadio wor(100, 2000);
+    // The sleeping announcement was lost, nobody is known to sleep
+    TEST_ASSERT_EQUAL_UINT16(0, wor.getPeerInterval());
+    wor.onDeliveryTimeout();
+    TEST_ASSERT_TRUE(wor.isFallback());
+    TEST_ASSERT_TRUE(wor.peerChanged());
+    TEST_ASSERT_EQUAL_UINT16(100, wor.getPeerInterval());
+    wor.onDeliveryTimeout();
+    TEST_ASSERT_FALSE(wor.peerChanged());
+
+    // Back to the short preamble once a frame gets through
+    wor.onDelivered();
+    TEST_ASSERT_FALSE(wor.isFallback());
+    TEST_ASSERT_TRUE(wor.peerChanged());
+    TEST_ASSERT_EQUAL_UINT16(0, wor.getPeerInterval());
+
+    // Peers announced longer intervals before, the fallback covers them
+    announce(wor, 0x0101, 400);
+    announce(wor, 0x0101, 0);
+    wor.onDeliveryTimeout();
+    TEST_ASSERT_EQUAL_UINT16(400, wor.getPeerInterval());
+    // Awake announcements do not end the fallback, only an ACK does
+    announce(wor, 0x0202, 0);
+    TEST_ASSERT_TRUE(wor.isFallback());
+    TEST_ASSERT_EQUAL_UINT16(400, wor.getPeerInterval());
+    wor.onDelivered();
+    TEST_ASSERT_EQUAL_UINT16(0, wor.getPeerInterval());
+}
+
+// Current draw, CC1101 per wake: RX sniff ~16 mA for ~0.5 ms, calibration
+// 8 mA 0.8 ms, crystal start 1.5 mA 0.7 ms, sleep 0.9 uA; the ESP32-S3 in
+// light sleep ~0.24 mA against ~56 mA listening continuously
+static const double WAKE_CHARGE = 16 * 0.5 + 8 * 0.8 + 1.5 * 0.7;  // mA ms
+static const double SLEEP_MA = 0.0009 + 0.24;
+static const double AWAKE_MA = 16 + 40;
+
+struct WorTimeline {
+    double current;      // mA on average
+    double latencyMean;  // ms, packet start until its sync word wakes the MCU
+    double latencyMax;
+    uint32_t chipWakes;
+    uint32_t wakes;
+    uint32_t retries;
+    int delivered;
+};
+
+static uint32_t worSeed;
+
+static uint32_t random32() {
+    worSeed ^= worSeed << 13;
+    worSeed ^= worSeed >> 17;
+    worSeed ^= worSeed << 5;
+    return worSeed;
+}
+
+// A receiver and a sender with a 30 byte message every 30..90 s, the
+// first one after the receiver fell asleep; 100 us
+// steps. Announcements and ACKs reach the other side as they are sent. A
+// sleeping receiver gets a packet only if one of its wake-ups (EVENT0
+// apart, sensing WAKE_OVERHEAD_US after each) falls into the preamble the
+// sender picked; otherwise the sender repeats it after the RTO.
+static WorTimeline timeline(uint16_t interval, uint8_t profile, unsigned long seconds) {
+    const uint16_t RECEIVER = 0x0B0B;
+    const uint64_t RTO_US = 500000;
+    const uint64_t SYNC_BITS = 32;
+    const uint64_t PAYLOAD_BITS = (30 + 2) * 8;
+    WakeOnRadio sender(interval, 2000);
+    WakeOnRadio receiver(interval, 2000);
+    float bitRate = RADIO_PROFILES[profile].bitRate;
+    uint64_t period = receiver.event0() * 750ull / 26;
+    worSeed = 2463534242u;
+
+    WorTimeline result = WorTimeline();
+    uint64_t end = seconds * 1000000ull;
+    uint64_t nextMessage = 5000000;
+    uint64_t attemptAt = 0;
+    uint64_t txStart = 0;
+    uint64_t txEnd = 0;
+    uint64_t preambleUs = 0;
+    uint64_t nextSniff = 0;
+    uint64_t latencySum = 0;
+    bool pending = false;
+    bool onAir = false;
+    bool caught = false;
+    uint8_t frame[WakeOnRadio::ANNOUNCE_LENGTH];
+    receiver.onActivity(0);
+
+    for (uint64_t now = 0; now < end; now += 100) {
+        unsigned long ms = (unsigned long)(now / 1000);
+        if (receiver.shouldSleep(ms, onAir)) {
+            receiver.buildAnnounce(frame, true);
+            sender.onAnnounce(RECEIVER, frame, sizeof(frame));
+            receiver.onSleep(ms);
+            nextSniff = now + period + WakeOnRadio::WAKE_OVERHEAD_US;
+        }
+
+        if (!pending && now >= nextMessage) {
+            pending = true;
+            attemptAt = now;
+        }
+        if (pending && !onAir && now >= attemptAt) {
+            uint8_t bits = WakeOnRadio::preambleBits(sender.getPeerInterval(), bitRate);
+            TEST_ASSERT_NOT_EQUAL(0, bits);
+            preambleUs = (uint64_t)(bits * 1000 / bitRate);
+            txStart = now;
+            txEnd = now + preambleUs + (uint64_t)((SYNC_BITS + PAYLOAD_BITS) * 1000 / bitRate);
+            onAir = true;
+            caught = !receiver.isAsleep();
+        }
+
+        if (receiver.isAsleep() && now >= nextSniff) {
+            result.chipWakes++;
+            caught = caught || (onAir && now < txStart + preambleUs);
+            nextSniff += period;
+        }
+
+        if (onAir && now >= txEnd) {
+            onAir = false;
+            if (caught) {
+                receiver.onActivity(ms);
+                uint64_t latency = preambleUs + (uint64_t)(SYNC_BITS * 1000 / bitRate);
+                latencySum += latency;
+                result.latencyMax = std::max(result.latencyMax, latency / 1000.0);
+                result.delivered++;
+                // The ACK carries the awake announcement
+                if (receiver.announcePending()) {
+                    receiver.buildAnnounce(frame, false);
+                    sender.onAnnounce(RECEIVER, frame, sizeof(frame));
+                }
+                sender.onDelivered();
+                pending = false;
+                nextMessage = now + 30000000 + random32() % 60000000;
+            } else {
+                result.retries++;
+                sender.onDeliveryTimeout();
+                attemptAt = now + RTO_US;
+            }
+        }
+    }
+
+    double sleepMs = receiver.getSleepTime(end / 1000);
+    double awakeMs = end / 1000.0 - sleepMs;
+    result.current = (awakeMs * AWAKE_MA + sleepMs * SLEEP_MA + result.chipWakes * WAKE_CHARGE) / (end / 1000.0);
+    result.latencyMean = result.delivered ? latencySum / 1000.0 / result.delivered : 0;
+    result.wakes = receiver.getWakeCount();
+    return result;
+}
+
+// Only intervals the slowest profile's longest preamble spans are served,
+// each at the fastest profile that still spans it
+void test_duty_cycle_model(void) {
+    TEST_ASSERT_FALSE(WakeOnRadio::fitsPreamble(250, RADIO_PROFILES[0].bitRate));
+    TEST_ASSERT_EQUAL_UINT8(0, WakeOnRadio::preambleBits(250, RADIO_PROFILES[0].bitRate));
+
+    const uint16_t intervals[] = { 25, 50, 100, 150 };
+    double previous = AWAKE_MA;
+    uint8_t previousProfile = 0xFF;
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        uint16_t interval = intervals[i];
+        uint8_t profile = WakeOnRadio::maxProfile(interval);
+        TEST_ASSERT_TRUE(WakeOnRadio::fitsPreamble(interval, RADIO_PROFILES[profile].bitRate));
+
+        WorTimeline t = timeline(interval, profile, 600);
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "interval %3u ms at %5.1f kbps: %.3f mA (x%.0f), %u CC1101 wakes, %u packets %u woke, "
+                 "wake latency mean %.1f ms worst %.1f ms",
+                 (unsigned int)interval, RADIO_PROFILES[profile].bitRate, t.current, AWAKE_MA / t.current,
+                 (unsigned int)t.chipWakes, (unsigned int)t.delivered, (unsigned int)t.wakes, t.latencyMean,
+                 t.latencyMax);
+        TEST_MESSAGE(line);
+        // Every packet is caught by the first wake-up in its preamble
+        TEST_ASSERT_TRUE(t.delivered > 0);
+        TEST_ASSERT_EQUAL_UINT32(0, t.retries);
+        TEST_ASSERT_EQUAL_UINT32(t.delivered, t.wakes);
+        // The preamble spans the interval, and is no longer than it can be
+        float syncMs = 32 / RADIO_PROFILES[profile].bitRate;
+        TEST_ASSERT_TRUE(t.latencyMean >= interval + syncMs);
+        TEST_ASSERT_TRUE(t.latencyMax <= WakeOnRadio::MAX_PREAMBLE_BITS / RADIO_PROFILES[profile].bitRate + syncMs + 0.1);
+        TEST_ASSERT_TRUE(t.current < AWAKE_MA / 10);
+        // Waking less often saves at the same bit rate
+        if (profile == previousProfile) {
+            TEST_ASSERT_TRUE(t.current < previous);
+        }
+        previous = t.current;
+        previousProfile = profile;
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_preamble_spans_the_interval);
+    RUN_TEST(test_sleep_cycle);
+    RUN_TEST(test_sleepers_tracked_per_source);
+    RUN_TEST(test_lost_announce_falls_back_after_timeout);
+    RUN_TEST(test_duty_cycle_model);
+    return UNITY_END();
+}
@@ -0,0 +1,59 @@
+/*
+  Host decoder for binary log captures (LOG_BINARY_OUTPUT = 1).
+
+  Scans a raw serial capture for LOG_SYNC markers, decodes the records
+  that follow and prints them with the firmware's format table. Bytes
+  between records (plain text output) are skipped.
+
+  Build:  g++ -O2 -std=c++17 -Iinclude tools/logdecode.cpp -o logdecode
+  Usage:  ./logdecode capture.bin   (or read from stdin)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "BinaryLog.hpp"
+#include "LogEvents.hpp"
+
+int main(int argc, char** argv) {
+  FILE* in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (in == NULL) {
+    fprintf(stderr, "cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  uint32_t decoded = 0;
+  uint32_t unknown = 0;
+  int previous = -1;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (previous != LOG_SYNC[0] || c != LOG_SYNC[1]) {
+      previous = c;
+      continue;
+    }
+    previous = -1;
+
+    LogRecord record;
+    if (fread(&record, sizeof(record), 1, in) != 1) {
+      break;
+    }
+
+    MessageBuilder<160> line;
+    line.append('[').append(record.timestamp / 1000).append('.');
+    uint32_t micros = record.timestamp % 1000;
+    line.append(micros < 100 ? (micros < 10 ? "00" : "0") : "").append(micros).append("] ");
+    if (record.event < LOG_EVENT_COUNT) {
+      BinaryLog<2>::format(record, LOG_FORMATS[record.event], line);
+    } else {
+      line.append("unknown event ").append(record.event);
+      unknown++;
+    }
+    puts(line.c_str());
+    decoded++;
+  }
+
+  fprintf(stderr, "%u records, %u unknown\n", decoded, unknown);
+  if (in != stdin) {
+    fclose(in);
+  }
+  return 0;
+}
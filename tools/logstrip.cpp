@@ -0,0 +1,109 @@
+/*
+  Host probe for compile-time log stripping, built twice by logstrip.sh.
+
+  Runs the receive path's logging the way the firmware does: LOG_EVENT()
+  calls of every level into the binary log on the hot path, and a drain
+  that either formats each record as text (default build) or streams it
+  as a binary frame (LOG_BINARY_OUTPUT=1). Prints the cost of both per
+  packet in nanoseconds and, on x86, in TSC cycles.
+
+  Build:  see tools/logstrip.sh
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "BinaryLog.hpp"
+#include "LogEvents.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0ULL
+#endif
+
+#ifndef LOG_BINARY_OUTPUT
+#define LOG_BINARY_OUTPUT 0
+#endif
+
+static BinaryLog<512> eventLog;
+static uint32_t now = 0;
+static volatile size_t sink = 0;
+
+void logWrite(LogEvent event) {
+  eventLog.write(event, now);
+}
+
+void logWrite(LogEvent event, int32_t a) {
+  eventLog.write(event, now, 1, a);
+}
+
+void logWrite(LogEvent event, int32_t a, int32_t b) {
+  eventLog.write(event, now, 2, a, b);
+}
+
+// What handleReceivedPacket() logs for one packet; every eighth fails CRC
+__attribute__((noinline)) void receivePacket(int32_t rssi, int32_t lqi, bool crcError) {
+  now += 1000;
+  if (crcError) {
+    LOG_EVENT(LOG_RX_CRC_ERROR);
+    return;
+  }
+  LOG_EVENT(LOG_RX_PACKET);
+  LOG_EVENT(LOG_RX_RSSI, rssi);
+  LOG_EVENT(LOG_RX_LQI, lqi);
+}
+
+// What the log task does with everything that was written
+__attribute__((noinline)) void drainLog() {
+  LogRecord record;
+  while (eventLog.read(record)) {
+#if LOG_BINARY_OUTPUT
+    uint8_t frame[LOG_FRAME_LENGTH];
+    logFrame(record, frame);
+    sink += frame[LOG_FRAME_LENGTH - 1];
+#else
+    MessageBuilder<96> line;
+    line.append('[').append(record.timestamp / 1000).append("] ");
+    BinaryLog<512>::format(record, LOG_FORMATS[record.event], line);
+    sink += line.length();
+#endif
+  }
+}
+
+// Packets between drains, their records have to fit the ring
+static const long BATCH = 64;
+
+int main(int argc, char** argv) {
+  long batches = (argc > 1 ? atol(argv[1]) : 1000000) / BATCH;
+  if (batches < 1) {
+    batches = 1;
+  }
+
+  unsigned long long hotCycles = 0;
+  unsigned long long drainCycles = 0;
+  std::chrono::steady_clock::duration hotTime(0);
+  std::chrono::steady_clock::duration drainTime(0);
+  long packet = 0;
+  for (long batch = 0; batch < batches; batch++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long long startCycles = CYCLES();
+    for (long i = 0; i < BATCH; i++, packet++) {
+      receivePacket(-9000 - (int32_t)(packet % 1000), (int32_t)(packet % 128), packet % 8 == 7);
+    }
+    unsigned long long middleCycles = CYCLES();
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    drainLog();
+    drainCycles += CYCLES() - middleCycles;
+    drainTime += std::chrono::steady_clock::now() - middle;
+    hotCycles += middleCycles - startCycles;
+    hotTime += middle - start;
+  }
+
+  printf("level=%d binary=%d  hot path %.1f ns %.0f cycles, drain %.1f ns %.0f cycles per packet\n",
+         LOG_LEVEL, LOG_BINARY_OUTPUT,
+         std::chrono::duration<double, std::nano>(hotTime).count() / packet, (double)hotCycles / packet,
+         std::chrono::duration<double, std::nano>(drainTime).count() / packet, (double)drainCycles / packet);
+  return eventLog.getDroppedCount() == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compare the full log build with the stripped release build.
+#
+# Builds tools/logstrip.cpp on the host with the default flags (all levels,
+# text output) and with the release flags from platformio.ini, prints their
+# code size and the per-packet cost of logging, and fails if the stripped
+# build still contains any LOG_FORMATS string. Given firmware ELF files
+# (e.g. .pio/build/esp32-s3-devkitc-1-n16r8v-release/firmware.elf), it
+# prints their size and runs the format string check on them instead.
+#
+#   tools/logstrip.sh [firmware.elf ...]
+
+set -e
+cd "$(dirname "$0")/.."
+CXX=${CXX:-g++}
+SIZE=${SIZE:-size}
+RELEASE_FLAGS="-DLOG_LEVEL=LOG_LEVEL_WARN -DLOG_BINARY_OUTPUT=1"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Every format string up to its first tab or placeholder
+sed -n '/LOG_FORMATS\[/,/^};/p' include/LogEvents.hpp | grep -o '"[^"]*"' |
+  sed 's/^"//; s/"$//; s/\\t.*//; s/{.*//' > "$work/formats"
+
+# Number of format strings found in a binary
+formats_in() {
+  strings -a "$1" | grep -c -F -f "$work/formats" || true
+}
+
+if [ $# -gt 0 ]; then
+  status=0
+  for elf in "$@"; do
+    $SIZE "$elf"
+    found=$(formats_in "$elf")
+    echo "$elf: $found format strings"
+    [ "$found" -eq 0 ] || status=1
+  done
+  exit $status
+fi
+
+$CXX -std=gnu++17 -O2 -Iinclude tools/logstrip.cpp -o "$work/full"
+$CXX -std=gnu++17 -O2 -Iinclude $RELEASE_FLAGS tools/logstrip.cpp -o "$work/stripped"
+
+for build in full stripped; do
+  echo "== $build"
+  $SIZE "$work/$build"
+  "$work/$build"
+  echo "format strings: $(formats_in "$work/$build")"
+done
+
+if [ "$(formats_in "$work/stripped")" -ne 0 ]; then
+  echo "stripped build still contains format strings"
+  exit 1
+fi